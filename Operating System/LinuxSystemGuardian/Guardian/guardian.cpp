@@ -0,0 +1,1375 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "../M1_SystemSnapshot/snapshot_collector.h"
+#include "../M1_SystemSnapshot/snapshot_series.h"
+#include "../M2_ProcessManager/process_logger.h"
+#include "../M2_ProcessManager/process_spawn.h"
+#include "../M3_FileAnalyzer/analysis_core.h"
+#include "../M4_IPC/ipc_service.h"
+#include "../M4_IPC/ipc_transport.h"
+#include "../M4_IPC/ipc_wire.h"
+
+using namespace std;
+
+// The guardian: all four modules as subsystems of one long-running process.
+//   snapshot    the M1 collector on a fixed tick, into the in-memory ring and
+//               the rolling series file (snapshot_exe --query reads it)
+//   supervisor  keeps a list of services running through the M2 launch
+//               backends, restarts them with backoff and logs their exits
+//   analyzer    the M3 counting core; re-analyzes watched files that changed
+//   ipc         the M4 receiver; a reader thread hands alerts to the pool
+//   service     analysis requests arriving over M4, answered by the pool
+//               from a result cache or the M3 counting core
+// They share one event loop (epoll: signals, child pidfds, timers and posted
+// callbacks) and one thread pool. The loop thread owns the subsystems' state;
+// work that may block or take long runs as a pool task, which hands its
+// result back through loop_post(). Nothing is compiled or exec'd for a module
+// run, so its cost is one pool task on threads that are already running.
+
+long long monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Reports come from the loop and from pool threads; one line at a time
+mutex report_lock;
+
+void report(const string& line) {
+    lock_guard<mutex> hold(report_lock);
+    cout << line << endl;
+}
+
+// --- Thread Pool ---
+
+struct ThreadPool {
+    vector<thread> workers;
+    deque<function<void()>> tasks;
+    mutex lock;
+    condition_variable wake;
+    bool stopping = false;
+    atomic<unsigned long> completed{0};
+};
+
+void pool_start(ThreadPool& pool, int threads) {
+    for (int i = 0; i < threads; ++i) {
+        pool.workers.emplace_back([&pool] {
+            unique_lock<mutex> hold(pool.lock);
+            for (;;) {
+                pool.wake.wait(hold, [&pool] { return pool.stopping || !pool.tasks.empty(); });
+                if (pool.tasks.empty()) {
+                    return; // stopping, and nothing left to run
+                }
+                function<void()> task = move(pool.tasks.front());
+                pool.tasks.pop_front();
+                hold.unlock();
+                task();
+                pool.completed++;
+                hold.lock();
+            }
+        });
+    }
+}
+
+void pool_submit(ThreadPool& pool, function<void()> task) {
+    {
+        lock_guard<mutex> hold(pool.lock);
+        pool.tasks.push_back(move(task));
+    }
+    pool.wake.notify_one();
+}
+
+// Run what is queued, then join the workers
+void pool_stop(ThreadPool& pool) {
+    {
+        lock_guard<mutex> hold(pool.lock);
+        pool.stopping = true;
+    }
+    pool.wake.notify_all();
+    for (thread& worker : pool.workers) {
+        worker.join();
+    }
+    pool.workers.clear();
+}
+
+// --- Event Loop ---
+
+struct EventLoop {
+    int epoll_fd = -1;
+    int wake_fd = -1; // eventfd: callbacks were posted
+    map<int, function<void(uint32_t)>> watched;
+    multimap<long long, function<void()>> timers; // by due time, monotonic
+    mutex posted_lock;
+    vector<function<void()>> posted;
+    bool running = true;
+};
+
+bool loop_watch(EventLoop& loop, int fd, function<void(uint32_t)> handler) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        return false;
+    }
+    loop.watched[fd] = move(handler);
+    return true;
+}
+
+void loop_unwatch(EventLoop& loop, int fd) {
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    loop.watched.erase(fd);
+}
+
+void loop_at(EventLoop& loop, long long due_ns, function<void()> fn) {
+    loop.timers.emplace(due_ns, move(fn));
+}
+
+// Run fn on the loop thread; callable from any thread
+void loop_post(EventLoop& loop, function<void()> fn) {
+    {
+        lock_guard<mutex> hold(loop.posted_lock);
+        loop.posted.push_back(move(fn));
+    }
+    uint64_t one = 1;
+    if (write(loop.wake_fd, &one, sizeof(one)) < 0) {
+        // the counter is already nonzero: the loop will wake anyway
+    }
+}
+
+void loop_run_posted(EventLoop& loop) {
+    vector<function<void()>> batch;
+    {
+        lock_guard<mutex> hold(loop.posted_lock);
+        batch.swap(loop.posted);
+    }
+    for (auto& fn : batch) {
+        fn();
+    }
+}
+
+bool loop_open(EventLoop& loop) {
+    loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop.epoll_fd < 0 || loop.wake_fd < 0) {
+        return false;
+    }
+    return loop_watch(loop, loop.wake_fd, [&loop](uint32_t) {
+        uint64_t count;
+        if (read(loop.wake_fd, &count, sizeof(count)) < 0) {
+            // nothing pending; a racing read took it
+        }
+        loop_run_posted(loop);
+    });
+}
+
+void loop_run(EventLoop& loop) {
+    const int MAX_EVENTS = 32;
+    struct epoll_event events[MAX_EVENTS];
+    while (loop.running) {
+        int timeout_ms = -1;
+        if (!loop.timers.empty()) {
+            long long wait_ns = loop.timers.begin()->first - monotonic_ns();
+            timeout_ms = wait_ns <= 0 ? 0 : (int)min((wait_ns + 999999) / 1000000, 3600000LL);
+        }
+        int count = epoll_wait(loop.epoll_fd, events, MAX_EVENTS, timeout_ms);
+        if (count < 0 && errno != EINTR) {
+            cerr << "epoll_wait failed: " << strerror(errno) << endl;
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            auto found = loop.watched.find(events[i].data.fd);
+            if (found != loop.watched.end()) {
+                function<void(uint32_t)> handler = found->second; // it may unwatch itself
+                handler(events[i].events);
+            }
+        }
+        long long now = monotonic_ns();
+        while (!loop.timers.empty() && loop.timers.begin()->first <= now) {
+            function<void()> fn = move(loop.timers.begin()->second);
+            loop.timers.erase(loop.timers.begin());
+            fn();
+        }
+    }
+}
+
+void loop_close(EventLoop& loop) {
+    close(loop.wake_fd);
+    close(loop.epoll_fd);
+}
+
+// --- Guardian State ---
+
+struct Guardian;
+
+struct SnapshotSubsystem {
+    long long interval_ns = 0; // 0: disabled
+    long long next_ns = 0;
+    SnapshotCollector collector;
+    ProcessTable processes;
+    SampleRing ring;
+    SeriesFile series;
+    string series_path;
+    long long flush_ns = 60000000000LL;
+    long long last_flush_ns = 0;
+    size_t top = 0;
+    bool busy = false;          // a sample is being taken on the pool
+    unsigned long samples = 0;
+    unsigned long skipped = 0;  // ticks that found the previous sample still running
+    wire_snapshot latest = {};
+};
+
+enum RestartPolicy { RESTART_ALWAYS, RESTART_ON_FAILURE, RESTART_NEVER };
+
+struct Service {
+    int id;
+    string name;
+    vector<string> args;
+    RestartPolicy restart = RESTART_ALWAYS;
+    pid_t pid = -1;
+    int pidfd = -1;
+    long long start_ns = 0;
+    long long backoff_ns = 0;
+    unsigned long restarts = 0;
+};
+
+struct SupervisorSubsystem {
+    vector<Service> services;
+    SpawnBackend backend = SPAWN_POSIX_SPAWN;
+    string log_dir = "./logs";
+    ProcessLogger exit_records;
+    int running = 0;
+    unsigned long exits = 0;
+    long long grace_ns = 5000000000LL; // SIGTERM to SIGKILL at shutdown
+};
+
+struct WatchedFile {
+    string path;
+    bool busy = false;
+    bool known = false;   // identity below is of the last analysis
+    bool failing = false; // the last attempt failed; reported once
+    dev_t dev = 0;
+    ino_t ino = 0;
+    off_t size = 0;
+    struct timespec mtime = {0, 0};
+};
+
+struct AnalyzerSubsystem {
+    vector<WatchedFile> files;
+    long long interval_ns = 10000000000LL;
+    TermScanner scanner;
+    ProcessLogger results;
+    unsigned long analyses = 0;
+    unsigned long unchanged = 0;
+};
+
+struct IpcSubsystem {
+    bool enabled = false;
+    ipc_transport_kind transport = IPC_DEFAULT_TRANSPORT;
+    ipc_receiver rx;
+    pthread_t reader;
+    bool reader_started = false;
+    atomic<bool> stop{false};
+    atomic<bool> done{false};
+    atomic<unsigned long> alerts[2] = {{0}, {0}}; // notifications, emergencies
+    atomic<unsigned long> wire_records{0};
+    bool quiet = false;
+};
+
+struct CachedResult {
+    string key;
+    AnalysisResults results;
+};
+
+struct ServiceSubsystem {
+    bool enabled = false;
+    string root; // resolved; requests outside it are refused
+    int reply_queue = -1;
+    size_t cache_entries = 4096;
+    vector<string> default_terms;
+    mutex lock; // the cache and the scanners; pool threads share them
+    list<CachedResult> lru; // most recently used first
+    unordered_map<string, list<CachedResult>::iterator> cache;
+    map<string, shared_ptr<const TermScanner>> scanners; // by term list
+    atomic<unsigned long> requests{0};
+    atomic<unsigned long> hits{0};
+    atomic<unsigned long> failures{0};
+    atomic<unsigned long> dropped{0}; // replies nobody was left to take
+};
+
+struct Guardian {
+    EventLoop loop;
+    ThreadPool pool;
+    int threads = 0;
+    int signal_fd = -1;
+    bool stopping = false;
+    long long started_ns = 0;
+    long long status_ns = 0;   // 0: no periodic status line
+    double run_for_sec = 0;    // 0: until SIGINT/SIGTERM
+    SnapshotSubsystem snapshot;
+    SupervisorSubsystem supervisor;
+    AnalyzerSubsystem analyzer;
+    IpcSubsystem ipc;
+    ServiceSubsystem service;
+};
+
+void guardian_maybe_finish(Guardian& g);
+
+// --- Snapshot Subsystem ---
+
+void snapshot_tick(Guardian& g);
+
+string format_top(const ProcessTable& t, size_t n) {
+    ostringstream out;
+    out << fixed << setprecision(1);
+    out << "[Snapshot] top CPU:";
+    for (const ProcessRank& r : process_top_cpu(t, n)) {
+        out << " " << r.comm << "(" << r.pid << ") " << r.cpu_percent << "%";
+    }
+    out << "\n[Snapshot] top RSS:";
+    for (const ProcessRank& r : process_top_rss(t, n)) {
+        out << " " << r.comm << "(" << r.pid << ") " << r.rss_kb << " KB";
+    }
+    return out.str();
+}
+
+// On the pool; the busy flag keeps one sample in flight at a time
+void snapshot_take(Guardian& g) {
+    SnapshotSubsystem& s = g.snapshot;
+    SeriesSample sample;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    sample.time_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    bool ok = collector_sample(s.collector, sample.snapshot);
+    if (ok) {
+        ring_push(s.ring, sample);
+        long long mono = monotonic_ns();
+        if (s.series.map != NULL &&
+            (s.ring.unflushed >= s.series.header->block_samples || mono - s.last_flush_ns >= s.flush_ns)) {
+            ring_flush(s.ring, s.series);
+            s.last_flush_ns = mono;
+            if (s.top > 0) {
+                report(format_top(s.processes, s.top));
+            }
+        }
+    }
+    int error = errno;
+    loop_post(g.loop, [&g, ok, error, sample] {
+        SnapshotSubsystem& s = g.snapshot;
+        s.busy = false;
+        if (!ok) {
+            report(string("[Snapshot] sample failed: ") + strerror(error));
+            return;
+        }
+        s.samples++;
+        s.latest = sample.snapshot;
+    });
+}
+
+void snapshot_tick(Guardian& g) {
+    SnapshotSubsystem& s = g.snapshot;
+    if (g.stopping) {
+        return;
+    }
+    if (s.busy) {
+        s.skipped++;
+    } else {
+        s.busy = true;
+        pool_submit(g.pool, [&g] { snapshot_take(g); });
+    }
+    // Fixed tick: the next one is due an interval after this one was
+    s.next_ns += s.interval_ns;
+    long long now = monotonic_ns();
+    if (s.next_ns < now) {
+        s.next_ns = now; // fell behind; do not fire a burst to catch up
+    }
+    loop_at(g.loop, s.next_ns, [&g] { snapshot_tick(g); });
+}
+
+bool snapshot_start(Guardian& g, uint32_t idle_every, long ring_samples, long block_samples, long file_blocks) {
+    SnapshotSubsystem& s = g.snapshot;
+    if (!collector_open(s.collector)) {
+        cerr << "Cannot open /proc sources: " << strerror(errno) << endl;
+        return false;
+    }
+    if (s.top > 0) {
+        // Supervised services would inherit a raised descriptor limit
+        process_table_init(s.processes, idle_every, false);
+        s.collector.processes = &s.processes;
+    }
+    ring_init(s.ring, ring_samples);
+    if (!s.series_path.empty() &&
+        !series_open_writer(s.series, s.series_path.c_str(), block_samples, file_blocks, s.interval_ns)) {
+        cerr << "Cannot open series file " << s.series_path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    s.last_flush_ns = s.next_ns = monotonic_ns();
+    loop_at(g.loop, s.next_ns, [&g] { snapshot_tick(g); });
+    return true;
+}
+
+void snapshot_stop(Guardian& g) {
+    SnapshotSubsystem& s = g.snapshot;
+    if (s.series.map != NULL) {
+        ring_flush(s.ring, s.series);
+        series_close(s.series);
+    }
+    process_table_close(s.processes);
+    collector_close(s.collector);
+}
+
+// --- Supervisor Subsystem ---
+// One service per line: optional key=value settings, then the command and its
+// arguments separated by whitespace. Blank lines and # comments are skipped.
+//   name=TEXT     label used in reports (defaults to the command)
+//   restart=WHEN  always (default), on-failure or never
+// Output goes to <log dir>/guardian_<name>.log. A service that exits is
+// started again after a backoff that doubles from 100 ms up to 30 s, and
+// resets once a run lasts longer than 10 s.
+
+const long long MIN_BACKOFF_NS = 100000000LL;
+const long long MAX_BACKOFF_NS = 30000000000LL;
+const long long STABLE_RUN_NS = 10000000000LL;
+
+bool load_services(const string& path, vector<Service>& services) {
+    ifstream file(path);
+    if (!file.is_open()) {
+        cerr << "Cannot open service list " << path << endl;
+        return false;
+    }
+    string line;
+    int line_number = 0;
+    while (getline(file, line)) {
+        line_number++;
+        size_t hash = line.find('#');
+        if (hash != string::npos) {
+            line.erase(hash);
+        }
+        istringstream words(line);
+        Service service;
+        service.id = (int)services.size() + 1;
+        string word;
+        while (words >> word) {
+            size_t equals = word.find('=');
+            if (service.args.empty() && equals != string::npos) {
+                string key = word.substr(0, equals), value = word.substr(equals + 1);
+                if (key == "name") {
+                    service.name = value;
+                } else if (key == "restart" && value == "always") {
+                    service.restart = RESTART_ALWAYS;
+                } else if (key == "restart" && value == "on-failure") {
+                    service.restart = RESTART_ON_FAILURE;
+                } else if (key == "restart" && value == "never") {
+                    service.restart = RESTART_NEVER;
+                } else {
+                    cerr << path << ":" << line_number << ": unknown setting '" << word << "'" << endl;
+                    return false;
+                }
+            } else {
+                service.args.push_back(word);
+            }
+        }
+        if (service.args.empty()) {
+            continue;
+        }
+        if (service.name.empty()) {
+            service.name = service.args[0].substr(service.args[0].rfind('/') + 1);
+        }
+        services.push_back(service);
+    }
+    return true;
+}
+
+int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+void service_exited(Guardian& g, Service& service);
+
+void service_start(Guardian& g, Service& service) {
+    SupervisorSubsystem& sup = g.supervisor;
+    if (g.stopping) {
+        return;
+    }
+    string log_path = sup.log_dir + "/guardian_" + service.name + ".log";
+    SpawnOptions options = {sup.backend, log_path.c_str(), log_path.c_str(), -1};
+    vector<char*> argv;
+    for (string& arg : service.args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(NULL);
+    service.start_ns = monotonic_ns();
+    service.pid = spawn_process(options, argv.data());
+    if (service.pid < 0) {
+        report("[Supervisor] cannot start " + service.name + ": " + strerror(errno));
+        service_exited(g, service);
+        return;
+    }
+    service.pidfd = open_pidfd(service.pid);
+    if (service.pidfd < 0 || !loop_watch(g.loop, service.pidfd, [&g, &service](uint32_t) {
+            service_exited(g, service);
+        })) {
+        // Without a pidfd there is nothing to wake us for this child
+        report("[Supervisor] cannot watch " + service.name + ": " + strerror(errno));
+        kill(service.pid, SIGKILL);
+        waitpid(service.pid, NULL, 0);
+        if (service.pidfd >= 0) {
+            close(service.pidfd);
+            service.pidfd = -1;
+        }
+        service.pid = -1;
+        service_exited(g, service);
+        return;
+    }
+    sup.running++;
+    report("[Supervisor] started " + service.name + " (PID " + to_string(service.pid) + ")");
+}
+
+void log_service_exit(SupervisorSubsystem& sup, const Service& service, int status, wire_outcome outcome,
+                      long long wall_ns, const struct rusage* ru) {
+    if (sup.exit_records.fd < 0) {
+        return;
+    }
+    wire_child_exit fixed = {};
+    fixed.pid = service.pid;
+    fixed.job_id = service.id;
+    fixed.wait_status = status;
+    fixed.outcome = outcome;
+    fixed.name_length = min(service.name.size(), (size_t)UINT16_MAX);
+    fixed.wall_ns = wall_ns;
+    if (ru != NULL) {
+        fixed.user_us = ru->ru_utime.tv_sec * 1000000LL + ru->ru_utime.tv_usec;
+        fixed.system_us = ru->ru_stime.tv_sec * 1000000LL + ru->ru_stime.tv_usec;
+        fixed.max_rss_kb = ru->ru_maxrss;
+        fixed.voluntary_switches = ru->ru_nvcsw;
+        fixed.involuntary_switches = ru->ru_nivcsw;
+    }
+    fixed.cgroup_memory_peak = -1;
+    fixed.cgroup_throttled_us = -1;
+    vector<char> record(sizeof(wire_header) + sizeof(fixed) + fixed.name_length);
+    size_t length = wire_encode_child_exit(record.data(), record.size(), &fixed, service.name.data());
+    logger_record(sup.exit_records, record.data(), length);
+}
+
+// Collect an exited (or never started) service and schedule its restart
+void service_exited(Guardian& g, Service& service) {
+    SupervisorSubsystem& sup = g.supervisor;
+    long long wall_ns = monotonic_ns() - service.start_ns;
+    int status = 0;
+    bool failed = true;
+    if (service.pid > 0) {
+        struct rusage ru;
+        if (wait4(service.pid, &status, WNOHANG, &ru) == 0) {
+            return; // pidfd woke early; not collected yet
+        }
+        loop_unwatch(g.loop, service.pidfd);
+        close(service.pidfd);
+        service.pidfd = -1;
+        sup.running--;
+        sup.exits++;
+        failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        log_service_exit(sup, service, status, WIFEXITED(status) ? WIRE_EXITED : WIRE_SIGNALED, wall_ns, &ru);
+        ostringstream line;
+        line << "[Supervisor] " << service.name << " (PID " << service.pid << ") ";
+        if (WIFEXITED(status)) {
+            line << "exited with status " << WEXITSTATUS(status);
+        } else {
+            line << "killed by signal " << WTERMSIG(status);
+        }
+        line << " after " << wall_ns / 1000000 << " ms";
+        report(line.str());
+    } else {
+        log_service_exit(sup, service, 0, WIRE_SPAWN_FAILED, 0, NULL);
+    }
+    service.pid = -1;
+
+    if (g.stopping) {
+        guardian_maybe_finish(g);
+        return;
+    }
+    if (service.restart == RESTART_NEVER || (service.restart == RESTART_ON_FAILURE && !failed)) {
+        guardian_maybe_finish(g);
+        return;
+    }
+    if (wall_ns >= STABLE_RUN_NS) {
+        service.backoff_ns = 0;
+    }
+    service.backoff_ns = service.backoff_ns == 0 ? MIN_BACKOFF_NS : min(service.backoff_ns * 2, MAX_BACKOFF_NS);
+    service.restarts++;
+    loop_at(g.loop, monotonic_ns() + service.backoff_ns, [&g, &service] { service_start(g, service); });
+}
+
+void supervisor_stop(Guardian& g) {
+    SupervisorSubsystem& sup = g.supervisor;
+    for (Service& service : sup.services) {
+        if (service.pid > 0) {
+            kill(service.pid, SIGTERM);
+        }
+    }
+    if (sup.running > 0) {
+        loop_at(g.loop, monotonic_ns() + sup.grace_ns, [&g] {
+            for (Service& service : g.supervisor.services) {
+                if (service.pid > 0) {
+                    report("[Supervisor] " + service.name + " ignored SIGTERM, killing it");
+                    kill(service.pid, SIGKILL);
+                }
+            }
+        });
+    }
+}
+
+// --- Analyzer Subsystem ---
+
+void analyzer_tick(Guardian& g);
+
+void analyzer_report(Guardian& g, const WatchedFile& file, const AnalysisResults& results, long long elapsed_ns,
+                     off_t bytes) {
+    AnalyzerSubsystem& a = g.analyzer;
+    ostringstream line;
+    line << "[Analyzer] " << file.path << ": " << results.total_chars << " chars, " << results.total_lines
+         << " lines, " << results.total_words << " words";
+    for (size_t i = 0; i < a.scanner.terms.size(); ++i) {
+        line << ", '" << a.scanner.terms[i] << "' " << results.term_occurrences[i];
+    }
+    line << " (" << fixed << setprecision(3) << elapsed_ns / 1e6 << " ms)";
+    report(line.str());
+
+    if (a.results.fd >= 0) {
+        wire_analysis run = {};
+        run.input_bytes = bytes;
+        run.elapsed_ns = elapsed_ns;
+        run.threads = 1;
+        run.files = 1;
+        vector<char> record;
+        size_t length = encode_results_record(record, results, a.scanner.terms, run, file.path.c_str());
+        if (length > 0) {
+            logger_record(a.results, record.data(), length);
+        }
+    }
+}
+
+// Analyze one file on the pool, then record its identity on the loop
+void analyzer_run(Guardian& g, size_t index) {
+    string path = g.analyzer.files[index].path; // the vector is never resized after startup
+    AnalysisResults results;
+    vector<size_t> scratch;
+    struct stat st;
+    long long start = monotonic_ns();
+    bool ok = analyze_file(g.analyzer.scanner, path.c_str(), results, scratch, &st);
+    int error = errno;
+    long long elapsed_ns = monotonic_ns() - start;
+    loop_post(g.loop, [&g, index, ok, error, st, results, elapsed_ns] {
+        WatchedFile& file = g.analyzer.files[index];
+        file.busy = false;
+        if (!ok) {
+            if (!file.failing) {
+                report("[Analyzer] cannot analyze " + file.path + ": " + strerror(error));
+            }
+            file.failing = true;
+            file.known = false;
+            return;
+        }
+        file.failing = false;
+        file.known = true;
+        file.dev = st.st_dev;
+        file.ino = st.st_ino;
+        file.size = st.st_size;
+        file.mtime = st.st_mtim;
+        g.analyzer.analyses++;
+        analyzer_report(g, file, results, elapsed_ns, st.st_size);
+    });
+}
+
+void analyzer_tick(Guardian& g) {
+    if (g.stopping) {
+        return;
+    }
+    AnalyzerSubsystem& a = g.analyzer;
+    for (size_t i = 0; i < a.files.size(); ++i) {
+        WatchedFile& file = a.files[i];
+        if (file.busy) {
+            continue;
+        }
+        // Same device, inode, size and modification time: the counts stand
+        struct stat st;
+        if (file.known && stat(file.path.c_str(), &st) == 0 && st.st_dev == file.dev && st.st_ino == file.ino &&
+            st.st_size == file.size && st.st_mtim.tv_sec == file.mtime.tv_sec &&
+            st.st_mtim.tv_nsec == file.mtime.tv_nsec) {
+            a.unchanged++;
+            continue;
+        }
+        file.busy = true;
+        pool_submit(g.pool, [&g, i] { analyzer_run(g, i); });
+    }
+    loop_at(g.loop, monotonic_ns() + a.interval_ns, [&g] { analyzer_tick(g); });
+}
+
+// --- Analysis Service ---
+// A WIRE_ANALYSIS_REQUEST names a file and the terms to count. Each request
+// is one pool task: the file's identity (device, inode, size and mtime to
+// the nanosecond) and the term list form the cache key, so a file that has
+// not changed is answered without reading it. Otherwise the file is counted
+// with a term scanner kept per term list, and the result is cached under
+// the identity fstat() gave when it was opened. Replies go to the reply
+// queue (ipc_service.h) as a WIRE_ANALYSIS_REPLY record followed by the
+// WIRE_ANALYSIS record.
+//
+// The request queue is open to every local user, and the guardian reads
+// with its own privileges, so only files under the serve root (--serve-root,
+// by default the working directory) are answered. The named path is
+// resolved with realpath() and must land under the root; once opened, the
+// descriptor's own path is checked again, so a directory swapped for a
+// symlink in between is still refused. Anything else gets EACCES, whether
+// or not it exists.
+
+const size_t MAX_SCANNERS = 64; // distinct term lists kept prepared
+
+// Length-prefixed, so no two term lists share a key
+string term_list_key(const vector<string>& terms) {
+    string key;
+    for (const string& term : terms) {
+        key += to_string(term.size()) + ":" + term;
+    }
+    return key;
+}
+
+string identity_key(const struct stat& st, const string& terms_key) {
+    char id[128];
+    snprintf(id, sizeof(id), "%llx:%llx:%llx:%lld.%09ld|", (unsigned long long)st.st_dev,
+             (unsigned long long)st.st_ino, (unsigned long long)st.st_size, (long long)st.st_mtim.tv_sec,
+             st.st_mtim.tv_nsec);
+    return id + terms_key;
+}
+
+shared_ptr<const TermScanner> service_scanner(ServiceSubsystem& svc, const vector<string>& terms,
+                                              const string& terms_key) {
+    lock_guard<mutex> hold(svc.lock);
+    auto found = svc.scanners.find(terms_key);
+    if (found != svc.scanners.end()) {
+        return found->second;
+    }
+    if (svc.scanners.size() >= MAX_SCANNERS) {
+        svc.scanners.clear(); // tasks still scanning hold their own reference
+    }
+    auto scanner = make_shared<TermScanner>();
+    prepare_term_scanner(*scanner, terms, detect_scan_kernel());
+    svc.scanners[terms_key] = scanner;
+    return scanner;
+}
+
+bool cache_lookup(ServiceSubsystem& svc, const string& key, AnalysisResults& results) {
+    lock_guard<mutex> hold(svc.lock);
+    auto found = svc.cache.find(key);
+    if (found == svc.cache.end()) {
+        return false;
+    }
+    svc.lru.splice(svc.lru.begin(), svc.lru, found->second);
+    results = found->second->results;
+    return true;
+}
+
+void cache_store(ServiceSubsystem& svc, const string& key, const AnalysisResults& results) {
+    if (svc.cache_entries == 0) {
+        return;
+    }
+    lock_guard<mutex> hold(svc.lock);
+    auto found = svc.cache.find(key);
+    if (found != svc.cache.end()) {
+        found->second->results = results;
+        svc.lru.splice(svc.lru.begin(), svc.lru, found->second);
+        return;
+    }
+    svc.lru.push_front(CachedResult{key, results});
+    svc.cache[key] = svc.lru.begin();
+    if (svc.lru.size() > svc.cache_entries) {
+        svc.cache.erase(svc.lru.back().key);
+        svc.lru.pop_back();
+    }
+}
+
+void service_reply(ServiceSubsystem& svc, const wire_analysis_request& request, int error, uint32_t flags,
+                   const AnalysisResults* results, const vector<string>& terms, const string& path,
+                   long long elapsed_ns, off_t bytes) {
+    vector<char> analysis;
+    size_t analysis_length = 0;
+    if (error == 0) {
+        wire_analysis run = {};
+        run.input_bytes = bytes;
+        run.elapsed_ns = elapsed_ns;
+        run.threads = 1;
+        run.files = 1;
+        analysis_length = encode_results_record(analysis, *results, terms, run, path.c_str());
+        if (analysis_length == 0 ||
+            analysis_length > IPC_BATCH_MAX_BYTES - sizeof(wire_header) - sizeof(wire_analysis_reply)) {
+            error = EMSGSIZE;
+            analysis_length = 0;
+        }
+    }
+    wire_analysis_reply reply = {request.request_id, error, flags};
+    char message[IPC_BATCH_MAX_BYTES];
+    size_t length = wire_encode_analysis_reply(message, sizeof(message), &reply);
+    memcpy(message + length, analysis.data(), analysis_length);
+    length += analysis_length;
+    // A reply for a client that is gone would sit in the queue for good
+    if ((kill(request.reply_to, 0) < 0 && errno == ESRCH) ||
+        ipc_service_reply(svc.reply_queue, request.reply_to, message, length) < 0) {
+        svc.dropped++;
+    }
+}
+
+// True if resolved, a path without symlinks or dot components, is root or
+// lies beneath it
+bool under_root(const string& root, const string& resolved) {
+    if (root == "/") {
+        return resolved[0] == '/';
+    }
+    return resolved.compare(0, root.size(), root) == 0 &&
+           (resolved.size() == root.size() || resolved[root.size()] == '/');
+}
+
+// A missing file named under the root is reported as such; nothing is said
+// about any other path. Lexically under the root means absolute, within it
+// and free of .. components; a dangling symlink there is not missing.
+int refusal_errno(const ServiceSubsystem& svc, const string& path, int resolve_errno) {
+    bool lexically_under = path[0] == '/' && under_root(svc.root, path) && path.find("/../") == string::npos &&
+                           (path.size() < 3 || path.compare(path.size() - 3, 3, "/..") != 0);
+    struct stat st;
+    return resolve_errno == ENOENT && lexically_under && lstat(path.c_str(), &st) < 0 ? ENOENT : EACCES;
+}
+
+bool fd_under_root(const ServiceSubsystem& svc, int fd) {
+    char link[64], target[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    ssize_t length = readlink(link, target, sizeof(target) - 1);
+    if (length <= 0) {
+        return false;
+    }
+    return under_root(svc.root, string(target, length));
+}
+
+void service_handle(Guardian& g, const string& payload) {
+    ServiceSubsystem& svc = g.service;
+    long long start = monotonic_ns();
+    svc.requests++;
+    struct wire_header header;
+    wire_request_view view;
+    if (wire_decode_header(payload.data(), payload.size(), &header) <= 0 ||
+        wire_decode_analysis_request(&header, wire_body(payload.data()), &view) < 0) {
+        svc.failures++; // without a reply_to there is no one to tell
+        return;
+    }
+    string path(view.path, view.fixed.path_length);
+    vector<string> terms;
+    const char* cursor = view.terms;
+    for (uint32_t i = 0; i < view.fixed.term_count; ++i) {
+        const char* term;
+        size_t length;
+        if (wire_next_term(&cursor, view.end, &term, &length) < 0) {
+            svc.failures++;
+            service_reply(svc, view.fixed, EINVAL, 0, NULL, terms, path, 0, 0);
+            return;
+        }
+        terms.emplace_back(term, length);
+    }
+    if (terms.empty()) {
+        terms = svc.default_terms;
+    }
+    string terms_key = term_list_key(terms);
+
+    char resolved[PATH_MAX];
+    if (path.empty() || realpath(path.c_str(), resolved) == NULL || !under_root(svc.root, resolved)) {
+        svc.failures++;
+        service_reply(svc, view.fixed, refusal_errno(svc, path, path.empty() ? EINVAL : errno), 0, NULL, terms,
+                      path, 0, 0);
+        return;
+    }
+
+    struct stat st;
+    AnalysisResults results;
+    bool use_cache = !(view.fixed.flags & WIRE_REQUEST_NO_CACHE);
+    if (use_cache && stat(resolved, &st) == 0 && cache_lookup(svc, identity_key(st, terms_key), results)) {
+        svc.hits++;
+        service_reply(svc, view.fixed, 0, WIRE_REPLY_CACHED, &results, terms, path, monotonic_ns() - start,
+                      st.st_size);
+        return;
+    }
+    int fd = open_regular_file(resolved, st);
+    int error = fd < 0 ? errno : 0;
+    if (fd >= 0 && !fd_under_root(svc, fd)) {
+        error = EACCES;
+    }
+    if (error == 0) {
+        shared_ptr<const TermScanner> scanner = service_scanner(svc, terms, terms_key);
+        static thread_local vector<size_t> scratch;
+        if (!analyze_fd(*scanner, fd, st, results, scratch)) {
+            error = errno;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (error != 0) {
+        svc.failures++;
+        service_reply(svc, view.fixed, error, 0, NULL, terms, path, 0, 0);
+        return;
+    }
+    cache_store(svc, identity_key(st, terms_key), results);
+    service_reply(svc, view.fixed, 0, 0, &results, terms, path, monotonic_ns() - start, st.st_size);
+}
+
+// --- IPC Subsystem ---
+
+void wakeup_handler(int signal_number) {
+    (void)signal_number;
+}
+
+struct AlertBatch {
+    vector<long> types;
+    vector<string> payloads;
+};
+
+void stage_alert(void* context, long mtype, const char* data, size_t length, uint64_t sent_ns) {
+    (void)sent_ns;
+    AlertBatch& batch = *(AlertBatch*)context;
+    batch.types.push_back(mtype);
+    batch.payloads.emplace_back(data, length); // arena payloads are released when we return
+}
+
+void handle_alerts(Guardian& g, const AlertBatch& batch) {
+    IpcSubsystem& ipc = g.ipc;
+    for (size_t i = 0; i < batch.types.size(); ++i) {
+        const string& payload = batch.payloads[i];
+        struct wire_header header;
+        if (g.service.enabled && wire_decode_header(payload.data(), payload.size(), &header) > 0 &&
+            header.type == WIRE_ANALYSIS_REQUEST) {
+            pool_submit(g.pool, [&g, payload] { service_handle(g, payload); });
+            continue;
+        }
+        bool emergency = batch.types[i] == EMERGENCY_TYPE;
+        ipc.alerts[emergency ? 1 : 0]++;
+        const char* text;
+        size_t length;
+        string shown;
+        if (wire_alert_text(payload.data(), payload.size(), &text, &length)) {
+            shown = string(text, length) + " (wire record)";
+        } else if (wire_decode_header(payload.data(), payload.size(), &header) > 0) {
+            ipc.wire_records++;
+            shown = string(wire_type_name(header.type)) + " wire record [" + to_string(payload.size()) + " bytes]";
+        } else {
+            size_t end = payload.find_first_of(string("\n\0", 2));
+            shown = payload.substr(0, end);
+            if (end != string::npos && end + 1 < payload.size()) {
+                shown += " [" + to_string(payload.size()) + " bytes]";
+            }
+        }
+        if (!ipc.quiet) {
+            report(string("[IPC] ") + (emergency ? "EMERGENCY: " : "notification: ") + shown);
+        }
+    }
+}
+
+// The reader thread: blocks in the transport, hands each batch to the pool.
+// SIGUSR1 from the loop interrupts the wait at shutdown.
+void* ipc_reader_main(void* arg) {
+    Guardian& g = *(Guardian*)arg;
+    IpcSubsystem& ipc = g.ipc;
+    sigset_t wakeup;
+    sigemptyset(&wakeup);
+    sigaddset(&wakeup, SIGUSR1);
+    pthread_sigmask(SIG_UNBLOCK, &wakeup, NULL);
+    while (!ipc.stop) {
+        AlertBatch* batch = new AlertBatch();
+        long received = ipc_receive(&ipc.rx, 1, 64, stage_alert, batch, NULL);
+        if (received < 0 && errno != EINTR) {
+            report(string("[IPC] receive failed: ") + strerror(errno));
+            delete batch;
+            break;
+        }
+        if (batch->types.empty()) {
+            delete batch;
+            continue;
+        }
+        pool_submit(g.pool, [&g, batch] {
+            handle_alerts(g, *batch);
+            delete batch;
+        });
+    }
+    ipc.done = true;
+    return NULL;
+}
+
+bool ipc_start(Guardian& g) {
+    IpcSubsystem& ipc = g.ipc;
+    if (ipc_receiver_open(&ipc.rx, ipc.transport, 1) < 0) {
+        cerr << (ipc.transport == IPC_TRANSPORT_SHM ? "shm_open failed: " : "msgget failed: ") << strerror(errno)
+             << endl;
+        return false;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = wakeup_handler; // no SA_RESTART
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+    ipc.reader_started = pthread_create(&ipc.reader, NULL, ipc_reader_main, &g) == 0;
+    return ipc.reader_started;
+}
+
+// Nudge the reader out of its blocking read until it notices the stop
+void ipc_stop(Guardian& g) {
+    IpcSubsystem& ipc = g.ipc;
+    if (!ipc.reader_started) {
+        return;
+    }
+    ipc.stop = true;
+    while (!ipc.done) {
+        pthread_kill(ipc.reader, SIGUSR1);
+        usleep(1000);
+    }
+    pthread_join(ipc.reader, NULL);
+    ipc_receiver_close(&ipc.rx);
+}
+
+// --- Lifecycle ---
+
+void print_status(Guardian& g) {
+    ostringstream line;
+    line << fixed << setprecision(1);
+    line << "[Guardian] up " << (monotonic_ns() - g.started_ns) / 1e9 << " s, " << g.threads << " pool threads, "
+         << g.pool.completed << " tasks";
+    if (g.snapshot.interval_ns > 0) {
+        const wire_snapshot& s = g.snapshot.latest;
+        line << " | snapshot: " << g.snapshot.samples << " samples (" << g.snapshot.skipped << " skipped), load "
+             << setprecision(2) << s.load_milli[0] / 1e3 << ", " << s.process_count << " processes, mem "
+             << s.mem_used_kb / 1024 << "/" << s.mem_total_kb / 1024 << " MB" << setprecision(1);
+    }
+    if (!g.supervisor.services.empty()) {
+        unsigned long restarts = 0;
+        for (const Service& service : g.supervisor.services) {
+            restarts += service.restarts;
+        }
+        line << " | supervisor: " << g.supervisor.running << "/" << g.supervisor.services.size()
+             << " running, " << restarts << " restarts";
+    }
+    if (!g.analyzer.files.empty()) {
+        line << " | analyzer: " << g.analyzer.analyses << " analyses, " << g.analyzer.unchanged << " unchanged";
+    }
+    if (g.ipc.enabled) {
+        line << " | ipc: " << g.ipc.alerts[0] << " notifications, " << g.ipc.alerts[1] << " emergencies";
+    }
+    if (g.service.enabled) {
+        size_t cached;
+        {
+            lock_guard<mutex> hold(g.service.lock);
+            cached = g.service.lru.size();
+        }
+        line << " | service: " << g.service.requests << " requests, " << g.service.hits << " cache hits, "
+             << g.service.failures << " failed, " << cached << " cached results";
+        if (g.service.dropped > 0) {
+            line << ", " << g.service.dropped << " replies dropped";
+        }
+    }
+    report(line.str());
+}
+
+void status_tick(Guardian& g) {
+    if (g.stopping) {
+        return;
+    }
+    print_status(g);
+    loop_at(g.loop, monotonic_ns() + g.status_ns, [&g] { status_tick(g); });
+}
+
+// The loop ends once a stop was requested and every service is collected
+void guardian_maybe_finish(Guardian& g) {
+    if (g.stopping && g.supervisor.running == 0) {
+        g.loop.running = false;
+    }
+}
+
+void guardian_stop(Guardian& g, const char* why) {
+    if (g.stopping) {
+        return;
+    }
+    report(string("[Guardian] ") + why + ", stopping...");
+    g.stopping = true;
+    supervisor_stop(g);
+    guardian_maybe_finish(g);
+}
+
+void print_usage(const char* program) {
+    cerr << "Usage: " << program << " [options]\n"
+         << "  --threads N          pool threads (default: one per CPU)\n"
+         << "  --run-for SEC        stop after SEC seconds (default: until SIGINT/SIGTERM)\n"
+         << "  --status-sec SEC     print a status line every SEC seconds (default 10, 0 = off)\n"
+         << "  --log-dir DIR        service output and default series file (default ./logs)\n"
+         << "Snapshot:\n"
+         << "  --snapshot-ms MS     sampling interval (default 1000, 0 = off)\n"
+         << "  --series FILE        rolling series file (default <log dir>/M1_series.bin, '' = none)\n"
+         << "  --ring N             samples kept in memory (default 3600)\n"
+         << "  --block-samples N    samples per series block (default 60)\n"
+         << "  --file-blocks N      blocks kept in the series file (default 1440)\n"
+         << "  --flush-sec SEC      longest time a sample waits for the file (default 60)\n"
+         << "  --top N              print the top N processes by CPU and RSS on each flush\n"
+         << "  --idle-every K       re-read idle processes every K samples (default 10)\n"
+         << "Supervisor:\n"
+         << "  --services FILE      services to keep running, one per line\n"
+         << "  --spawn BACKEND      fork, posix_spawn (default) or vfork\n"
+         << "  --exit-records FILE  append a WIRE_CHILD_EXIT record for every exit\n"
+         << "Analyzer:\n"
+         << "  --analyze PATH       watch a file (repeatable)\n"
+         << "  --term TEXT          count words containing TEXT (repeatable, default 'threads')\n"
+         << "  --analyze-sec SEC    how often watched files are checked for changes (default 10)\n"
+         << "  --results-out FILE   append a WIRE_ANALYSIS record for every analysis\n"
+         << "IPC:\n"
+         << "  --ipc                receive alerts from M4 senders\n"
+         << "  --transport KIND     msgq or shm (default " << ipc_transport_name(IPC_DEFAULT_TRANSPORT) << ")\n"
+         << "  --quiet-alerts       count alerts without printing them\n"
+         << "Service:\n"
+         << "  --serve              answer analysis requests (analysis_client) received over IPC; implies --ipc\n"
+         << "  --serve-root DIR     only answer for files under DIR (default: the working directory)\n"
+         << "  --cache-entries N    results kept by file identity and terms (default 4096, 0 = none)\n"
+         << "                       (--term sets the terms counted when a request names none)\n";
+}
+
+int main(int argc, char* argv[]) {
+    Guardian g;
+    double status_sec = 10;
+    long snapshot_ms = 1000;
+    bool series_given = false;
+    long ring_samples = 3600;
+    long block_samples = 60;
+    long file_blocks = 1440;
+    double flush_sec = 60;
+    long idle_every = 10;
+    string services_file;
+    string exit_records_file;
+    string results_file;
+    string serve_root = ".";
+    double analyze_sec = 10;
+    vector<string> terms;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            g.threads = atoi(argv[++i]);
+        } else if (arg == "--run-for" && i + 1 < argc) {
+            g.run_for_sec = atof(argv[++i]);
+        } else if (arg == "--status-sec" && i + 1 < argc) {
+            status_sec = atof(argv[++i]);
+        } else if (arg == "--log-dir" && i + 1 < argc) {
+            g.supervisor.log_dir = argv[++i];
+        } else if (arg == "--snapshot-ms" && i + 1 < argc) {
+            snapshot_ms = atol(argv[++i]);
+        } else if (arg == "--series" && i + 1 < argc) {
+            g.snapshot.series_path = argv[++i];
+            series_given = true;
+        } else if (arg == "--ring" && i + 1 < argc) {
+            ring_samples = atol(argv[++i]);
+        } else if (arg == "--block-samples" && i + 1 < argc) {
+            block_samples = atol(argv[++i]);
+        } else if (arg == "--file-blocks" && i + 1 < argc) {
+            file_blocks = atol(argv[++i]);
+        } else if (arg == "--flush-sec" && i + 1 < argc) {
+            flush_sec = atof(argv[++i]);
+        } else if (arg == "--top" && i + 1 < argc) {
+            g.snapshot.top = atol(argv[++i]);
+        } else if (arg == "--idle-every" && i + 1 < argc) {
+            idle_every = atol(argv[++i]);
+        } else if (arg == "--services" && i + 1 < argc) {
+            services_file = argv[++i];
+        } else if (arg == "--spawn" && i + 1 < argc) {
+            if (!parse_spawn_backend(argv[++i], g.supervisor.backend)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--exit-records" && i + 1 < argc) {
+            exit_records_file = argv[++i];
+        } else if (arg == "--analyze" && i + 1 < argc) {
+            WatchedFile file;
+            file.path = argv[++i];
+            g.analyzer.files.push_back(file);
+        } else if (arg == "--term" && i + 1 < argc) {
+            terms.push_back(argv[++i]);
+        } else if (arg == "--analyze-sec" && i + 1 < argc) {
+            analyze_sec = atof(argv[++i]);
+        } else if (arg == "--results-out" && i + 1 < argc) {
+            results_file = argv[++i];
+        } else if (arg == "--ipc") {
+            g.ipc.enabled = true;
+        } else if (arg == "--transport" && i + 1 < argc) {
+            if (ipc_parse_transport(argv[++i], &g.ipc.transport) < 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--quiet-alerts") {
+            g.ipc.quiet = true;
+        } else if (arg == "--serve") {
+            g.service.enabled = true;
+            g.ipc.enabled = true;
+        } else if (arg == "--serve-root" && i + 1 < argc) {
+            serve_root = argv[++i];
+        } else if (arg == "--cache-entries" && i + 1 < argc) {
+            g.service.cache_entries = atol(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (g.threads <= 0) {
+        g.threads = max(1, (int)sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    if (!services_file.empty() && !load_services(services_file, g.supervisor.services)) {
+        return 1;
+    }
+    if (snapshot_ms > 0 && (ring_samples < 1 || block_samples < 1 || file_blocks < 1)) {
+        cerr << "--ring, --block-samples and --file-blocks must be at least 1" << endl;
+        return 1;
+    }
+    if (terms.empty()) {
+        terms.push_back("threads"); // as the analyzer counts by default
+    }
+    mkdir(g.supervisor.log_dir.c_str(), 0755);
+
+    // Signals arrive through a signalfd; every thread started below inherits
+    // the mask, so none of them is interrupted by SIGINT/SIGTERM
+    sigset_t blocked;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGUSR1); // only the IPC reader takes it
+    pthread_sigmask(SIG_BLOCK, &blocked, NULL);
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    g.signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (!loop_open(g.loop) || g.signal_fd < 0) {
+        cerr << "Cannot set up the event loop: " << strerror(errno) << endl;
+        return 1;
+    }
+    loop_watch(g.loop, g.signal_fd, [&g](uint32_t) {
+        struct signalfd_siginfo info;
+        while (read(g.signal_fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+            guardian_stop(g, info.ssi_signo == SIGINT ? "SIGINT received" : "SIGTERM received");
+        }
+    });
+
+    // Everything that can fail is opened before the pool threads and the
+    // services start, so a failed start has nothing to stop
+    g.started_ns = monotonic_ns();
+    cout << "Guardian started: PID " << getpid() << ", " << g.threads << " pool threads" << endl;
+
+    if (snapshot_ms > 0) {
+        g.snapshot.interval_ns = snapshot_ms * 1000000LL;
+        g.snapshot.flush_ns = (long long)(flush_sec * 1e9);
+        if (!series_given) {
+            g.snapshot.series_path = g.supervisor.log_dir + "/M1_series.bin";
+        }
+        if (!snapshot_start(g, (uint32_t)max(1L, idle_every), ring_samples, block_samples, file_blocks)) {
+            return 1;
+        }
+        cout << "  snapshot: every " << snapshot_ms << " ms"
+             << (g.snapshot.series_path.empty() ? "" : " into " + g.snapshot.series_path) << endl;
+    }
+    if (!exit_records_file.empty() &&
+        !logger_open(g.supervisor.exit_records, exit_records_file.c_str(), DEFAULT_LOGGER_OPTIONS)) {
+        cerr << "Cannot open " << exit_records_file << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    if (!g.analyzer.files.empty()) {
+        prepare_term_scanner(g.analyzer.scanner, terms, detect_scan_kernel());
+        g.analyzer.interval_ns = (long long)(max(analyze_sec, 0.001) * 1e9);
+        if (!results_file.empty() && !logger_open(g.analyzer.results, results_file.c_str(), DEFAULT_LOGGER_OPTIONS)) {
+            cerr << "Cannot open " << results_file << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        cout << "  analyzer: " << g.analyzer.files.size() << " files, " << terms.size() << " terms, "
+             << scan_kernel_name(g.analyzer.scanner.kernel) << " kernel" << endl;
+        loop_at(g.loop, monotonic_ns(), [&g] { analyzer_tick(g); });
+    }
+    if (g.service.enabled) {
+        g.service.default_terms = terms;
+        char resolved[PATH_MAX];
+        if (realpath(serve_root.c_str(), resolved) == NULL) {
+            cerr << "Cannot resolve the serve root " << serve_root << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        g.service.root = resolved;
+        g.service.reply_queue = ipc_service_reply_queue(1);
+        if (g.service.reply_queue < 0) {
+            cerr << "msgget failed for the reply queue: " << strerror(errno) << endl;
+            return 1;
+        }
+        cout << "  service: answering analysis requests under " << g.service.root << ", cache of "
+             << g.service.cache_entries << " results" << endl;
+    }
+    if (g.ipc.enabled) {
+        if (!ipc_start(g)) {
+            return 1;
+        }
+        cout << "  ipc: receiving over " << ipc_transport_name(g.ipc.transport) << endl;
+    }
+    pool_start(g.pool, g.threads); // the reader may already have queued work
+    for (Service& service : g.supervisor.services) {
+        service_start(g, service);
+    }
+    if (status_sec > 0) {
+        g.status_ns = (long long)(status_sec * 1e9);
+        loop_at(g.loop, monotonic_ns() + g.status_ns, [&g] { status_tick(g); });
+    }
+    if (g.run_for_sec > 0) {
+        loop_at(g.loop, g.started_ns + (long long)(g.run_for_sec * 1e9), [&g] { guardian_stop(g, "run time over"); });
+    }
+
+    loop_run(g.loop);
+
+    // Services are collected; finish the queued work, then close down
+    ipc_stop(g);
+    pool_stop(g.pool);
+    loop_run_posted(g.loop);
+    if (g.snapshot.interval_ns > 0) {
+        snapshot_stop(g);
+    }
+    logger_close(g.supervisor.exit_records);
+    logger_close(g.analyzer.results);
+    print_status(g);
+    loop_close(g.loop);
+    close(g.signal_fd);
+    cout << "Guardian finished." << endl;
+    return 0;
+}
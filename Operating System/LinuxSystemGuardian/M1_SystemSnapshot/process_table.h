@@ -0,0 +1,353 @@
+#ifndef PROCESS_TABLE_H
+#define PROCESS_TABLE_H
+
+// Per-process CPU and memory tracking for the snapshot collector.
+//
+// Every process keeps an entry with its /proc/[pid]/stat descriptor left
+// open, so reading it costs one pread() and no open()/close(). CPU% is the
+// change in utime + stime since the entry's previous read, over the wall
+// time between them. RSS comes from the same stat line (field 24), so statm
+// is only read for the processes that make the top-N report.
+//
+// Processes that used no CPU since their last read are idle. An idle entry
+// is re-read only every idle_every ticks, and its CPU% counts as 0 in
+// between. Walking /proc costs about as much per process as a read, so new
+// processes are also only looked for every idle_every ticks; in between a
+// tick visits the table alone. The cost of a tick then follows the number of
+// busy processes rather than the number of processes.
+//
+// An exited process's stat descriptor fails with ESRCH on the next read and
+// the entry is dropped (a reused PID gets a fresh entry, told apart by its
+// start time). If descriptors run out, further entries read their stat file
+// with open/read/close instead. That is also how the guardian runs it: it
+// keeps the descriptor limit its services would inherit.
+//
+// Top-N lists are kept with bounded min-heaps: O(processes x log N) a tick.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/sysinfo.h>
+
+struct ProcessEntry {
+    int pid;
+    int stat_fd;             // -1: not cached, opened per read
+    uint64_t start_time;     // clock ticks after boot, tells reused PIDs apart
+    uint64_t cpu_ticks;      // utime + stime at the last read
+    long long read_ns;       // when it was last read
+    uint64_t next_read_tick; // idle entries wait until this tick
+    uint32_t seen_tick;      // last tick the PID was listed in /proc
+    double cpu_percent;      // of one CPU, over the last read interval
+    uint64_t rss_pages;
+    char state;
+    char comm[32];
+};
+
+struct ProcessTable {
+    std::unordered_map<int, ProcessEntry> entries;
+    uint32_t tick = 0;
+    uint32_t idle_every = 10;
+    long ticks_per_second = 100;
+    long page_kb = 4;
+    unsigned long reads = 0; // stat reads over the table's life
+    char path[64];
+    char buffer[1024];
+};
+
+// One descriptor per process: raise the soft limit to what the processes
+// running now need, with room to grow, and no further. The limit is
+// inherited across exec, so a process that starts others should leave it
+// alone (raise_fd_limit = false) rather than hand them a huge one.
+inline void process_table_init(ProcessTable& t, uint32_t idle_every = 10, bool raise_fd_limit = true) {
+    t.idle_every = idle_every > 0 ? idle_every : 1;
+    t.ticks_per_second = sysconf(_SC_CLK_TCK);
+    t.page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    struct rlimit limit;
+    struct sysinfo info;
+    if (!raise_fd_limit || getrlimit(RLIMIT_NOFILE, &limit) != 0 || sysinfo(&info) != 0) {
+        return;
+    }
+    rlim_t wanted = (rlim_t)info.procs * 3 / 2 + 256; // procs counts threads: an upper bound
+    if (limit.rlim_cur < wanted) {
+        limit.rlim_cur = std::min(wanted, limit.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+inline void process_table_close(ProcessTable& t) {
+    for (auto& item : t.entries) {
+        if (item.second.stat_fd >= 0) {
+            close(item.second.stat_fd);
+        }
+    }
+    t.entries.clear();
+}
+
+inline long long process_clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Parse a stat line: comm, state, CPU ticks, start time and RSS
+inline bool parse_process_stat(const char* text, ProcessEntry& e, uint64_t& cpu_ticks, uint64_t& start_time) {
+    const char* open_paren = strchr(text, '(');
+    const char* close_paren = strrchr(text, ')'); // comm may itself hold ')'
+    if (open_paren == NULL || close_paren == NULL || close_paren < open_paren || close_paren[1] != ' ') {
+        return false;
+    }
+    size_t comm_length = std::min((size_t)(close_paren - open_paren - 1), sizeof(e.comm) - 1);
+    memcpy(e.comm, open_paren + 1, comm_length);
+    e.comm[comm_length] = '\0';
+
+    // Fields from 3 (state) on; we need 14 utime, 15 stime, 22 starttime, 24 rss
+    const char* p = close_paren + 2;
+    e.state = *p;
+    uint64_t utime = 0, stime = 0, rss = 0;
+    start_time = 0;
+    for (int field = 3; field <= 24 && *p != '\0'; ++field) {
+        uint64_t value = 0;
+        for (; *p >= '0' && *p <= '9'; ++p) {
+            value = value * 10 + (*p - '0');
+        }
+        if (field == 14) {
+            utime = value;
+        } else if (field == 15) {
+            stime = value;
+        } else if (field == 22) {
+            start_time = value;
+        } else if (field == 24) {
+            rss = value;
+        }
+        while (*p != ' ' && *p != '\0') {
+            p++; // state letter or a negative number's sign
+        }
+        while (*p == ' ') {
+            p++;
+        }
+    }
+    cpu_ticks = utime + stime;
+    e.rss_pages = rss;
+    return true;
+}
+
+// Read one entry's stat line. Returns false if the process is gone.
+inline bool process_read_stat(ProcessTable& t, ProcessEntry& e) {
+    int fd = e.stat_fd;
+    if (fd < 0) {
+        snprintf(t.path, sizeof(t.path), "/proc/%d/stat", e.pid);
+        fd = open(t.path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+    }
+    ssize_t n = pread(fd, t.buffer, sizeof(t.buffer) - 1, 0);
+    if (e.stat_fd < 0) {
+        close(fd);
+    }
+    if (n <= 0) {
+        return false;
+    }
+    t.buffer[n] = '\0';
+    t.reads++;
+
+    uint64_t cpu_ticks, start_time;
+    long long now = process_clock_ns();
+    if (!parse_process_stat(t.buffer, e, cpu_ticks, start_time)) {
+        return false;
+    }
+    if (e.read_ns != 0 && start_time == e.start_time && now > e.read_ns && cpu_ticks >= e.cpu_ticks) {
+        double cpu_seconds = (double)(cpu_ticks - e.cpu_ticks) / t.ticks_per_second;
+        e.cpu_percent = cpu_seconds * 1e11 / (now - e.read_ns);
+    } else {
+        e.cpu_percent = 0; // first read: no interval yet
+    }
+    bool idle = e.read_ns != 0 && cpu_ticks == e.cpu_ticks;
+    e.next_read_tick = t.tick + (idle ? t.idle_every : 1);
+    e.cpu_ticks = cpu_ticks;
+    e.start_time = start_time;
+    e.read_ns = now;
+    return true;
+}
+
+inline void process_drop(ProcessEntry& e) {
+    if (e.stat_fd >= 0) {
+        close(e.stat_fd);
+        e.stat_fd = -1;
+    }
+}
+
+inline bool process_open(ProcessTable& t, int pid, ProcessEntry& e) {
+    memset(&e, 0, sizeof(e));
+    e.pid = pid;
+    snprintf(t.path, sizeof(t.path), "/proc/%d/stat", pid);
+    e.stat_fd = open(t.path, O_RDONLY | O_CLOEXEC);
+    if (e.stat_fd < 0) {
+        return errno == EMFILE || errno == ENFILE; // else it exited already
+    }
+    return true;
+}
+
+// Read an entry if it is due. Returns false once its process is gone.
+inline bool process_refresh(ProcessTable& t, ProcessEntry& e) {
+    if (e.next_read_tick > t.tick) {
+        e.cpu_percent = 0; // idle: not re-read this tick
+        return true;
+    }
+    if (process_read_stat(t, e)) {
+        return true;
+    }
+    // Gone, or its PID already reused: start over with a new entry
+    ProcessEntry fresh;
+    bool reused = process_open(t, e.pid, fresh) && process_read_stat(t, fresh);
+    process_drop(e);
+    if (!reused) {
+        process_drop(fresh);
+        return false;
+    }
+    fresh.seen_tick = e.seen_tick;
+    e = fresh;
+    return true;
+}
+
+// One tick. Every idle_every ticks, walk /proc: add new processes and drop
+// those no longer listed. In between, only re-read the entries that are due.
+// Returns the number of processes (between walks, the ones still tracked).
+inline uint32_t process_table_update(ProcessTable& t, DIR* proc_dir) {
+    t.tick++;
+    if ((t.tick - 1) % t.idle_every != 0) {
+        for (auto item = t.entries.begin(); item != t.entries.end();) {
+            if (process_refresh(t, item->second)) {
+                ++item;
+            } else {
+                item = t.entries.erase(item);
+            }
+        }
+        return (uint32_t)t.entries.size();
+    }
+
+    uint32_t listed = 0;
+    rewinddir(proc_dir);
+    while (struct dirent* entry = readdir(proc_dir)) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+            continue;
+        }
+        listed++;
+        int pid = atoi(entry->d_name);
+        auto found = t.entries.find(pid);
+        if (found == t.entries.end()) {
+            ProcessEntry fresh;
+            if (!process_open(t, pid, fresh)) {
+                continue;
+            }
+            found = t.entries.emplace(pid, fresh).first;
+        }
+        found->second.seen_tick = t.tick;
+        if (!process_refresh(t, found->second)) {
+            t.entries.erase(found);
+        }
+    }
+    for (auto item = t.entries.begin(); item != t.entries.end();) {
+        if (item->second.seen_tick != t.tick) {
+            process_drop(item->second);
+            item = t.entries.erase(item);
+        } else {
+            ++item;
+        }
+    }
+    return listed;
+}
+
+// Entries reading their stat file without a cached descriptor
+inline size_t process_table_uncached(const ProcessTable& t) {
+    size_t count = 0;
+    for (const auto& item : t.entries) {
+        count += item.second.stat_fd < 0;
+    }
+    return count;
+}
+
+// --- Top-N ---
+
+struct ProcessRank {
+    int pid;
+    double cpu_percent;
+    uint64_t rss_kb;
+    char comm[32];
+};
+
+// The n largest entries by key, largest first, through a bounded min-heap
+template <typename Key>
+std::vector<ProcessRank> process_top(const ProcessTable& t, size_t n, Key key) {
+    auto smaller_first = [&](const ProcessRank& a, const ProcessRank& b) { return key(a) > key(b); };
+    std::vector<ProcessRank> heap;
+    if (n == 0) {
+        return heap;
+    }
+    heap.reserve(n + 1);
+    for (const auto& item : t.entries) {
+        const ProcessEntry& e = item.second;
+        if (e.read_ns == 0) {
+            continue;
+        }
+        ProcessRank rank;
+        rank.pid = e.pid;
+        rank.cpu_percent = e.cpu_percent;
+        rank.rss_kb = e.rss_pages * t.page_kb;
+        memcpy(rank.comm, e.comm, sizeof(rank.comm));
+        if (heap.size() < n) {
+            heap.push_back(rank);
+            std::push_heap(heap.begin(), heap.end(), smaller_first);
+        } else if (key(rank) > key(heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), smaller_first);
+            heap.back() = rank;
+            std::push_heap(heap.begin(), heap.end(), smaller_first);
+        }
+    }
+    std::sort_heap(heap.begin(), heap.end(), smaller_first);
+    return heap;
+}
+
+inline std::vector<ProcessRank> process_top_cpu(const ProcessTable& t, size_t n) {
+    return process_top(t, n, [](const ProcessRank& r) { return r.cpu_percent; });
+}
+
+inline std::vector<ProcessRank> process_top_rss(const ProcessTable& t, size_t n) {
+    return process_top(t, n, [](const ProcessRank& r) { return (double)r.rss_kb; });
+}
+
+// Resident and shared memory in KB from /proc/[pid]/statm
+inline bool process_statm(const ProcessTable& t, int pid, uint64_t& resident_kb, uint64_t& shared_kb) {
+    char path[64];
+    char text[256];
+    snprintf(path, sizeof(path), "/proc/%d/statm", pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t n = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (n <= 0) {
+        return false;
+    }
+    text[n] = '\0';
+    unsigned long long size, resident, shared;
+    if (sscanf(text, "%llu %llu %llu", &size, &resident, &shared) != 3) {
+        return false;
+    }
+    resident_kb = resident * t.page_kb;
+    shared_kb = shared * t.page_kb;
+    return true;
+}
+
+#endif
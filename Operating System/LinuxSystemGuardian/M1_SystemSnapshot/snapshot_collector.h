@@ -0,0 +1,183 @@
+#ifndef SNAPSHOT_COLLECTOR_H
+#define SNAPSHOT_COLLECTOR_H
+
+// Native system snapshot: the numbers system_snapshot.sh gets from uptime,
+// free, df and ps, read straight from the kernel.
+//
+// The /proc files are opened once and re-read with pread() at offset 0 on
+// every sample (procfs regenerates them on each read), the root filesystem
+// is queried with fstatvfs() on a descriptor kept open, and processes are
+// counted by rewinding one open /proc directory stream. A sample is a
+// handful of syscalls and no process spawns.
+//
+// With a ProcessTable attached, the same /proc walk also updates per-process
+// CPU and RSS (process_table.h).
+//
+// Samples are wire_snapshot bodies (M4_IPC/ipc_wire.h), so they can be
+// logged or sent without conversion. Memory "used" follows procps free:
+// MemTotal - MemAvailable.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/statvfs.h>
+#include "../M4_IPC/ipc_wire.h"
+#include "process_table.h"
+
+struct SnapshotCollector {
+    int loadavg_fd = -1;
+    int meminfo_fd = -1;
+    int uptime_fd = -1;
+    int root_fd = -1;
+    DIR* proc_dir = NULL;
+    ProcessTable* processes = NULL; // optional per-process tracking
+    char buffer[8192]; // one /proc file at a time
+};
+
+inline void collector_close(SnapshotCollector& c) {
+    int* fds[] = {&c.loadavg_fd, &c.meminfo_fd, &c.uptime_fd, &c.root_fd};
+    for (int* fd : fds) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+    if (c.proc_dir != NULL) {
+        closedir(c.proc_dir);
+        c.proc_dir = NULL;
+    }
+}
+
+// Returns false with errno if any source cannot be opened
+inline bool collector_open(SnapshotCollector& c, const char* root = "/") {
+    c.loadavg_fd = open("/proc/loadavg", O_RDONLY | O_CLOEXEC);
+    c.meminfo_fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    c.uptime_fd = open("/proc/uptime", O_RDONLY | O_CLOEXEC);
+    c.root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    c.proc_dir = opendir("/proc");
+    if (c.loadavg_fd < 0 || c.meminfo_fd < 0 || c.uptime_fd < 0 || c.root_fd < 0 || c.proc_dir == NULL) {
+        int error = errno;
+        collector_close(c);
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+// Read a whole /proc file into the collector's buffer, NUL-terminated
+inline const char* collector_read(SnapshotCollector& c, int fd) {
+    ssize_t n;
+    do {
+        n = pread(fd, c.buffer, sizeof(c.buffer) - 1, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return NULL;
+    }
+    c.buffer[n] = '\0';
+    return c.buffer;
+}
+
+// "12.345" -> 12345: a decimal with up to three places, in thousandths
+inline uint64_t parse_milli(const char*& p) {
+    while (*p == ' ') {
+        p++;
+    }
+    uint64_t whole = 0;
+    while (*p >= '0' && *p <= '9') {
+        whole = whole * 10 + (*p++ - '0');
+    }
+    uint64_t fraction = 0;
+    int places = 0;
+    if (*p == '.') {
+        p++;
+        for (; *p >= '0' && *p <= '9'; ++p) {
+            if (places < 3) {
+                fraction = fraction * 10 + (*p - '0');
+                places++;
+            }
+        }
+    }
+    for (; places < 3; ++places) {
+        fraction *= 10;
+    }
+    return whole * 1000 + fraction;
+}
+
+// Value of a "Key:  1234 kB" line, 0 if the key is missing
+inline uint64_t meminfo_field(const char* text, const char* key, size_t key_length) {
+    for (const char* line = text; *line != '\0';) {
+        if (strncmp(line, key, key_length) == 0 && line[key_length] == ':') {
+            const char* p = line + key_length + 1;
+            while (*p == ' ') {
+                p++;
+            }
+            uint64_t value = 0;
+            while (*p >= '0' && *p <= '9') {
+                value = value * 10 + (*p++ - '0');
+            }
+            return value;
+        }
+        const char* next = strchr(line, '\n');
+        if (next == NULL) {
+            break;
+        }
+        line = next + 1;
+    }
+    return 0;
+}
+
+// Processes, as ps -e counts them: the numeric entries of /proc
+inline uint32_t collector_count_processes(SnapshotCollector& c) {
+    uint32_t count = 0;
+    rewinddir(c.proc_dir);
+    while (struct dirent* entry = readdir(c.proc_dir)) {
+        if (entry->d_name[0] >= '0' && entry->d_name[0] <= '9') {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Take one sample. Returns false with errno if a source could not be read.
+inline bool collector_sample(SnapshotCollector& c, wire_snapshot& s) {
+    memset(&s, 0, sizeof(s));
+
+    const char* text = collector_read(c, c.uptime_fd);
+    if (text == NULL) {
+        return false;
+    }
+    s.uptime_ms = parse_milli(text);
+
+    if ((text = collector_read(c, c.loadavg_fd)) == NULL) {
+        return false;
+    }
+    for (int i = 0; i < 3; ++i) {
+        s.load_milli[i] = (uint32_t)parse_milli(text);
+    }
+
+    if ((text = collector_read(c, c.meminfo_fd)) == NULL) {
+        return false;
+    }
+    // MemTotal, MemFree and MemAvailable are the first three lines
+    s.mem_total_kb = meminfo_field(text, "MemTotal", 8);
+    s.mem_free_kb = meminfo_field(text, "MemFree", 7);
+    s.mem_available_kb = meminfo_field(text, "MemAvailable", 12);
+    s.mem_used_kb = s.mem_total_kb > s.mem_available_kb ? s.mem_total_kb - s.mem_available_kb : 0;
+
+    struct statvfs fs;
+    if (fstatvfs(c.root_fd, &fs) < 0) {
+        return false;
+    }
+    s.disk_total_bytes = (uint64_t)fs.f_blocks * fs.f_frsize;
+    s.disk_used_bytes = (uint64_t)(fs.f_blocks - fs.f_bfree) * fs.f_frsize;
+    s.disk_available_bytes = (uint64_t)fs.f_bavail * fs.f_frsize;
+
+    s.process_count = c.processes != NULL ? process_table_update(*c.processes, c.proc_dir)
+                                          : collector_count_processes(c);
+    return true;
+}
+
+#endif
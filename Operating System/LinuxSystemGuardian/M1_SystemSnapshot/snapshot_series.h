@@ -0,0 +1,248 @@
+#ifndef SNAPSHOT_SERIES_H
+#define SNAPSHOT_SERIES_H
+
+// Time series of snapshots for the M1 sampling daemon.
+//
+// The daemon keeps recent samples in a fixed-size in-memory ring and, every
+// block's worth of samples or flush interval, copies the unflushed ones as
+// one block into a rolling series file. The file is a header page followed
+// by block_count fixed-size block slots. Block n goes to slot n % block_count,
+// so the file never grows and always holds the newest blocks.
+//
+// The file is shared through mmap(): readers map it read-only and answer
+// "last N minutes" by checking block headers and copying only the blocks in
+// range. A block's sequence is cleared while it is rewritten and set to its
+// number + 1 when complete. Readers check it before and after copying, so a
+// block overwritten mid-read is skipped rather than mixed.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../M4_IPC/ipc_wire.h"
+
+#define SERIES_MAGIC 0x5354314Du /* "M1TS" */
+#define SERIES_VERSION 1
+
+struct SeriesSample {
+    uint64_t time_ns; // CLOCK_REALTIME
+    wire_snapshot snapshot;
+};
+static_assert(sizeof(SeriesSample) == 88, "SeriesSample layout");
+
+struct SeriesFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sample_bytes;
+    uint32_t block_samples;  // samples each block slot can hold
+    uint32_t block_count;
+    uint32_t reserved;
+    uint64_t blocks_written; // ever; the next block goes to blocks_written % block_count
+    uint64_t interval_ns;    // the writer's sampling interval
+};
+
+struct SeriesBlockHeader {
+    uint64_t sequence; // 0 while being written, else block number + 1
+    uint64_t first_ns;
+    uint64_t last_ns;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+const size_t SERIES_HEADER_BYTES = 4096;
+
+struct SeriesFile {
+    int fd = -1;
+    char* map = NULL;
+    size_t size = 0;
+    SeriesFileHeader* header = NULL;
+};
+
+inline size_t series_block_bytes(uint32_t block_samples) {
+    return sizeof(SeriesBlockHeader) + (size_t)block_samples * sizeof(SeriesSample);
+}
+
+inline size_t series_file_bytes(uint32_t block_samples, uint32_t block_count) {
+    return SERIES_HEADER_BYTES + series_block_bytes(block_samples) * block_count;
+}
+
+inline SeriesBlockHeader* series_block(SeriesFile& f, uint64_t number) {
+    size_t slot = number % f.header->block_count;
+    return (SeriesBlockHeader*)(f.map + SERIES_HEADER_BYTES + slot * series_block_bytes(f.header->block_samples));
+}
+
+inline void series_close(SeriesFile& f) {
+    if (f.map != NULL) {
+        munmap(f.map, f.size);
+        f.map = NULL;
+        f.header = NULL;
+    }
+    if (f.fd >= 0) {
+        close(f.fd);
+        f.fd = -1;
+    }
+}
+
+inline bool series_header_matches(const SeriesFileHeader& h, size_t file_size) {
+    return h.magic == SERIES_MAGIC && h.version == SERIES_VERSION && h.sample_bytes == sizeof(SeriesSample) &&
+           h.block_samples > 0 && h.block_count > 0 && file_size >= series_file_bytes(h.block_samples, h.block_count);
+}
+
+// Open path for writing. A file with the same geometry keeps its history;
+// anything else is reset. Returns false with errno.
+inline bool series_open_writer(SeriesFile& f, const char* path, uint32_t block_samples, uint32_t block_count,
+                               uint64_t interval_ns) {
+    f.fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (f.fd < 0) {
+        return false;
+    }
+    size_t size = series_file_bytes(block_samples, block_count);
+    struct stat st;
+    SeriesFileHeader existing;
+    bool reuse = fstat(f.fd, &st) == 0 && pread(f.fd, &existing, sizeof(existing), 0) == (ssize_t)sizeof(existing) &&
+                 series_header_matches(existing, (size_t)st.st_size) && existing.block_samples == block_samples &&
+                 existing.block_count == block_count;
+    if (!reuse && (ftruncate(f.fd, 0) < 0 || ftruncate(f.fd, (off_t)size) < 0)) {
+        int error = errno;
+        series_close(f);
+        errno = error;
+        return false;
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, f.fd, 0);
+    if (map == MAP_FAILED) {
+        int error = errno;
+        series_close(f);
+        errno = error;
+        return false;
+    }
+    f.map = (char*)map;
+    f.size = size;
+    f.header = (SeriesFileHeader*)map;
+    if (!reuse) {
+        f.header->version = SERIES_VERSION;
+        f.header->sample_bytes = sizeof(SeriesSample);
+        f.header->block_samples = block_samples;
+        f.header->block_count = block_count;
+        __atomic_store_n(&f.header->magic, SERIES_MAGIC, __ATOMIC_RELEASE);
+    }
+    f.header->interval_ns = interval_ns;
+    return true;
+}
+
+// Map path read-only. Returns false with errno (EPROTO: not a series file).
+inline bool series_open_reader(SeriesFile& f, const char* path) {
+    f.fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (f.fd < 0) {
+        return false;
+    }
+    struct stat st;
+    SeriesFileHeader header;
+    if (fstat(f.fd, &st) < 0 || pread(f.fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        !series_header_matches(header, (size_t)st.st_size)) {
+        series_close(f);
+        errno = EPROTO;
+        return false;
+    }
+    f.size = series_file_bytes(header.block_samples, header.block_count);
+    void* map = mmap(NULL, f.size, PROT_READ, MAP_SHARED, f.fd, 0);
+    if (map == MAP_FAILED) {
+        int error = errno;
+        series_close(f);
+        errno = error;
+        return false;
+    }
+    f.map = (char*)map;
+    f.header = (SeriesFileHeader*)map;
+    return true;
+}
+
+// Write samples (at most block_samples) as the next block
+inline void series_append_block(SeriesFile& f, const SeriesSample* samples, uint32_t count) {
+    uint64_t number = f.header->blocks_written;
+    SeriesBlockHeader* block = series_block(f, number);
+    __atomic_store_n(&block->sequence, 0, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    memcpy(block + 1, samples, (size_t)count * sizeof(SeriesSample));
+    block->first_ns = samples[0].time_ns;
+    block->last_ns = samples[count - 1].time_ns;
+    block->count = count;
+    __atomic_store_n(&block->sequence, number + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&f.header->blocks_written, number + 1, __ATOMIC_RELEASE);
+}
+
+// Append every retained sample taken at or after since_ns, oldest first
+inline void series_query(SeriesFile& f, uint64_t since_ns, std::vector<SeriesSample>& out) {
+    uint64_t written = __atomic_load_n(&f.header->blocks_written, __ATOMIC_ACQUIRE);
+    uint64_t first = written > f.header->block_count ? written - f.header->block_count : 0;
+    uint32_t capacity = f.header->block_samples;
+    for (uint64_t number = first; number < written; ++number) {
+        SeriesBlockHeader* block = series_block(f, number);
+        if (__atomic_load_n(&block->sequence, __ATOMIC_ACQUIRE) != number + 1 || block->last_ns < since_ns) {
+            continue;
+        }
+        size_t kept = out.size();
+        uint32_t count = block->count < capacity ? block->count : capacity;
+        const SeriesSample* samples = (const SeriesSample*)(block + 1);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (samples[i].time_ns >= since_ns) {
+                out.push_back(samples[i]);
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&block->sequence, __ATOMIC_RELAXED) != number + 1) {
+            out.resize(kept); // rewritten while we copied it
+        }
+    }
+}
+
+// --- In-memory ring ---
+
+struct SampleRing {
+    std::vector<SeriesSample> slots;
+    size_t next = 0;       // where the next sample goes
+    size_t count = 0;      // samples held, up to slots.size()
+    size_t unflushed = 0;  // newest samples not yet in the file
+};
+
+inline void ring_init(SampleRing& ring, size_t capacity) {
+    ring.slots.assign(capacity > 0 ? capacity : 1, SeriesSample());
+    ring.next = ring.count = ring.unflushed = 0;
+}
+
+inline void ring_push(SampleRing& ring, const SeriesSample& sample) {
+    ring.slots[ring.next] = sample;
+    ring.next = (ring.next + 1) % ring.slots.size();
+    if (ring.count < ring.slots.size()) {
+        ring.count++;
+    }
+    if (ring.unflushed < ring.slots.size()) {
+        ring.unflushed++; // past capacity, the oldest unflushed sample is lost
+    }
+}
+
+// Sample i of the newest n, oldest first
+inline const SeriesSample& ring_recent(const SampleRing& ring, size_t n, size_t i) {
+    size_t size = ring.slots.size();
+    return ring.slots[(ring.next + size - n + i) % size];
+}
+
+// Write the unflushed samples to the file in blocks
+inline void ring_flush(SampleRing& ring, SeriesFile& f) {
+    std::vector<SeriesSample> block;
+    uint32_t capacity = f.header->block_samples;
+    while (ring.unflushed > 0) {
+        size_t n = ring.unflushed < capacity ? ring.unflushed : capacity;
+        block.clear();
+        for (size_t i = 0; i < n; ++i) {
+            block.push_back(ring_recent(ring, ring.unflushed, i));
+        }
+        series_append_block(f, block.data(), (uint32_t)n);
+        ring.unflushed -= n;
+    }
+}
+
+#endif
@@ -0,0 +1,481 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "snapshot_collector.h"
+#include "snapshot_series.h"
+
+using namespace std;
+
+// Native replacement for system_snapshot.sh: the same five readings and the
+// same text log, collected without spawning a process. With --samples it
+// keeps sampling on a fixed tick, and --records appends each sample as a
+// binary WIRE_SNAPSHOT record. --daemon samples until SIGINT/SIGTERM into
+// the rolling series file (snapshot_series.h) instead of text logs, and
+// --query reads the last N minutes back from that file.
+
+// --- Formatting ---
+
+// "up 2 days, 3 hours, 1 minute", as uptime -p prints it
+string format_uptime(uint64_t uptime_ms) {
+    uint64_t minutes = uptime_ms / 60000;
+    const struct {
+        uint64_t minutes;
+        const char* unit;
+    } units[] = {{7 * 24 * 60, "week"}, {24 * 60, "day"}, {60, "hour"}, {1, "minute"}};
+    string out = "up";
+    bool first = true;
+    for (const auto& unit : units) {
+        uint64_t n = minutes / unit.minutes;
+        minutes %= unit.minutes;
+        if (n == 0 && !(unit.minutes == 1 && first)) {
+            continue;
+        }
+        out += first ? " " : ", ";
+        out += to_string(n) + " " + unit.unit + (n == 1 ? "" : "s");
+        first = false;
+    }
+    return out;
+}
+
+// Human-readable size the way df -h rounds: up, one decimal below 10
+string format_size(uint64_t bytes) {
+    const char* units = "BKMGTPE";
+    double value = (double)bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 6) {
+        value /= 1024;
+        unit++;
+    }
+    char text[32];
+    if (unit == 0) {
+        snprintf(text, sizeof(text), "%llu", (unsigned long long)bytes);
+    } else if (value < 10) {
+        double tenths = value * 10;
+        long rounded = (long)tenths;
+        if (rounded < tenths) {
+            rounded++;
+        }
+        snprintf(text, sizeof(text), "%ld.%ld%c", rounded / 10, rounded % 10, units[unit]);
+    } else {
+        long rounded = (long)value;
+        if (rounded < value) {
+            rounded++;
+        }
+        snprintf(text, sizeof(text), "%ld%c", rounded, units[unit]);
+    }
+    return text;
+}
+
+int use_percent(const wire_snapshot& s) {
+    uint64_t usable = s.disk_used_bytes + s.disk_available_bytes;
+    if (usable == 0) {
+        return 0;
+    }
+    return (int)((s.disk_used_bytes * 100 + usable - 1) / usable);
+}
+
+string format_load(const wire_snapshot& s) {
+    char text[64];
+    snprintf(text, sizeof(text), "%u.%02u %u.%02u %u.%02u", s.load_milli[0] / 1000, s.load_milli[0] % 1000 / 10,
+             s.load_milli[1] / 1000, s.load_milli[1] % 1000 / 10, s.load_milli[2] / 1000, s.load_milli[2] % 1000 / 10);
+    return text;
+}
+
+// The report system_snapshot.sh writes, prefix-numbered for the console
+void write_report(ostream& out, const wire_snapshot& s, bool numbered) {
+    const char* labels[] = {"System Uptime: ", "CPU Load (1m, 5m, 15m): ", "RAM Usage (MB):",
+                            "Disk Usage (/):", "Running Processes Count: "};
+    for (int i = 0; i < 5; ++i) {
+        if (numbered) {
+            out << i + 1 << ". ";
+        }
+        out << labels[i];
+        switch (i) {
+            case 0: out << format_uptime(s.uptime_ms); break;
+            case 1: out << format_load(s); break;
+            case 2:
+                out << "\n  Total: " << s.mem_total_kb / 1024 << " MB\n  Used: " << s.mem_used_kb / 1024
+                    << " MB\n  Free: " << s.mem_free_kb / 1024 << " MB";
+                break;
+            case 3:
+                out << "\n  Size: " << format_size(s.disk_total_bytes) << "\n  Used: " << format_size(s.disk_used_bytes)
+                    << "\n  Available: " << format_size(s.disk_available_bytes) << "\n  Use Percent: "
+                    << use_percent(s) << "%";
+                break;
+            case 4: out << s.process_count; break;
+        }
+        out << "\n";
+    }
+}
+
+// One line per sample when sampling repeatedly
+void write_line(ostream& out, const wire_snapshot& s) {
+    out << "load " << format_load(s) << " | mem used " << s.mem_used_kb / 1024 << "/" << s.mem_total_kb / 1024
+        << " MB | disk " << use_percent(s) << "% | " << s.process_count << " processes\n";
+}
+
+// Top processes by CPU and by RSS, with statm's view of the RSS leaders
+void write_top(ostream& out, const ProcessTable& table, size_t n) {
+    vector<ProcessRank> by_cpu = process_top_cpu(table, n);
+    vector<ProcessRank> by_rss = process_top_rss(table, n);
+    out << "Top " << n << " by CPU (" << table.entries.size() << " processes tracked):\n"
+        << "      PID   CPU%     RSS MB  COMMAND\n" << fixed;
+    for (const ProcessRank& r : by_cpu) {
+        out << setw(9) << r.pid << setw(7) << setprecision(1) << r.cpu_percent << setw(11) << setprecision(1)
+            << r.rss_kb / 1024.0 << "  " << r.comm << "\n";
+    }
+    out << "Top " << n << " by RSS:\n"
+        << "      PID     RSS MB  SHARED MB   CPU%  COMMAND\n";
+    for (const ProcessRank& r : by_rss) {
+        uint64_t resident_kb = r.rss_kb, shared_kb = 0;
+        process_statm(table, r.pid, resident_kb, shared_kb);
+        out << setw(9) << r.pid << setw(11) << setprecision(1) << resident_kb / 1024.0 << setw(11)
+            << shared_kb / 1024.0 << setw(7) << r.cpu_percent << "  " << r.comm << "\n";
+    }
+    out.unsetf(ios::floatfield);
+    out << setprecision(6);
+}
+
+// --- Series Queries ---
+
+// Print the samples of the last minutes and their min/avg/max
+int run_query(const string& path, double minutes, bool quiet) {
+    SeriesFile series;
+    if (!series_open_reader(series, path.c_str())) {
+        cerr << "Error: cannot read series " << path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    uint64_t now = wire_now_ns();
+    uint64_t span = (uint64_t)(minutes * 60e9);
+    vector<SeriesSample> samples;
+    series_query(series, now > span ? now - span : 0, samples);
+    cout << "Series " << path << ": " << series.header->blocks_written << " blocks written, "
+         << min<uint64_t>(series.header->blocks_written, series.header->block_count) << " of "
+         << series.header->block_count << " kept" << endl;
+    series_close(series);
+
+    cout << samples.size() << " samples in the last " << minutes << " minutes" << endl;
+    if (samples.empty()) {
+        return 0;
+    }
+    struct Metric {
+        const char* label;
+        double low, high, total;
+    } metrics[] = {{"load (1m)", 1e300, -1e300, 0}, {"memory used (MB)", 1e300, -1e300, 0},
+                   {"disk used (%)", 1e300, -1e300, 0}, {"processes", 1e300, -1e300, 0}};
+    for (const SeriesSample& sample : samples) {
+        const wire_snapshot& s = sample.snapshot;
+        double values[] = {s.load_milli[0] / 1e3, s.mem_used_kb / 1024.0, (double)use_percent(s),
+                           (double)s.process_count};
+        for (int i = 0; i < 4; ++i) {
+            metrics[i].low = min(metrics[i].low, values[i]);
+            metrics[i].high = max(metrics[i].high, values[i]);
+            metrics[i].total += values[i];
+        }
+        if (!quiet) {
+            time_t when = (time_t)(sample.time_ns / 1000000000ULL);
+            char stamp[32];
+            strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&when));
+            cout << stamp << " ";
+            write_line(cout, s);
+        }
+    }
+    cout << "  " << left << setw(18) << "" << right << setw(10) << "min" << setw(10) << "avg" << setw(10) << "max"
+         << endl << fixed << setprecision(2);
+    for (const Metric& m : metrics) {
+        cout << "  " << left << setw(18) << m.label << right << setw(10) << m.low << setw(10)
+             << m.total / samples.size() << setw(10) << m.high << endl;
+    }
+    return 0;
+}
+
+// --- Main Program ---
+
+volatile sig_atomic_t stop_requested = 0;
+
+void stop_handler(int) {
+    stop_requested = 1;
+}
+
+void print_usage(const char* program) {
+    cerr << "Usage: " << program << " [options]\n"
+         << "  --samples N        take N samples, one per interval (default 1)\n"
+         << "  --interval-ms MS   time between samples (default 1000)\n"
+         << "  --log-dir DIR      where the text log goes (default ./logs)\n"
+         << "  --no-log           do not write the text log\n"
+         << "  --records FILE     append each sample as a binary record (M4_IPC/ipc_wire.h)\n"
+         << "  --quiet            no per-sample console output\n"
+         << "  --daemon           sample until SIGINT/SIGTERM into the series file, no text log\n"
+         << "  --series FILE      rolling series file (default ./logs/M1_series.bin)\n"
+         << "  --ring N           samples kept in memory (default 3600)\n"
+         << "  --block-samples N  samples per file block (default 60)\n"
+         << "  --file-blocks N    blocks the file keeps before rolling over (default 1440)\n"
+         << "  --flush-sec S      longest a sample stays only in memory (default 60)\n"
+         << "  --query MINUTES    print the last MINUTES of the series file and exit\n"
+         << "  --top N            also track every process and report the top N by CPU and RSS\n"
+         << "  --idle-every K     re-read processes that used no CPU every K samples (default 10)" << endl;
+}
+
+long long monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+double cpu_seconds() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+    long samples = 1;
+    long interval_ms = 1000;
+    string log_dir = "./logs";
+    bool text_log = true;
+    string records_path;
+    bool quiet = false;
+    bool daemon_mode = false;
+    bool samples_given = false;
+    string series_path = "./logs/M1_series.bin";
+    long ring_samples = 3600;
+    long block_samples = 60;
+    long file_blocks = 1440;
+    double flush_sec = 60;
+    double query_minutes = -1;
+    long top = 0;
+    long idle_every = 10;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            samples = atol(argv[++i]);
+            samples_given = true;
+        } else if (arg == "--interval-ms" && i + 1 < argc) {
+            interval_ms = atol(argv[++i]);
+        } else if (arg == "--log-dir" && i + 1 < argc) {
+            log_dir = argv[++i];
+        } else if (arg == "--no-log") {
+            text_log = false;
+        } else if (arg == "--records" && i + 1 < argc) {
+            records_path = argv[++i];
+        } else if (arg == "--quiet") {
+            quiet = true;
+        } else if (arg == "--daemon") {
+            daemon_mode = true;
+        } else if (arg == "--series" && i + 1 < argc) {
+            series_path = argv[++i];
+        } else if (arg == "--ring" && i + 1 < argc) {
+            ring_samples = atol(argv[++i]);
+        } else if (arg == "--block-samples" && i + 1 < argc) {
+            block_samples = atol(argv[++i]);
+        } else if (arg == "--file-blocks" && i + 1 < argc) {
+            file_blocks = atol(argv[++i]);
+        } else if (arg == "--flush-sec" && i + 1 < argc) {
+            flush_sec = atof(argv[++i]);
+        } else if (arg == "--query" && i + 1 < argc) {
+            query_minutes = atof(argv[++i]);
+        } else if (arg == "--top" && i + 1 < argc) {
+            top = atol(argv[++i]);
+        } else if (arg == "--idle-every" && i + 1 < argc) {
+            idle_every = atol(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (query_minutes >= 0) {
+        return run_query(series_path, query_minutes, quiet);
+    }
+    if (samples < 1 || (daemon_mode && !samples_given)) {
+        samples = daemon_mode ? 0 : 1; // 0: until stopped
+    }
+    if (interval_ms < 0) {
+        interval_ms = 0;
+    }
+    block_samples = max(1L, block_samples);
+    file_blocks = max(1L, file_blocks);
+    ring_samples = max(block_samples, ring_samples);
+
+    SnapshotCollector collector;
+    if (!collector_open(collector)) {
+        cerr << "Error: cannot open /proc: " << strerror(errno) << endl;
+        return 1;
+    }
+    ProcessTable processes;
+    if (top > 0) {
+        process_table_init(processes, (uint32_t)max(1L, idle_every));
+        collector.processes = &processes;
+    }
+
+    cout << "--- Linux System Guardian: System Snapshot ---" << endl;
+    ofstream log;
+    string log_path;
+    SeriesFile series;
+    SampleRing ring;
+    if (daemon_mode) {
+        text_log = false;
+        size_t slash = series_path.rfind('/');
+        if (slash != string::npos) {
+            mkdir(series_path.substr(0, slash).c_str(), 0755);
+        }
+        if (!series_open_writer(series, series_path.c_str(), block_samples, file_blocks,
+                                (uint64_t)interval_ms * 1000000)) {
+            cerr << "Error: cannot open series " << series_path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        ring_init(ring, ring_samples);
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = stop_handler; // no SA_RESTART: the tick sleep returns early
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+        cout << "Sampling every " << interval_ms << " ms into " << series_path << " (" << file_blocks
+             << " blocks of " << block_samples << " samples, " << series_file_bytes(block_samples, file_blocks)
+             << " bytes)" << endl;
+    }
+    if (text_log) {
+        char stamp[32];
+        time_t now = time(NULL);
+        strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+        mkdir(log_dir.c_str(), 0755);
+        log_path = log_dir + "/system-log-" + stamp + ".txt";
+        log.open(log_path.c_str(), ios::app);
+        if (!log.is_open()) {
+            cerr << "Warning: cannot open " << log_path << ": " << strerror(errno) << endl;
+        } else {
+            cout << "Log file: " << log_path << endl;
+        }
+    }
+    int records_fd = -1;
+    if (!records_path.empty()) {
+        records_fd = open(records_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (records_fd < 0) {
+            cerr << "Warning: cannot open " << records_path << ": " << strerror(errno) << endl;
+        }
+    }
+    cout << endl;
+
+    if (top > 0 && samples == 1) {
+        // CPU% needs two readings: take a baseline a moment before the sample
+        wire_snapshot baseline;
+        collector_sample(collector, baseline);
+        usleep(min(interval_ms, 1000L) * 1000);
+    }
+
+    double cpu_start = cpu_seconds();
+    long long start_ns = monotonic_ns();
+    struct timespec tick;
+    clock_gettime(CLOCK_MONOTONIC, &tick);
+    long long last_flush_ns = start_ns;
+    long taken = 0;
+    for (long n = 0; (samples == 0 || n < samples) && !stop_requested; ++n) {
+        if (n > 0 && interval_ms > 0) {
+            // Absolute ticks, so a slow sample does not push the rest back
+            tick.tv_sec += interval_ms / 1000;
+            tick.tv_nsec += interval_ms % 1000 * 1000000L;
+            if (tick.tv_nsec >= 1000000000L) {
+                tick.tv_sec++;
+                tick.tv_nsec -= 1000000000L;
+            }
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tick, NULL) == EINTR && !stop_requested) {
+            }
+            if (stop_requested) {
+                break;
+            }
+        }
+        wire_snapshot s;
+        if (!collector_sample(collector, s)) {
+            cerr << "Error: sampling failed: " << strerror(errno) << endl;
+            break;
+        }
+        taken++;
+        if (daemon_mode) {
+            SeriesSample sample;
+            sample.time_ns = wire_now_ns();
+            sample.snapshot = s;
+            ring_push(ring, sample);
+            long long now = monotonic_ns();
+            if (ring.unflushed >= (size_t)block_samples || now - last_flush_ns >= flush_sec * 1e9) {
+                ring_flush(ring, series);
+                last_flush_ns = now;
+                if (top > 0 && !quiet) {
+                    write_top(cout, processes, top);
+                }
+            }
+        }
+        if (!quiet && !daemon_mode) {
+            if (samples == 1) {
+                write_report(cout, s, true);
+            } else {
+                write_line(cout, s);
+            }
+            if (top > 0) {
+                write_top(cout, processes, top);
+            }
+        }
+        if (log.is_open()) {
+            time_t now = time(NULL);
+            char date[64];
+            strftime(date, sizeof(date), "%a %b %e %H:%M:%S %Z %Y", localtime(&now));
+            log << "----------------------------------------\n" << "Timestamp: " << date << "\n";
+            write_report(log, s, false);
+        }
+        if (records_fd >= 0) {
+            char record[sizeof(wire_header) + sizeof(wire_snapshot)];
+            size_t length = wire_encode_snapshot(record, sizeof(record), &s);
+            if (write(records_fd, record, length) != (ssize_t)length) {
+                cerr << "Warning: cannot write " << records_path << ": " << strerror(errno) << endl;
+                close(records_fd);
+                records_fd = -1;
+            }
+        }
+    }
+    double cpu_used = cpu_seconds() - cpu_start;
+    double elapsed = (monotonic_ns() - start_ns) / 1e9;
+
+    if (daemon_mode) {
+        if (stop_requested) {
+            cout << "Stop requested, flushing the series." << endl;
+        }
+        ring_flush(ring, series);
+        cout << "The series holds " << series.header->blocks_written << " blocks written so far." << endl;
+        series_close(series);
+    }
+    unsigned long process_reads = processes.reads;
+    size_t uncached = process_table_uncached(processes);
+    process_table_close(processes);
+    collector_close(collector);
+    if (records_fd >= 0) {
+        close(records_fd);
+    }
+    cout << "----------------------------------------" << endl;
+    if (samples != 1) {
+        cout << "Collected " << taken << " samples in " << fixed << setprecision(3) << elapsed << " s, "
+             << setprecision(2) << cpu_used * 1e6 / (taken ? taken : 1) << " us CPU per sample" << endl;
+        if (top > 0) {
+            cout << "Per-process tracking: " << setprecision(1) << (double)process_reads / (taken ? taken : 1)
+                 << " stat reads per sample";
+            if (uncached > 0) {
+                cout << ", " << uncached << " processes without a cached descriptor";
+            }
+            cout << endl;
+        }
+    }
+    if (log.is_open()) {
+        cout << "Successfully generated log: " << log_path << endl;
+    }
+    cout << "Module 1 demonstration complete." << endl;
+    return taken == samples || stop_requested ? 0 : 1;
+}
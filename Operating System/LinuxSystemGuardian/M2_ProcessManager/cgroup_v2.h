@@ -0,0 +1,279 @@
+#ifndef CGROUP_V2_H
+#define CGROUP_V2_H
+
+// cgroup v2 groups for the process manager's children.
+//
+// A run creates <parent>/m2-<pid>, where parent defaults to the manager's own
+// cgroup, and enables the cpu, memory and io controllers below it. Each job
+// gets a leaf group inside it with cpu.max, memory.max and io.weight set from
+// its definition. Children move themselves into their group before exec, so
+// nothing they start escapes the limits. When a group's last child exits,
+// its memory.peak and cpu.stat are read back and the group is removed.
+//
+// cgroup v2 forbids processes in a group whose controllers are enabled for
+// its children. If the parent is the manager's own cgroup, the manager moves
+// into a leaf of its own (<parent>/m2-<pid>-manager) first, and back to where
+// it started at teardown. A --cgroup-parent the manager does not live in is
+// never moved into: other processes there are not ours to work around.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct CgroupLimits {
+    double cpus;        // cpu.max quota in CPUs, 0 = unlimited
+    long long memory;   // memory.max in bytes, 0 = unlimited
+    int io_weight;      // io.weight (1-10000), 0 = default
+};
+
+struct CgroupTree {
+    std::string mount;   // cgroup2 mount point
+    std::string parent;  // group the run group was created in
+    std::string run;     // <parent>/m2-<pid>
+    std::string origin;  // the manager's own cgroup when the run started
+    std::string manager; // leaf the manager moved into, if it had to
+    std::string parent_enabled; // controllers we enabled in the parent
+    bool cpu;            // controllers available to job groups
+    bool memory;
+    bool io;
+};
+
+struct CgroupUsage {
+    long long memory_peak;    // bytes, -1 if the kernel lacks memory.peak
+    long long usage_usec;
+    long long user_usec;
+    long long system_usec;
+    long long nr_throttled;
+    long long throttled_usec;
+};
+
+inline bool cgroup_write(const std::string& path, const std::string& value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t n = write(fd, value.data(), value.size());
+    int error = errno;
+    close(fd);
+    errno = error;
+    return n == (ssize_t)value.size();
+}
+
+inline std::string cgroup_read(const std::string& path) {
+    std::ifstream file(path.c_str());
+    std::stringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+// The cgroup2 mount (pure v2 at /sys/fs/cgroup, or hybrid at .../unified)
+inline bool cgroup_find_mount(std::string& mount) {
+    std::ifstream mountinfo("/proc/self/mountinfo");
+    std::string line;
+    while (std::getline(mountinfo, line)) {
+        size_t separator = line.find(" - ");
+        if (separator == std::string::npos || line.compare(separator + 3, 8, "cgroup2 ") != 0) {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string id, parent, device, root, point;
+        fields >> id >> parent >> device >> root >> point;
+        mount = point;
+        return true;
+    }
+    return false;
+}
+
+// Our own group, from the "0::" line of /proc/self/cgroup
+inline bool cgroup_self_path(const std::string& mount, std::string& path) {
+    std::ifstream file("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            path = mount + (line.size() > 3 && line != "0::/" ? line.substr(3) : "");
+            return true;
+        }
+    }
+    return false;
+}
+
+// Two spellings of one group (trailing slashes, symlinks) compare equal
+inline bool cgroup_same_path(const std::string& a, const std::string& b) {
+    char* real_a = realpath(a.c_str(), NULL);
+    char* real_b = realpath(b.c_str(), NULL);
+    bool same = real_a != NULL && real_b != NULL ? strcmp(real_a, real_b) == 0 : a == b;
+    free(real_a);
+    free(real_b);
+    return same;
+}
+
+inline bool cgroup_has_word(const std::string& text, const char* word) {
+    std::istringstream words(text);
+    std::string item;
+    while (words >> item) {
+        if (item == word) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Enable whichever of cpu, memory and io the group offers for its children
+inline void cgroup_enable_controllers(const std::string& group, bool& cpu, bool& memory, bool& io) {
+    std::string available = cgroup_read(group + "/cgroup.controllers");
+    const char* names[] = {"cpu", "memory", "io"};
+    bool* flags[] = {&cpu, &memory, &io};
+    for (int i = 0; i < 3; ++i) {
+        *flags[i] = cgroup_has_word(available, names[i]) &&
+                    cgroup_write(group + "/cgroup.subtree_control", std::string("+") + names[i]);
+    }
+}
+
+inline bool cgroup_setup(CgroupTree& tree, const std::string& parent, std::string& error) {
+    if (!cgroup_find_mount(tree.mount)) {
+        error = "no cgroup2 file system is mounted";
+        return false;
+    }
+    if (!cgroup_self_path(tree.mount, tree.origin)) {
+        error = "cannot find our cgroup in /proc/self/cgroup";
+        return false;
+    }
+    tree.parent = parent.empty() ? tree.origin : parent;
+    bool own_parent = cgroup_same_path(tree.parent, tree.origin);
+
+    // The parent must pass the controllers down to the run group. If the
+    // manager itself sits in the parent, cgroup v2 refuses (EBUSY) until it
+    // moves out; in any other parent EBUSY means someone else's processes.
+    std::string wanted = cgroup_read(tree.parent + "/cgroup.controllers");
+    std::string enabled = cgroup_read(tree.parent + "/cgroup.subtree_control");
+    const char* names[] = {"cpu", "memory", "io"};
+    for (int i = 0; i < 3; ++i) {
+        if (!cgroup_has_word(wanted, names[i]) || cgroup_has_word(enabled, names[i])) {
+            continue;
+        }
+        std::string control = std::string("+") + names[i];
+        bool done = cgroup_write(tree.parent + "/cgroup.subtree_control", control);
+        if (!done && errno == EBUSY && own_parent && tree.manager.empty()) {
+            std::string leaf = tree.parent + "/m2-" + std::to_string(getpid()) + "-manager";
+            if (mkdir(leaf.c_str(), 0755) == 0 && cgroup_write(leaf + "/cgroup.procs", "0")) {
+                tree.manager = leaf;
+                done = cgroup_write(tree.parent + "/cgroup.subtree_control", control);
+            }
+        }
+        if (done) {
+            tree.parent_enabled += std::string(" ") + names[i];
+        }
+    }
+
+    tree.run = tree.parent + "/m2-" + std::to_string(getpid());
+    if (mkdir(tree.run.c_str(), 0755) != 0) {
+        error = "cannot create " + tree.run + ": " + strerror(errno);
+        return false;
+    }
+    cgroup_enable_controllers(tree.run, tree.cpu, tree.memory, tree.io);
+    return true;
+}
+
+// Create a job group under the run group and apply its limits. Limits whose
+// controller is missing are skipped and named in warning.
+inline bool cgroup_create(const CgroupTree& tree, const std::string& name, const CgroupLimits& limits,
+                          std::string& path, std::string& warning) {
+    path = tree.run + "/" + name;
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+        warning = "cannot create " + path + ": " + strerror(errno);
+        return false;
+    }
+    warning.clear();
+    if (limits.cpus > 0) {
+        char value[64];
+        snprintf(value, sizeof(value), "%lld 100000", (long long)(limits.cpus * 100000 + 0.5));
+        if (!tree.cpu || !cgroup_write(path + "/cpu.max", value)) {
+            warning += " cpu.max";
+        }
+    }
+    if (limits.memory > 0) {
+        if (!tree.memory || !cgroup_write(path + "/memory.max", std::to_string(limits.memory))) {
+            warning += " memory.max";
+        }
+    }
+    if (limits.io_weight > 0) {
+        if (!tree.io || (!cgroup_write(path + "/io.weight", "default " + std::to_string(limits.io_weight)) &&
+                         !cgroup_write(path + "/io.bfq.weight", std::to_string(limits.io_weight)))) {
+            warning += " io.weight";
+        }
+    }
+    return true;
+}
+
+// Descriptor a child writes "0" to in order to join the group
+inline int cgroup_open_procs(const std::string& path) {
+    return open((path + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+}
+
+inline void cgroup_read_usage(const std::string& path, CgroupUsage& usage) {
+    std::string peak = cgroup_read(path + "/memory.peak");
+    usage.memory_peak = peak.empty() ? -1 : atoll(peak.c_str());
+    usage.usage_usec = usage.user_usec = usage.system_usec = 0;
+    usage.nr_throttled = usage.throttled_usec = 0;
+
+    std::istringstream stat(cgroup_read(path + "/cpu.stat"));
+    std::string key;
+    long long value;
+    while (stat >> key >> value) {
+        if (key == "usage_usec") {
+            usage.usage_usec = value;
+        } else if (key == "user_usec") {
+            usage.user_usec = value;
+        } else if (key == "system_usec") {
+            usage.system_usec = value;
+        } else if (key == "nr_throttled") {
+            usage.nr_throttled = value;
+        } else if (key == "throttled_usec") {
+            usage.throttled_usec = value;
+        }
+    }
+}
+
+// Kill everything left in a group (cgroup.kill needs 5.14)
+inline bool cgroup_kill(const std::string& path) {
+    return cgroup_write(path + "/cgroup.kill", "1");
+}
+
+// Remove a group, killing stragglers and waiting briefly for them to go
+inline bool cgroup_remove(const std::string& path) {
+    if (rmdir(path.c_str()) == 0 || errno == ENOENT) {
+        return true;
+    }
+    if (errno != EBUSY || !cgroup_kill(path)) {
+        return false;
+    }
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        if (rmdir(path.c_str()) == 0) {
+            return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+// Remove the run group and undo what setup changed in the parent
+inline void cgroup_teardown(const CgroupTree& tree) {
+    cgroup_remove(tree.run);
+    std::istringstream names(tree.parent_enabled);
+    std::string name;
+    while (names >> name) {
+        cgroup_write(tree.parent + "/cgroup.subtree_control", "-" + name);
+    }
+    if (!tree.manager.empty() && cgroup_write(tree.origin + "/cgroup.procs", "0")) {
+        rmdir(tree.manager.c_str());
+    }
+}
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef PROCESS_LOGGER_H
+#define PROCESS_LOGGER_H
+
+// Buffered, asynchronous line logger for the process manager.
+//
+// Callers append lines into a preallocated buffer under a short critical
+// section; a background thread swaps it with a spare buffer and writes the
+// whole batch with one write(). The log file is opened once with
+// O_APPEND | O_CLOEXEC, so children never inherit it. Lines reach the file
+// within the flush interval, sooner when the buffer is half full, on
+// logger_flush() and on logger_close(). fsync() is optional: never, after
+// every batch, or once at close.
+//
+// After fork() the child must not log and should leave with _exit(), so the
+// parent's unwritten lines are not written twice.
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+enum LogSyncPolicy {
+    LOG_SYNC_NONE,  // leave durability to the kernel
+    LOG_SYNC_FLUSH, // fsync after every batch
+    LOG_SYNC_CLOSE  // fsync once when the log is closed
+};
+
+struct LoggerOptions {
+    size_t buffer_size;    // bytes per buffer (two are allocated)
+    int flush_interval_ms; // longest time a line waits in the buffer
+    LogSyncPolicy sync;
+};
+
+const LoggerOptions DEFAULT_LOGGER_OPTIONS = {64 << 10, 200, LOG_SYNC_NONE};
+
+struct ProcessLogger {
+    int fd = -1;              // -1 until logger_open() succeeds
+    LoggerOptions options;
+    std::vector<char> active; // lines being appended
+    std::vector<char> spare;  // batch being written
+    size_t used;              // bytes in active
+    long long first_pending_ns;
+    bool flush_requested;
+    bool writing;             // the flusher is writing spare
+    bool stopping;
+    bool threaded;            // false if the flusher could not start: writes are synchronous
+    bool write_failed;
+    pthread_t flusher;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;      // flusher: lines, a full buffer or a flush request
+    pthread_cond_t drained;   // writers: the buffer was taken or written
+};
+
+inline long long logger_clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+inline void logger_write_all(ProcessLogger& log, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(log.fd, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            log.write_failed = true;
+            return;
+        }
+        data += n;
+        length -= n;
+    }
+}
+
+inline void* logger_flush_thread(void* arg) {
+    ProcessLogger& log = *(ProcessLogger*)arg;
+    pthread_mutex_lock(&log.lock);
+    for (;;) {
+        if (log.used == 0) {
+            if (log.stopping) {
+                break;
+            }
+            pthread_cond_wait(&log.wake, &log.lock);
+            continue;
+        }
+
+        // Let lines gather until the oldest has waited the flush interval,
+        // unless the buffer is half full or someone wants them out now
+        long long deadline = log.first_pending_ns + log.options.flush_interval_ms * 1000000LL;
+        if (!log.stopping && !log.flush_requested && log.used < log.options.buffer_size / 2 &&
+            logger_clock_ns() < deadline) {
+            struct timespec ts;
+            ts.tv_sec = deadline / 1000000000LL;
+            ts.tv_nsec = deadline % 1000000000LL;
+            pthread_cond_timedwait(&log.wake, &log.lock, &ts);
+            continue;
+        }
+
+        log.active.swap(log.spare);
+        size_t length = log.used;
+        log.used = 0;
+        log.flush_requested = false;
+        log.writing = true;
+        pthread_cond_broadcast(&log.drained);
+        pthread_mutex_unlock(&log.lock);
+
+        logger_write_all(log, log.spare.data(), length);
+        if (log.options.sync == LOG_SYNC_FLUSH) {
+            fdatasync(log.fd);
+        }
+
+        pthread_mutex_lock(&log.lock);
+        log.writing = false;
+        pthread_cond_broadcast(&log.drained);
+    }
+    pthread_mutex_unlock(&log.lock);
+    return NULL;
+}
+
+inline bool logger_open(ProcessLogger& log, const char* path, const LoggerOptions& options) {
+    log.fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (log.fd < 0) {
+        return false;
+    }
+    log.options = options;
+    if (log.options.buffer_size < 256) {
+        log.options.buffer_size = 256;
+    }
+    log.active.resize(log.options.buffer_size);
+    log.spare.resize(log.options.buffer_size);
+    log.used = 0;
+    log.first_pending_ns = 0;
+    log.flush_requested = false;
+    log.writing = false;
+    log.stopping = false;
+    log.write_failed = false;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&log.lock, NULL);
+    pthread_cond_init(&log.wake, &attr);
+    pthread_cond_init(&log.drained, NULL);
+    pthread_condattr_destroy(&attr);
+    log.threaded = pthread_create(&log.flusher, NULL, logger_flush_thread, &log) == 0;
+    return true;
+}
+
+// Append length bytes, plus a newline if newline is set
+inline void logger_append(ProcessLogger& log, const char* data, size_t length, bool newline) {
+    if (log.fd < 0) {
+        return;
+    }
+    size_t total = length + (newline ? 1 : 0);
+    pthread_mutex_lock(&log.lock);
+    if (!log.threaded) {
+        logger_write_all(log, data, length);
+        if (newline) {
+            logger_write_all(log, "\n", 1);
+        }
+        pthread_mutex_unlock(&log.lock);
+        return;
+    }
+    // A full buffer waits for the flusher to take it
+    while (log.used > 0 && log.used + total > log.active.size()) {
+        log.flush_requested = true;
+        pthread_cond_signal(&log.wake);
+        pthread_cond_wait(&log.drained, &log.lock);
+    }
+    if (total > log.active.size()) {
+        log.active.resize(total); // a single entry larger than the buffer
+    }
+    bool was_empty = log.used == 0;
+    memcpy(log.active.data() + log.used, data, length);
+    if (newline) {
+        log.active[log.used + length] = '\n';
+    }
+    log.used += total;
+    if (was_empty) {
+        log.first_pending_ns = logger_clock_ns();
+        pthread_cond_signal(&log.wake);
+    } else if (log.used >= log.options.buffer_size / 2) {
+        pthread_cond_signal(&log.wake);
+    }
+    pthread_mutex_unlock(&log.lock);
+}
+
+// Append one line (a newline is added)
+inline void logger_line(ProcessLogger& log, const char* text, size_t length) {
+    logger_append(log, text, length, true);
+}
+
+// Append a binary record as is; it reaches the file in one piece
+inline void logger_record(ProcessLogger& log, const void* data, size_t length) {
+    logger_append(log, (const char*)data, length, false);
+}
+
+inline void logger_line(ProcessLogger& log, const std::string& line) {
+    logger_line(log, line.data(), line.size());
+}
+
+// Block until every line logged so far is in the file
+inline void logger_flush(ProcessLogger& log) {
+    if (log.fd < 0 || !log.threaded) {
+        return;
+    }
+    pthread_mutex_lock(&log.lock);
+    while (log.used > 0 || log.writing) {
+        log.flush_requested = true;
+        pthread_cond_signal(&log.wake);
+        pthread_cond_wait(&log.drained, &log.lock);
+    }
+    pthread_mutex_unlock(&log.lock);
+}
+
+inline void logger_close(ProcessLogger& log) {
+    if (log.fd < 0) {
+        return;
+    }
+    if (log.threaded) {
+        pthread_mutex_lock(&log.lock);
+        log.stopping = true;
+        pthread_cond_signal(&log.wake);
+        pthread_mutex_unlock(&log.lock);
+        pthread_join(log.flusher, NULL);
+    }
+    if (log.options.sync != LOG_SYNC_NONE) {
+        fdatasync(log.fd);
+    }
+    close(log.fd);
+    log.fd = -1;
+    pthread_mutex_destroy(&log.lock);
+    pthread_cond_destroy(&log.wake);
+    pthread_cond_destroy(&log.drained);
+}
+
+#endif
@@ -1,66 +1,984 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+#include <time.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 
+#include "cgroup_v2.h"
+#include "process_logger.h"
+#include "process_spawn.h"
+#include "../M4_IPC/ipc_wire.h"
+
 using namespace std;
 
+// --- Process Log ---
+// Opened once; lines are buffered and written in batches by a flusher thread
+ProcessLogger process_log;
+
 void log_process(const string& message) {
-    ofstream log_file("logs/M2_process_log.txt", ios::app);
-    if (log_file.is_open()) {
-        log_file << message << endl;
-        log_file.close();
+    logger_line(process_log, message);
+}
+
+long long monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// --- Job List ---
+// One job per line: optional key=value settings, then the command and its
+// arguments separated by whitespace. Blank lines and # comments are skipped.
+//   priority=N   higher runs first; equal priorities run in file order
+//   timeout=SEC  SIGTERM after SEC seconds, SIGKILL after the grace period
+//   name=TEXT    label used in reports (defaults to the command)
+//   cpu=N        cgroup cpu.max, in CPUs (0.5 = half a core)
+//   memory=SIZE  cgroup memory.max, with an optional K, M or G suffix
+//   io_weight=N  cgroup io.weight, 1 to 10000
+//   cgroup=NAME  share a cgroup with other jobs of the same NAME; the first
+//                job to create it sets its limits
+// Jobs with any cgroup setting get a cgroup of their own unless they name one.
+const char* DEFAULT_TASK = "M2_ProcessManager/child_task.sh";
+const int DEFAULT_JOB_COUNT = 3;
+
+struct Job {
+    int id;             // position in the job list, from 1
+    string name;
+    int priority;
+    double timeout_sec; // 0 = no limit
+    CgroupLimits limits;
+    string cgroup;      // shared group name, empty = a group per job if limited
+    vector<string> argv;
+};
+
+bool job_wants_cgroup(const Job& job) {
+    return !job.cgroup.empty() || job.limits.cpus > 0 || job.limits.memory > 0 || job.limits.io_weight > 0;
+}
+
+// Byte count with an optional K, M or G suffix
+bool parse_size(const string& text, long long& size) {
+    char* end = NULL;
+    double value = strtod(text.c_str(), &end);
+    if (end == text.c_str() || value < 0) {
+        return false;
+    }
+    long long scale = 1;
+    if (*end == 'K' || *end == 'k') {
+        scale = 1LL << 10;
+        ++end;
+    } else if (*end == 'M' || *end == 'm') {
+        scale = 1LL << 20;
+        ++end;
+    } else if (*end == 'G' || *end == 'g') {
+        scale = 1LL << 30;
+        ++end;
+    }
+    if (*end != '\0') {
+        return false;
     }
+    size = (long long)(value * scale);
+    return true;
 }
 
-int main() {
-    cout << "--- Linux System Guardian: Process Manager Mini-Simulator ---" << endl;
-    log_process("\n--- New Simulation Start ---");
-    
-    pid_t pid;
-    int num_children = 3;
+bool parse_job_line(const string& line, Job& job, string& error) {
+    istringstream tokens(line);
+    string token;
+    while (tokens >> token) {
+        size_t equals = token.find('=');
+        if (!job.argv.empty() || equals == string::npos) {
+            job.argv.push_back(token);
+            continue;
+        }
+        string key = token.substr(0, equals);
+        string value = token.substr(equals + 1);
+        char* end = NULL;
+        if (key == "priority") {
+            job.priority = (int)strtol(value.c_str(), &end, 10);
+        } else if (key == "timeout") {
+            job.timeout_sec = strtod(value.c_str(), &end);
+            if (job.timeout_sec < 0) {
+                end = NULL;
+            }
+        } else if (key == "name") {
+            job.name = value;
+            continue;
+        } else if (key == "cpu") {
+            job.limits.cpus = strtod(value.c_str(), &end);
+            if (job.limits.cpus <= 0) {
+                end = NULL;
+            }
+        } else if (key == "memory") {
+            if (!parse_size(value, job.limits.memory) || job.limits.memory == 0) {
+                error = "bad value for 'memory': " + value;
+                return false;
+            }
+            continue;
+        } else if (key == "io_weight") {
+            job.limits.io_weight = (int)strtol(value.c_str(), &end, 10);
+            if (job.limits.io_weight < 1 || job.limits.io_weight > 10000) {
+                end = NULL;
+            }
+        } else if (key == "cgroup") {
+            if (value.empty() || value.find('/') != string::npos || value == "." || value == "..") {
+                error = "bad cgroup name: " + value;
+                return false;
+            }
+            job.cgroup = value;
+            continue;
+        } else {
+            error = "unknown setting '" + key + "'";
+            return false;
+        }
+        if (end == NULL || end == value.c_str() || *end != '\0') {
+            error = "bad value for '" + key + "': " + value;
+            return false;
+        }
+    }
+    if (job.argv.empty()) {
+        error = "no command";
+        return false;
+    }
+    if (job.name.empty()) {
+        job.name = job.argv[0];
+    }
+    return true;
+}
+
+bool load_jobs(const string& path, double default_timeout, vector<Job>& jobs) {
+    ifstream file(path.c_str());
+    if (!file.is_open()) {
+        cerr << "Cannot open job list " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    string line;
+    int line_number = 0;
+    while (getline(file, line)) {
+        ++line_number;
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == string::npos || line[start] == '#') {
+            continue;
+        }
+        Job job;
+        job.id = (int)jobs.size() + 1;
+        job.priority = 0;
+        job.timeout_sec = default_timeout;
+        memset(&job.limits, 0, sizeof(job.limits));
+        string error;
+        if (!parse_job_line(line, job, error)) {
+            cerr << path << ":" << line_number << ": " << error << endl;
+            return false;
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
 
-    for (int i = 0; i < num_children; ++i) {
-        pid = fork();
+// --- Child Events ---
+// Children are watched through pidfds in an epoll set, so an exit wakes the
+// loop for exactly that child. Kernels without pidfd_open (before 5.3) fall
+// back to a signalfd for the blocked SIGCHLD, after which every wakeup reaps
+// whatever has exited. Timeouts share the loop through one timerfd armed for
+// the earliest deadline.
+const uint64_t TIMER_EVENT = 0;         // pids are never 0
+const uint64_t SIGNAL_EVENT = ~0ULL;
 
-        if (pid < 0) {
-            cerr << "Fork failed for child " << i + 1 << endl;
-            log_process("Fork failed");
-            return 1;
+struct ChildMonitor {
+    int epoll_fd;
+    int timer_fd;
+    int signal_fd;      // -1 while every child has a pidfd
+    long long armed_ns; // deadline timer_fd is set for, 0 = disarmed
+};
+
+int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+bool monitor_use_signalfd(ChildMonitor& monitor) {
+    if (monitor.signal_fd >= 0) {
+        return true;
+    }
+    sigset_t child_signal;
+    sigemptyset(&child_signal);
+    sigaddset(&child_signal, SIGCHLD);
+    monitor.signal_fd = signalfd(-1, &child_signal, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (monitor.signal_fd < 0) {
+        return false;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = SIGNAL_EVENT;
+    return epoll_ctl(monitor.epoll_fd, EPOLL_CTL_ADD, monitor.signal_fd, &event) == 0;
+}
 
-        } else if (pid == 0) {
-            cout << "Child " << i + 1 << " created. PID: " << getpid() << ", Parent PID: " << getppid() << endl;
-            char *args[] = {(char*)"M2_ProcessManager/child_task.sh", (char*)0};
-            execv(args[0], args);
-            cerr << "Exec failed for child " << i + 1 << endl;
-            exit(1);
-            
+bool monitor_init(ChildMonitor& monitor) {
+    monitor.signal_fd = -1;
+    monitor.armed_ns = 0;
+    monitor.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    monitor.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (monitor.epoll_fd < 0 || monitor.timer_fd < 0) {
+        return false;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = TIMER_EVENT;
+    if (epoll_ctl(monitor.epoll_fd, EPOLL_CTL_ADD, monitor.timer_fd, &event) != 0) {
+        return false;
+    }
+    int probe = open_pidfd(getpid());
+    if (probe < 0) {
+        return monitor_use_signalfd(monitor);
+    }
+    close(probe);
+    return true;
+}
+
+// Returns the child's pidfd, or -1 if it is covered by the signalfd instead
+int monitor_watch(ChildMonitor& monitor, pid_t pid) {
+    int pidfd = open_pidfd(pid);
+    if (pidfd >= 0) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = (uint64_t)pid;
+        if (epoll_ctl(monitor.epoll_fd, EPOLL_CTL_ADD, pidfd, &event) == 0) {
+            return pidfd;
+        }
+        close(pidfd);
+    }
+    // Out of descriptors or no pidfd support: SIGCHLD covers this child
+    monitor_use_signalfd(monitor);
+    return -1;
+}
+
+void monitor_arm(ChildMonitor& monitor, long long deadline_ns) {
+    if (deadline_ns == monitor.armed_ns) {
+        return;
+    }
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = deadline_ns / 1000000000LL;
+    spec.it_value.tv_nsec = deadline_ns % 1000000000LL;
+    timerfd_settime(monitor.timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    monitor.armed_ns = deadline_ns;
+}
+
+void monitor_destroy(ChildMonitor& monitor) {
+    if (monitor.signal_fd >= 0) {
+        close(monitor.signal_fd);
+    }
+    close(monitor.timer_fd);
+    close(monitor.epoll_fd);
+}
+
+// --- Scheduler ---
+// Keeps up to max_running children alive, launching the next job by
+// priority as soon as one exits. The parent never blocks in wait(): it
+// sleeps in epoll_wait() until a child exits or a timer is due.
+struct SchedulerOptions {
+    int max_running;
+    double kill_grace_sec;   // SIGTERM to SIGKILL delay for timed-out jobs
+    long min_available_mb;   // hold launches while MemAvailable is below this
+    bool quiet;              // no per-child console lines
+    bool cgroup_all;         // a cgroup for every job, limited or not
+    string cgroup_parent;    // where the run group goes (default: our cgroup)
+    SpawnOptions spawn;
+};
+
+struct JobOrder {
+    bool operator()(const Job* a, const Job* b) const {
+        if (a->priority != b->priority) {
+            return a->priority < b->priority;
+        }
+        return a->id > b->id;
+    }
+};
+
+typedef multimap<long long, pid_t> TimerQueue;
+
+struct RunningJob {
+    const Job* job;
+    int pidfd;             // -1 when watched through SIGCHLD
+    long long start_ns;
+    bool has_timer;
+    TimerQueue::iterator timer; // the pending SIGTERM or SIGKILL
+    bool timed_out;
+    string group;          // cgroup name under the run group, empty = none
+};
+
+// --- Resource Accounting ---
+// wait4() returns each child's rusage (its own plus its reaped descendants')
+// as the child is collected. Every child gets a JSON line in the stats log,
+// and the run ends with percentiles over all of them. Linux keeps the RSS
+// high-water mark across exec, so under posix_spawn and vfork a small
+// child's max RSS never reads below the supervisor's own. With
+// --exit-records each child (and each job that could not start) also gets a
+// binary WIRE_CHILD_EXIT record.
+ProcessLogger stats_log;
+ProcessLogger exit_records;
+
+struct ChildUsage {
+    double wall_ms;
+    double user_ms;
+    double sys_ms;
+    double max_rss_kb;
+    double voluntary_switches;   // blocked waiting (I/O, sleep, locks)
+    double involuntary_switches; // preempted
+};
+
+struct SchedulerTotals {
+    int started;
+    int succeeded;
+    int failed;        // non-zero exit status
+    int abnormal;      // killed by a signal
+    int timed_out;
+    int spawn_failed;
+    size_t peak_running;
+    vector<ChildUsage> usage;
+};
+
+double timeval_ms(const struct timeval& tv) {
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+string json_string(const string& text) {
+    string out = "\"";
+    for (size_t i = 0; i < text.length(); ++i) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
         } else {
-            string log_msg = "Parent (PID: " + to_string(getpid()) + ") created Child (PID: " + to_string(pid) + ")";
-            log_process(log_msg);
+            out += c;
         }
     }
+    return out + "\"";
+}
 
-    cout << "\nParent is waiting for all " << num_children << " children to finish..." << endl;
+void log_exit_record(pid_t pid, const Job& job, int status, wire_outcome outcome, long long wall_ns,
+                     const struct rusage* ru, const CgroupUsage* cgroup) {
+    if (exit_records.fd < 0) {
+        return;
+    }
+    wire_child_exit fixed = {};
+    fixed.pid = pid;
+    fixed.job_id = job.id;
+    fixed.wait_status = status;
+    fixed.outcome = outcome;
+    fixed.name_length = min(job.name.size(), (size_t)UINT16_MAX);
+    fixed.wall_ns = wall_ns;
+    if (ru != NULL) {
+        fixed.user_us = ru->ru_utime.tv_sec * 1000000LL + ru->ru_utime.tv_usec;
+        fixed.system_us = ru->ru_stime.tv_sec * 1000000LL + ru->ru_stime.tv_usec;
+        fixed.max_rss_kb = ru->ru_maxrss;
+        fixed.voluntary_switches = ru->ru_nvcsw;
+        fixed.involuntary_switches = ru->ru_nivcsw;
+    }
+    fixed.cgroup_memory_peak = cgroup != NULL ? cgroup->memory_peak : -1;
+    fixed.cgroup_throttled_us = cgroup != NULL ? cgroup->throttled_usec : -1;
+    vector<char> record(sizeof(wire_header) + sizeof(fixed) + fixed.name_length);
+    size_t length = wire_encode_child_exit(record.data(), record.size(), &fixed, job.name.data());
+    logger_record(exit_records, record.data(), length);
+}
 
-    int status;
-    pid_t wpid;
-    while ((wpid = wait(&status)) > 0) {
-        cout << "Child (PID: " << wpid << ") finished." << endl;
-        
-        if (WIFEXITED(status)) {
-            int exit_status = WEXITSTATUS(status);
-            cout << "  - Exit Status: " << exit_status << endl;
-            string log_msg = "Child (PID: " + to_string(wpid) + ") exited with status: " + to_string(exit_status);
-            log_process(log_msg);
+ChildUsage record_usage(pid_t pid, const Job& job, int status, bool timed_out, long long wall_ns,
+                        const struct rusage& ru, const string& group, const CgroupUsage* cgroup) {
+    ChildUsage usage;
+    usage.wall_ms = wall_ns / 1e6;
+    usage.user_ms = timeval_ms(ru.ru_utime);
+    usage.sys_ms = timeval_ms(ru.ru_stime);
+    usage.max_rss_kb = ru.ru_maxrss;
+    usage.voluntary_switches = ru.ru_nvcsw;
+    usage.involuntary_switches = ru.ru_nivcsw;
+
+    ostringstream line;
+    line << fixed << setprecision(3);
+    line << "{\"time\": " << time(NULL) << ", \"job\": " << job.id << ", \"name\": " << json_string(job.name)
+         << ", \"pid\": " << pid;
+    if (WIFEXITED(status)) {
+        line << ", \"outcome\": " << (timed_out ? "\"timeout\"" : "\"exited\"")
+             << ", \"exit_code\": " << WEXITSTATUS(status);
+    } else {
+        line << ", \"outcome\": " << (timed_out ? "\"timeout\"" : "\"signaled\"")
+             << ", \"signal\": " << WTERMSIG(status);
+    }
+    line << ", \"wall_ms\": " << usage.wall_ms << ", \"user_ms\": " << usage.user_ms
+         << ", \"sys_ms\": " << usage.sys_ms << ", \"max_rss_kb\": " << ru.ru_maxrss
+         << ", \"voluntary_ctx_switches\": " << ru.ru_nvcsw
+         << ", \"involuntary_ctx_switches\": " << ru.ru_nivcsw;
+    if (cgroup != NULL) {
+        line << ", \"cgroup\": {\"name\": " << json_string(group) << ", \"memory_peak_bytes\": " << cgroup->memory_peak
+             << ", \"cpu_usage_usec\": " << cgroup->usage_usec << ", \"cpu_user_usec\": " << cgroup->user_usec
+             << ", \"cpu_system_usec\": " << cgroup->system_usec << ", \"nr_throttled\": " << cgroup->nr_throttled
+             << ", \"throttled_usec\": " << cgroup->throttled_usec << "}";
+    }
+    line << "}";
+    logger_line(stats_log, line.str());
+    log_exit_record(pid, job, status,
+                    timed_out ? WIRE_TIMED_OUT : WIFEXITED(status) ? WIRE_EXITED : WIRE_SIGNALED, wall_ns, &ru,
+                    cgroup);
+    return usage;
+}
+
+// Nearest-rank percentile of a sorted sample
+double percentile(const vector<double>& sorted, double p) {
+    size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+    rank = min(max(rank, (size_t)1), sorted.size());
+    return sorted[rank - 1];
+}
+
+// Print one metric's distribution and add it to the JSON summary
+void summarize_metric(const vector<ChildUsage>& usage, double ChildUsage::*field, const char* label,
+                      const char* key, ostringstream& json) {
+    vector<double> values;
+    for (size_t i = 0; i < usage.size(); ++i) {
+        values.push_back(usage[i].*field);
+    }
+    sort(values.begin(), values.end());
+    double p50 = percentile(values, 50), p90 = percentile(values, 90), p99 = percentile(values, 99);
+    cout << "  " << left << setw(22) << label << right << fixed << setprecision(1) << setw(12) << p50
+         << setw(12) << p90 << setw(12) << p99 << setw(12) << values.back() << endl;
+    json << ", \"" << key << "\": {\"p50\": " << p50 << ", \"p90\": " << p90 << ", \"p99\": " << p99
+         << ", \"max\": " << values.back() << "}";
+}
+
+void report_usage(const vector<ChildUsage>& usage) {
+    if (usage.empty()) {
+        return;
+    }
+    ostringstream json;
+    json << fixed << setprecision(3);
+    json << "{\"time\": " << time(NULL) << ", \"summary\": true, \"children\": " << usage.size();
+    cout << "\nPer-child usage over " << usage.size() << " children:" << endl;
+    cout << "  " << left << setw(22) << "" << right << setw(12) << "p50" << setw(12) << "p90" << setw(12) << "p99"
+         << setw(12) << "max" << endl;
+    summarize_metric(usage, &ChildUsage::wall_ms, "wall time (ms)", "wall_ms", json);
+    summarize_metric(usage, &ChildUsage::user_ms, "user CPU (ms)", "user_ms", json);
+    summarize_metric(usage, &ChildUsage::sys_ms, "system CPU (ms)", "sys_ms", json);
+    summarize_metric(usage, &ChildUsage::max_rss_kb, "max RSS (KB)", "max_rss_kb", json);
+    summarize_metric(usage, &ChildUsage::voluntary_switches, "voluntary switches", "voluntary_ctx_switches", json);
+    summarize_metric(usage, &ChildUsage::involuntary_switches, "involuntary switches",
+                     "involuntary_ctx_switches", json);
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+    json << "}";
+    logger_line(stats_log, json.str());
+}
+
+// MemAvailable in MB, or -1 if /proc/meminfo cannot be read
+long available_memory_mb() {
+    ifstream meminfo("/proc/meminfo");
+    string key;
+    long value;
+    string unit;
+    while (meminfo >> key >> value >> unit) {
+        if (key == "MemAvailable:") {
+            return value / 1024;
+        }
+    }
+    return -1;
+}
+
+void report_exit(pid_t pid, const RunningJob& run, int status, bool quiet, SchedulerTotals& totals) {
+    if (!quiet) {
+        cout << "Child (PID: " << pid << ") finished." << endl;
+    }
+    if (run.timed_out) {
+        totals.timed_out++;
+        if (!quiet) {
+            cout << "  - Timed out after " << run.job->timeout_sec << "s." << endl;
+        }
+        log_process("Child (PID: " + to_string(pid) + ") timed out: " + run.job->name);
+    } else if (WIFEXITED(status)) {
+        int exit_status = WEXITSTATUS(status);
+        if (exit_status == 0) {
+            totals.succeeded++;
         } else {
+            totals.failed++;
+        }
+        if (!quiet) {
+            cout << "  - Exit Status: " << exit_status << endl;
+        }
+        string log_msg = "Child (PID: " + to_string(pid) + ") exited with status: " + to_string(exit_status);
+        log_process(log_msg);
+    } else {
+        totals.abnormal++;
+        if (!quiet) {
             cout << "  - Child terminated abnormally." << endl;
-            log_process("Child (PID: " + to_string(wpid) + ") terminated abnormally.");
+        }
+        log_process("Child (PID: " + to_string(pid) + ") terminated abnormally.");
+    }
+}
+
+// A job cgroup under the run group, shared by the children in it
+struct JobGroup {
+    string path;
+    int procs_fd;  // cgroup.procs, written by each child before exec
+    int members;   // running children
+};
+
+struct Scheduler {
+    const SchedulerOptions* options;
+    ChildMonitor monitor;
+    priority_queue<const Job*, vector<const Job*>, JobOrder> pending;
+    map<pid_t, RunningJob> running;
+    TimerQueue timers;
+    SchedulerTotals totals;
+    bool use_cgroups;
+    CgroupTree cgroups;
+    map<string, JobGroup> groups;
+};
+
+// Find or create the job's cgroup. Returns its name, or "" to run unconfined.
+string join_group(Scheduler& scheduler, const Job& job) {
+    if (!scheduler.use_cgroups || (!scheduler.options->cgroup_all && !job_wants_cgroup(job))) {
+        return "";
+    }
+    string name = job.cgroup.empty() ? "job-" + to_string(job.id) : job.cgroup;
+    map<string, JobGroup>::iterator it = scheduler.groups.find(name);
+    if (it == scheduler.groups.end()) {
+        JobGroup group;
+        string warning;
+        if (!cgroup_create(scheduler.cgroups, name, job.limits, group.path, warning)) {
+            cerr << "Warning: " << warning << "; job " << job.id << " runs without a cgroup" << endl;
+            return "";
+        }
+        if (!warning.empty()) {
+            cerr << "Warning: cgroup " << name << ": could not set" << warning << endl;
+        }
+        group.procs_fd = cgroup_open_procs(group.path);
+        group.members = 0;
+        if (group.procs_fd < 0) {
+            cerr << "Warning: cannot open " << group.path << "/cgroup.procs: " << strerror(errno) << endl;
+            rmdir(group.path.c_str());
+            return "";
+        }
+        it = scheduler.groups.insert(make_pair(name, group)).first;
+    }
+    it->second.members++;
+    return name;
+}
+
+// A child of the group has exited: read the group's counters, and remove the
+// group once it is empty
+void leave_group(Scheduler& scheduler, const string& name, CgroupUsage& usage) {
+    JobGroup& group = scheduler.groups[name];
+    cgroup_read_usage(group.path, usage);
+    if (--group.members == 0) {
+        close(group.procs_fd);
+        cgroup_remove(group.path);
+        scheduler.groups.erase(name);
+    }
+}
+
+void set_timer(Scheduler& scheduler, pid_t pid, RunningJob& run, long long when_ns) {
+    if (run.has_timer) {
+        scheduler.timers.erase(run.timer);
+    }
+    run.timer = scheduler.timers.insert(make_pair(when_ns, pid));
+    run.has_timer = true;
+}
+
+void launch_job(Scheduler& scheduler, const Job* job) {
+    vector<char*> args;
+    for (size_t i = 0; i < job->argv.size(); ++i) {
+        args.push_back((char*)job->argv[i].c_str());
+    }
+    args.push_back(NULL);
+    SpawnOptions spawn = scheduler.options->spawn;
+    string group = join_group(scheduler, *job);
+    spawn.cgroup_fd = group.empty() ? -1 : scheduler.groups[group].procs_fd;
+    pid_t pid = spawn_process(spawn, args.data());
+    if (pid < 0) {
+        if (!group.empty()) {
+            CgroupUsage unused;
+            leave_group(scheduler, group, unused);
+        }
+        cerr << "Spawn failed for job " << job->id << " (" << job->name << "): " << strerror(errno) << endl;
+        log_process("Spawn failed: " + job->name);
+        log_exit_record(-1, *job, 0, WIRE_SPAWN_FAILED, 0, NULL, NULL);
+        scheduler.totals.spawn_failed++;
+        return;
+    }
+
+    RunningJob& run = scheduler.running[pid];
+    run.job = job;
+    run.pidfd = monitor_watch(scheduler.monitor, pid);
+    run.start_ns = monotonic_ns();
+    run.has_timer = false;
+    run.timed_out = false;
+    run.group = group;
+    if (job->timeout_sec > 0) {
+        set_timer(scheduler, pid, run, run.start_ns + (long long)(job->timeout_sec * 1e9));
+    }
+
+    scheduler.totals.started++;
+    if (scheduler.running.size() > scheduler.totals.peak_running) {
+        scheduler.totals.peak_running = scheduler.running.size();
+    }
+    if (!scheduler.options->quiet) {
+        cout << "Child " << job->id << " created. PID: " << pid << ", Parent PID: " << getpid() << endl;
+    }
+    string log_msg = "Parent (PID: " + to_string(getpid()) + ") created Child (PID: " + to_string(pid) + ")";
+    log_process(log_msg);
+}
+
+// Collect one child if it has exited. Returns false if it is still running.
+bool reap_child(Scheduler& scheduler, pid_t pid) {
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, WNOHANG, &ru) <= 0) {
+        return false;
+    }
+    long long wall_ns = monotonic_ns();
+    map<pid_t, RunningJob>::iterator it = scheduler.running.find(pid);
+    if (it == scheduler.running.end()) {
+        return true;
+    }
+    RunningJob& run = it->second;
+    wall_ns -= run.start_ns;
+    report_exit(pid, run, status, scheduler.options->quiet, scheduler.totals);
+    CgroupUsage cgroup_usage;
+    if (!run.group.empty()) {
+        leave_group(scheduler, run.group, cgroup_usage);
+    }
+    scheduler.totals.usage.push_back(record_usage(pid, *run.job, status, run.timed_out, wall_ns, ru, run.group,
+                                                  run.group.empty() ? NULL : &cgroup_usage));
+    if (run.pidfd >= 0) {
+        close(run.pidfd); // also drops it from the epoll set
+    }
+    if (run.has_timer) {
+        scheduler.timers.erase(run.timer);
+    }
+    scheduler.running.erase(it);
+    return true;
+}
+
+// SIGCHLD fallback: one signal may stand for several exits
+void reap_any(Scheduler& scheduler) {
+    for (;;) {
+        siginfo_t info;
+        info.si_pid = 0;
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) != 0 || info.si_pid == 0) {
+            return;
+        }
+        if (!reap_child(scheduler, info.si_pid)) {
+            return;
         }
     }
+}
+
+void expire_timers(Scheduler& scheduler, long long now) {
+    while (!scheduler.timers.empty() && scheduler.timers.begin()->first <= now) {
+        pid_t pid = scheduler.timers.begin()->second;
+        scheduler.timers.erase(scheduler.timers.begin());
+        RunningJob& run = scheduler.running[pid];
+        run.has_timer = false;
+        if (!run.timed_out) {
+            kill(pid, SIGTERM);
+            run.timed_out = true;
+            set_timer(scheduler, pid, run, now + (long long)(scheduler.options->kill_grace_sec * 1e9));
+        } else {
+            kill(pid, SIGKILL);
+            // A private cgroup also takes down anything the job left behind
+            if (!run.group.empty() && scheduler.groups[run.group].members == 1) {
+                cgroup_kill(scheduler.groups[run.group].path);
+            }
+        }
+    }
+}
+
+SchedulerTotals run_jobs(const vector<Job>& jobs, const SchedulerOptions& options) {
+    Scheduler scheduler;
+    scheduler.options = &options;
+    SchedulerTotals& totals = scheduler.totals;
+    totals.started = totals.succeeded = totals.failed = totals.abnormal = 0;
+    totals.timed_out = totals.spawn_failed = 0;
+    totals.peak_running = 0;
+    totals.usage.reserve(jobs.size());
+    if (!monitor_init(scheduler.monitor)) {
+        cerr << "Cannot set up child monitoring: " << strerror(errno) << endl;
+        scheduler.totals.spawn_failed = (int)jobs.size();
+        return scheduler.totals;
+    }
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        scheduler.pending.push(&jobs[i]);
+    }
+
+    scheduler.use_cgroups = options.cgroup_all;
+    for (size_t i = 0; i < jobs.size() && !scheduler.use_cgroups; ++i) {
+        scheduler.use_cgroups = job_wants_cgroup(jobs[i]);
+    }
+    if (scheduler.use_cgroups) {
+        string error;
+        if (cgroup_setup(scheduler.cgroups, options.cgroup_parent, error)) {
+            cout << "cgroups: " << scheduler.cgroups.run << " (controllers:" << (scheduler.cgroups.cpu ? " cpu" : "")
+                 << (scheduler.cgroups.memory ? " memory" : "") << (scheduler.cgroups.io ? " io" : "")
+                 << (scheduler.cgroups.cpu || scheduler.cgroups.memory || scheduler.cgroups.io ? "" : " none")
+                 << ")" << endl;
+        } else {
+            cerr << "Warning: " << error << "; jobs run without cgroups" << endl;
+            scheduler.use_cgroups = false;
+        }
+    }
+
+    const int MAX_EVENTS = 64;
+    struct epoll_event events[MAX_EVENTS];
+    while (!scheduler.pending.empty() || !scheduler.running.empty()) {
+        // Fill free slots. Under memory pressure wait for running jobs to
+        // finish, but never hold with nothing running.
+        long long hold_until = 0;
+        while (!scheduler.pending.empty() && (int)scheduler.running.size() < options.max_running) {
+            if (options.min_available_mb > 0 && !scheduler.running.empty()) {
+                long available = available_memory_mb();
+                if (available >= 0 && available < options.min_available_mb) {
+                    hold_until = monotonic_ns() + 100000000LL; // recheck memory
+                    break;
+                }
+            }
+            const Job* job = scheduler.pending.top();
+            scheduler.pending.pop();
+            launch_job(scheduler, job);
+        }
+        if (scheduler.running.empty()) {
+            continue;
+        }
+
+        long long wake = scheduler.timers.empty() ? 0 : scheduler.timers.begin()->first;
+        if (hold_until != 0 && (wake == 0 || hold_until < wake)) {
+            wake = hold_until;
+        }
+        monitor_arm(scheduler.monitor, wake);
+
+        int count = epoll_wait(scheduler.monitor.epoll_fd, events, MAX_EVENTS, -1);
+        if (count < 0 && errno != EINTR) {
+            cerr << "epoll_wait failed: " << strerror(errno) << endl;
+            break;
+        }
+        bool signalled = false;
+        for (int i = 0; i < count; ++i) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == TIMER_EVENT) {
+                uint64_t expirations;
+                if (read(scheduler.monitor.timer_fd, &expirations, sizeof(expirations)) > 0) {
+                    scheduler.monitor.armed_ns = 0;
+                }
+            } else if (tag == SIGNAL_EVENT) {
+                struct signalfd_siginfo info;
+                while (read(scheduler.monitor.signal_fd, &info, sizeof(info)) > 0) {
+                }
+                signalled = true;
+            } else {
+                reap_child(scheduler, (pid_t)tag);
+            }
+        }
+        if (signalled) {
+            reap_any(scheduler);
+        }
+        expire_timers(scheduler, monotonic_ns());
+    }
+    monitor_destroy(scheduler.monitor);
+    if (scheduler.use_cgroups) {
+        for (map<string, JobGroup>::iterator it = scheduler.groups.begin(); it != scheduler.groups.end(); ++it) {
+            close(it->second.procs_fd);
+            cgroup_remove(it->second.path);
+        }
+        cgroup_teardown(scheduler.cgroups);
+    }
+    return scheduler.totals;
+}
+
+// --- Main Program ---
+const char* DEFAULT_STATS_FILE = "logs/M2_process_stats.jsonl";
+
+void print_usage(const char* program) {
+    cerr << "Usage: " << program << " [options]\n"
+         << "  --jobs FILE          job list to run (default: " << DEFAULT_JOB_COUNT << " x " << DEFAULT_TASK << ")\n"
+         << "  --count N            number of default tasks when no job list is given\n"
+         << "  --max-running K      children allowed at once (default: number of CPUs with --jobs,\n"
+         << "                       all of them for the default tasks)\n"
+         << "  --timeout SEC        timeout for jobs that do not set one (default: none)\n"
+         << "  --kill-grace SEC     SIGTERM to SIGKILL delay for timed-out jobs (default 2)\n"
+         << "  --min-available MB   hold launches while available memory is below MB\n"
+         << "  --quiet              no per-child console output\n"
+         << "  --cgroup             put every job in a cgroup, even without limits\n"
+         << "  --cgroup-parent DIR  cgroup to create the run's groups in (default: our own)\n"
+         << "  --stats-file FILE    per-child resource usage as JSON lines (default " << DEFAULT_STATS_FILE << ")\n"
+         << "  --exit-records FILE  also append a binary record per child (M4_IPC/ipc_wire.h)\n"
+         << "  --log-flush-ms N     longest time a log line stays buffered (default "
+         << DEFAULT_LOGGER_OPTIONS.flush_interval_ms << ")\n"
+         << "  --log-buffer BYTES   log buffer size (default " << DEFAULT_LOGGER_OPTIONS.buffer_size << ")\n"
+         << "  --log-fsync POLICY   none, flush (after every batch) or close (default none)\n"
+         << "  --spawn BACKEND      fork, posix_spawn or vfork (default posix_spawn)\n"
+         << "  --child-stdout FILE  append the children's stdout to FILE\n"
+         << "  --child-stderr FILE  append the children's stderr to FILE" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    LoggerOptions log_options = DEFAULT_LOGGER_OPTIONS;
+    SchedulerOptions options;
+    options.max_running = 0; // set below once we know whether a job list is used
+    options.kill_grace_sec = 2.0;
+    options.min_available_mb = 0;
+    options.quiet = false;
+    options.cgroup_all = false;
+    options.spawn.backend = SPAWN_POSIX_SPAWN;
+    options.spawn.stdout_path = NULL;
+    options.spawn.stderr_path = NULL;
+    options.spawn.cgroup_fd = -1;
+    string job_file;
+    string stats_file = DEFAULT_STATS_FILE;
+    string exit_records_file;
+    int job_count = DEFAULT_JOB_COUNT;
+    double default_timeout = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--jobs" && i + 1 < argc) {
+            job_file = argv[++i];
+        } else if (arg == "--count" && i + 1 < argc) {
+            job_count = atoi(argv[++i]);
+        } else if (arg == "--max-running" && i + 1 < argc) {
+            options.max_running = atoi(argv[++i]);
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            default_timeout = atof(argv[++i]);
+        } else if (arg == "--kill-grace" && i + 1 < argc) {
+            options.kill_grace_sec = atof(argv[++i]);
+        } else if (arg == "--min-available" && i + 1 < argc) {
+            options.min_available_mb = atol(argv[++i]);
+        } else if (arg == "--stats-file" && i + 1 < argc) {
+            stats_file = argv[++i];
+        } else if (arg == "--exit-records" && i + 1 < argc) {
+            exit_records_file = argv[++i];
+        } else if (arg == "--cgroup") {
+            options.cgroup_all = true;
+        } else if (arg == "--cgroup-parent" && i + 1 < argc) {
+            options.cgroup_parent = argv[++i];
+        } else if (arg == "--quiet") {
+            options.quiet = true;
+        } else if (arg == "--log-flush-ms" && i + 1 < argc) {
+            log_options.flush_interval_ms = atoi(argv[++i]);
+            if (log_options.flush_interval_ms < 0) {
+                log_options.flush_interval_ms = 0;
+            }
+        } else if (arg == "--log-buffer" && i + 1 < argc) {
+            log_options.buffer_size = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--log-fsync" && i + 1 < argc) {
+            string policy = argv[++i];
+            if (policy == "none") {
+                log_options.sync = LOG_SYNC_NONE;
+            } else if (policy == "flush") {
+                log_options.sync = LOG_SYNC_FLUSH;
+            } else if (policy == "close") {
+                log_options.sync = LOG_SYNC_CLOSE;
+            } else {
+                cerr << "Unknown fsync policy: " << policy << endl;
+                return 1;
+            }
+        } else if (arg == "--spawn" && i + 1 < argc) {
+            if (!parse_spawn_backend(argv[++i], options.spawn.backend)) {
+                cerr << "Unknown spawn backend: " << argv[i] << endl;
+                return 1;
+            }
+        } else if (arg == "--child-stdout" && i + 1 < argc) {
+            options.spawn.stdout_path = argv[++i];
+        } else if (arg == "--child-stderr" && i + 1 < argc) {
+            options.spawn.stderr_path = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (default_timeout < 0) {
+        default_timeout = 0;
+    }
+
+    vector<Job> jobs;
+    if (!job_file.empty()) {
+        if (!load_jobs(job_file, default_timeout, jobs)) {
+            return 1;
+        }
+    } else {
+        for (int i = 0; i < job_count; ++i) {
+            Job job;
+            job.id = i + 1;
+            job.name = DEFAULT_TASK;
+            job.priority = 0;
+            job.timeout_sec = default_timeout;
+            memset(&job.limits, 0, sizeof(job.limits));
+            job.argv.push_back(DEFAULT_TASK);
+            jobs.push_back(job);
+        }
+    }
+    // The default tasks all run at once, as they always have; a job list
+    // is throttled to the CPU count unless told otherwise
+    if (options.max_running == 0) {
+        options.max_running =
+            job_file.empty() ? max((int)jobs.size(), 1) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (options.max_running < 1) {
+        options.max_running = 1;
+    }
+
+    // Block SIGCHLD before any thread starts: without pidfds the scheduler
+    // reads it from a signalfd, and no thread may take it first
+    sigset_t child_signal;
+    sigemptyset(&child_signal);
+    sigaddset(&child_signal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &child_signal, NULL);
+
+    if (!logger_open(process_log, "logs/M2_process_log.txt", log_options)) {
+        cerr << "Warning: cannot open logs/M2_process_log.txt: " << strerror(errno) << endl;
+    }
+    if (!logger_open(stats_log, stats_file.c_str(), log_options)) {
+        cerr << "Warning: cannot open " << stats_file << ": " << strerror(errno) << endl;
+    }
+    if (!exit_records_file.empty() && !logger_open(exit_records, exit_records_file.c_str(), log_options)) {
+        cerr << "Warning: cannot open " << exit_records_file << ": " << strerror(errno) << endl;
+    }
+
+    cout << "--- Linux System Guardian: Process Manager Mini-Simulator ---" << endl;
+    log_process("\n--- New Simulation Start ---");
+    cout << "Spawn backend: " << spawn_backend_name(options.spawn.backend) << endl;
+    cout << "Running " << jobs.size() << " jobs, at most " << options.max_running << " at a time." << endl;
+
+    long long start_ns = monotonic_ns();
+    SchedulerTotals totals = run_jobs(jobs, options);
+    double elapsed = (monotonic_ns() - start_ns) / 1e9;
+
+    logger_close(process_log);
 
     cout << "\nParent (PID: " << getpid() << ") finished managing all processes." << endl;
+    cout << "Jobs: " << totals.started << " run in " << elapsed << "s (peak " << totals.peak_running
+         << " at once), " << totals.succeeded << " succeeded, " << totals.failed << " failed, "
+         << totals.abnormal << " killed, " << totals.timed_out << " timed out, "
+         << totals.spawn_failed << " could not start." << endl;
+    report_usage(totals.usage);
+    logger_close(stats_log);
+    logger_close(exit_records);
     cout << "Module 2 demonstration complete. Check M2_process_log.txt." << endl;
-    return 0;
-}
\ No newline at end of file
+    return totals.spawn_failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+#ifndef PROCESS_SPAWN_H
+#define PROCESS_SPAWN_H
+
+// Child launch backends for the process manager.
+//
+// fork() copies the parent's page tables, so its cost grows with the
+// supervisor's memory. posix_spawn() and clone(CLONE_VM | CLONE_VFORK) run
+// the child on the parent's address space until it execs, which keeps launch
+// latency flat. The child's stdout and stderr can be redirected to files
+// (opened for append) by every backend, and every child starts with an empty
+// signal mask whatever the supervisor blocks. A child can also be placed in
+// a cgroup before it execs; glibc's posix_spawn() has no way to do that, so
+// such launches go through the vfork backend.
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+enum SpawnBackend { SPAWN_FORK, SPAWN_POSIX_SPAWN, SPAWN_VFORK };
+
+struct SpawnOptions {
+    SpawnBackend backend;
+    const char* stdout_path; // NULL keeps the parent's stdout
+    const char* stderr_path;
+    int cgroup_fd;           // open cgroup.procs to join before exec, or -1
+};
+
+inline const char* spawn_backend_name(SpawnBackend backend) {
+    switch (backend) {
+        case SPAWN_FORK: return "fork";
+        case SPAWN_POSIX_SPAWN: return "posix_spawn";
+        case SPAWN_VFORK: return "vfork";
+    }
+    return "?";
+}
+
+inline bool parse_spawn_backend(const char* name, SpawnBackend& backend) {
+    if (strcmp(name, "fork") == 0) {
+        backend = SPAWN_FORK;
+    } else if (strcmp(name, "posix_spawn") == 0 || strcmp(name, "spawn") == 0) {
+        backend = SPAWN_POSIX_SPAWN;
+    } else if (strcmp(name, "vfork") == 0 || strcmp(name, "clone") == 0) {
+        backend = SPAWN_VFORK;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// --- Child side (fork and vfork backends) ---
+// Only async-signal-safe calls: under vfork the child shares our memory.
+inline int spawn_redirect(const char* path, int target) {
+    if (path == NULL) {
+        return 0;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return errno;
+    }
+    if (fd != target) {
+        if (dup2(fd, target) < 0) {
+            return errno;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+struct SpawnChild {
+    const SpawnOptions* options;
+    char* const* argv;
+    volatile int error;    // set by a vfork child that failed to exec
+};
+
+inline int spawn_child_main(void* arg) {
+    SpawnChild& child = *(SpawnChild*)arg;
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+    int error = 0;
+    if (child.options->cgroup_fd >= 0 && write(child.options->cgroup_fd, "0", 1) != 1) {
+        error = errno;
+    }
+    if (error == 0) {
+        error = spawn_redirect(child.options->stdout_path, STDOUT_FILENO);
+    }
+    if (error == 0) {
+        error = spawn_redirect(child.options->stderr_path, STDERR_FILENO);
+    }
+    if (error == 0) {
+        execv(child.argv[0], child.argv);
+        error = errno;
+    }
+    child.error = error;
+    _exit(127);
+}
+
+// --- Launch ---
+// Returns the child's PID, or -1 with errno set when the child could not be
+// created. Exec failures are reported the same way by posix_spawn and vfork;
+// a fork child that fails to exec exits with status 127 instead.
+inline pid_t spawn_process(const SpawnOptions& options, char* const argv[]) {
+    if (options.backend == SPAWN_POSIX_SPAWN && options.cgroup_fd < 0) {
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        if (options.stdout_path != NULL) {
+            posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, options.stdout_path,
+                                             O_WRONLY | O_CREAT | O_APPEND, 0644);
+        }
+        if (options.stderr_path != NULL) {
+            posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, options.stderr_path,
+                                             O_WRONLY | O_CREAT | O_APPEND, 0644);
+        }
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        sigset_t empty;
+        sigemptyset(&empty);
+        posix_spawnattr_setsigmask(&attr, &empty);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+        pid_t pid;
+        int error = posix_spawn(&pid, argv[0], &actions, &attr, argv, environ);
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&actions);
+        if (error != 0) {
+            errno = error;
+            return -1;
+        }
+        return pid;
+    }
+
+    SpawnChild child = {&options, argv, 0};
+
+    if (options.backend == SPAWN_FORK) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            spawn_child_main(&child);
+        }
+        return pid;
+    }
+
+    // vfork: the child runs on a per-thread stack in our memory, and we are
+    // suspended until it execs or exits. Signals stay blocked until
+    // the child clears its mask so no handler of ours runs on its stack.
+    alignas(16) static thread_local char stack[64 << 10];
+    sigset_t all, original;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &original);
+    pid_t pid = clone(spawn_child_main, stack + sizeof(stack), CLONE_VM | CLONE_VFORK | SIGCHLD, &child);
+    int clone_error = errno;
+    pthread_sigmask(SIG_SETMASK, &original, NULL);
+    if (pid < 0) {
+        errno = clone_error;
+        return -1;
+    }
+    if (child.error != 0) {
+        // The child has exited; collect it so it does not linger as a zombie
+        int status;
+        waitpid(pid, &status, 0);
+        errno = child.error;
+        return -1;
+    }
+    return pid;
+}
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef AHO_CORASICK_H
+#define AHO_CORASICK_H
+
+// Multi-pattern term counting for the file analyzer.
+//
+// All search terms are compiled into one Aho-Corasick automaton stored as a
+// dense transition table, so a chunk is scanned once whatever the number of
+// terms. Like the single-term kernels it counts words, not occurrences: a
+// term counts once for every whitespace-delimited word that contains it.
+// Every whitespace byte moves the automaton to a boundary state that starts
+// a new word, so matches never span words.
+//
+// Bytes are first mapped to classes (one per byte that occurs in a term, one
+// for whitespace, one for everything else) to keep the table small enough to
+// stay in cache. Table entries hold the target row offset shifted left by
+// one, with the low bit set for states that complete a term, so the hot loop
+// does one dependent load per byte and branches only on matches.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "scan_kernels.h"
+
+struct TermAutomaton {
+    size_t pattern_count;
+    size_t class_count;
+    uint8_t byte_class[256];
+    std::vector<uint32_t> next;      // (state * class_count + class) -> tagged row offset
+    std::vector<uint32_t> out_start; // outputs of state s are out_ids[out_start[s] .. out_start[s + 1])
+    std::vector<uint32_t> out_ids;
+    std::vector<size_t> empty_ids;   // "" is contained in every word
+    size_t state_count;
+};
+
+const uint32_t AC_ROOT = 0;
+const uint32_t AC_BOUNDARY_STATE = 1;
+const uint8_t AC_CLASS_OTHER = 0;
+const uint8_t AC_CLASS_SPACE = 1;
+
+inline void build_term_automaton(TermAutomaton& ac, const std::vector<std::string>& patterns) {
+    ac.pattern_count = patterns.size();
+    ac.empty_ids.clear();
+
+    // Terms with whitespace can never match a word; their count stays 0
+    std::vector<bool> usable(patterns.size(), false);
+    for (size_t id = 0; id < patterns.size(); ++id) {
+        const std::string& pattern = patterns[id];
+        if (pattern.empty()) {
+            ac.empty_ids.push_back(id);
+            continue;
+        }
+        usable[id] = true;
+        for (size_t i = 0; i < pattern.length(); ++i) {
+            if (is_space_byte((unsigned char)pattern[i])) {
+                usable[id] = false;
+            }
+        }
+    }
+
+    // Byte classes
+    ac.class_count = 2;
+    for (int c = 0; c < 256; ++c) {
+        ac.byte_class[c] = is_space_byte((unsigned char)c) ? AC_CLASS_SPACE : AC_CLASS_OTHER;
+    }
+    for (size_t id = 0; id < patterns.size(); ++id) {
+        for (size_t i = 0; usable[id] && i < patterns[id].length(); ++i) {
+            unsigned char c = (unsigned char)patterns[id][i];
+            if (ac.byte_class[c] == AC_CLASS_OTHER) {
+                ac.byte_class[c] = (uint8_t)ac.class_count++;
+            }
+        }
+    }
+    const size_t width = ac.class_count;
+
+    // Trie over state numbers; 0 marks a missing edge (the root is never a child)
+    std::vector<std::vector<uint32_t> > outputs(2);
+    std::vector<uint32_t> edges(2 * width, 0);
+    for (size_t id = 0; id < patterns.size(); ++id) {
+        if (!usable[id]) {
+            continue;
+        }
+        uint32_t state = AC_ROOT;
+        for (size_t i = 0; i < patterns[id].length(); ++i) {
+            size_t cls = ac.byte_class[(unsigned char)patterns[id][i]];
+            if (edges[state * width + cls] == 0) {
+                edges[state * width + cls] = (uint32_t)outputs.size();
+                outputs.push_back(std::vector<uint32_t>());
+                edges.resize(outputs.size() * width, 0);
+            }
+            state = edges[state * width + cls];
+        }
+        outputs[state].push_back((uint32_t)id);
+    }
+
+    // Breadth-first fill of failure transitions turns the trie into a DFA.
+    // A state's outputs include those of its failure state.
+    const size_t states = outputs.size();
+    std::vector<uint32_t> failure(states, AC_ROOT);
+    std::vector<uint32_t> queue;
+    for (size_t cls = 0; cls < width; ++cls) {
+        if (edges[AC_ROOT * width + cls] != 0) {
+            queue.push_back(edges[AC_ROOT * width + cls]);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t state = queue[head];
+        const std::vector<uint32_t>& inherited = outputs[failure[state]];
+        outputs[state].insert(outputs[state].end(), inherited.begin(), inherited.end());
+        for (size_t cls = 0; cls < width; ++cls) {
+            uint32_t& edge = edges[state * width + cls];
+            uint32_t fallback = edges[failure[state] * width + cls];
+            if (edge == 0) {
+                edge = fallback;
+            } else {
+                failure[edge] = fallback;
+                queue.push_back(edge);
+            }
+        }
+    }
+
+    // Whitespace ends the word from every state; the boundary state then
+    // behaves exactly like the root
+    for (size_t cls = 0; cls < width; ++cls) {
+        edges[AC_BOUNDARY_STATE * width + cls] = edges[AC_ROOT * width + cls];
+    }
+    for (size_t state = 0; state < states; ++state) {
+        edges[state * width + AC_CLASS_SPACE] = AC_BOUNDARY_STATE;
+    }
+
+    // Flatten outputs and tag the transitions into states that need handling
+    ac.state_count = states;
+    ac.out_start.assign(states + 1, 0);
+    ac.out_ids.clear();
+    for (size_t state = 0; state < states; ++state) {
+        ac.out_start[state] = (uint32_t)ac.out_ids.size();
+        ac.out_ids.insert(ac.out_ids.end(), outputs[state].begin(), outputs[state].end());
+    }
+    ac.out_start[states] = (uint32_t)ac.out_ids.size();
+
+    ac.next.assign(states * width, 0);
+    for (size_t i = 0; i < edges.size(); ++i) {
+        uint32_t target = edges[i];
+        ac.next[i] = ((target * (uint32_t)width) << 1) | (outputs[target].empty() ? 0 : 1);
+    }
+}
+
+// Add, for each term, the number of words in the block that contain it. The
+// block must start at a word boundary; word_count comes from the scan kernel
+// and only feeds the empty term. last_word is scratch space, one entry per term.
+inline void count_terms(const TermAutomaton& ac, const char* data, size_t length, long word_count,
+                        long* counts, std::vector<size_t>& last_word) {
+    const unsigned char* p = (const unsigned char*)data;
+    const uint32_t* next = ac.next.data();
+    const uint8_t* byte_class = ac.byte_class;
+    const uint32_t width = (uint32_t)ac.class_count;
+    last_word.assign(ac.pattern_count, 0);
+
+    // Word ids only need to differ between words, so every whitespace byte
+    // simply opens a new one (without a branch)
+    size_t word = 1;
+    uint32_t entry = AC_ROOT;
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t cls = byte_class[p[i]];
+        word += (cls == AC_CLASS_SPACE);
+        entry = next[(entry >> 1) + cls];
+        if ((entry & 1) == 0) {
+            continue;
+        }
+        uint32_t state = (entry >> 1) / width;
+        for (uint32_t o = ac.out_start[state]; o < ac.out_start[state + 1]; ++o) {
+            uint32_t id = ac.out_ids[o];
+            if (last_word[id] != word) {
+                last_word[id] = word;
+                counts[id]++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < ac.empty_ids.size(); ++i) {
+        counts[ac.empty_ids[i]] += word_count;
+    }
+}
+
+#endif
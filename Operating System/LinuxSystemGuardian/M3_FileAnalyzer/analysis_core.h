@@ -0,0 +1,227 @@
+#ifndef ANALYSIS_CORE_H
+#define ANALYSIS_CORE_H
+
+// The analyzer's counting core, shared by the analyzer and the guardian.
+//
+// A TermScanner holds the search term tables and the kernel chosen for this
+// CPU. A single term is matched inside the scan kernel; with several terms
+// the kernel only counts lines and words and the automaton counts the terms.
+// It is read-only once prepared, so any number of threads can scan with it.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "scan_kernels.h"
+#include "aho_corasick.h"
+#include "../M4_IPC/ipc_wire.h"
+
+struct AnalysisResults {
+    long total_chars;
+    long total_lines;
+    long total_words;
+    std::vector<long> term_occurrences; // one count per search term
+};
+
+inline void reset_results(AnalysisResults& results, size_t term_count) {
+    results.total_chars = 0;
+    results.total_lines = 0;
+    results.total_words = 0;
+    results.term_occurrences.assign(term_count, 0);
+}
+
+inline void add_results(AnalysisResults& total, const AnalysisResults& part) {
+    total.total_chars += part.total_chars;
+    total.total_lines += part.total_lines;
+    total.total_words += part.total_words;
+    for (size_t i = 0; i < part.term_occurrences.size(); ++i) {
+        total.term_occurrences[i] += part.term_occurrences[i];
+    }
+}
+
+inline void subtract_results(AnalysisResults& total, const AnalysisResults& part) {
+    total.total_chars -= part.total_chars;
+    total.total_lines -= part.total_lines;
+    total.total_words -= part.total_words;
+    for (size_t i = 0; i < part.term_occurrences.size(); ++i) {
+        total.term_occurrences[i] -= part.term_occurrences[i];
+    }
+}
+
+// --- Term Scanner ---
+
+struct TermScanner {
+    std::vector<std::string> terms;
+    ScanTerm term;
+    TermAutomaton automaton;
+    bool use_automaton = false;
+    ScanKernel kernel = KERNEL_SCALAR;
+};
+
+inline void prepare_term_scanner(TermScanner& scanner, const std::vector<std::string>& terms, ScanKernel kernel) {
+    scanner.terms = terms;
+    scanner.kernel = kernel;
+    scanner.use_automaton = terms.size() > 1;
+    if (scanner.use_automaton) {
+        scanner.term = make_word_count_term();
+        build_term_automaton(scanner.automaton, terms);
+    } else {
+        scanner.term = make_scan_term(terms[0]);
+    }
+}
+
+// Counts one chunk into totals. The chunk must start at a word boundary; its
+// characters are its bytes and its lines are its newlines. Together with
+// count_unterminated_line() on the whole input this produces the same numbers
+// as reading the text with getline() and then operator>> per word: every line
+// counts its length plus one for the newline, and a word counts once towards
+// a term however many times it contains that term.
+inline void scan_section(const TermScanner& scanner, const char* data, size_t length, AnalysisResults& totals,
+                         std::vector<size_t>& scratch) {
+    ScanCounts scanned = scan_text(scanner.kernel, data, length, scanner.term);
+
+    totals.total_chars += length;
+    totals.total_lines += scanned.lines;
+    totals.total_words += scanned.words;
+    if (scanner.use_automaton) {
+        count_terms(scanner.automaton, data, length, scanned.words, totals.term_occurrences.data(), scratch);
+    } else {
+        totals.term_occurrences[0] += scanned.term_hits;
+    }
+}
+
+// A trailing line without a newline still counts as a line of length + 1
+inline void count_unterminated_line(AnalysisResults& totals, size_t input_length, char last_byte) {
+    if (input_length > 0 && last_byte != '\n') {
+        totals.total_chars++;
+        totals.total_lines++;
+    }
+}
+
+const size_t ANALYZE_CHUNK_SIZE = 1 << 20; // read size; one longer token grows the buffer
+
+// Open path for counting. It is opened non-blocking and anything but a
+// regular file is refused before a read, so a FIFO or device never holds
+// the caller. Returns the descriptor with st filled in, or -1 with errno
+// (EINVAL if it is not a regular file).
+inline int open_regular_file(const char* path, struct stat& st) {
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    int stat_result = fstat(fd, &st);
+    if (stat_result < 0 || !S_ISREG(st.st_mode)) {
+        int error = stat_result < 0 ? errno : EINVAL;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+// Count a whole uncompressed file, opened with open_regular_file(), into
+// results (reset first), in one pass on the calling thread. It is read into
+// a per-thread buffer in chunks cut after the last whitespace, as the
+// analyzer's stream reader does; nothing is mapped, so a file truncated
+// meanwhile (copytruncate) just counts the bytes that were still there. At
+// most st.st_size bytes are read, so the counts match that identity. The
+// descriptor is left open. Returns false with errno if a read fails.
+inline bool analyze_fd(const TermScanner& scanner, int fd, const struct stat& st, AnalysisResults& results,
+                       std::vector<size_t>& scratch) {
+    reset_results(results, scanner.terms.size());
+    static thread_local std::vector<char> buffer;
+    if (buffer.size() < ANALYZE_CHUNK_SIZE) {
+        buffer.resize(ANALYZE_CHUNK_SIZE);
+    }
+    size_t remaining = (size_t)st.st_size, used = 0, total = 0;
+    char last_byte = '\n';
+    bool eof = remaining == 0;
+    while (!eof) {
+        while (used < buffer.size() && remaining > 0) {
+            ssize_t n = read(fd, buffer.data() + used, std::min(buffer.size() - used, remaining));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                return false;
+            }
+            if (n == 0) {
+                break; // truncated since fstat(): count what is there
+            }
+            used += (size_t)n;
+            remaining -= (size_t)n;
+        }
+        eof = used < buffer.size();
+        size_t cut = used;
+        if (!eof) {
+            while (cut > 0 && !is_space_byte((unsigned char)buffer[cut - 1])) {
+                cut--;
+            }
+            if (cut == 0) {
+                buffer.resize(buffer.size() * 2); // one unbroken token fills the buffer
+                continue;
+            }
+        }
+        if (cut > 0) {
+            scan_section(scanner, buffer.data(), cut, results, scratch);
+            last_byte = buffer[cut - 1];
+            total += cut;
+        }
+        memmove(buffer.data(), buffer.data() + cut, used - cut);
+        used -= cut;
+    }
+    count_unterminated_line(results, total, last_byte);
+    return true;
+}
+
+// open_regular_file() and analyze_fd() in one. Returns false with errno;
+// on success info, if given, holds the identity that was counted.
+inline bool analyze_file(const TermScanner& scanner, const char* path, AnalysisResults& results,
+                         std::vector<size_t>& scratch, struct stat* info = NULL) {
+    reset_results(results, scanner.terms.size());
+    struct stat st;
+    int fd = open_regular_file(path, st);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = analyze_fd(scanner, fd, st, results, scratch);
+    int error = errno;
+    close(fd);
+    if (info != NULL) {
+        *info = st;
+    }
+    errno = error;
+    return ok;
+}
+
+// Encode results as one WIRE_ANALYSIS record. fixed carries the run fields
+// (input bytes, time, threads, files); the counts, terms and path are filled
+// in here. Returns the record's size, 0 if it could not be encoded.
+inline size_t encode_results_record(std::vector<char>& record, const AnalysisResults& results,
+                                    const std::vector<std::string>& terms, wire_analysis fixed, const char* input) {
+    fixed.total_chars = results.total_chars;
+    fixed.total_lines = results.total_lines;
+    fixed.total_words = results.total_words;
+    fixed.term_count = terms.size();
+    fixed.path_length = std::min(strlen(input), (size_t)UINT16_MAX);
+
+    std::vector<uint64_t> counts(results.term_occurrences.begin(), results.term_occurrences.end());
+    std::vector<const char*> term_data;
+    std::vector<size_t> term_lengths;
+    size_t capacity = sizeof(wire_header) + sizeof(fixed) + counts.size() * sizeof(uint64_t) + fixed.path_length;
+    for (const std::string& term : terms) {
+        term_data.push_back(term.data());
+        term_lengths.push_back(term.size());
+        capacity += sizeof(uint16_t) + term.size();
+    }
+    record.resize(capacity);
+    return wire_encode_analysis(record.data(), record.size(), &fixed, counts.data(), input, term_data.data(),
+                                term_lengths.data());
+}
+
+#endif
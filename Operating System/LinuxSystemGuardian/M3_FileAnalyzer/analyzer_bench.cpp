@@ -0,0 +1,441 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <cerrno>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// Benchmark harness for the Module 3 analyzer: generates a synthetic corpus,
+// runs analyzer_exe on it across thread counts and input modes, and reports
+// throughput, wall-time percentiles and peak RSS as JSON. Every run is also
+// checked against the counts the generator knows the corpus holds.
+
+// --- Corpus Generator ---
+
+struct CorpusSpec {
+    size_t size;          // total bytes to write
+    size_t line_length;   // average line length in bytes
+    double term_density;  // fraction of words that are the search term
+    string term;
+    uint64_t seed;
+};
+
+struct CorpusCounts {
+    long chars;
+    long lines;
+    long words;
+    long term_words;      // words containing the term, what the analyzer counts
+};
+
+// Filler vocabulary; the generator still checks every word for the term
+const char* FILLER_WORDS[] = {
+    "the", "kernel", "process", "memory", "page", "cache", "signal", "queue",
+    "scheduler", "file", "buffer", "socket", "mutex", "lock", "core", "task",
+    "system", "guardian", "analyzer", "monitor", "device", "driver", "block",
+    "inode", "mount", "proc", "sys", "log", "event", "timer", "user", "group"
+};
+const size_t FILLER_COUNT = sizeof(FILLER_WORDS) / sizeof(FILLER_WORDS[0]);
+
+// xorshift64*: fast and reproducible for a given seed
+uint64_t next_random(uint64_t& state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+bool generate_corpus(const string& path, const CorpusSpec& spec, CorpusCounts& counts) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    uint64_t state = spec.seed != 0 ? spec.seed : 1;
+    uint64_t term_threshold = (uint64_t)(spec.term_density * 4294967296.0);
+    vector<char> block;
+    block.reserve((1 << 20) + 256);
+    counts.chars = counts.lines = counts.words = counts.term_words = 0;
+
+    size_t written = 0;
+    size_t line_used = 0;
+    size_t line_target = spec.line_length;
+    bool ok = true;
+    while (ok && written + block.size() < spec.size) {
+        const char* word = FILLER_WORDS[next_random(state) % FILLER_COUNT];
+        size_t word_length = strlen(word);
+        if ((next_random(state) >> 32) < term_threshold) {
+            word = spec.term.c_str();
+            word_length = spec.term.length();
+        }
+
+        // The final line is cut short rather than overshooting the size, and
+        // one byte is always left for the closing newline
+        size_t remaining = spec.size - written - block.size();
+        if (word_length + 2 > remaining) {
+            break;
+        }
+        block.insert(block.end(), word, word + word_length);
+        counts.words++;
+        if (string(word, word_length).find(spec.term) != string::npos) {
+            counts.term_words++;
+        }
+        line_used += word_length + 1;
+
+        // Lines vary between half and one and a half times the average length
+        if (line_used >= line_target) {
+            block.push_back('\n');
+            counts.lines++;
+            line_used = 0;
+            line_target = spec.line_length / 2 + next_random(state) % (spec.line_length + 1);
+        } else {
+            block.push_back(' ');
+        }
+
+        if (block.size() >= (1 << 20)) {
+            ok = write(fd, block.data(), block.size()) == (ssize_t)block.size();
+            written += block.size();
+            block.clear();
+        }
+    }
+    // Pad with newlines up to the exact size; the file always ends in one
+    while (ok && written + block.size() < spec.size) {
+        block.push_back('\n');
+        counts.lines++;
+    }
+    if (ok && !block.empty()) {
+        ok = write(fd, block.data(), block.size()) == (ssize_t)block.size();
+        written += block.size();
+    }
+    counts.chars = written;
+    close(fd);
+    return ok;
+}
+
+// --- Benchmark Runner ---
+
+struct RunResult {
+    double wall_seconds;
+    long peak_rss_kb;
+    bool ok;              // exited 0 with the expected counts
+};
+
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Pull "Label: N" out of the analyzer's report
+long report_value(const string& output, const string& label) {
+    size_t pos = output.rfind(label);
+    if (pos == string::npos) {
+        return -1;
+    }
+    return atol(output.c_str() + pos + label.length());
+}
+
+RunResult run_analyzer(const string& analyzer, const vector<string>& args, const CorpusCounts& expected,
+                       const string& term) {
+    RunResult result = {0.0, 0, false};
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        return result;
+    }
+
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return result;
+    } else if (pid == 0) {
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        vector<char*> argv;
+        argv.push_back((char*)analyzer.c_str());
+        for (size_t i = 0; i < args.size(); ++i) {
+            argv.push_back((char*)args[i].c_str());
+        }
+        argv.push_back((char*)0);
+        execv(argv[0], argv.data());
+        cerr << "Exec failed for " << analyzer << endl;
+        _exit(127);
+    }
+
+    close(pipe_fds[1]);
+    string output;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = read(pipe_fds[0], chunk, sizeof(chunk))) != 0) {
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            break;
+        }
+        output.append(chunk, n);
+    }
+    close(pipe_fds[0]);
+
+    int status;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {
+    }
+    result.wall_seconds = now_seconds() - start;
+    result.peak_rss_kb = usage.ru_maxrss;
+    result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+                report_value(output, "Total Characters: ") == expected.chars &&
+                report_value(output, "Total Lines:      ") == expected.lines &&
+                report_value(output, "Total Words:      ") == expected.words &&
+                report_value(output, "Term ('" + term + "') Occurrences: ") == expected.term_words;
+    return result;
+}
+
+// Nearest-rank percentile of a sorted sample
+double percentile(const vector<double>& sorted, double p) {
+    size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+    rank = min(max(rank, (size_t)1), sorted.size());
+    return sorted[rank - 1];
+}
+
+// --- JSON Output ---
+
+string json_string(const string& text) {
+    string out = "\"";
+    for (size_t i = 0; i < text.length(); ++i) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// --- Main Program ---
+
+bool parse_size(const char* text, size_t& size) {
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) {
+        return false;
+    }
+    switch (toupper(*end)) {
+        case 'G': value <<= 10; // fall through
+        case 'M': value <<= 10; // fall through
+        case 'K': value <<= 10; ++end; break;
+        default: break;
+    }
+    size = value;
+    return *end == '\0' && value > 0;
+}
+
+bool parse_list(const string& text, vector<string>& items) {
+    items.clear();
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return !items.empty();
+}
+
+void print_usage(const char* program) {
+    cerr << "Usage: " << program << " [--analyzer PATH] [--size SIZE] [--line-length N] [--term-density F]"
+         << " [--term WORD] [--seed N] [--threads 1,2,4] [--modes read,mmap,stream,async] [--repeat N]"
+         << " [--corpus PATH] [--keep-corpus] [--output FILE]" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    CorpusSpec spec = {64 << 20, 80, 0.01, "threads", 1};
+    string analyzer;
+    string corpus_path;
+    string output_path;
+    bool keep_corpus = false;
+    int repeat = 5;
+    vector<string> modes;
+    vector<string> thread_counts;
+    parse_list("read,mmap,stream", modes);
+
+    // Default thread counts: powers of two up to the CPU count, and the count itself
+    unsigned cpus = max(1u, thread::hardware_concurrency());
+    for (unsigned t = 1; t < cpus; t *= 2) {
+        thread_counts.push_back(to_string(t));
+    }
+    thread_counts.push_back(to_string(cpus));
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--analyzer") == 0 && has_value) {
+            analyzer = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && has_value) {
+            if (!parse_size(argv[++i], spec.size)) {
+                cerr << "Error: --size needs a size such as 256M or 1G" << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--line-length") == 0 && has_value) {
+            spec.line_length = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--term-density") == 0 && has_value) {
+            spec.term_density = atof(argv[++i]);
+            if (spec.term_density < 0.0 || spec.term_density > 1.0) {
+                cerr << "Error: --term-density must be between 0 and 1" << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--term") == 0 && has_value) {
+            spec.term = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+            spec.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+            parse_list(argv[++i], thread_counts);
+        } else if (strcmp(argv[i], "--modes") == 0 && has_value) {
+            parse_list(argv[++i], modes);
+        } else if (strcmp(argv[i], "--repeat") == 0 && has_value) {
+            repeat = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--corpus") == 0 && has_value) {
+            corpus_path = argv[++i];
+        } else if (strcmp(argv[i], "--keep-corpus") == 0) {
+            keep_corpus = true;
+        } else if (strcmp(argv[i], "--output") == 0 && has_value) {
+            output_path = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < modes.size(); ++i) {
+        if (modes[i] != "read" && modes[i] != "mmap" && modes[i] != "stream" && modes[i] != "async") {
+            cerr << "Error: unknown input mode " << modes[i] << endl;
+            return 1;
+        }
+    }
+    if (spec.term.empty()) {
+        cerr << "Error: --term needs a non-empty word" << endl;
+        return 1;
+    }
+    for (size_t i = 0; i < spec.term.length(); ++i) {
+        if (isspace((unsigned char)spec.term[i])) {
+            cerr << "Error: --term must be a single word" << endl;
+            return 1;
+        }
+    }
+
+    // By default the analyzer is the analyzer_exe built next to this program
+    if (analyzer.empty()) {
+        string self = argv[0];
+        size_t slash = self.rfind('/');
+        analyzer = (slash == string::npos ? string(".") : self.substr(0, slash)) + "/analyzer_exe";
+    }
+    if (access(analyzer.c_str(), X_OK) != 0) {
+        cerr << "Error: analyzer " << analyzer << " is not executable (use --analyzer)" << endl;
+        return 1;
+    }
+
+    bool temporary_corpus = corpus_path.empty();
+    if (temporary_corpus) {
+        const char* tmp = getenv("TMPDIR");
+        corpus_path = string(tmp != NULL ? tmp : "/tmp") + "/m3_bench_corpus_" + to_string(getpid()) + ".txt";
+    }
+    cerr << "Generating " << spec.size << " byte corpus at " << corpus_path << "..." << endl;
+    CorpusCounts counts;
+    double generate_start = now_seconds();
+    if (!generate_corpus(corpus_path, spec, counts)) {
+        cerr << "Error: could not write corpus " << corpus_path << endl;
+        return 1;
+    }
+    double generate_seconds = now_seconds() - generate_start;
+
+    ostringstream json;
+    json.precision(6);
+    json << fixed;
+    json << "{\n"
+         << "  \"analyzer\": " << json_string(analyzer) << ",\n"
+         << "  \"repeat\": " << repeat << ",\n"
+         << "  \"corpus\": {\"path\": " << json_string(corpus_path) << ", \"bytes\": " << counts.chars
+         << ", \"lines\": " << counts.lines << ", \"words\": " << counts.words
+         << ", \"term\": " << json_string(spec.term) << ", \"term_words\": " << counts.term_words
+         << ", \"line_length\": " << spec.line_length << ", \"term_density\": " << spec.term_density
+         << ", \"seed\": " << spec.seed << ", \"generate_seconds\": " << generate_seconds << "},\n"
+         << "  \"runs\": [";
+
+    bool all_ok = true;
+    bool first = true;
+    for (size_t m = 0; m < modes.size(); ++m) {
+        for (size_t t = 0; t < thread_counts.size(); ++t) {
+            vector<string> args;
+            args.push_back("--" + modes[m]);
+            args.push_back("--threads");
+            args.push_back(thread_counts[t]);
+            args.push_back("--term");
+            args.push_back(spec.term);
+            args.push_back(corpus_path);
+
+            // One untimed warm-up run so every configuration sees a hot page cache
+            run_analyzer(analyzer, args, counts, spec.term);
+            vector<double> walls;
+            long peak_rss_kb = 0;
+            bool ok = true;
+            for (int r = 0; r < repeat; ++r) {
+                RunResult run = run_analyzer(analyzer, args, counts, spec.term);
+                walls.push_back(run.wall_seconds);
+                peak_rss_kb = max(peak_rss_kb, run.peak_rss_kb);
+                ok = ok && run.ok;
+            }
+            sort(walls.begin(), walls.end());
+            double p50 = percentile(walls, 50);
+            all_ok = all_ok && ok;
+            cerr << modes[m] << " x" << thread_counts[t] << ": p50 " << p50 << " s"
+                 << (ok ? "" : " (WRONG RESULTS)") << endl;
+
+            json << (first ? "\n" : ",\n")
+                 << "    {\"mode\": " << json_string(modes[m]) << ", \"threads\": " << atoi(thread_counts[t].c_str())
+                 << ", \"wall_min_s\": " << walls.front() << ", \"wall_p50_s\": " << p50
+                 << ", \"wall_p99_s\": " << percentile(walls, 99) << ", \"wall_max_s\": " << walls.back()
+                 << ", \"throughput_gb_s\": " << (p50 > 0 ? counts.chars / p50 / 1e9 : 0.0)
+                 << ", \"peak_rss_kb\": " << peak_rss_kb << ", \"correct\": " << (ok ? "true" : "false") << "}";
+            first = false;
+        }
+    }
+    json << "\n  ]\n}\n";
+
+    if (temporary_corpus && !keep_corpus) {
+        unlink(corpus_path.c_str());
+    }
+
+    if (output_path.empty()) {
+        cout << json.str();
+    } else {
+        ofstream out(output_path.c_str());
+        out << json.str();
+        if (!out) {
+            cerr << "Error: could not write " << output_path << endl;
+            return 1;
+        }
+        cerr << "Results written to " << output_path << endl;
+    }
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,306 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+// Asynchronous positional reads for the file analyzer.
+//
+// The reader keeps several chunk reads in flight so the disk stays busy
+// while workers scan earlier chunks. On Linux the reads go through io_uring,
+// driven by raw syscalls so no liburing is needed. Where io_uring is missing
+// or blocked (old kernels, seccomp filters) a small pool of threads issues
+// plain pread() calls instead. Either way requests carry a caller tag and
+// completions may come back in any order.
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define ASYNC_HAVE_URING 1
+#else
+#define ASYNC_HAVE_URING 0
+#endif
+
+enum AsyncEngine { ASYNC_ENGINE_URING, ASYNC_ENGINE_THREADS };
+
+struct AsyncRequest {
+    uint64_t tag;
+    char* buffer;
+    size_t length;
+    size_t offset;
+};
+
+struct AsyncCompletion {
+    uint64_t tag;
+    long result; // bytes read, or -errno
+};
+
+struct AsyncReader {
+    AsyncEngine engine;
+    int fd;
+    unsigned depth;
+    bool abandoned;
+
+#if ASYNC_HAVE_URING
+    // io_uring: one shared mapping holds both rings, a second one the SQEs
+    int ring_fd;
+    void* ring_map;
+    size_t ring_map_size;
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+    unsigned unsubmitted;
+#endif
+
+    // pread pool
+    std::vector<pthread_t> threads;
+    pthread_mutex_t lock;
+    pthread_cond_t has_request;
+    pthread_cond_t has_completion;
+    std::deque<AsyncRequest> requests;
+    std::deque<AsyncCompletion> completions;
+    bool stopping;
+};
+
+inline const char* async_engine_name(AsyncEngine engine) {
+    return engine == ASYNC_ENGINE_URING ? "io_uring" : "pread threads";
+}
+
+#if ASYNC_HAVE_URING
+inline bool async_uring_init(AsyncReader& io) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = (int)syscall(__NR_io_uring_setup, io.depth, &params);
+    if (ring_fd < 0) {
+        return false;
+    }
+    // IORING_OP_READ and the single ring mapping need 5.6 and 5.4; RW_CUR_POS
+    // arrived with 5.6 and stands in for both
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0 || (params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+        close(ring_fd);
+        return false;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    io.ring_map_size = sq_size > cq_size ? sq_size : cq_size;
+    io.ring_map = mmap(NULL, io.ring_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd, IORING_OFF_SQ_RING);
+    if (io.ring_map == MAP_FAILED) {
+        close(ring_fd);
+        return false;
+    }
+    io.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(NULL, io.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        munmap(io.ring_map, io.ring_map_size);
+        close(ring_fd);
+        return false;
+    }
+
+    char* base = (char*)io.ring_map;
+    io.ring_fd = ring_fd;
+    io.sqes = (io_uring_sqe*)sqes;
+    io.sq_tail = (unsigned*)(base + params.sq_off.tail);
+    io.sq_mask = (unsigned*)(base + params.sq_off.ring_mask);
+    io.sq_array = (unsigned*)(base + params.sq_off.array);
+    io.cq_head = (unsigned*)(base + params.cq_off.head);
+    io.cq_tail = (unsigned*)(base + params.cq_off.tail);
+    io.cq_mask = (unsigned*)(base + params.cq_off.ring_mask);
+    io.cqes = (io_uring_cqe*)(base + params.cq_off.cqes);
+    io.unsubmitted = 0;
+    return true;
+}
+#endif
+
+inline void* async_pread_worker(void* arg) {
+    AsyncReader& io = *(AsyncReader*)arg;
+    pthread_mutex_lock(&io.lock);
+    for (;;) {
+        while (io.requests.empty() && !io.stopping) {
+            pthread_cond_wait(&io.has_request, &io.lock);
+        }
+        if (io.requests.empty()) {
+            break;
+        }
+        AsyncRequest request = io.requests.front();
+        io.requests.pop_front();
+        pthread_mutex_unlock(&io.lock);
+
+        // Fill the whole request unless EOF or an error cuts it short
+        long done = 0;
+        while ((size_t)done < request.length) {
+            ssize_t n = pread(io.fd, request.buffer + done, request.length - done, request.offset + done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                done = done > 0 ? done : -errno;
+                break;
+            }
+            if (n == 0) {
+                break;
+            }
+            done += n;
+        }
+
+        pthread_mutex_lock(&io.lock);
+        io.completions.push_back(AsyncCompletion{request.tag, done});
+        pthread_cond_signal(&io.has_completion);
+    }
+    pthread_mutex_unlock(&io.lock);
+    return NULL;
+}
+
+// Set up a reader for fd with up to depth requests in flight. io_uring is
+// tried first unless the caller asks for the thread pool.
+inline bool async_reader_init(AsyncReader& io, int fd, unsigned depth, AsyncEngine preferred) {
+    io.fd = fd;
+    io.depth = depth;
+    io.abandoned = false;
+    io.stopping = false;
+#if ASYNC_HAVE_URING
+    if (preferred == ASYNC_ENGINE_URING && async_uring_init(io)) {
+        io.engine = ASYNC_ENGINE_URING;
+        return true;
+    }
+#else
+    (void)preferred;
+#endif
+    io.engine = ASYNC_ENGINE_THREADS;
+    pthread_mutex_init(&io.lock, NULL);
+    pthread_cond_init(&io.has_request, NULL);
+    pthread_cond_init(&io.has_completion, NULL);
+    io.threads.resize(depth < 16 ? depth : 16);
+    for (size_t i = 0; i < io.threads.size(); ++i) {
+        if (pthread_create(&io.threads[i], NULL, async_pread_worker, &io) != 0) {
+            io.threads.resize(i);
+            break;
+        }
+    }
+    return !io.threads.empty();
+}
+
+inline void async_submit(AsyncReader& io, const AsyncRequest& request) {
+#if ASYNC_HAVE_URING
+    if (io.engine == ASYNC_ENGINE_URING) {
+        unsigned tail = *io.sq_tail;
+        unsigned index = tail & *io.sq_mask;
+        io_uring_sqe& sqe = io.sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = io.fd;
+        sqe.addr = (uint64_t)(uintptr_t)request.buffer;
+        sqe.len = (uint32_t)request.length;
+        sqe.off = request.offset;
+        sqe.user_data = request.tag;
+        io.sq_array[index] = index;
+        __atomic_store_n(io.sq_tail, tail + 1, __ATOMIC_RELEASE);
+        io.unsubmitted++;
+        return;
+    }
+#endif
+    pthread_mutex_lock(&io.lock);
+    io.requests.push_back(request);
+    pthread_cond_signal(&io.has_request);
+    pthread_mutex_unlock(&io.lock);
+}
+
+// Block until one request completes. Queued io_uring requests are handed to
+// the kernel in the same system call.
+inline bool async_wait(AsyncReader& io, AsyncCompletion& completion) {
+#if ASYNC_HAVE_URING
+    if (io.engine == ASYNC_ENGINE_URING) {
+        for (;;) {
+            unsigned head = *io.cq_head;
+            if (head != __atomic_load_n(io.cq_tail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = io.cqes[head & *io.cq_mask];
+                completion.tag = cqe.user_data;
+                completion.result = cqe.res;
+                __atomic_store_n(io.cq_head, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            long entered = syscall(__NR_io_uring_enter, io.ring_fd, io.unsubmitted, 1,
+                                   IORING_ENTER_GETEVENTS, NULL, 0);
+            if (entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                return false;
+            }
+            if (entered > 0) {
+                io.unsubmitted -= entered < (long)io.unsubmitted ? (unsigned)entered : io.unsubmitted;
+            }
+        }
+    }
+#endif
+    pthread_mutex_lock(&io.lock);
+    while (io.completions.empty()) {
+        pthread_cond_wait(&io.has_completion, &io.lock);
+    }
+    completion = io.completions.front();
+    io.completions.pop_front();
+    pthread_mutex_unlock(&io.lock);
+    return true;
+}
+
+// Every submitted request must have been waited for, or the reader abandoned
+inline void async_reader_destroy(AsyncReader& io) {
+    if (io.abandoned) {
+        return;
+    }
+#if ASYNC_HAVE_URING
+    if (io.engine == ASYNC_ENGINE_URING) {
+        munmap(io.sqes, io.sqes_size);
+        munmap(io.ring_map, io.ring_map_size);
+        close(io.ring_fd);
+        return;
+    }
+#endif
+    pthread_mutex_lock(&io.lock);
+    io.stopping = true;
+    pthread_cond_broadcast(&io.has_request);
+    pthread_mutex_unlock(&io.lock);
+    for (size_t i = 0; i < io.threads.size(); ++i) {
+        pthread_join(io.threads[i], NULL);
+    }
+    io.threads.clear();
+    pthread_mutex_destroy(&io.lock);
+    pthread_cond_destroy(&io.has_request);
+    pthread_cond_destroy(&io.has_completion);
+}
+
+// After async_wait() has failed, with requests still in flight: give up on
+// the reader without waiting for them. The io_uring instance is closed, which
+// makes the kernel cancel them, but it may still be writing into their
+// buffers for a while after that, so the caller must never reuse or free any
+// buffer a request was not waited for. async_reader_destroy() is then a no-op.
+inline void async_reader_abandon(AsyncReader& io) {
+    if (io.abandoned) {
+        return;
+    }
+#if ASYNC_HAVE_URING
+    if (io.engine == ASYNC_ENGINE_URING) {
+        munmap(io.sqes, io.sqes_size);
+        munmap(io.ring_map, io.ring_map_size);
+        close(io.ring_fd);
+        io.abandoned = true;
+        return;
+    }
+#endif
+    async_reader_destroy(io); // the pread threads finish every request first
+    io.abandoned = true;
+}
+
+#endif
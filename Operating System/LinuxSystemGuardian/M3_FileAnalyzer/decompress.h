@@ -0,0 +1,401 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+// Transparent decompression for the file analyzer.
+//
+// Compressed input is recognised by its magic bytes, not its name. gzip
+// goes through zlib, zstd through libzstd when its header is available at
+// build time. Plain text is produced piece by piece straight into the
+// analyzer's buffers and never held in full.
+//
+// Two layouts can be decoded in parallel because their pieces are
+// independent and their sizes are known up front:
+//  - BGZF (bgzip, also what samtools and htslib write): a series of gzip
+//    members of at most 64 KiB, each naming its compressed size in a "BC"
+//    extra field and its plain size in the trailer.
+//  - zstd files made of several frames that record their content size
+//    (pzstd output, or concatenated .zst files).
+// Everything else (ordinary gzip, pigz, single-frame zstd) is decoded
+// sequentially by a StreamDecoder.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <pthread.h>
+
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#define M3_HAVE_ZLIB 1
+#else
+#define M3_HAVE_ZLIB 0
+#endif
+
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define M3_HAVE_ZSTD 1
+#else
+#define M3_HAVE_ZSTD 0
+#endif
+
+enum Compression { COMPRESSION_NONE, COMPRESSION_GZIP, COMPRESSION_ZSTD };
+
+const size_t COMPRESSION_MAGIC_BYTES = 4;
+
+inline Compression detect_compression(const unsigned char* p, size_t length) {
+    if (length >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+        return COMPRESSION_GZIP;
+    }
+    if (length >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd) {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+inline const char* compression_name(Compression kind) {
+    return kind == COMPRESSION_GZIP ? "gzip" : kind == COMPRESSION_ZSTD ? "zstd" : "none";
+}
+
+inline bool compression_supported(Compression kind) {
+    return (kind == COMPRESSION_GZIP && M3_HAVE_ZLIB) || (kind == COMPRESSION_ZSTD && M3_HAVE_ZSTD) ||
+           kind == COMPRESSION_NONE;
+}
+
+// --- Independent Segments ---
+
+// One independently decodable piece of a compressed file
+struct CompressedSegment {
+    size_t offset;
+    size_t length;
+    size_t plain_size;
+};
+
+inline uint32_t read_le32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Size of the BGZF member at p, or 0 if it is not one
+inline size_t bgzf_member_size(const unsigned char* p, size_t avail) {
+    if (avail < 18 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || (p[3] & 4) == 0) {
+        return 0;
+    }
+    size_t extra_length = p[10] | (p[11] << 8);
+    if (12 + extra_length > avail) {
+        return 0;
+    }
+    const unsigned char* field = p + 12;
+    const unsigned char* end = field + extra_length;
+    while (field + 4 <= end) {
+        size_t field_length = field[2] | (field[3] << 8);
+        if (field[0] == 'B' && field[1] == 'C' && field_length == 2 && field + 6 <= end) {
+            size_t size = (field[4] | (field[5] << 8)) + 1;
+            return size <= avail && size >= 12 + extra_length + 8 ? size : 0;
+        }
+        field += 4 + field_length;
+    }
+    return 0;
+}
+
+// Split a whole BGZF file into its members. False if any part of the file
+// is not BGZF, in which case it has to be decoded sequentially.
+inline bool find_bgzf_segments(const unsigned char* data, size_t size, std::vector<CompressedSegment>& segments) {
+    segments.clear();
+    size_t offset = 0;
+    while (offset < size) {
+        size_t member = bgzf_member_size(data + offset, size - offset);
+        if (member == 0) {
+            return false;
+        }
+        segments.push_back(CompressedSegment{offset, member, read_le32(data + offset + member - 4)});
+        offset += member;
+    }
+    return !segments.empty();
+}
+
+// Split a zstd file into frames; false unless there are several and every
+// one records its content size
+inline bool find_zstd_segments(const unsigned char* data, size_t size, std::vector<CompressedSegment>& segments) {
+    segments.clear();
+#if M3_HAVE_ZSTD
+    size_t offset = 0;
+    while (offset < size) {
+        size_t frame = ZSTD_findFrameCompressedSize(data + offset, size - offset);
+        unsigned long long content = ZSTD_getFrameContentSize(data + offset, size - offset);
+        if (ZSTD_isError(frame) || content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR) {
+            return false;
+        }
+        segments.push_back(CompressedSegment{offset, frame, (size_t)content});
+        offset += frame;
+    }
+    return segments.size() > 1;
+#else
+    (void)data;
+    (void)size;
+    return false;
+#endif
+}
+
+// Decode a run of whole segments into out. Returns the plain bytes
+// produced, or -1 on corrupt input or if out is too small.
+inline long decode_segments(Compression kind, const char* in, size_t in_length, char* out, size_t capacity) {
+#if M3_HAVE_ZLIB
+    if (kind == COMPRESSION_GZIP) {
+        z_stream z;
+        memset(&z, 0, sizeof(z));
+        if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) {
+            return -1;
+        }
+        z.next_in = (Bytef*)in;
+        z.avail_in = (uInt)in_length;
+        z.next_out = (Bytef*)out;
+        z.avail_out = (uInt)capacity;
+        long produced = -1;
+        for (;;) {
+            int status = inflate(&z, Z_FINISH);
+            if (status == Z_STREAM_END && z.avail_in == 0) {
+                produced = (long)z.total_out;
+                break;
+            }
+            if (status != Z_STREAM_END) {
+                break;
+            }
+            // Next member: reset keeps the output position
+            uLong total_out = z.total_out;
+            inflateReset(&z);
+            z.total_out = total_out;
+        }
+        inflateEnd(&z);
+        return produced;
+    }
+#endif
+#if M3_HAVE_ZSTD
+    if (kind == COMPRESSION_ZSTD) {
+        size_t produced = ZSTD_decompress(out, capacity, in, in_length);
+        return ZSTD_isError(produced) ? -1 : (long)produced;
+    }
+#endif
+    (void)in;
+    (void)in_length;
+    (void)out;
+    (void)capacity;
+    return -1;
+}
+
+// --- Sequential Decoder ---
+
+struct StreamDecoder {
+    Compression kind;
+    bool at_member_end; // the last gzip member or zstd frame is complete
+    bool output_pending; // the output filled up; more may come without input
+    bool finished;      // the compressed data ended (trailing bytes are ignored)
+    bool failed;
+#if M3_HAVE_ZLIB
+    z_stream z;
+#endif
+#if M3_HAVE_ZSTD
+    ZSTD_DStream* zstd;
+#endif
+};
+
+inline bool decoder_init(StreamDecoder& d, Compression kind) {
+    d.kind = kind;
+    d.at_member_end = false;
+    d.output_pending = false;
+    d.finished = false;
+    d.failed = false;
+#if M3_HAVE_ZLIB
+    if (kind == COMPRESSION_GZIP) {
+        memset(&d.z, 0, sizeof(d.z));
+        return inflateInit2(&d.z, 16 + MAX_WBITS) == Z_OK;
+    }
+#endif
+#if M3_HAVE_ZSTD
+    if (kind == COMPRESSION_ZSTD) {
+        d.zstd = ZSTD_createDStream();
+        return d.zstd != NULL && !ZSTD_isError(ZSTD_initDStream(d.zstd));
+    }
+#endif
+    return false;
+}
+
+// Decode from in into out[produced, capacity), advancing both. Returns once
+// the output is full, the input is used up, or the data ends. Concatenated
+// gzip members and zstd frames are decoded one after another. The caller
+// keeps at least COMPRESSION_MAGIC_BYTES of input available while more can
+// be read, so the next member's magic is never split.
+inline void decoder_run(StreamDecoder& d, const unsigned char*& in, size_t& in_length, char* out, size_t capacity,
+                        size_t& produced) {
+#if M3_HAVE_ZLIB
+    if (d.kind == COMPRESSION_GZIP) {
+        while (!d.finished && !d.failed && (in_length > 0 || d.output_pending) && produced < capacity) {
+            if (d.at_member_end) {
+                // Another member follows, or the rest is padding
+                if (in_length < 2 || in[0] != 0x1f || in[1] != 0x8b) {
+                    d.finished = true;
+                    return;
+                }
+                inflateReset(&d.z);
+                d.at_member_end = false;
+            }
+            d.z.next_in = (Bytef*)in;
+            d.z.avail_in = (uInt)in_length;
+            d.z.next_out = (Bytef*)(out + produced);
+            d.z.avail_out = (uInt)(capacity - produced);
+            int status = inflate(&d.z, Z_NO_FLUSH);
+            size_t consumed = in_length - d.z.avail_in;
+            in += consumed;
+            in_length -= consumed;
+            produced = capacity - d.z.avail_out;
+            d.output_pending = status == Z_OK && d.z.avail_out == 0;
+            if (status == Z_STREAM_END) {
+                d.at_member_end = true;
+            } else if (status != Z_OK && status != Z_BUF_ERROR) {
+                d.failed = true;
+            }
+        }
+        return;
+    }
+#endif
+#if M3_HAVE_ZSTD
+    if (d.kind == COMPRESSION_ZSTD) {
+        while (!d.failed && (in_length > 0 || d.output_pending) && produced < capacity) {
+            ZSTD_inBuffer input = {in, in_length, 0};
+            ZSTD_outBuffer output = {out, capacity, produced};
+            size_t status = ZSTD_decompressStream(d.zstd, &output, &input);
+            in += input.pos;
+            in_length -= input.pos;
+            produced = output.pos;
+            d.output_pending = output.pos == output.size;
+            if (ZSTD_isError(status)) {
+                d.failed = true;
+            } else {
+                d.at_member_end = (status == 0);
+            }
+        }
+        return;
+    }
+#endif
+    (void)in;
+    (void)in_length;
+    (void)out;
+    (void)capacity;
+    (void)produced;
+    d.failed = true;
+}
+
+inline void decoder_destroy(StreamDecoder& d) {
+#if M3_HAVE_ZLIB
+    if (d.kind == COMPRESSION_GZIP) {
+        inflateEnd(&d.z);
+    }
+#endif
+#if M3_HAVE_ZSTD
+    if (d.kind == COMPRESSION_ZSTD && d.zstd != NULL) {
+        ZSTD_freeDStream(d.zstd);
+    }
+#endif
+    d.kind = COMPRESSION_NONE;
+}
+
+// --- Decode Pool ---
+
+// Threads that decode segment runs handed in by the reader. Jobs carry a
+// caller tag; results come back in completion order.
+struct DecodeJob {
+    uint64_t tag;
+    Compression kind;
+    const char* in;
+    size_t in_length;
+    char* out;
+    size_t capacity;
+};
+
+struct DecodeResult {
+    uint64_t tag;
+    long produced; // -1 on failure
+};
+
+struct DecodePool {
+    std::vector<pthread_t> threads;
+    pthread_mutex_t lock;
+    pthread_cond_t has_job;
+    pthread_cond_t has_result;
+    std::deque<DecodeJob> jobs;
+    std::deque<DecodeResult> results;
+    bool stopping;
+};
+
+inline void* decode_pool_worker(void* arg) {
+    DecodePool& pool = *(DecodePool*)arg;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (pool.jobs.empty() && !pool.stopping) {
+            pthread_cond_wait(&pool.has_job, &pool.lock);
+        }
+        if (pool.jobs.empty()) {
+            break;
+        }
+        DecodeJob job = pool.jobs.front();
+        pool.jobs.pop_front();
+        pthread_mutex_unlock(&pool.lock);
+
+        long produced = decode_segments(job.kind, job.in, job.in_length, job.out, job.capacity);
+
+        pthread_mutex_lock(&pool.lock);
+        pool.results.push_back(DecodeResult{job.tag, produced});
+        pthread_cond_signal(&pool.has_result);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+inline bool decode_pool_init(DecodePool& pool, int thread_count) {
+    pool.stopping = false;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.has_job, NULL);
+    pthread_cond_init(&pool.has_result, NULL);
+    pool.threads.resize(thread_count);
+    for (size_t i = 0; i < pool.threads.size(); ++i) {
+        if (pthread_create(&pool.threads[i], NULL, decode_pool_worker, &pool) != 0) {
+            pool.threads.resize(i);
+            break;
+        }
+    }
+    return !pool.threads.empty();
+}
+
+inline void decode_pool_submit(DecodePool& pool, const DecodeJob& job) {
+    pthread_mutex_lock(&pool.lock);
+    pool.jobs.push_back(job);
+    pthread_cond_signal(&pool.has_job);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+inline DecodeResult decode_pool_wait(DecodePool& pool) {
+    pthread_mutex_lock(&pool.lock);
+    while (pool.results.empty()) {
+        pthread_cond_wait(&pool.has_result, &pool.lock);
+    }
+    DecodeResult result = pool.results.front();
+    pool.results.pop_front();
+    pthread_mutex_unlock(&pool.lock);
+    return result;
+}
+
+// Every submitted job must have been waited for
+inline void decode_pool_destroy(DecodePool& pool) {
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = true;
+    pthread_cond_broadcast(&pool.has_job);
+    pthread_mutex_unlock(&pool.lock);
+    for (size_t i = 0; i < pool.threads.size(); ++i) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    pool.threads.clear();
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.has_job);
+    pthread_cond_destroy(&pool.has_result);
+}
+
+#endif
@@ -2,165 +2,2300 @@
 #include <fstream>
 #include <vector>
 #include <string>
-#include <sstream>
 #include <pthread.h>
 #include <algorithm> // for std::count
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <dirent.h>
+#include <glob.h>
+#include <sched.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "analysis_core.h"
+#include "async_io.h"
+#include "decompress.h"
+#include "../M4_IPC/ipc_wire.h"
 
 using namespace std;
 
-// Global structure to hold shared results
-struct AnalysisResults {
-    long total_chars;
-    long total_lines;
-    long total_words;
-    long term_occurrences;
+// Global instance of the results, the sum of every worker's slot after join
+AnalysisResults shared_results;
+
+const string DEFAULT_SEARCH_TERM = "threads"; // Counted when no terms are given
+
+// The terms to count, from --term and --terms; filled once in main()
+vector<string> search_terms;
+
+// Read one term per line; blank lines are skipped and a trailing '\r' is dropped
+bool load_terms_file(const char* path, vector<string>& terms) {
+    ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    string line;
+    while (getline(file, line)) {
+        if (!line.empty() && line[line.length() - 1] == '\r') {
+            line.erase(line.length() - 1);
+        }
+        if (!line.empty()) {
+            terms.push_back(line);
+        }
+    }
+    return true;
+}
+
+
+// --- Run Statistics ---
+
+// --stats times each phase of a run and what every worker spends its time
+// on. The hot paths only test one global flag; the clock is read only when
+// statistics were asked for.
+enum StatsFormat { STATS_OFF, STATS_JSON, STATS_PROMETHEUS };
+
+enum RunPhase {
+    PHASE_SETUP,      // options, terms, automaton
+    PHASE_PLAN,       // input collection, stat(), checkpoints, work items
+    PHASE_SPAWN,      // thread creation
+    PHASE_WORKERS,    // all threads started to last thread joined
+    PHASE_REDUCE,     // per-file totals and report accumulation
+    PHASE_CHECKPOINT, // sidecar writes
+    PHASE_COUNT
+};
+
+const char* phase_names[PHASE_COUNT] = {"setup", "plan", "spawn", "workers", "reduce", "checkpoint"};
+
+StatsFormat stats_format = STATS_OFF;
+long long phase_ns[PHASE_COUNT];
+
+long long monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+inline long long stats_now() {
+    return stats_format == STATS_OFF ? 0 : monotonic_ns();
+}
+
+// Charge the time since mark to a phase and restart the mark
+inline void stats_lap(RunPhase phase, long long& mark) {
+    if (stats_format != STATS_OFF) {
+        long long now = monotonic_ns();
+        phase_ns[phase] += now - mark;
+        mark = now;
+    }
+}
+
+
+// Assumed cache line size; slots written by different workers never share one
+const size_t CACHE_LINE_SIZE = 64;
+
+// Structure passed to each worker thread. Workers pull work from the shared
+// scheduler (or the stream ring) until it runs dry and count into their own
+// slot, which no other thread writes, so the scan itself needs no lock.
+// main() sums the streamed slots once after join; file chunks are merged into
+// their file's totals.
+struct alignas(CACHE_LINE_SIZE) ThreadData {
+    int worker_id;
+    AnalysisResults results;      // totals of streamed chunks
+    AnalysisResults chunk_counts; // counts of the file chunk in hand
+    vector<size_t> term_scratch;  // per-term bookkeeping for the automaton
+    vector<char> read_buffer;     // reused for small files read whole
+    vector<char> decode_buffer;   // plain text of the compressed file in hand
+    vector<char> compressed_input;
+    long chunks_scanned;
+    long bytes_scanned;
+
+    // Nanoseconds per activity, only measured with --stats
+    long long load_ns;  // mapping or reading input, including the file lock
+    long long scan_ns;
+    long long merge_ns; // adding chunk counts to the file, including the lock
+    long long wait_ns;  // blocked on the stream ring
+    long long busy_ns;  // whole thread lifetime
+};
+
+
+// --- Input Buffer ---
+
+// How the file content is brought into memory
+enum InputMode {
+    INPUT_MMAP,  // map the file read-only and scan the page cache in place
+    INPUT_READ,  // read the whole file into one heap buffer
+    INPUT_STREAM, // read through a bounded ring of buffers (stdin, pipes, huge files)
+    INPUT_ASYNC   // the stream ring fed by several reads in flight (cold-cache files)
+};
+
+// File content from a start offset to the end, either mapped or owned
+struct InputBuffer {
+    const char* data;   // byte at the start offset
+    size_t length;
+    void* map_base;     // non-null when the content is an mmap region
+    size_t map_length;  // length of the mapping, from the page below the offset
+    vector<char> owned; // backing storage for INPUT_READ
+};
+
+bool map_input_file(const char* filename, InputBuffer& input, size_t offset) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+
+    // mmap offsets must be page aligned; the mapping starts at the page
+    // holding the offset and data skips the bytes before it
+    size_t file_size = st.st_size;
+    offset = min(offset, file_size);
+    size_t aligned = offset & ~(size_t)(sysconf(_SC_PAGESIZE) - 1);
+    input.length = file_size - offset;
+    input.map_base = NULL;
+    input.map_length = 0;
+    input.data = "";
+    if (input.length > 0) {
+        void* base = mmap(NULL, file_size - aligned, PROT_READ, MAP_PRIVATE, fd, aligned);
+        if (base == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        // The file is scanned front to back: ask for aggressive read-ahead
+        // and early reclaim of pages behind the scan.
+        madvise(base, file_size - aligned, MADV_SEQUENTIAL);
+        input.map_base = base;
+        input.map_length = file_size - aligned;
+        input.data = (const char*)base + (offset - aligned);
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    return true;
+}
+
+bool read_input_file(const char* filename, InputBuffer& input, size_t offset) {
+    ifstream file(filename, ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // Get file size and read content
+    file.seekg(0, ios::end);
+    long file_size = file.tellg();
+    if (file_size < 0) {
+        return false;
+    }
+    size_t start = min(offset, (size_t)file_size);
+    input.owned.resize(file_size - start);
+    file.seekg(start, ios::beg);
+    file.read(input.owned.data(), input.owned.size());
+    file.close();
+
+    input.map_base = NULL;
+    input.map_length = 0;
+    input.data = input.owned.empty() ? "" : input.owned.data();
+    input.length = input.owned.size();
+    return true;
+}
+
+void release_input(InputBuffer& input) {
+    if (input.map_base != NULL) {
+        munmap(input.map_base, input.map_length);
+        input.map_base = NULL;
+    }
+    input.owned.clear();
+    input.owned.shrink_to_fit();
+    input.data = NULL;
+    input.length = 0;
+}
+
+// Drop a scanned section's pages from this process's mapping, so resident
+// memory follows the scan position instead of growing to the file size.
+// The pages stay in the page cache; only our references to them go away.
+void release_scanned_pages(const char* start, size_t length) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)start;
+    uintptr_t end = begin + length;
+    // Only whole pages inside the chunk, so neighbouring chunks are untouched
+    begin = (begin + page_size - 1) & ~(uintptr_t)(page_size - 1);
+    end &= ~(uintptr_t)(page_size - 1);
+    if (end > begin) {
+        madvise((void*)begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+
+// gzip and zstd files are recognised by their magic bytes and decoded on
+// the fly (see Compressed Input)
+bool decompress_inputs = true; // --no-decompress turns detection off
+
+Compression sniff_compression(const char* path) {
+    unsigned char magic[COMPRESSION_MAGIC_BYTES];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return COMPRESSION_NONE;
+    }
+    ssize_t n = pread(fd, magic, sizeof(magic), 0);
+    close(fd);
+    return n > 0 ? detect_compression(magic, n) : COMPRESSION_NONE;
+}
+
+
+// --- CPU Topology ---
+
+// How worker threads are bound to CPUs
+enum PinMode {
+    PIN_NONE, // let the scheduler place threads
+    PIN_CPU,  // one allowed CPU per worker, round robin
+    PIN_NUMA  // all allowed CPUs of one NUMA node per worker, round robin
+};
+
+// Parse a kernel cpulist such as "0-3,8,10-11" into a CPU set
+void parse_cpu_list(const string& list, cpu_set_t& set) {
+    CPU_ZERO(&set);
+    size_t pos = 0;
+    while (pos < list.length()) {
+        char* next;
+        long first = strtol(list.c_str() + pos, &next, 10);
+        if (next == list.c_str() + pos) {
+            break;
+        }
+        long last = first;
+        if (*next == '-') {
+            last = strtol(next + 1, &next, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &set);
+        }
+        pos = (next - list.c_str()) + 1; // skip the ','
+    }
+}
+
+// CPUs this process may run on, as reported by sched_getaffinity()
+vector<int> allowed_cpus() {
+    vector<int> cpus;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+// cgroup v2 directory of this process ("0::/path" in /proc/self/cgroup)
+string cgroup_v2_dir() {
+    ifstream cgroup("/proc/self/cgroup");
+    string line;
+    while (getline(cgroup, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            return "/sys/fs/cgroup" + line.substr(3);
+        }
+    }
+    return "/sys/fs/cgroup";
+}
+
+// CPU limit from the cgroup quota (v2 cpu.max, else v1 cfs quota), 0 if unlimited
+int cgroup_cpu_limit() {
+    long quota = -1;
+    long period = 0;
+
+    ifstream cpu_max(cgroup_v2_dir() + "/cpu.max");
+    if (!cpu_max.is_open()) {
+        cpu_max.open("/sys/fs/cgroup/cpu.max");
+    }
+    string quota_text;
+    if (cpu_max >> quota_text >> period) {
+        if (quota_text != "max") {
+            quota = atol(quota_text.c_str());
+        }
+    } else {
+        ifstream v1_quota("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+        ifstream v1_period("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+        if (!(v1_quota >> quota) || !(v1_period >> period)) {
+            quota = -1;
+        }
+    }
+
+    if (quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return (int)((quota + period - 1) / period); // round partial CPUs up
+}
+
+// Default worker count: online CPUs, narrowed by affinity and cgroup quota
+int detect_worker_count() {
+    int count = (int)thread::hardware_concurrency();
+    int affinity = (int)allowed_cpus().size();
+    if (affinity > 0 && (count == 0 || affinity < count)) {
+        count = affinity;
+    }
+    int quota = cgroup_cpu_limit();
+    if (quota > 0 && (count == 0 || quota < count)) {
+        count = quota;
+    }
+    return max(count, 1);
+}
+
+// Allowed CPUs grouped by NUMA node; a single group if the machine has no
+// NUMA information in sysfs
+vector<cpu_set_t> numa_node_cpus(const vector<int>& allowed) {
+    vector<cpu_set_t> nodes;
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir != NULL) {
+        vector<int> node_ids;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strncmp(entry->d_name, "node", 4) == 0 && isdigit((unsigned char)entry->d_name[4])) {
+                node_ids.push_back(atoi(entry->d_name + 4));
+            }
+        }
+        closedir(dir);
+        sort(node_ids.begin(), node_ids.end());
+
+        for (size_t i = 0; i < node_ids.size(); ++i) {
+            ifstream cpulist("/sys/devices/system/node/node" + to_string(node_ids[i]) + "/cpulist");
+            string list;
+            if (!getline(cpulist, list)) {
+                continue;
+            }
+            cpu_set_t node_set;
+            cpu_set_t usable;
+            parse_cpu_list(list, node_set);
+            CPU_ZERO(&usable);
+            for (size_t c = 0; c < allowed.size(); ++c) {
+                if (CPU_ISSET(allowed[c], &node_set)) {
+                    CPU_SET(allowed[c], &usable);
+                }
+            }
+            if (CPU_COUNT(&usable) > 0) {
+                nodes.push_back(usable);
+            }
+        }
+    }
+
+    if (nodes.empty()) {
+        cpu_set_t all;
+        CPU_ZERO(&all);
+        for (size_t c = 0; c < allowed.size(); ++c) {
+            CPU_SET(allowed[c], &all);
+        }
+        nodes.push_back(all);
+    }
+    return nodes;
+}
+
+// Affinity mask for each worker under the given pin mode (empty for PIN_NONE)
+vector<cpu_set_t> worker_affinities(PinMode mode, int num_workers) {
+    vector<cpu_set_t> masks;
+    vector<int> allowed = allowed_cpus();
+    if (mode == PIN_NONE || allowed.empty()) {
+        return masks;
+    }
+
+    vector<cpu_set_t> nodes;
+    if (mode == PIN_NUMA) {
+        nodes = numa_node_cpus(allowed);
+    }
+    for (int i = 0; i < num_workers; ++i) {
+        cpu_set_t set;
+        if (mode == PIN_CPU) {
+            CPU_ZERO(&set);
+            CPU_SET(allowed[i % allowed.size()], &set);
+        } else {
+            set = nodes[i % nodes.size()];
+        }
+        masks.push_back(set);
+    }
+    return masks;
+}
+
+
+// --- Byte Scanner ---
+
+// Search term tables and the kernel chosen for this CPU, set up once in main()
+ScanKernel scan_kernel = KERNEL_SCALAR;
+TermScanner term_scanner;
+
+void prepare_search_terms() {
+    prepare_term_scanner(term_scanner, search_terms, scan_kernel);
+}
+
+void scan_section(const char* data, size_t length, AnalysisResults& totals, vector<size_t>& scratch) {
+    scan_section(term_scanner, data, length, totals, scratch);
+}
+
+
+// --- Chunk Scheduler ---
+
+const size_t DEFAULT_CHUNK_SIZE = 2 << 20; // 2 MB
+const size_t MAX_BATCH_FILES = 256;        // most small files in one work item
+
+// One input file and its running totals. A large file is cut into
+// fixed-size chunks, each snapped forward to the next line start; the first
+// worker that needs it loads it (mapped or read) and the worker that finishes
+// its last chunk releases it. Small files in batch mode are read whole by the
+// worker that owns their batch.
+struct InputFile {
+    string path;
+    struct stat identity; // from stat() when the work was planned
+    size_t size;
+    size_t start_offset;  // first byte to scan; past 0 when resuming a checkpoint
+    size_t chunk_count;
+    bool batched;         // read whole as part of a run of small files
+    Compression compression; // compressed files are one work item, decoded by one worker
+    int checkpoint_status;
+
+    pthread_mutex_t lock; // guards everything below
+    bool loaded;
+    bool failed;
+    InputBuffer buffer;
+    size_t chunks_left;
+    size_t scanned_end;   // file offset one past the last byte scanned
+    AnalysisResults results;
+    char last_byte;       // last byte of the file, for the unterminated line
+};
+
+// One unit of work: a chunk of a large file, or a run of small files
+struct WorkItem {
+    size_t file;
+    size_t file_count; // more than one only for batches of small files
+    size_t chunk;
+};
+
+// Workers claim work items from one atomic cursor, so a slow or oversized
+// item only delays the worker that took it, and one pool serves every file.
+struct ChunkScheduler {
+    vector<InputFile> files;
+    vector<WorkItem> items;
+    InputMode mode; // how large files are loaded: INPUT_MMAP or INPUT_READ
+    size_t chunk_size;
+    atomic<size_t> next_item;
+};
+
+ChunkScheduler scheduler;
+
+// --- Checkpoints ---
+
+// With --checkpoint DIR every file gets a sidecar in DIR recording its
+// identity, the offset analysis can resume from and the counts up to that
+// offset. The resume offset always sits right after a whitespace byte, where
+// every count is additive, so a later run scans only the bytes after it and
+// adds the checkpoint's counts. The trailing partial word is rescanned each
+// run, which keeps a word that is still being written from being split.
+
+const char* CHECKPOINT_MAGIC = "m3-checkpoint";
+const int CHECKPOINT_VERSION = 1;
+const size_t FINGERPRINT_BYTES = 4096; // hashed at the file head and before the offset
+
+enum CheckpointStatus {
+    CKPT_DISABLED,
+    CKPT_NEW,           // no usable sidecar yet: full scan
+    CKPT_RESUMED,       // same file, appended or unchanged: tail scan only
+    CKPT_ROTATED,       // device or inode changed: full scan
+    CKPT_TRUNCATED,     // shorter than the resume offset: full scan
+    CKPT_REWRITTEN,     // fingerprint or same-size mtime mismatch: full scan
+    CKPT_TERMS_CHANGED  // counts are for other terms: full scan
+};
+
+const char* checkpoint_status_names[] = {
+    "disabled", "new", "resumed", "rotated", "truncated", "rewritten", "terms changed"
+};
+
+struct Checkpoint {
+    unsigned long long device;
+    unsigned long long inode;
+    size_t size;            // bytes analyzed when the checkpoint was written
+    long long mtime_sec;
+    long long mtime_nsec;
+    size_t offset;          // resume point
+    int last_byte;          // byte at offset - 1 ('\n' when offset is 0)
+    unsigned long long fingerprint;
+    AnalysisResults results; // raw counts of [0, offset)
+    vector<string> terms;
+};
+
+string checkpoint_dir; // empty when checkpoints are off
+
+// Sidecar name: the file's absolute path with '%' and '/' escaped
+string checkpoint_path(const string& file_path) {
+    char resolved[PATH_MAX];
+    string key = realpath(file_path.c_str(), resolved) != NULL ? resolved : file_path;
+    string name;
+    for (size_t i = 0; i < key.length(); ++i) {
+        if (key[i] == '%') {
+            name += "%25";
+        } else if (key[i] == '/') {
+            name += "%2F";
+        } else {
+            name += key[i];
+        }
+    }
+    return checkpoint_dir + "/" + name + ".ckpt";
+}
+
+bool load_checkpoint(const string& path, Checkpoint& ckpt) {
+    ifstream in(path.c_str());
+    string magic;
+    int version = 0;
+    size_t term_count = 0;
+    string tag_identity, tag_resume, tag_counts, tag_terms;
+    if (!(in >> magic >> version) || magic != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION) {
+        return false;
+    }
+    if (!(in >> tag_identity >> ckpt.device >> ckpt.inode >> ckpt.size >> ckpt.mtime_sec >> ckpt.mtime_nsec) ||
+        !(in >> tag_resume >> ckpt.offset >> ckpt.last_byte >> hex >> ckpt.fingerprint >> dec) ||
+        !(in >> tag_counts >> ckpt.results.total_chars >> ckpt.results.total_lines >> ckpt.results.total_words) ||
+        !(in >> tag_terms >> term_count)) {
+        return false;
+    }
+    ckpt.terms.clear();
+    ckpt.results.term_occurrences.clear();
+    for (size_t i = 0; i < term_count; ++i) {
+        long count;
+        string term;
+        if (!(in >> count) || in.get() != ' ' || !getline(in, term)) {
+            return false;
+        }
+        ckpt.results.term_occurrences.push_back(count);
+        ckpt.terms.push_back(term);
+    }
+    return true;
+}
+
+// Written to a temporary file and renamed, so a crash never leaves a torn sidecar
+bool save_checkpoint(const string& path, const Checkpoint& ckpt) {
+    string temp = path + ".tmp";
+    {
+        ofstream out(temp.c_str(), ios::trunc);
+        out << CHECKPOINT_MAGIC << " " << CHECKPOINT_VERSION << "\n"
+            << "identity " << ckpt.device << " " << ckpt.inode << " " << ckpt.size << " "
+            << ckpt.mtime_sec << " " << ckpt.mtime_nsec << "\n"
+            << "resume " << ckpt.offset << " " << ckpt.last_byte << " " << hex << ckpt.fingerprint << dec << "\n"
+            << "counts " << ckpt.results.total_chars << " " << ckpt.results.total_lines << " "
+            << ckpt.results.total_words << "\n"
+            << "terms " << ckpt.terms.size() << "\n";
+        for (size_t i = 0; i < ckpt.terms.size(); ++i) {
+            out << ckpt.results.term_occurrences[i] << " " << ckpt.terms[i] << "\n";
+        }
+        if (!out.flush()) {
+            return false;
+        }
+    }
+    return rename(temp.c_str(), path.c_str()) == 0;
+}
+
+bool pread_exact(int fd, char* buffer, size_t length, size_t offset) {
+    while (length > 0) {
+        ssize_t n = pread(fd, buffer, length, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buffer += n;
+        length -= n;
+        offset += n;
+    }
+    return true;
+}
+
+// FNV-1a over the file's first bytes and the bytes just before offset
+bool fingerprint_file(const char* path, size_t offset, unsigned long long& hash) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    size_t span = min(offset, FINGERPRINT_BYTES);
+    vector<char> bytes(2 * span);
+    bool ok = pread_exact(fd, bytes.data(), span, 0) &&
+              pread_exact(fd, bytes.data() + span, span, offset - span);
+    close(fd);
+
+    hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ULL;
+    }
+    return ok;
+}
+
+// Decide where the scan of this file starts, seeding its totals from the
+// checkpoint when it can be resumed
+CheckpointStatus resume_from_checkpoint(const string& path, const struct stat& st,
+                                        size_t& start_offset, AnalysisResults& results, char& last_byte) {
+    Checkpoint ckpt;
+    start_offset = 0;
+    if (!load_checkpoint(checkpoint_path(path), ckpt)) {
+        return CKPT_NEW;
+    }
+    if (ckpt.terms != search_terms) {
+        return CKPT_TERMS_CHANGED;
+    }
+    if (ckpt.device != (unsigned long long)st.st_dev || ckpt.inode != (unsigned long long)st.st_ino) {
+        return CKPT_ROTATED;
+    }
+    if ((size_t)st.st_size < ckpt.size) {
+        return CKPT_TRUNCATED;
+    }
+    unsigned long long fingerprint;
+    bool same_size_touched = (size_t)st.st_size == ckpt.size &&
+                             (st.st_mtim.tv_sec != ckpt.mtime_sec || st.st_mtim.tv_nsec != ckpt.mtime_nsec);
+    if (same_size_touched || !fingerprint_file(path.c_str(), ckpt.offset, fingerprint) ||
+        fingerprint != ckpt.fingerprint) {
+        return CKPT_REWRITTEN;
+    }
+
+    start_offset = ckpt.offset;
+    results = ckpt.results;
+    last_byte = (char)ckpt.last_byte;
+    return CKPT_RESUMED;
+}
+
+// Offset just after the last whitespace byte in [start, end), or start if the
+// range holds none
+size_t find_resume_offset(int fd, size_t start, size_t end) {
+    const size_t block = 64 << 10;
+    vector<char> bytes(block);
+    while (end > start) {
+        size_t span = min(block, end - start);
+        if (!pread_exact(fd, bytes.data(), span, end - span)) {
+            return start;
+        }
+        for (size_t i = span; i > 0; --i) {
+            if (is_space_byte((unsigned char)bytes[i - 1])) {
+                return end - span + i;
+            }
+        }
+        end -= span;
+    }
+    return start;
+}
+
+
+// Record where the next run can resume. The counts of this run cover
+// [0, scanned_end); the partial word after the last whitespace is scanned
+// again and taken back out so the checkpoint ends on a word boundary. Takes
+// the raw counts, before the unterminated-line adjustment.
+bool write_checkpoint(const InputFile& file, vector<size_t>& scratch) {
+    int fd = open(file.path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    Checkpoint ckpt;
+    ckpt.device = file.identity.st_dev;
+    ckpt.inode = file.identity.st_ino;
+    ckpt.size = file.scanned_end;
+    ckpt.mtime_sec = file.identity.st_mtim.tv_sec;
+    ckpt.mtime_nsec = file.identity.st_mtim.tv_nsec;
+    ckpt.offset = find_resume_offset(fd, file.start_offset, file.scanned_end);
+    ckpt.terms = search_terms;
+    ckpt.results = file.results;
+
+    char before = '\n';
+    vector<char> fragment(file.scanned_end - ckpt.offset);
+    bool ok = (ckpt.offset == 0 || pread_exact(fd, &before, 1, ckpt.offset - 1)) &&
+              pread_exact(fd, fragment.data(), fragment.size(), ckpt.offset);
+    close(fd);
+    if (!ok) {
+        return false;
+    }
+    ckpt.last_byte = (unsigned char)before;
+
+    AnalysisResults partial;
+    reset_results(partial, search_terms.size());
+    scan_section(fragment.data(), fragment.size(), partial, scratch);
+    subtract_results(ckpt.results, partial);
+
+    return fingerprint_file(file.path.c_str(), ckpt.offset, ckpt.fingerprint) &&
+           save_checkpoint(checkpoint_path(file.path), ckpt);
+}
+
+
+// --- Work Planning ---
+
+// Plan the run: large files get one item per chunk, consecutive small files
+// are packed into items of up to chunk_size bytes when batching is enabled
+void plan_work(ChunkScheduler& sched, const vector<string>& paths, bool batch_small_files) {
+    sched.files = vector<InputFile>(paths.size());
+    sched.items.clear();
+    sched.next_item.store(0);
+
+    size_t batch_bytes = 0;
+    bool batch_open = false;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        InputFile& file = sched.files[i];
+        file.path = paths[i];
+        struct stat& st = file.identity;
+        bool regular = stat(file.path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+        file.size = regular ? st.st_size : 0;
+
+        pthread_mutex_init(&file.lock, NULL);
+        file.loaded = false;
+        file.failed = !regular;
+        file.buffer.data = NULL;
+        file.buffer.length = 0;
+        file.buffer.map_base = NULL;
+        reset_results(file.results, search_terms.size());
+        file.last_byte = '\n';
+        file.start_offset = 0;
+        file.checkpoint_status = CKPT_DISABLED;
+        file.compression = regular && decompress_inputs ? sniff_compression(file.path.c_str()) : COMPRESSION_NONE;
+        if (file.compression != COMPRESSION_NONE) {
+            // Offsets into compressed data cannot be resumed from
+            file.failed = !compression_supported(file.compression);
+            file.chunk_count = 1;
+            file.chunks_left = 1;
+            file.batched = false;
+            file.scanned_end = 0;
+            if (!file.failed) {
+                batch_open = false;
+                sched.items.push_back(WorkItem{i, 1, 0});
+            }
+            continue;
+        }
+        if (regular && !checkpoint_dir.empty()) {
+            char last_byte = '\n';
+            file.checkpoint_status = resume_from_checkpoint(file.path, st, file.start_offset, file.results, last_byte);
+            file.last_byte = last_byte;
+        }
+        file.scanned_end = file.start_offset;
+
+        // Only the bytes past the start offset are scanned. A resumed file
+        // with nothing new needs no work item at all.
+        size_t pending = file.size - file.start_offset;
+        file.chunk_count = max((size_t)1, (pending + sched.chunk_size - 1) / sched.chunk_size);
+        if (file.start_offset > 0 && pending == 0) {
+            file.chunk_count = 0;
+            file.loaded = true;
+        }
+        file.batched = batch_small_files && pending <= sched.chunk_size;
+        file.chunks_left = file.chunk_count;
+        if (file.failed || file.chunk_count == 0) {
+            continue;
+        }
+
+        if (file.batched) {
+            if (batch_open && batch_bytes + pending <= sched.chunk_size &&
+                sched.items.back().file_count < MAX_BATCH_FILES) {
+                sched.items.back().file_count++;
+                batch_bytes += pending;
+            } else {
+                sched.items.push_back(WorkItem{i, 1, 0});
+                batch_open = true;
+                batch_bytes = pending;
+            }
+            continue;
+        }
+
+        batch_open = false;
+        for (size_t c = 0; c < file.chunk_count; ++c) {
+            sched.items.push_back(WorkItem{i, 1, c});
+        }
+    }
+}
+
+void destroy_work(ChunkScheduler& sched) {
+    for (size_t i = 0; i < sched.files.size(); ++i) {
+        release_input(sched.files[i].buffer);
+        pthread_mutex_destroy(&sched.files[i].lock);
+    }
+}
+
+// Start of chunk i: the first line that begins at or after i * chunk_size.
+// Neighbouring chunks compute the shared boundary the same way, so workers
+// find their own bounds without any upfront pass over the file. The last
+// chunk runs to the end even if the file grew after it was planned.
+size_t chunk_boundary(const InputBuffer& buffer, size_t chunk_size, size_t index, size_t chunk_count) {
+    if (index == 0) {
+        return 0;
+    }
+    size_t nominal = index * chunk_size;
+    if (index >= chunk_count || nominal >= buffer.length) {
+        return buffer.length;
+    }
+    const char* newline = (const char*)memchr(buffer.data + nominal - 1, '\n', buffer.length - nominal + 1);
+    return newline == NULL ? buffer.length : (size_t)(newline - buffer.data) + 1;
+}
+
+// Load a large file on first use; false if it cannot be opened
+bool acquire_file(ChunkScheduler& sched, InputFile& file) {
+    pthread_mutex_lock(&file.lock);
+    if (!file.loaded && !file.failed) {
+        bool ok = false;
+        if (sched.mode == INPUT_MMAP) {
+            ok = map_input_file(file.path.c_str(), file.buffer, file.start_offset);
+        }
+        if (!ok) {
+            ok = read_input_file(file.path.c_str(), file.buffer, file.start_offset);
+        }
+        file.loaded = ok;
+        file.failed = !ok;
+        file.scanned_end = file.start_offset + (ok ? file.buffer.length : 0);
+    }
+    bool usable = file.loaded;
+    pthread_mutex_unlock(&file.lock);
+    return usable;
+}
+
+// Read a small file from offset to its end into a reusable buffer, however
+// much it has grown
+bool read_whole_file(const char* path, size_t offset, vector<char>& buffer, size_t& length) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    if (offset > 0 && lseek(fd, offset, SEEK_SET) < 0) {
+        close(fd);
+        return false;
+    }
+    length = 0;
+    for (;;) {
+        if (length == buffer.size()) {
+            buffer.resize(max((size_t)64 << 10, buffer.size() * 2));
+        }
+        ssize_t n = read(fd, buffer.data() + length, buffer.size() - length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            close(fd);
+            return n == 0;
+        }
+        length += n;
+    }
+}
+
+// Accepts a plain byte count or a K/M/G suffix, e.g. "4M"
+bool parse_size(const char* text, size_t& size) {
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) {
+        return false;
+    }
+    switch (*end) {
+    case 'G': case 'g': value <<= 30; end++; break;
+    case 'M': case 'm': value <<= 20; end++; break;
+    case 'K': case 'k': value <<= 10; end++; break;
+    default: break;
+    }
+    if (*end != '\0' || value == 0) {
+        return false;
+    }
+    size = value;
+    return true;
+}
+
+
+// --- Input Collection ---
+
+bool has_glob_chars(const string& path) {
+    return path.find_first_of("*?[") != string::npos;
+}
+
+// Expand the command line inputs. A directory contributes the regular files
+// directly inside it, in name order; a pattern that names no existing file
+// is expanded with glob(), for callers that pass it quoted.
+void collect_inputs(const vector<string>& args, vector<string>& paths) {
+    for (size_t i = 0; i < args.size(); ++i) {
+        struct stat st;
+        bool exists = stat(args[i].c_str(), &st) == 0;
+        if (exists && S_ISDIR(st.st_mode)) {
+            vector<string> entries;
+            DIR* dir = opendir(args[i].c_str());
+            struct dirent* entry;
+            while (dir != NULL && (entry = readdir(dir)) != NULL) {
+                string path = args[i] + "/" + entry->d_name;
+                struct stat entry_st;
+                if (stat(path.c_str(), &entry_st) == 0 && S_ISREG(entry_st.st_mode)) {
+                    entries.push_back(path);
+                }
+            }
+            if (dir != NULL) {
+                closedir(dir);
+            }
+            sort(entries.begin(), entries.end());
+            paths.insert(paths.end(), entries.begin(), entries.end());
+        } else if (!exists && has_glob_chars(args[i])) {
+            glob_t matches;
+            if (glob(args[i].c_str(), 0, NULL, &matches) == 0) {
+                for (size_t m = 0; m < matches.gl_pathc; ++m) {
+                    paths.push_back(matches.gl_pathv[m]);
+                }
+            }
+            globfree(&matches);
+        } else {
+            paths.push_back(args[i]);
+        }
+    }
+}
+
+
+// --- Streaming Input ---
+
+// A fixed set of reusable buffers cycles between the reader and the workers:
+// the reader fills a free buffer and queues it, a worker scans it and hands
+// it back. Memory use is slots * chunk size however long the input is.
+struct StreamRing {
+    vector<vector<char> > buffers;
+    vector<size_t> starts;   // where the bytes to scan begin in each buffer
+    vector<size_t> lengths;  // bytes to scan in each buffer
+    vector<int> free_slots;  // buffers waiting to be filled
+    vector<int> ready_slots; // circular FIFO of filled buffers
+    size_t ready_head;
+    size_t ready_count;
+    bool finished;           // the reader has queued its last buffer
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free;
+    pthread_cond_t slot_ready;
+
+    // Filled in by the reader for the whole stream
+    size_t total_bytes;
+    char last_byte;
+    bool read_failed;
+    long long read_ns;      // in read(), with --stats
+    long long reader_wait_ns; // waiting for a free buffer, with --stats
+};
+
+StreamRing stream_ring;
+bool input_is_stream = false;
+
+void init_stream_ring(StreamRing& ring, int slots, size_t chunk_size) {
+    ring.buffers.assign(slots, vector<char>(chunk_size));
+    ring.starts.assign(slots, 0);
+    ring.lengths.assign(slots, 0);
+    ring.free_slots.clear();
+    for (int i = slots - 1; i >= 0; --i) {
+        ring.free_slots.push_back(i);
+    }
+    ring.ready_slots.assign(slots, -1);
+    ring.ready_head = 0;
+    ring.ready_count = 0;
+    ring.finished = false;
+    ring.total_bytes = 0;
+    ring.last_byte = '\n';
+    ring.read_ns = 0;
+    ring.reader_wait_ns = 0;
+    ring.read_failed = false;
+    pthread_mutex_init(&ring.lock, NULL);
+    pthread_cond_init(&ring.slot_free, NULL);
+    pthread_cond_init(&ring.slot_ready, NULL);
+}
+
+void destroy_stream_ring(StreamRing& ring) {
+    pthread_mutex_destroy(&ring.lock);
+    pthread_cond_destroy(&ring.slot_free);
+    pthread_cond_destroy(&ring.slot_ready);
+    ring.buffers.clear();
+}
+
+// Worker side: wait for a filled buffer; false once the stream is drained
+bool stream_take(StreamRing& ring, int& slot) {
+    pthread_mutex_lock(&ring.lock);
+    while (ring.ready_count == 0 && !ring.finished) {
+        pthread_cond_wait(&ring.slot_ready, &ring.lock);
+    }
+    bool have_slot = ring.ready_count > 0;
+    if (have_slot) {
+        slot = ring.ready_slots[ring.ready_head];
+        ring.ready_head = (ring.ready_head + 1) % ring.ready_slots.size();
+        ring.ready_count--;
+    }
+    pthread_mutex_unlock(&ring.lock);
+    return have_slot;
+}
+
+void stream_release(StreamRing& ring, int slot) {
+    pthread_mutex_lock(&ring.lock);
+    ring.free_slots.push_back(slot);
+    pthread_cond_signal(&ring.slot_free);
+    pthread_mutex_unlock(&ring.lock);
+}
+
+// Reader side: wait until a worker has handed a buffer back
+int stream_acquire_free(StreamRing& ring) {
+    pthread_mutex_lock(&ring.lock);
+    while (ring.free_slots.empty()) {
+        pthread_cond_wait(&ring.slot_free, &ring.lock);
+    }
+    int slot = ring.free_slots.back();
+    ring.free_slots.pop_back();
+    pthread_mutex_unlock(&ring.lock);
+    return slot;
+}
+
+void stream_publish(StreamRing& ring, int slot, size_t start, size_t length) {
+    pthread_mutex_lock(&ring.lock);
+    ring.starts[slot] = start;
+    ring.lengths[slot] = length;
+    size_t tail = (ring.ready_head + ring.ready_count) % ring.ready_slots.size();
+    ring.ready_slots[tail] = slot;
+    ring.ready_count++;
+    pthread_cond_signal(&ring.slot_ready);
+    pthread_mutex_unlock(&ring.lock);
+}
+
+void stream_finish(StreamRing& ring) {
+    pthread_mutex_lock(&ring.lock);
+    ring.finished = true;
+    pthread_cond_broadcast(&ring.slot_ready);
+    pthread_mutex_unlock(&ring.lock);
+}
+
+// Fill buffers from fd until EOF, starting with prefix (bytes of the stream
+// already read to sniff its format). Each buffer is cut after its last
+// whitespace byte and the unfinished word (or line tail) is carried to the
+// front of the next buffer, so every chunk starts at a word boundary and no
+// word is split or counted twice. Only a single token longer than a whole
+// buffer makes that buffer grow.
+void stream_reader(StreamRing& ring, int fd, const vector<char>& prefix) {
+    vector<char> carry(prefix);
+    bool eof = false;
+    while (!eof) {
+        long long mark = stats_now();
+        int slot = stream_acquire_free(ring);
+        if (stats_format != STATS_OFF) {
+            long long now = monotonic_ns();
+            ring.reader_wait_ns += now - mark;
+            mark = now;
+        }
+        vector<char>& buf = ring.buffers[slot];
+        size_t used = carry.size();
+        if (used > buf.size()) {
+            buf.resize(used);
+        }
+        if (used > 0) {
+            memcpy(buf.data(), carry.data(), used);
+        }
+
+        size_t cut = 0;
+        for (;;) {
+            while (used < buf.size() && !eof) {
+                ssize_t n = read(fd, buf.data() + used, buf.size() - used);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0) {
+                    ring.read_failed = true;
+                }
+                if (n <= 0) {
+                    eof = true;
+                    break;
+                }
+                used += n;
+            }
+            if (eof) {
+                cut = used;
+                break;
+            }
+            cut = used;
+            while (cut > 0 && !is_space_byte((unsigned char)buf[cut - 1])) {
+                cut--;
+            }
+            if (cut > 0) {
+                break;
+            }
+            buf.resize(buf.size() * 2); // one unbroken token fills the buffer
+        }
+        if (stats_format != STATS_OFF) {
+            ring.read_ns += monotonic_ns() - mark;
+        }
+
+        carry.assign(buf.begin() + cut, buf.begin() + used);
+        if (cut > 0) {
+            ring.total_bytes += cut;
+            ring.last_byte = buf[cut - 1];
+            stream_publish(ring, slot, 0, cut);
+        } else {
+            stream_release(ring, slot);
+        }
+    }
+    stream_finish(ring);
+}
+
+
+// Producers that fill slots out of order (async reads, parallel
+// decompression) write into an aligned target behind a headroom. Once a
+// slot's turn comes, the carried partial word is copied into the headroom
+// just in front of the new data, so chunks are cut exactly as in
+// stream_reader without moving the data itself.
+const size_t SLOT_ALIGNMENT = 4096;          // O_DIRECT block alignment
+const size_t SLOT_CARRY_HEADROOM = 64 << 10; // longest carry copied in place
+
+size_t slot_buffer_bytes(size_t capacity) {
+    return SLOT_CARRY_HEADROOM + SLOT_ALIGNMENT + capacity;
+}
+
+char* slot_data_target(vector<char>& buffer) {
+    uintptr_t address = (uintptr_t)buffer.data() + SLOT_CARRY_HEADROOM;
+    return (char*)((address + SLOT_ALIGNMENT - 1) & ~(uintptr_t)(SLOT_ALIGNMENT - 1));
+}
+
+// Non-blocking variant for producers that keep several slots in flight
+int stream_try_acquire_free(StreamRing& ring) {
+    pthread_mutex_lock(&ring.lock);
+    int slot = -1;
+    if (!ring.free_slots.empty()) {
+        slot = ring.free_slots.back();
+        ring.free_slots.pop_back();
+    }
+    pthread_mutex_unlock(&ring.lock);
+    return slot;
+}
+
+// Queue the length bytes at data (the slot's target) behind the carry, cut
+// after the last whitespace unless this is the last piece of the stream.
+// Only a carry longer than the headroom makes the buffer get rebuilt.
+void publish_with_carry(StreamRing& ring, vector<char>& carry, int slot, char* data, size_t length, bool last) {
+    vector<char>& buffer = ring.buffers[slot];
+    char* start = data - carry.size();
+    if (carry.size() > (size_t)(data - buffer.data())) {
+        vector<char> joined(max(buffer.size(), carry.size() + length));
+        memcpy(joined.data() + carry.size(), data, length);
+        buffer.swap(joined);
+        start = buffer.data();
+    }
+    if (!carry.empty()) {
+        memcpy(start, carry.data(), carry.size());
+    }
+    size_t used = carry.size() + length;
+
+    size_t cut = used;
+    if (!last) {
+        while (cut > 0 && !is_space_byte((unsigned char)start[cut - 1])) {
+            cut--;
+        }
+    }
+    if (cut == 0) {
+        carry.assign(start, start + used); // one unbroken token spans the piece
+        stream_release(ring, slot);
+        return;
+    }
+    carry.assign(start + cut, start + used);
+    ring.total_bytes += cut;
+    ring.last_byte = start[cut - 1];
+    stream_publish(ring, slot, start - buffer.data(), cut);
+}
+
+
+// --- Asynchronous File Input ---
+
+// --async feeds the stream ring from a regular file with several reads in
+// flight at once (io_uring, or pread threads), so workers scan the first
+// chunks while later ones are still coming off the disk. Reads land in the
+// slot targets and are published in file order through publish_with_carry.
+// With --direct the reads bypass the page cache (O_DIRECT), which needs
+// block-aligned buffers, offsets and lengths.
+
+const unsigned DEFAULT_IO_DEPTH = 8;
+
+struct AsyncChunk {
+    int slot;
+    char* data;       // where the read lands, aligned
+    size_t requested; // bytes of file data expected
+    long result;
+    bool done;
 };
 
-// Global instance of the results, shared among all threads
-AnalysisResults shared_results = {0, 0, 0, 0};
-// Mutex lock to protect access to the shared_results structure
-pthread_mutex_t mutex_lock;
+// Once async_wait() has failed the kernel may still write into the reads in
+// flight, so their buffers are given up for good: each such slot gets a new
+// one, and nothing a read could land in is ever reused or freed
+void abandon_async_chunks(StreamRing& ring, AsyncReader& io, vector<AsyncChunk>& window, size_t from,
+                          size_t to) {
+    async_reader_abandon(io);
+    for (size_t i = from; i < to; ++i) {
+        AsyncChunk& chunk = window[i % window.size()];
+        if (!chunk.done) {
+            new vector<char>(move(ring.buffers[chunk.slot])); // deliberately leaked
+            ring.buffers[chunk.slot].clear();
+        }
+        stream_release(ring, chunk.slot);
+    }
+}
+
+// io reads the file, through O_DIRECT when direct is set (chunk_size is then
+// a whole number of blocks); fd is a buffered descriptor for finishing short
+// reads
+void async_stream_reader(StreamRing& ring, AsyncReader& io, int fd, size_t file_size, size_t chunk_size,
+                         bool direct) {
+    const size_t depth = io.depth;
+    const size_t chunk_count = (file_size + chunk_size - 1) / chunk_size;
+    vector<AsyncChunk> window(depth);
+    vector<char> carry;
+    size_t submitted = 0;
+    size_t published = 0;
+    bool eof = false;
+    bool broken = false; // async_wait() failed: reads in flight cannot be waited for
+
+    while (published < chunk_count && !eof) {
+        // Keep the window full while buffers are free; block for one only
+        // when nothing is in flight
+        long long mark = stats_now();
+        while (submitted < chunk_count && submitted - published < depth) {
+            int slot = submitted == published ? stream_acquire_free(ring) : stream_try_acquire_free(ring);
+            if (slot < 0) {
+                break;
+            }
+            vector<char>& buffer = ring.buffers[slot];
+            if (buffer.size() < slot_buffer_bytes(chunk_size)) {
+                buffer.resize(slot_buffer_bytes(chunk_size));
+            }
+            AsyncChunk& chunk = window[submitted % depth];
+            size_t offset = submitted * chunk_size;
+            chunk.slot = slot;
+            chunk.data = slot_data_target(buffer);
+            chunk.requested = min(chunk_size, file_size - offset);
+            chunk.done = false;
+            size_t length = chunk.requested;
+            if (direct) {
+                length = (length + SLOT_ALIGNMENT - 1) & ~(SLOT_ALIGNMENT - 1);
+            }
+            async_submit(io, AsyncRequest{submitted, chunk.data, length, offset});
+            submitted++;
+        }
+        if (stats_format != STATS_OFF) {
+            long long now = monotonic_ns();
+            ring.reader_wait_ns += now - mark;
+            mark = now;
+        }
+
+        // Chunks are published in file order, whatever order reads finish in
+        AsyncChunk& chunk = window[published % depth];
+        while (!chunk.done) {
+            AsyncCompletion completion;
+            if (!async_wait(io, completion)) {
+                broken = true;
+                break;
+            }
+            window[completion.tag % depth].result = completion.result;
+            window[completion.tag % depth].done = true;
+        }
+        if (broken) {
+            break;
+        }
+        size_t offset = published * chunk_size;
+        published++;
+
+        size_t length = 0;
+        if (chunk.result < 0) {
+            ring.read_failed = true;
+        } else {
+            length = min((size_t)chunk.result, chunk.requested);
+        }
+        // A short read before the expected end is finished through the page
+        // cache; if that also comes up short the file shrank
+        while (chunk.result >= 0 && length < chunk.requested) {
+            ssize_t n = pread(fd, chunk.data + length, chunk.requested - length, offset + length);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                ring.read_failed = true;
+            }
+            if (n <= 0) {
+                break;
+            }
+            length += n;
+        }
+        if (length < chunk.requested) {
+            eof = true;
+        }
+        if (stats_format != STATS_OFF) {
+            ring.read_ns += monotonic_ns() - mark;
+        }
+
+        publish_with_carry(ring, carry, chunk.slot, chunk.data, length, eof || published == chunk_count);
+    }
+
+    // Reads still in flight after an early end are waited for and dropped
+    while (!broken && published < submitted) {
+        AsyncChunk& chunk = window[published % depth];
+        while (!chunk.done) {
+            AsyncCompletion completion;
+            if (!async_wait(io, completion)) {
+                broken = true;
+                break;
+            }
+            window[completion.tag % depth].done = true;
+        }
+        if (!broken) {
+            stream_release(ring, chunk.slot);
+            published++;
+        }
+    }
+    if (broken) {
+        ring.read_failed = true;
+        abandon_async_chunks(ring, io, window, published, submitted);
+    }
+    stream_finish(ring);
+}
+
+
+// --- Compressed Input ---
 
+// gzip and zstd input is decoded straight into stream ring slots, so the
+// plain text only ever exists a chunk at a time. BGZF files and multi-frame
+// zstd files are split into independent segments that a pool decodes in
+// parallel; anything else is decoded sequentially by the reader while the
+// workers scan.
+
+const size_t COMPRESSED_READ_SIZE = 256 << 10;
+const size_t MAX_SEGMENT_PLAIN_SIZE = 64 << 20; // larger frames are decoded sequentially
+
+// Fill out[produced, capacity) from the decoder, reading more compressed
+// input from fd as needed. in/in_length track the unread part of input.
+// Returns true once the compressed data is exhausted.
+bool decode_from_fd(StreamDecoder& decoder, int fd, vector<char>& input, const unsigned char*& in,
+                    size_t& in_length, bool& input_eof, char* out, size_t capacity, size_t& produced) {
+    while (produced < capacity && !decoder.finished && !decoder.failed) {
+        // Keep a whole magic number in view so the next gzip member is recognised
+        if (in_length < COMPRESSION_MAGIC_BYTES && !input_eof) {
+            memmove(input.data(), in, in_length);
+            in = (const unsigned char*)input.data();
+            ssize_t n = read(fd, input.data() + in_length, input.size() - in_length);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                decoder.failed = true;
+            }
+            if (n <= 0) {
+                input_eof = true;
+            } else {
+                in_length += n;
+            }
+            continue;
+        }
+        if (in_length == 0 && !decoder.output_pending) {
+            break;
+        }
+        decoder_run(decoder, in, in_length, out, capacity, produced);
+    }
+    bool exhausted = decoder.finished || decoder.failed ||
+                     (input_eof && in_length == 0 && !decoder.output_pending);
+    // Data that stops inside a member or frame is truncated
+    if (exhausted && !decoder.finished && !decoder.at_member_end) {
+        decoder.failed = true;
+    }
+    return exhausted;
+}
 
-const string SEARCH_TERM = "threads"; // The term to count occurrences of
+// Sequential decoding into the ring. prefix holds bytes already read from fd
+// (the sniffed magic of a standard input stream).
+void decompress_stream_reader(StreamRing& ring, int fd, Compression kind, const vector<char>& prefix,
+                              size_t chunk_size) {
+    StreamDecoder decoder;
+    if (!decoder_init(decoder, kind)) {
+        ring.read_failed = true;
+        stream_finish(ring);
+        return;
+    }
+    vector<char> input(max(COMPRESSED_READ_SIZE, prefix.size()));
+    memcpy(input.data(), prefix.data(), prefix.size());
+    const unsigned char* in = (const unsigned char*)input.data();
+    size_t in_length = prefix.size();
+    bool input_eof = false;
+    vector<char> carry;
 
+    bool last = false;
+    while (!last) {
+        int slot = stream_acquire_free(ring);
+        vector<char>& buffer = ring.buffers[slot];
+        if (buffer.size() < slot_buffer_bytes(chunk_size)) {
+            buffer.resize(slot_buffer_bytes(chunk_size));
+        }
+        char* out = slot_data_target(buffer);
+        size_t produced = 0;
+        long long mark = stats_now();
+        last = decode_from_fd(decoder, fd, input, in, in_length, input_eof, out, chunk_size, produced);
+        if (stats_format != STATS_OFF) {
+            ring.read_ns += monotonic_ns() - mark;
+        }
+        publish_with_carry(ring, carry, slot, out, produced, last);
+    }
+    if (decoder.failed) {
+        ring.read_failed = true;
+    }
+    decoder_destroy(decoder);
+    stream_finish(ring);
+}
 
-// Structure passed to each thread containing its specific analysis section
-struct ThreadData {
-    string content_section;
+struct DecodeChunk {
+    int slot;
+    char* out;
+    size_t expected; // plain bytes the segments declare
+    long produced;
+    bool done;
 };
 
+// Parallel decoding of independent segments. Runs of whole segments of up
+// to chunk_size plain bytes go to the pool; results are published in file
+// order, as in async_stream_reader.
+void parallel_decompress_reader(StreamRing& ring, DecodePool& pool, Compression kind, const char* data,
+                                const vector<CompressedSegment>& segments, size_t chunk_size, size_t capacity) {
+    const size_t depth = 2 * pool.threads.size();
+    vector<DecodeChunk> window(depth);
+    vector<char> carry;
+    size_t next_segment = 0;
+    size_t submitted = 0;
+    size_t published = 0;
+    bool failed = false;
+
+    while (!failed && (next_segment < segments.size() || published < submitted)) {
+        long long mark = stats_now();
+        while (next_segment < segments.size() && submitted - published < depth) {
+            int slot = submitted == published ? stream_acquire_free(ring) : stream_try_acquire_free(ring);
+            if (slot < 0) {
+                break;
+            }
+            size_t first = next_segment;
+            size_t plain = segments[next_segment++].plain_size;
+            while (next_segment < segments.size() && plain + segments[next_segment].plain_size <= chunk_size) {
+                plain += segments[next_segment++].plain_size;
+            }
+            const CompressedSegment& last_segment = segments[next_segment - 1];
+            size_t in_length = last_segment.offset + last_segment.length - segments[first].offset;
+
+            vector<char>& buffer = ring.buffers[slot];
+            if (buffer.size() < slot_buffer_bytes(capacity)) {
+                buffer.resize(slot_buffer_bytes(capacity));
+            }
+            DecodeChunk& chunk = window[submitted % depth];
+            chunk.slot = slot;
+            chunk.out = slot_data_target(buffer);
+            chunk.expected = plain;
+            chunk.done = false;
+            decode_pool_submit(pool, DecodeJob{submitted, kind, data + segments[first].offset, in_length,
+                                               chunk.out, plain});
+            submitted++;
+        }
+        if (stats_format != STATS_OFF) {
+            long long now = monotonic_ns();
+            ring.reader_wait_ns += now - mark;
+            mark = now;
+        }
+
+        DecodeChunk& chunk = window[published % depth];
+        while (!chunk.done) {
+            DecodeResult result = decode_pool_wait(pool);
+            window[result.tag % depth].produced = result.produced;
+            window[result.tag % depth].done = true;
+        }
+        published++;
+        if (stats_format != STATS_OFF) {
+            ring.read_ns += monotonic_ns() - mark;
+        }
+
+        // A segment that does not decode to its declared size is corrupt;
+        // what was published so far stands
+        failed = chunk.produced != (long)chunk.expected;
+        bool last = failed || (next_segment == segments.size() && published == submitted);
+        publish_with_carry(ring, carry, chunk.slot, chunk.out, failed ? 0 : chunk.expected, last);
+    }
+
+    while (published < submitted) {
+        DecodeChunk& chunk = window[published % depth];
+        while (!chunk.done) {
+            DecodeResult result = decode_pool_wait(pool);
+            window[result.tag % depth].done = true;
+        }
+        stream_release(ring, chunk.slot);
+        published++;
+    }
+    if (failed) {
+        ring.read_failed = true;
+    }
+    stream_finish(ring);
+}
+
 
 // --- Thread Function ---
-void* analyze_section(void* arg) {
-    ThreadData* data = (ThreadData*)arg;
-    stringstream ss(data->content_section);
-    string line;
 
-    // Local counters for this specific thread
-    long local_chars = 0;
-    long local_lines = 0;
-    long local_words = 0;
-    long local_term_occurrences = 0;
-    
-    // Process the content line by line
-    while (getline(ss, line)) {
-        local_lines++;
-        local_chars += line.length() + 1; 
-        
-        string word;
-        stringstream line_stream(line);
-        
-        // Process the line word by word
-        while (line_stream >> word) {
-            local_words++;
-            if (word.find(SEARCH_TERM) != string::npos) {
-                local_term_occurrences++;
+// Scan one chunk of a large file and merge it into the file's totals. The
+// per-file lock is taken once per chunk and only contended by workers on
+// the same file.
+void analyze_file_chunk(ThreadData* data, const WorkItem& item) {
+    InputFile& file = scheduler.files[item.file];
+    AnalysisResults& counts = data->chunk_counts;
+    reset_results(counts, search_terms.size());
+
+    size_t begin = 0;
+    size_t end = 0;
+    long long mark = stats_now();
+    if (acquire_file(scheduler, file)) {
+        begin = chunk_boundary(file.buffer, scheduler.chunk_size, item.chunk, file.chunk_count);
+        end = chunk_boundary(file.buffer, scheduler.chunk_size, item.chunk + 1, file.chunk_count);
+        long long scan_mark = stats_now();
+        data->load_ns += scan_mark - mark;
+        mark = scan_mark;
+        scan_section(file.buffer.data + begin, end - begin, counts, data->term_scratch);
+        if (file.buffer.map_base != NULL) {
+            release_scanned_pages(file.buffer.data + begin, end - begin);
+        }
+    }
+    long long merge_mark = stats_now();
+    data->scan_ns += merge_mark - mark;
+    data->chunks_scanned++;
+    data->bytes_scanned += end - begin;
+
+    pthread_mutex_lock(&file.lock);
+    if (file.loaded) {
+        add_results(file.results, counts);
+        if (end == file.buffer.length && end > 0) {
+            file.last_byte = file.buffer.data[end - 1];
+        }
+    }
+    if (--file.chunks_left == 0) {
+        release_input(file.buffer);
+    }
+    pthread_mutex_unlock(&file.lock);
+    data->merge_ns += stats_now() - merge_mark;
+}
+
+// Read and scan a run of small files; this worker is their only writer
+void analyze_small_files(ThreadData* data, const WorkItem& item) {
+    for (size_t f = item.file; f < item.file + item.file_count; ++f) {
+        InputFile& file = scheduler.files[f];
+        size_t length;
+        long long mark = stats_now();
+        if (!read_whole_file(file.path.c_str(), file.start_offset, data->read_buffer, length)) {
+            file.failed = true;
+            continue;
+        }
+        long long scan_mark = stats_now();
+        data->load_ns += scan_mark - mark;
+        scan_section(data->read_buffer.data(), length, file.results, data->term_scratch);
+        data->scan_ns += stats_now() - scan_mark;
+        file.loaded = true;
+        file.scanned_end = file.start_offset + length;
+        if (length > 0) {
+            file.last_byte = data->read_buffer[length - 1];
+        }
+        data->bytes_scanned += length;
+    }
+    data->chunks_scanned++;
+}
+
+// Decode a compressed file piece by piece into this worker's buffer,
+// scanning up to the last whitespace of each piece and carrying the rest
+void analyze_compressed_file(ThreadData* data, const WorkItem& item) {
+    InputFile& file = scheduler.files[item.file];
+    long long mark = stats_now();
+    StreamDecoder decoder;
+    int fd = open(file.path.c_str(), O_RDONLY);
+    if (fd < 0 || !decoder_init(decoder, file.compression)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        file.failed = true;
+        data->chunks_scanned++;
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    vector<char>& input = data->compressed_input;
+    vector<char>& buffer = data->decode_buffer;
+    input.resize(COMPRESSED_READ_SIZE);
+    buffer.resize(max(buffer.size(), scheduler.chunk_size));
+    const unsigned char* in = (const unsigned char*)input.data();
+    size_t in_length = 0;
+    bool input_eof = false;
+    size_t carried = 0;
+    size_t plain_bytes = 0;
+
+    bool last = false;
+    while (!last) {
+        // A token longer than the buffer makes it grow
+        if (carried == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        size_t produced = carried;
+        last = decode_from_fd(decoder, fd, input, in, in_length, input_eof, buffer.data(), buffer.size(), produced);
+        long long scan_mark = stats_now();
+        data->load_ns += scan_mark - mark;
+
+        size_t cut = produced;
+        if (!last) {
+            while (cut > 0 && !is_space_byte((unsigned char)buffer[cut - 1])) {
+                cut--;
             }
         }
+        scan_section(buffer.data(), cut, file.results, data->term_scratch);
+        if (cut > 0) {
+            file.last_byte = buffer[cut - 1];
+        }
+        plain_bytes += cut;
+        carried = produced - cut;
+        memmove(buffer.data(), buffer.data() + cut, carried);
+        mark = stats_now();
+        data->scan_ns += mark - scan_mark;
     }
+    close(fd);
 
-    // Critical Section
-    pthread_mutex_lock(&mutex_lock);
+    file.loaded = true;
+    file.failed = decoder.failed;
+    decoder_destroy(decoder);
+    data->chunks_scanned++;
+    data->bytes_scanned += plain_bytes;
+}
+
+void* analyze_section(void* arg) {
+    ThreadData* data = (ThreadData*)arg;
+    long long started = stats_now();
 
-    // Update the shared global counters (Critical Section)
-    shared_results.total_chars += local_chars;
-    shared_results.total_lines += local_lines;
-    shared_results.total_words += local_words;
-    shared_results.term_occurrences += local_term_occurrences;
+    if (input_is_stream) {
+        int slot;
+        long long mark = started;
+        while (stream_take(stream_ring, slot)) {
+            size_t length = stream_ring.lengths[slot];
+            long long scan_mark = stats_now();
+            data->wait_ns += scan_mark - mark;
+            const char* start = stream_ring.buffers[slot].data() + stream_ring.starts[slot];
+            scan_section(start, length, data->results, data->term_scratch);
+            stream_release(stream_ring, slot);
+            mark = stats_now();
+            data->scan_ns += mark - scan_mark;
+            data->chunks_scanned++;
+            data->bytes_scanned += length;
+        }
+        data->wait_ns += stats_now() - mark;
+        data->busy_ns = stats_now() - started;
+        pthread_exit(NULL);
+    }
 
-    // Release the lock
-    pthread_mutex_unlock(&mutex_lock);
+    size_t index;
+    while ((index = scheduler.next_item.fetch_add(1, memory_order_relaxed)) < scheduler.items.size()) {
+        const WorkItem& item = scheduler.items[index];
+        if (scheduler.files[item.file].compression != COMPRESSION_NONE) {
+            analyze_compressed_file(data, item);
+        } else if (scheduler.files[item.file].batched) {
+            analyze_small_files(data, item);
+        } else {
+            analyze_file_chunk(data, item);
+        }
+    }
 
+    data->busy_ns = stats_now() - started;
     pthread_exit(NULL);
 }
 
 
 // --- Main Program ---
+
+void print_usage(const char* program) {
+    cerr << "Usage: " << program << " [--mmap | --read | --stream | --async] [--threads N] [--chunk-size SIZE]"
+         << " [--pin none|cpu|numa] [--term WORD]... [--terms FILE] [--checkpoint DIR]"
+         << " [--stats json|prometheus] [--stats-file FILE] [--io-depth N] [--io-engine uring|threads] [--direct]"
+         << " [--no-decompress] [--results-out FILE]"
+         << " [--kernel scalar|sse42|avx2|neon] <input_file | directory | pattern | ->..." << endl;
+}
+
+void print_term_counts(const AnalysisResults& results) {
+    for (size_t i = 0; i < search_terms.size(); ++i) {
+        cout << ", '" << search_terms[i] << "' " << results.term_occurrences[i];
+    }
+}
+
+// Statistics snapshot of a finished run
+struct RunSummary {
+    const char* input_mode;
+    int threads;
+    long long bytes;
+    long long stream_read_ns;
+    long long stream_wait_ns;
+};
+
+double ns_to_seconds(long long ns) {
+    return ns / 1e9;
+}
+
+double bytes_per_second(long long bytes, long long ns) {
+    return ns > 0 ? bytes / ns_to_seconds(ns) : 0.0;
+}
+
+void write_stats_json(ostream& out, const RunSummary& run, const vector<ThreadData>& workers) {
+    long long total_ns = 0;
+    out << "{\"input_mode\": \"" << run.input_mode << "\", \"threads\": " << run.threads
+        << ", \"kernel\": \"" << scan_kernel_name(scan_kernel) << "\", \"bytes\": " << run.bytes
+        << ", \"phases_seconds\": {";
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        out << (p > 0 ? ", " : "") << "\"" << phase_names[p] << "\": " << ns_to_seconds(phase_ns[p]);
+        total_ns += phase_ns[p];
+    }
+    out << ", \"total\": " << ns_to_seconds(total_ns) << "}"
+        << ", \"bytes_per_second\": " << bytes_per_second(run.bytes, phase_ns[PHASE_WORKERS]);
+    if (input_is_stream) {
+        out << ", \"stream\": {\"read_seconds\": " << ns_to_seconds(run.stream_read_ns)
+            << ", \"reader_wait_seconds\": " << ns_to_seconds(run.stream_wait_ns) << "}";
+    }
+    out << ", \"workers\": [";
+    for (size_t i = 0; i < workers.size(); ++i) {
+        const ThreadData& w = workers[i];
+        out << (i > 0 ? ", " : "") << "{\"id\": " << w.worker_id + 1 << ", \"items\": " << w.chunks_scanned
+            << ", \"bytes\": " << w.bytes_scanned << ", \"load_seconds\": " << ns_to_seconds(w.load_ns)
+            << ", \"scan_seconds\": " << ns_to_seconds(w.scan_ns) << ", \"merge_seconds\": " << ns_to_seconds(w.merge_ns)
+            << ", \"wait_seconds\": " << ns_to_seconds(w.wait_ns) << ", \"busy_seconds\": " << ns_to_seconds(w.busy_ns)
+            << ", \"scan_bytes_per_second\": " << bytes_per_second(w.bytes_scanned, w.scan_ns) << "}";
+    }
+    out << "]}" << endl;
+}
+
+// Prometheus text exposition format, for a textfile collector or a pushgateway
+void write_stats_prometheus(ostream& out, const RunSummary& run, const vector<ThreadData>& workers) {
+    out << "# HELP m3_phase_seconds Wall time of each analyzer phase.\n"
+        << "# TYPE m3_phase_seconds gauge\n";
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        out << "m3_phase_seconds{phase=\"" << phase_names[p] << "\"} " << ns_to_seconds(phase_ns[p]) << "\n";
+    }
+    out << "# HELP m3_bytes_scanned Bytes scanned in this run.\n"
+        << "# TYPE m3_bytes_scanned gauge\n"
+        << "m3_bytes_scanned{mode=\"" << run.input_mode << "\",threads=\"" << run.threads << "\"} " << run.bytes << "\n"
+        << "# HELP m3_bytes_per_second Bytes scanned per second of worker wall time.\n"
+        << "# TYPE m3_bytes_per_second gauge\n"
+        << "m3_bytes_per_second " << bytes_per_second(run.bytes, phase_ns[PHASE_WORKERS]) << "\n";
+    if (input_is_stream) {
+        out << "# HELP m3_stream_reader_seconds Time the stream reader spent per activity.\n"
+            << "# TYPE m3_stream_reader_seconds gauge\n"
+            << "m3_stream_reader_seconds{activity=\"read\"} " << ns_to_seconds(run.stream_read_ns) << "\n"
+            << "m3_stream_reader_seconds{activity=\"wait\"} " << ns_to_seconds(run.stream_wait_ns) << "\n";
+    }
+    out << "# HELP m3_worker_bytes_scanned Bytes scanned by each worker.\n"
+        << "# TYPE m3_worker_bytes_scanned gauge\n";
+    for (size_t i = 0; i < workers.size(); ++i) {
+        out << "m3_worker_bytes_scanned{worker=\"" << workers[i].worker_id + 1 << "\"} " << workers[i].bytes_scanned << "\n";
+    }
+    out << "# HELP m3_worker_seconds Time each worker spent per activity.\n"
+        << "# TYPE m3_worker_seconds gauge\n";
+    const char* activities[] = {"load", "scan", "merge", "wait", "busy"};
+    for (size_t i = 0; i < workers.size(); ++i) {
+        const ThreadData& w = workers[i];
+        long long values[] = {w.load_ns, w.scan_ns, w.merge_ns, w.wait_ns, w.busy_ns};
+        for (int a = 0; a < 5; ++a) {
+            out << "m3_worker_seconds{worker=\"" << w.worker_id + 1 << "\",activity=\"" << activities[a] << "\"} "
+                << ns_to_seconds(values[a]) << "\n";
+        }
+    }
+    out.flush();
+}
+
+// Append the final results to path as one WIRE_ANALYSIS record, so other
+// modules can read them without parsing the report
+bool write_results_record(const string& path, const char* input, long long bytes, long long elapsed_ns, int threads,
+                          size_t files, size_t failed_files) {
+    wire_analysis fixed = {};
+    fixed.input_bytes = bytes;
+    fixed.elapsed_ns = elapsed_ns;
+    fixed.threads = threads;
+    fixed.files = files;
+    fixed.failed_files = failed_files;
+    vector<char> record;
+    size_t length = encode_results_record(record, shared_results, search_terms, fixed, input);
+    if (length == 0) {
+        return false;
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool written = write(fd, record.data(), length) == (ssize_t)length;
+    return close(fd) == 0 && written;
+}
+
 int main(int argc, char* argv[]) {
+    long long run_started = monotonic_ns();
+    long long phase_mark = run_started;
     cout << "--- Linux System Guardian: Multithreaded File Analyzer ---" << endl;
 
-    if (argc < 2) {
-        cerr << "Usage: " << argv[0] << " <input_file>" << endl;
+    InputMode input_mode = INPUT_MMAP;
+    PinMode pin_mode = PIN_NONE;
+    int num_threads = 0; // 0 means one per available CPU
+    size_t chunk_size = DEFAULT_CHUNK_SIZE;
+    scan_kernel = detect_scan_kernel();
+    vector<string> inputs;
+    string stats_path;
+    string results_path;
+    unsigned io_depth = DEFAULT_IO_DEPTH;
+    AsyncEngine io_engine = ASYNC_ENGINE_URING;
+    bool direct_io = false;
+    bool usage_error = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            ScanKernel requested;
+            if (!parse_scan_kernel(argv[++i], requested) || !scan_kernel_supported(requested)) {
+                cerr << "Error: kernel '" << argv[i] << "' is not available on this CPU" << endl;
+                return 1;
+            }
+            scan_kernel = requested;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+            if (num_threads < 1) {
+                cerr << "Error: --threads needs a positive number" << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--term") == 0 && i + 1 < argc) {
+            search_terms.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--terms") == 0 && i + 1 < argc) {
+            if (!load_terms_file(argv[++i], search_terms)) {
+                cerr << "Error: Could not open terms file " << argv[i] << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--chunk-size") == 0 && i + 1 < argc) {
+            if (!parse_size(argv[++i], chunk_size)) {
+                cerr << "Error: --chunk-size needs a size such as 4M or 512K" << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--pin") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "none") == 0) {
+                pin_mode = PIN_NONE;
+            } else if (strcmp(mode, "cpu") == 0) {
+                pin_mode = PIN_CPU;
+            } else if (strcmp(mode, "numa") == 0) {
+                pin_mode = PIN_NUMA;
+            } else {
+                usage_error = true;
+            }
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpoint_dir = argv[++i];
+            struct stat dir_stat;
+            if (stat(checkpoint_dir.c_str(), &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode)) {
+                cerr << "Error: checkpoint directory " << checkpoint_dir << " does not exist" << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            const char* format = argv[++i];
+            if (strcmp(format, "json") == 0) {
+                stats_format = STATS_JSON;
+            } else if (strcmp(format, "prometheus") == 0 || strcmp(format, "prom") == 0) {
+                stats_format = STATS_PROMETHEUS;
+            } else {
+                usage_error = true;
+            }
+        } else if (strcmp(argv[i], "--stats-file") == 0 && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (strcmp(argv[i], "--results-out") == 0 && i + 1 < argc) {
+            results_path = argv[++i];
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            input_mode = INPUT_MMAP;
+        } else if (strcmp(argv[i], "--read") == 0) {
+            input_mode = INPUT_READ;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            input_mode = INPUT_STREAM;
+        } else if (strcmp(argv[i], "--async") == 0) {
+            input_mode = INPUT_ASYNC;
+        } else if (strcmp(argv[i], "--no-decompress") == 0) {
+            decompress_inputs = false;
+        } else if (strcmp(argv[i], "--direct") == 0) {
+            direct_io = true;
+        } else if (strcmp(argv[i], "--io-depth") == 0 && i + 1 < argc) {
+            int depth = atoi(argv[++i]);
+            if (depth < 1 || depth > 256) {
+                cerr << "Error: --io-depth needs a number from 1 to 256" << endl;
+                return 1;
+            }
+            io_depth = depth;
+        } else if (strcmp(argv[i], "--io-engine") == 0 && i + 1 < argc) {
+            const char* engine = argv[++i];
+            if (strcmp(engine, "uring") == 0) {
+                io_engine = ASYNC_ENGINE_URING;
+            } else if (strcmp(engine, "threads") == 0) {
+                io_engine = ASYNC_ENGINE_THREADS;
+            } else {
+                usage_error = true;
+            }
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            usage_error = true;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+
+    if (inputs.empty() || usage_error) {
+        print_usage(argv[0]);
         return 1;
     }
-    
-    const char* filename = argv[1];
-    
-    // Read the entire file content into a single string
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cerr << "Error: Could not open file " << filename << endl;
+
+    // Standard input, pipes and other non-regular files can only be streamed
+    struct stat input_stat;
+    bool from_stdin = inputs[0] == "-";
+    if (inputs.size() == 1 && (from_stdin || (stat(inputs[0].c_str(), &input_stat) == 0 &&
+                                              !S_ISREG(input_stat.st_mode) && !S_ISDIR(input_stat.st_mode)))) {
+        input_mode = INPUT_STREAM;
+    }
+    // A single compressed file is decoded into the ring whatever mode was asked for
+    Compression input_compression = COMPRESSION_NONE;
+    bool regular_input = inputs.size() == 1 && !from_stdin && stat(inputs[0].c_str(), &input_stat) == 0 &&
+                         S_ISREG(input_stat.st_mode);
+    if (regular_input && decompress_inputs) {
+        input_compression = sniff_compression(inputs[0].c_str());
+        if (input_compression != COMPRESSION_NONE) {
+            input_mode = INPUT_STREAM;
+        }
+    }
+    if (input_mode == INPUT_ASYNC && (inputs.size() > 1 || stat(inputs[0].c_str(), &input_stat) != 0 ||
+                                      !S_ISREG(input_stat.st_mode))) {
+        cerr << "Error: --async reads a single regular file" << endl;
         return 1;
     }
-    
-    // Get file size and read content
-    file.seekg(0, ios::end);
-    long file_size = file.tellg();
-    string file_content(file_size, ' ');
-    file.seekg(0, ios::beg);
-    file.read(&file_content[0], file_size);
-    file.close();
+    input_is_stream = (input_mode == INPUT_STREAM || input_mode == INPUT_ASYNC);
+    if (input_is_stream && inputs.size() > 1) {
+        cerr << "Error: streaming analyzes a single input" << endl;
+        return 1;
+    }
+
+    if (input_is_stream && !checkpoint_dir.empty()) {
+        cerr << "Warning: streamed input cannot be resumed, --checkpoint is ignored" << endl;
+        checkpoint_dir.clear();
+    }
+
+    if (search_terms.empty()) {
+        search_terms.push_back(DEFAULT_SEARCH_TERM);
+    }
+    prepare_search_terms();
+    reset_results(shared_results, search_terms.size());
+    stats_lap(PHASE_SETUP, phase_mark);
+
+    // Streams are read through the ring; files are planned as work items
+    const char* filename = inputs[0].c_str();
+    int stream_fd = -1;
+    vector<string> paths;
+    vector<char> stream_prefix; // bytes read from a stream to sniff its format
+    if (input_is_stream) {
+        stream_fd = from_stdin ? STDIN_FILENO : open(filename, O_RDONLY);
+        if (stream_fd < 0) {
+            cerr << "Error: Could not open file " << filename << endl;
+            return 1;
+        }
+        posix_fadvise(stream_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        if (!regular_input && decompress_inputs) {
+            stream_prefix.resize(COMPRESSION_MAGIC_BYTES);
+            size_t got = 0;
+            while (got < stream_prefix.size()) {
+                ssize_t n = read(stream_fd, stream_prefix.data() + got, stream_prefix.size() - got);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    break;
+                }
+                got += n;
+            }
+            stream_prefix.resize(got);
+            input_compression = detect_compression((const unsigned char*)stream_prefix.data(), got);
+        }
+        if (!compression_supported(input_compression)) {
+            cerr << "Error: " << filename << " is " << compression_name(input_compression)
+                 << "-compressed but this build has no " << compression_name(input_compression) << " support" << endl;
+            return 1;
+        }
+    } else {
+        collect_inputs(inputs, paths);
+        if (paths.empty()) {
+            cerr << "Error: no input files found" << endl;
+            return 1;
+        }
+    }
+    bool batch_mode = paths.size() > 1 || (inputs.size() == 1 && paths.size() == 1 && paths[0] != inputs[0]);
+    if (!input_is_stream) {
+        scheduler.mode = input_mode;
+        scheduler.chunk_size = chunk_size;
+        plan_work(scheduler, paths, batch_mode);
+        if (!batch_mode && scheduler.files[0].failed) {
+            cerr << "Error: Could not open file " << filename << endl;
+            return 1;
+        }
+    }
+    stats_lap(PHASE_PLAN, phase_mark);
 
     // Determine the number of threads
-    int num_threads = 4;
-    pthread_t threads[num_threads];
-    vector<ThreadData> thread_data(num_threads);
-    
-    // Initialize the Mutex
-    if (pthread_mutex_init(&mutex_lock, NULL) != 0) {
-        cerr << "Mutex initialization failed" << endl;
-        return 1;
+    if (num_threads == 0) {
+        num_threads = detect_worker_count();
     }
+    vector<pthread_t> threads(num_threads);
+    vector<ThreadData> thread_data(num_threads);
+    vector<cpu_set_t> affinities = worker_affinities(pin_mode, num_threads);
 
-    // --- Divide Content and Create Threads ---
+    // --- Set Up the Work Source and Start the Worker Pool ---
 
-    int section_size = file_content.length() / num_threads;
-    cout << "Analyzing file: " << filename << " using " << num_threads << " threads." << endl;
-    cout << "Search term: '" << SEARCH_TERM << "'" << endl;
+    // Async reads go through their own descriptor, which bypasses the page
+    // cache with --direct; O_DIRECT chunks must be whole blocks
+    AsyncReader async_io;
+    int async_fd = stream_fd;
+    if (input_mode == INPUT_ASYNC) {
+        if (direct_io) {
+            chunk_size = (chunk_size + SLOT_ALIGNMENT - 1) & ~(SLOT_ALIGNMENT - 1);
+            async_fd = open(filename, O_RDONLY | O_DIRECT);
+            if (async_fd < 0) {
+                cerr << "Warning: O_DIRECT is not supported for " << filename << ", reading through the page cache" << endl;
+                async_fd = stream_fd;
+                direct_io = false;
+            }
+        }
+        if (!async_reader_init(async_io, async_fd, io_depth, io_engine)) {
+            cerr << "Error: could not start asynchronous reads" << endl;
+            return 1;
+        }
+    }
 
-    for (int i = 0; i < num_threads; ++i) {
-        int start = i * section_size;
-        int end = (i == num_threads - 1) ? file_content.length() : (i + 1) * section_size;
-        
-      
-        if (i < num_threads - 1 && end < file_content.length()) {
-            end = file_content.find('\n', end);
-            if (end == string::npos) {
-                end = file_content.length();
+    // Independent segments of a compressed file are decoded in parallel.
+    // Only the compressed bytes are mapped, never the plain text.
+    DecodePool decode_pool;
+    vector<CompressedSegment> segments;
+    void* compressed_map = MAP_FAILED;
+    size_t slot_capacity = chunk_size;
+    if (input_compression != COMPRESSION_NONE && regular_input && input_stat.st_size > 0) {
+        compressed_map = mmap(NULL, input_stat.st_size, PROT_READ, MAP_PRIVATE, stream_fd, 0);
+        if (compressed_map != MAP_FAILED) {
+            const unsigned char* bytes = (const unsigned char*)compressed_map;
+            bool split = input_compression == COMPRESSION_GZIP ? find_bgzf_segments(bytes, input_stat.st_size, segments)
+                                                               : find_zstd_segments(bytes, input_stat.st_size, segments);
+            size_t largest = 0;
+            for (size_t i = 0; i < segments.size(); ++i) {
+                largest = max(largest, segments[i].plain_size);
+            }
+            if (split && largest <= MAX_SEGMENT_PLAIN_SIZE && decode_pool_init(decode_pool, num_threads)) {
+                slot_capacity = max(chunk_size, largest);
             } else {
-                end++; // Include the newline in the section
+                segments.clear();
+                munmap(compressed_map, input_stat.st_size);
+                compressed_map = MAP_FAILED;
+            }
+        }
+    }
+
+    // Two buffers per worker keep the reader one chunk ahead of every
+    // worker, plus one per read or decode in flight
+    int stream_slots = 2 * num_threads + 1;
+    if (input_mode == INPUT_ASYNC) {
+        stream_slots += io_depth;
+    } else if (!segments.empty()) {
+        stream_slots += 2 * decode_pool.threads.size();
+    }
+    if (input_is_stream) {
+        bool slot_targets = input_mode == INPUT_ASYNC || input_compression != COMPRESSION_NONE;
+        init_stream_ring(stream_ring, stream_slots, slot_targets ? slot_buffer_bytes(slot_capacity) : chunk_size);
+    }
+
+    const char* mode_names[] = {"mmap", "read", "stream", "async"};
+    const char* pin_names[] = {"unpinned", "pinned per CPU", "pinned per NUMA node"};
+    if (batch_mode) {
+        size_t batched = 0;
+        for (size_t i = 0; i < scheduler.files.size(); ++i) {
+            batched += scheduler.files[i].batched ? 1 : 0;
+        }
+        cout << "Analyzing " << paths.size() << " files (" << batched << " small files read in batches)";
+    } else {
+        cout << "Analyzing file: " << filename;
+    }
+    cout << " using " << num_threads << " threads"
+         << " (" << mode_names[input_mode] << " input, "
+         << pin_names[affinities.empty() ? PIN_NONE : pin_mode] << ")." << endl;
+    if (term_scanner.use_automaton) {
+        cout << "Search terms: " << search_terms.size() << " (" << scan_kernel_name(scan_kernel)
+             << " kernel, Aho-Corasick with " << term_scanner.automaton.state_count << " states)" << endl;
+    } else {
+        cout << "Search term: '" << search_terms[0] << "' (" << scan_kernel_name(scan_kernel) << " kernel)" << endl;
+    }
+    if (input_is_stream) {
+        cout << "Streaming through " << stream_slots << " buffers of " << chunk_size << " bytes" << endl;
+        if (input_mode == INPUT_ASYNC) {
+            cout << "Async reads: " << async_engine_name(async_io.engine) << ", " << io_depth << " in flight"
+                 << (direct_io ? ", O_DIRECT" : "") << endl;
+        }
+        if (!segments.empty()) {
+            cout << "Decompressing " << compression_name(input_compression) << " input: " << segments.size()
+                 << " independent segments decoded by " << decode_pool.threads.size() << " threads" << endl;
+        } else if (input_compression != COMPRESSION_NONE) {
+            cout << "Decompressing " << compression_name(input_compression) << " input sequentially" << endl;
+        }
+    } else {
+        cout << "Scheduling " << scheduler.items.size() << " work items of up to " << chunk_size << " bytes" << endl;
+    }
+    if (!checkpoint_dir.empty()) {
+        size_t by_status[CKPT_TERMS_CHANGED + 1] = {0};
+        size_t resumed_bytes = 0;
+        for (size_t i = 0; i < scheduler.files.size(); ++i) {
+            by_status[scheduler.files[i].checkpoint_status]++;
+            resumed_bytes += scheduler.files[i].start_offset;
+        }
+        cout << "Checkpoints: " << by_status[CKPT_RESUMED] << " resumed (" << resumed_bytes << " bytes skipped)";
+        for (int status = CKPT_NEW; status <= CKPT_TERMS_CHANGED; ++status) {
+            if (status != CKPT_RESUMED && by_status[status] > 0) {
+                cout << ", " << by_status[status] << " " << checkpoint_status_names[status];
             }
         }
-        
-        thread_data[i].content_section = file_content.substr(start, end - start);
-        
-        // Create the thread and execute the analysis function
-        if (pthread_create(&threads[i], NULL, analyze_section, &thread_data[i]) != 0) {
+        cout << endl;
+    }
+
+    stats_lap(PHASE_SETUP, phase_mark);
+    for (int i = 0; i < num_threads; ++i) {
+        thread_data[i].worker_id = i;
+        reset_results(thread_data[i].results, search_terms.size());
+        thread_data[i].chunks_scanned = 0;
+        thread_data[i].bytes_scanned = 0;
+        thread_data[i].load_ns = 0;
+        thread_data[i].scan_ns = 0;
+        thread_data[i].merge_ns = 0;
+        thread_data[i].wait_ns = 0;
+        thread_data[i].busy_ns = 0;
+
+        // Create the thread (bound to its CPUs when pinning) and execute the analysis function
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (!affinities.empty()) {
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &affinities[i]);
+        }
+        int created = pthread_create(&threads[i], &attr, analyze_section, &thread_data[i]);
+        pthread_attr_destroy(&attr);
+        if (created != 0) {
             cerr << "Error creating thread " << i << endl;
             return 1;
         }
-        cout << "Created thread " << i+1 << " to analyze section from " << start << " to " << end << endl;
+        cout << "Created thread " << i+1 << endl;
+    }
+    stats_lap(PHASE_SPAWN, phase_mark);
+
+    // In streaming mode the main thread is the reader that feeds the ring
+    if (input_mode == INPUT_ASYNC) {
+        async_stream_reader(stream_ring, async_io, stream_fd, input_stat.st_size, chunk_size, direct_io);
+    } else if (!segments.empty()) {
+        parallel_decompress_reader(stream_ring, decode_pool, input_compression, (const char*)compressed_map,
+                                   segments, chunk_size, slot_capacity);
+    } else if (input_compression != COMPRESSION_NONE) {
+        decompress_stream_reader(stream_ring, stream_fd, input_compression, stream_prefix, chunk_size);
+    } else if (input_is_stream) {
+        stream_reader(stream_ring, stream_fd, stream_prefix);
     }
     
     // --- Synchronization: Wait for all threads to finish ---
     
-    // Wait for every thread to complete its execution (join)
+    // Wait for every thread to complete its execution (join), then reduce
+    // the per-worker slots into the final totals
     for (int i = 0; i < num_threads; ++i) {
         pthread_join(threads[i], NULL);
+        add_results(shared_results, thread_data[i].results);
+        cout << "Thread " << i+1 << " scanned " << thread_data[i].chunks_scanned << " work items ("
+             << thread_data[i].bytes_scanned << " bytes)" << endl;
     }
-    
-    // Destroy the Mutex
-    pthread_mutex_destroy(&mutex_lock);
+    stats_lap(PHASE_WORKERS, phase_mark);
+
+    // The last line has no newline of its own when the input does not end in one
+    size_t failed_files = 0;
+    if (input_is_stream) {
+        count_unterminated_line(shared_results, stream_ring.total_bytes, stream_ring.last_byte);
+        destroy_stream_ring(stream_ring);
+        if (!segments.empty()) {
+            decode_pool_destroy(decode_pool);
+            munmap(compressed_map, input_stat.st_size);
+        }
+        if (input_mode == INPUT_ASYNC) {
+            async_reader_destroy(async_io);
+            if (async_fd != stream_fd) {
+                close(async_fd);
+            }
+        }
+        if (stream_fd != STDIN_FILENO) {
+            close(stream_fd);
+        }
+        // Partial counts are reported, but the run fails like a batch with a
+        // file that could not be read
+        if (stream_ring.read_failed) {
+            cerr << "Error: reading " << filename << " failed, results cover only the data read" << endl;
+            failed_files = 1;
+        }
+    } else {
+        if (batch_mode) {
+            cout << "\n--- Per-File Results ---" << endl;
+        }
+        vector<size_t> checkpoint_scratch;
+        for (size_t i = 0; i < scheduler.files.size(); ++i) {
+            InputFile& file = scheduler.files[i];
+            if (file.failed) {
+                failed_files++;
+                if (!compression_supported(file.compression)) {
+                    cerr << "Error: " << file.path << " is " << compression_name(file.compression)
+                         << "-compressed but this build has no " << compression_name(file.compression) << " support" << endl;
+                } else {
+                    cerr << "Error: Could not read file " << file.path << endl;
+                }
+                continue;
+            }
+            if (!checkpoint_dir.empty() && file.compression == COMPRESSION_NONE) {
+                long long checkpoint_mark = stats_now();
+                if (!write_checkpoint(file, checkpoint_scratch)) {
+                    cerr << "Warning: could not write checkpoint for " << file.path << endl;
+                }
+                phase_ns[PHASE_CHECKPOINT] += stats_now() - checkpoint_mark;
+            }
+            count_unterminated_line(file.results, file.results.total_chars, file.last_byte);
+            add_results(shared_results, file.results);
+            if (batch_mode) {
+                cout << file.path << ": " << file.results.total_chars << " chars, "
+                     << file.results.total_lines << " lines, " << file.results.total_words << " words";
+                print_term_counts(file.results);
+                cout << endl;
+            }
+        }
+        destroy_work(scheduler);
+    }
+    stats_lap(PHASE_REDUCE, phase_mark);
+    phase_ns[PHASE_REDUCE] -= phase_ns[PHASE_CHECKPOINT];
 
     // --- Display Final Results ---
     
     cout << "\n--- Final Analysis Results ---" << endl;
+    if (batch_mode) {
+        cout << "Files Analyzed:   " << paths.size() - failed_files << " (" << failed_files << " failed)" << endl;
+    }
     cout << "Total Characters: " << shared_results.total_chars << endl;
     cout << "Total Lines:      " << shared_results.total_lines << endl;
     cout << "Total Words:      " << shared_results.total_words << endl;
-    cout << "Term ('" << SEARCH_TERM << "') Occurrences: " << shared_results.term_occurrences << endl;
+    for (size_t i = 0; i < search_terms.size(); ++i) {
+        cout << "Term ('" << search_terms[i] << "') Occurrences: " << shared_results.term_occurrences[i] << endl;
+    }
     cout << "Module 3 demonstration complete." << endl;
 
-    return 0;
-}
\ No newline at end of file
+    long long scanned_bytes = 0;
+    for (int i = 0; i < num_threads; ++i) {
+        scanned_bytes += thread_data[i].bytes_scanned;
+    }
+    if (!results_path.empty()) {
+        size_t files = batch_mode ? paths.size() : 1;
+        if (!write_results_record(results_path, batch_mode && inputs.size() > 1 ? "" : filename, scanned_bytes,
+                                  monotonic_ns() - run_started, num_threads, files, failed_files)) {
+            cerr << "Error: Could not write results to " << results_path << endl;
+        }
+    }
+
+    if (stats_format != STATS_OFF) {
+        RunSummary run = {mode_names[input_mode], num_threads, scanned_bytes, stream_ring.read_ns,
+                          stream_ring.reader_wait_ns};
+        ofstream stats_file;
+        if (!stats_path.empty()) {
+            stats_file.open(stats_path.c_str(), ios::trunc);
+            if (!stats_file.is_open()) {
+                cerr << "Error: Could not write statistics to " << stats_path << endl;
+            }
+        }
+        ostream& out = stats_path.empty() ? cerr : stats_file;
+        if (stats_format == STATS_JSON) {
+            write_stats_json(out, run, thread_data);
+        } else {
+            write_stats_prometheus(out, run, thread_data);
+        }
+    }
+
+    return failed_files > 0 ? 1 : 0;
+}
@@ -0,0 +1,457 @@
+#ifndef SCAN_KERNELS_H
+#define SCAN_KERNELS_H
+
+// Byte classification and term search kernels for the file analyzer.
+//
+// Every kernel counts newlines, whitespace-delimited words, and words that
+// contain the search term over one block of text. The block must start at a
+// word boundary (the start of a buffer or right after whitespace). The SIMD
+// kernels classify 64 bytes per step and find term candidates by comparing the
+// term's first and last byte at every offset, verifying only where both match.
+// They are compiled with per-function target attributes, so the file builds
+// without -mavx2 and the kernel is picked at runtime.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_HAVE_X86 1
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define SCAN_HAVE_NEON 1
+#endif
+
+// Counts produced by one pass over a block of text
+struct ScanCounts {
+    long lines;     // newline bytes
+    long words;     // whitespace-delimited words
+    long term_hits; // words containing the term at least once
+};
+
+// Search term plus the tables the kernels need, built once per run
+struct ScanTerm {
+    std::string text;
+    std::vector<size_t> failure; // KMP failure table for the scalar kernel
+    bool has_space;              // no word can contain a term with whitespace,
+                                 // so the kernels skip term matching
+};
+
+enum ScanKernel {
+    KERNEL_SCALAR,
+    KERNEL_SSE42,
+    KERNEL_AVX2,
+    KERNEL_NEON
+};
+
+// Same set as isspace() in the "C" locale, which is what operator>> uses
+inline bool is_space_byte(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline ScanTerm make_scan_term(const std::string& text) {
+    ScanTerm term;
+    term.text = text;
+    term.has_space = false;
+    for (size_t i = 0; i < text.length(); ++i) {
+        if (is_space_byte((unsigned char)text[i])) {
+            term.has_space = true;
+        }
+    }
+
+    // failure[i] is the length of the longest proper prefix of the term that
+    // is also a suffix of its first i + 1 bytes
+    term.failure.assign(text.length(), 0);
+    size_t k = 0;
+    for (size_t i = 1; i < text.length(); ++i) {
+        while (k > 0 && text[i] != text[k]) {
+            k = term.failure[k - 1];
+        }
+        if (text[i] == text[k]) {
+            k++;
+        }
+        term.failure[i] = k;
+    }
+    return term;
+}
+
+// A term no word can contain: the kernels then only count lines and words
+inline ScanTerm make_word_count_term() {
+    ScanTerm term;
+    term.has_space = true;
+    return term;
+}
+
+
+// --- Scalar Kernel ---
+
+// One byte at a time. The term is matched with a KMP automaton whose state
+// resets at every word boundary.
+inline ScanCounts scan_text_scalar(const char* data, size_t length, const ScanTerm& term) {
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* t = (const unsigned char*)term.text.data();
+    const size_t term_length = term.text.length();
+    const bool match_term = !term.has_space;
+
+    ScanCounts counts = {0, 0, 0};
+    bool in_word = false;
+    bool word_matched = false; // current word already counted for the term
+    size_t matched = 0;        // bytes of the term matched so far in this word
+
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = p[i];
+        if (is_space_byte(c)) {
+            if (c == '\n') {
+                counts.lines++;
+            }
+            in_word = false;
+            continue;
+        }
+
+        if (!in_word) {
+            in_word = true;
+            counts.words++;
+            matched = 0;
+            word_matched = !match_term || term_length == 0;
+            if (match_term && term_length == 0) {
+                counts.term_hits++;
+            }
+        }
+        if (word_matched) {
+            continue;
+        }
+
+        while (matched > 0 && t[matched] != c) {
+            matched = term.failure[matched - 1];
+        }
+        if (t[matched] == c) {
+            matched++;
+        }
+        if (matched == term_length) {
+            counts.term_hits++;
+            word_matched = true;
+        }
+    }
+    return counts;
+}
+
+
+// --- Shared Block Bookkeeping ---
+
+// State carried from one 64-byte block to the next
+struct BlockScanState {
+    uint64_t prev_space; // 1 if the byte before the block is whitespace
+    size_t word_end;     // first whitespace after the last counted term hit
+    ScanCounts counts;
+};
+
+inline void init_block_state(BlockScanState& state) {
+    state.prev_space = 1;
+    state.word_end = 0;
+    state.counts.lines = 0;
+    state.counts.words = 0;
+    state.counts.term_hits = 0;
+}
+
+// A word starts at a non-space byte whose predecessor is whitespace
+inline void accumulate_block(BlockScanState& state, uint64_t space, uint64_t newline) {
+    uint64_t starts = ~space & ((space << 1) | state.prev_space);
+    state.prev_space = space >> 63;
+    state.counts.words += __builtin_popcountll(starts);
+    state.counts.lines += __builtin_popcountll(newline);
+}
+
+inline size_t find_word_end(const unsigned char* p, size_t from, size_t length) {
+    while (from < length && !is_space_byte(p[from])) {
+        from++;
+    }
+    return from;
+}
+
+// A confirmed occurrence counts only if it lies outside the word that
+// produced the previous hit, so each word is counted once
+inline void record_term_hit(BlockScanState& state, const unsigned char* p,
+                            size_t pos, size_t term_length, size_t length) {
+    if (pos < state.word_end) {
+        return;
+    }
+    state.counts.term_hits++;
+    state.word_end = find_word_end(p, pos + term_length, length);
+}
+
+// Verify first/last-byte candidates at offsets base + bit
+inline void verify_candidates(BlockScanState& state, uint64_t candidates, const unsigned char* p,
+                              size_t base, const ScanTerm& term, size_t length) {
+    const size_t term_length = term.text.length();
+    const char* middle = term.text.data() + 1;
+    while (candidates != 0) {
+        size_t pos = base + __builtin_ctzll(candidates);
+        candidates &= candidates - 1;
+        if (pos < state.word_end) {
+            continue;
+        }
+        if (term_length <= 2 || memcmp(p + pos + 1, middle, term_length - 2) == 0) {
+            record_term_hit(state, p, pos, term_length, length);
+        }
+    }
+}
+
+// Scalar finish for the bytes after the last full SIMD step
+inline ScanCounts finish_block_scan(BlockScanState& state, const unsigned char* p, size_t i,
+                                    size_t length, const ScanTerm& term, bool match_term) {
+    const size_t term_length = term.text.length();
+    const unsigned char first = match_term ? (unsigned char)term.text[0] : 0;
+    for (; i < length; ++i) {
+        unsigned char c = p[i];
+        uint64_t space = is_space_byte(c) ? 1 : 0;
+        if (c == '\n') {
+            state.counts.lines++;
+        }
+        if (!space && state.prev_space) {
+            state.counts.words++;
+        }
+        state.prev_space = space;
+        if (match_term && c == first && i + term_length <= length &&
+            memcmp(p + i, term.text.data(), term_length) == 0) {
+            record_term_hit(state, p, i, term_length, length);
+        }
+    }
+
+    ScanCounts counts = state.counts;
+    if (!term.has_space && term_length == 0) {
+        counts.term_hits = counts.words; // every word contains the empty string
+    }
+    return counts;
+}
+
+
+// --- x86 Kernels ---
+
+#if SCAN_HAVE_X86
+
+__attribute__((target("sse4.2,popcnt")))
+inline uint64_t sse_byte_mask(__m128i v, __m128i byte) {
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, byte));
+}
+
+// Whitespace is ' ' or 9..13; the range test is an unsigned min after -9
+__attribute__((target("sse4.2,popcnt")))
+inline uint64_t sse_space_mask(__m128i v) {
+    __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(9));
+    __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+    __m128i blank = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    return (uint32_t)_mm_movemask_epi8(_mm_or_si128(control, blank));
+}
+
+__attribute__((target("sse4.2,popcnt")))
+inline ScanCounts scan_text_sse42(const char* data, size_t length, const ScanTerm& term) {
+    const unsigned char* p = (const unsigned char*)data;
+    const bool match_term = !term.has_space && !term.text.empty();
+    const size_t last_offset = match_term ? term.text.length() - 1 : 0;
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i first = _mm_set1_epi8(match_term ? term.text[0] : 0);
+    const __m128i last = _mm_set1_epi8(match_term ? term.text[last_offset] : 0);
+
+    BlockScanState state;
+    init_block_state(state);
+    size_t i = 0;
+    for (; i + 64 + last_offset <= length; i += 64) {
+        uint64_t space = 0;
+        uint64_t lines = 0;
+        uint64_t candidates = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(p + i + lane * 16));
+            space |= sse_space_mask(v) << (lane * 16);
+            lines |= sse_byte_mask(v, newline) << (lane * 16);
+            if (match_term) {
+                __m128i tail = _mm_loadu_si128((const __m128i*)(p + i + last_offset + lane * 16));
+                candidates |= (sse_byte_mask(v, first) & sse_byte_mask(tail, last)) << (lane * 16);
+            }
+        }
+        accumulate_block(state, space, lines);
+        verify_candidates(state, candidates, p, i, term, length);
+    }
+    return finish_block_scan(state, p, i, length, term, match_term);
+}
+
+__attribute__((target("avx2,popcnt")))
+inline uint64_t avx2_byte_mask(__m256i v, __m256i byte) {
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, byte));
+}
+
+__attribute__((target("avx2,popcnt")))
+inline uint64_t avx2_space_mask(__m256i v) {
+    __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(9));
+    __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(4)), shifted);
+    __m256i blank = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(control, blank));
+}
+
+__attribute__((target("avx2,popcnt")))
+inline ScanCounts scan_text_avx2(const char* data, size_t length, const ScanTerm& term) {
+    const unsigned char* p = (const unsigned char*)data;
+    const bool match_term = !term.has_space && !term.text.empty();
+    const size_t last_offset = match_term ? term.text.length() - 1 : 0;
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i first = _mm256_set1_epi8(match_term ? term.text[0] : 0);
+    const __m256i last = _mm256_set1_epi8(match_term ? term.text[last_offset] : 0);
+
+    BlockScanState state;
+    init_block_state(state);
+    size_t i = 0;
+    for (; i + 64 + last_offset <= length; i += 64) {
+        __m256i lo = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i*)(p + i + 32));
+        uint64_t space = avx2_space_mask(lo) | (avx2_space_mask(hi) << 32);
+        uint64_t lines = avx2_byte_mask(lo, newline) | (avx2_byte_mask(hi, newline) << 32);
+        accumulate_block(state, space, lines);
+
+        if (match_term) {
+            __m256i tail_lo = _mm256_loadu_si256((const __m256i*)(p + i + last_offset));
+            __m256i tail_hi = _mm256_loadu_si256((const __m256i*)(p + i + last_offset + 32));
+            uint64_t candidates =
+                (avx2_byte_mask(lo, first) & avx2_byte_mask(tail_lo, last)) |
+                ((avx2_byte_mask(hi, first) & avx2_byte_mask(tail_hi, last)) << 32);
+            verify_candidates(state, candidates, p, i, term, length);
+        }
+    }
+    return finish_block_scan(state, p, i, length, term, match_term);
+}
+
+#endif // SCAN_HAVE_X86
+
+
+// --- NEON Kernel ---
+
+#if SCAN_HAVE_NEON
+
+// Collapse four 16-byte compare results into one bit per byte
+inline uint64_t neon_mask64(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d) {
+    const uint8x16_t bits = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t ab = vpaddq_u8(vandq_u8(a, bits), vandq_u8(b, bits));
+    uint8x16_t cd = vpaddq_u8(vandq_u8(c, bits), vandq_u8(d, bits));
+    uint8x16_t abcd = vpaddq_u8(ab, cd);
+    abcd = vpaddq_u8(abcd, abcd);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(abcd), 0);
+}
+
+inline uint8x16_t neon_space(uint8x16_t v) {
+    uint8x16_t control = vcleq_u8(vsubq_u8(v, vdupq_n_u8(9)), vdupq_n_u8(4));
+    return vorrq_u8(control, vceqq_u8(v, vdupq_n_u8(' ')));
+}
+
+inline ScanCounts scan_text_neon(const char* data, size_t length, const ScanTerm& term) {
+    const unsigned char* p = (const unsigned char*)data;
+    const bool match_term = !term.has_space && !term.text.empty();
+    const size_t last_offset = match_term ? term.text.length() - 1 : 0;
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    const uint8x16_t first = vdupq_n_u8(match_term ? term.text[0] : 0);
+    const uint8x16_t last = vdupq_n_u8(match_term ? term.text[last_offset] : 0);
+
+    BlockScanState state;
+    init_block_state(state);
+    size_t i = 0;
+    for (; i + 64 + last_offset <= length; i += 64) {
+        uint8x16_t v0 = vld1q_u8(p + i);
+        uint8x16_t v1 = vld1q_u8(p + i + 16);
+        uint8x16_t v2 = vld1q_u8(p + i + 32);
+        uint8x16_t v3 = vld1q_u8(p + i + 48);
+        uint64_t space = neon_mask64(neon_space(v0), neon_space(v1), neon_space(v2), neon_space(v3));
+        uint64_t lines = neon_mask64(vceqq_u8(v0, newline), vceqq_u8(v1, newline),
+                                     vceqq_u8(v2, newline), vceqq_u8(v3, newline));
+        accumulate_block(state, space, lines);
+
+        if (match_term) {
+            const unsigned char* q = p + i + last_offset;
+            uint64_t candidates = neon_mask64(
+                vandq_u8(vceqq_u8(v0, first), vceqq_u8(vld1q_u8(q), last)),
+                vandq_u8(vceqq_u8(v1, first), vceqq_u8(vld1q_u8(q + 16), last)),
+                vandq_u8(vceqq_u8(v2, first), vceqq_u8(vld1q_u8(q + 32), last)),
+                vandq_u8(vceqq_u8(v3, first), vceqq_u8(vld1q_u8(q + 48), last)));
+            verify_candidates(state, candidates, p, i, term, length);
+        }
+    }
+    return finish_block_scan(state, p, i, length, term, match_term);
+}
+
+#endif // SCAN_HAVE_NEON
+
+
+// --- Runtime Dispatch ---
+
+inline bool scan_kernel_supported(ScanKernel kernel) {
+    switch (kernel) {
+    case KERNEL_SCALAR:
+        return true;
+#if SCAN_HAVE_X86
+    case KERNEL_SSE42:
+        return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+    case KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#endif
+#if SCAN_HAVE_NEON
+    case KERNEL_NEON:
+        return true; // NEON is mandatory on AArch64
+#endif
+    default:
+        return false;
+    }
+}
+
+// Fastest kernel the running CPU supports
+inline ScanKernel detect_scan_kernel() {
+    if (scan_kernel_supported(KERNEL_AVX2)) {
+        return KERNEL_AVX2;
+    }
+    if (scan_kernel_supported(KERNEL_SSE42)) {
+        return KERNEL_SSE42;
+    }
+    if (scan_kernel_supported(KERNEL_NEON)) {
+        return KERNEL_NEON;
+    }
+    return KERNEL_SCALAR;
+}
+
+inline const char* scan_kernel_name(ScanKernel kernel) {
+    switch (kernel) {
+    case KERNEL_SSE42: return "sse42";
+    case KERNEL_AVX2:  return "avx2";
+    case KERNEL_NEON:  return "neon";
+    default:           return "scalar";
+    }
+}
+
+inline bool parse_scan_kernel(const char* name, ScanKernel& kernel) {
+    const ScanKernel all[] = {KERNEL_SCALAR, KERNEL_SSE42, KERNEL_AVX2, KERNEL_NEON};
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); ++i) {
+        if (strcmp(name, scan_kernel_name(all[i])) == 0) {
+            kernel = all[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+inline ScanCounts scan_text(ScanKernel kernel, const char* data, size_t length, const ScanTerm& term) {
+    switch (kernel) {
+#if SCAN_HAVE_X86
+    case KERNEL_AVX2:
+        return scan_text_avx2(data, length, term);
+    case KERNEL_SSE42:
+        return scan_text_sse42(data, length, term);
+#endif
+#if SCAN_HAVE_NEON
+    case KERNEL_NEON:
+        return scan_text_neon(data, length, term);
+#endif
+    default:
+        return scan_text_scalar(data, length, term);
+    }
+}
+
+#endif
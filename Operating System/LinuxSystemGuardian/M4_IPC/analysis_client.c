@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "ipc_common.h"
+#include "ipc_transport.h"
+#include "ipc_service.h"
+#include "ipc_wire.h"
+
+/*
+ * Client for the guardian's analysis service (guardian_exe --serve). Sends
+ * one WIRE_ANALYSIS_REQUEST per file, --repeat times over, keeping up to
+ * --window requests in flight, and prints the WIRE_ANALYSIS record of each
+ * reply. The last line gives the request rate and how many replies the
+ * service answered from its cache. Paths are sent resolved, since the
+ * guardian runs elsewhere; it only answers for files under its --serve-root.
+ */
+
+struct client_options {
+    enum ipc_transport_kind transport;
+    long repeat;
+    long window;          /* requests in flight; their replies must fit the reply queue */
+    long timeout_ms;      /* longest wait for any one reply */
+    uint32_t flags;       /* WIRE_REQUEST_* */
+    int quiet;
+};
+
+static volatile sig_atomic_t timed_out = 0;
+
+static void timeout_handler(int signal_number) {
+    (void)signal_number;
+    timed_out = 1;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [options] FILE...\n"
+            "  --transport NAME  msgq or shm (default %s), as the guardian receives\n"
+            "  --term TEXT       count words containing TEXT (repeatable, default: the service's)\n"
+            "  --repeat N        request every file N times (default 1)\n"
+            "  --window N        requests in flight (default 32)\n"
+            "  --timeout-ms N    give up when a reply takes longer (default 5000)\n"
+            "  --no-cache        have every request analyzed afresh\n"
+            "  --quiet           print only the summary\n",
+            program, ipc_transport_name(IPC_DEFAULT_TRANSPORT));
+}
+
+static void send_request(struct ipc_sender* tx, uint64_t id, const char* path, char** terms, uint32_t term_count,
+                         uint32_t flags) {
+    struct wire_analysis_request fixed;
+    memset(&fixed, 0, sizeof(fixed));
+    fixed.request_id = id;
+    fixed.reply_to = (int32_t)getpid();
+    fixed.flags = flags;
+    fixed.term_count = term_count;
+    size_t path_length = strlen(path);
+    fixed.path_length = (uint16_t)(path_length > UINT16_MAX ? UINT16_MAX : path_length);
+    char record[IPC_BATCH_MAX_RECORD];
+    size_t length = wire_encode_analysis_request(record, sizeof(record), &fixed, path, (const char* const*)terms,
+                                                 NULL);
+    if (length == 0) {
+        fprintf(stderr, "Request for %s too large\n", path);
+        exit(1);
+    }
+    /* Wait for the guardian while the transport is full */
+    while (ipc_send(tx, NOTIFICATION_TYPE, record, length) < 0) {
+        if (errno != EAGAIN) {
+            perror("send failed");
+            exit(1);
+        }
+        usleep(50);
+    }
+}
+
+static void print_result(const char* path, const char* data, size_t length, uint32_t flags) {
+    struct wire_header header;
+    struct wire_analysis_view view;
+    if (wire_decode_header(data, length, &header) <= 0 || wire_decode_analysis(&header, wire_body(data), &view) < 0) {
+        printf("%s: malformed reply\n", path);
+        return;
+    }
+    const struct wire_analysis* a = &view.fixed;
+    printf("%s: %llu chars, %llu lines, %llu words", path, (unsigned long long)a->total_chars,
+           (unsigned long long)a->total_lines, (unsigned long long)a->total_words);
+    const char* cursor = view.terms;
+    for (uint32_t i = 0; i < a->term_count; ++i) {
+        const char* term;
+        size_t term_length;
+        if (wire_next_term(&cursor, view.end, &term, &term_length) < 0) {
+            break;
+        }
+        printf(", '%.*s' %llu", (int)term_length, term, (unsigned long long)wire_analysis_count(&view, i));
+    }
+    if (flags & WIRE_REPLY_CACHED) {
+        printf(" (cached)\n");
+    } else {
+        printf(" (%.3f ms)\n", a->elapsed_ns / 1e6);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    struct client_options options = {IPC_DEFAULT_TRANSPORT, 1, 32, 5000, 0, 0};
+    char** terms = calloc((size_t)argc, sizeof(char*));
+    char** files = calloc((size_t)argc, sizeof(char*));
+    char** sent_paths = calloc((size_t)argc, sizeof(char*));
+    uint32_t term_count = 0;
+    long file_count = 0;
+    if (terms == NULL || files == NULL || sent_paths == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+            if (ipc_parse_transport(argv[++i], &options.transport) < 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--term") == 0 && i + 1 < argc) {
+            terms[term_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            options.repeat = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            options.window = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--timeout-ms") == 0 && i + 1 < argc) {
+            options.timeout_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            options.flags |= WIRE_REQUEST_NO_CACHE;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            options.quiet = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            files[file_count++] = argv[i];
+        }
+    }
+    if (file_count == 0 || options.repeat < 1 || options.window < 1 || options.timeout_ms < 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    /* A path that does not resolve is still sent absolute, for the service's error */
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        return 1;
+    }
+    for (long i = 0; i < file_count; ++i) {
+        sent_paths[i] = realpath(files[i], NULL);
+        if (sent_paths[i] == NULL) {
+            int absolute = files[i][0] == '/';
+            size_t length = strlen(cwd) + strlen(files[i]) + 2;
+            sent_paths[i] = malloc(length);
+            if (sent_paths[i] == NULL) {
+                perror("malloc");
+                return 1;
+            }
+            snprintf(sent_paths[i], length, "%s%s%s", absolute ? "" : cwd, absolute ? "" : "/", files[i]);
+        }
+    }
+
+    struct ipc_sender tx;
+    if (ipc_sender_open(&tx, options.transport, IPC_BATCH_MAX_BYTES, 1000 * 1000) < 0) {
+        perror(options.transport == IPC_TRANSPORT_SHM ? "shm_open failed" : "msgget failed");
+        return 1;
+    }
+    int reply_queue = ipc_service_reply_queue(1);
+    if (reply_queue < 0) {
+        perror("msgget failed for the reply queue");
+        return 1;
+    }
+    /* Replies left over by an earlier client with our PID */
+    struct ipc_batch_buf buf;
+    while (ipc_service_next_reply(reply_queue, getpid(), &buf, 1) >= 0) {
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = timeout_handler; /* no SA_RESTART: msgrcv returns EINTR */
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGALRM, &action, NULL);
+    struct itimerval timeout;
+    memset(&timeout, 0, sizeof(timeout));
+    timeout.it_value.tv_sec = options.timeout_ms / 1000;
+    timeout.it_value.tv_usec = (options.timeout_ms % 1000) * 1000;
+    struct itimerval disarm;
+    memset(&disarm, 0, sizeof(disarm));
+
+    long total = file_count * options.repeat;
+    long sent = 0, done = 0, cached = 0, failed = 0;
+    uint64_t start_ns = ipc_now_ns();
+    while (done < total) {
+        while (sent < total && sent - done < options.window) {
+            send_request(&tx, (uint64_t)sent + 1, sent_paths[sent % file_count], terms, term_count, options.flags);
+            sent++;
+        }
+        while (ipc_sender_flush(&tx) < 0) {
+            if (errno != EAGAIN) {
+                perror("send failed");
+                return 1;
+            }
+            usleep(50);
+        }
+
+        setitimer(ITIMER_REAL, &timeout, NULL);
+        long size = ipc_service_next_reply(reply_queue, getpid(), &buf, 0);
+        setitimer(ITIMER_REAL, &disarm, NULL);
+        if (size < 0) {
+            if (errno == EINTR && timed_out) {
+                fprintf(stderr, "No reply within %ld ms; is guardian_exe --serve running?\n", options.timeout_ms);
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("msgrcv failed");
+            return 1;
+        }
+        struct wire_header header;
+        struct wire_analysis_reply reply;
+        long reply_size = wire_decode_header(buf.mtext, (size_t)size, &header);
+        if (reply_size <= 0 || wire_decode_analysis_reply(&header, wire_body(buf.mtext), &reply) < 0 ||
+            reply.request_id == 0 || reply.request_id > (uint64_t)sent) {
+            fprintf(stderr, "Discarding a malformed reply\n");
+            continue;
+        }
+        done++;
+        const char* path = files[(reply.request_id - 1) % (uint64_t)file_count];
+        if (reply.error != 0) {
+            failed++;
+            if (!options.quiet) {
+                printf("%s: %s\n", path, strerror(reply.error));
+            }
+            continue;
+        }
+        if (reply.flags & WIRE_REPLY_CACHED) {
+            cached++;
+        }
+        if (!options.quiet) {
+            print_result(path, buf.mtext + reply_size, (size_t)(size - reply_size), reply.flags);
+        }
+    }
+    double elapsed_ms = (ipc_now_ns() - start_ns) / 1e6;
+    printf("%ld of %ld requests answered in %.3f ms (%.0f per second): %ld cached, %ld failed.\n", done, total,
+           elapsed_ms, elapsed_ms > 0 ? done * 1000.0 / elapsed_ms : 0.0, cached, failed);
+    ipc_sender_close(&tx);
+    for (long i = 0; i < file_count; ++i) {
+        free(sent_paths[i]);
+    }
+    free(sent_paths);
+    free(terms);
+    free(files);
+    return done == total && failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+#ifndef IPC_ARENA_H
+#define IPC_ARENA_H
+
+/*
+ * Shared-memory arena for payloads too large to travel inline.
+ *
+ * The arena is a POSIX shared memory segment cut into fixed-size slots. A
+ * sender claims enough contiguous slots for its payload, copies the payload
+ * in once and sends only a small descriptor (offset, length, generation)
+ * through the alert transport. The receiver reads the payload where it is
+ * and releases the slots afterwards.
+ *
+ * Each slot's owner word holds the generation of the allocation using it,
+ * or 0 when free. Slots are claimed with a compare-and-swap per slot, so
+ * any number of senders can allocate at once. The generation lets a
+ * receiver reject a descriptor whose slots have been freed or reused, for
+ * example one replayed from a queue that outlived its sender.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "ipc_common.h"
+#include "ipc_shm.h"
+
+#define IPC_ARENA_MAGIC 0x4D34414Eu
+#define IPC_ARENA_SLOT_BYTES (64u << 10)
+#define IPC_ARENA_SLOTS 256 /* 16 MiB of payload space */
+#define IPC_ARENA_MAX_PAYLOAD ((size_t)IPC_ARENA_SLOT_BYTES * IPC_ARENA_SLOTS / 4)
+
+struct ipc_arena_shared {
+    uint32_t magic; /* written last by the creator */
+    uint32_t slot_bytes;
+    uint32_t slots;
+    uint32_t next_generation;
+    uint32_t hint; /* where the next search starts */
+    uint32_t owner[IPC_ARENA_SLOTS];
+};
+
+struct ipc_arena {
+    struct ipc_arena_shared* shared;
+    char* data;
+    size_t map_size;
+    char name[64];
+};
+
+#define IPC_ARENA_DATA_OFFSET ((sizeof(struct ipc_arena_shared) + 4095) & ~(size_t)4095)
+
+/* What travels through the transport in place of a large payload */
+#define IPC_DESCRIPTOR_MAGIC 0x44534C47u
+
+struct ipc_descriptor {
+    uint32_t magic;
+    uint32_t generation;
+    uint64_t offset; /* from the start of the payload space, slot aligned */
+    uint64_t length;
+};
+
+static inline void ipc_arena_name(char* name, size_t size) {
+    snprintf(name, size, "/m4_ipc_arena_%d", MSG_KEY);
+}
+
+/* Map the arena, creating it if create is set. Returns 0, or -1 with errno. */
+static inline int ipc_arena_open(struct ipc_arena* arena, int create) {
+    ipc_arena_name(arena->name, sizeof(arena->name));
+    arena->map_size = IPC_ARENA_DATA_OFFSET + (size_t)IPC_ARENA_SLOTS * IPC_ARENA_SLOT_BYTES;
+    int created;
+    void* map = ipc_shm_map(arena->name, arena->map_size, create, &created);
+    if (map == NULL) {
+        return -1;
+    }
+    arena->shared = (struct ipc_arena_shared*)map;
+    arena->data = (char*)map + IPC_ARENA_DATA_OFFSET;
+    if (created) {
+        arena->shared->slot_bytes = IPC_ARENA_SLOT_BYTES;
+        arena->shared->slots = IPC_ARENA_SLOTS;
+        __atomic_store_n(&arena->shared->magic, IPC_ARENA_MAGIC, __ATOMIC_RELEASE);
+    } else if (ipc_shm_wait_ready(&arena->shared->magic, IPC_ARENA_MAGIC) < 0) {
+        munmap(map, arena->map_size);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void ipc_arena_close(struct ipc_arena* arena) {
+    if (arena->shared != NULL) {
+        munmap(arena->shared, arena->map_size);
+        arena->shared = NULL;
+    }
+}
+
+static inline uint32_t ipc_arena_slots_for(uint64_t length) {
+    return (uint32_t)((length + IPC_ARENA_SLOT_BYTES - 1) / IPC_ARENA_SLOT_BYTES);
+}
+
+static inline void ipc_arena_unclaim(struct ipc_arena_shared* shared, uint32_t first, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        __atomic_store_n(&shared->owner[first + i], 0, __ATOMIC_RELEASE);
+    }
+}
+
+/* --- Sender --- */
+
+/* Copy a payload into the arena and fill in its descriptor. Returns 0, or -1
+ * with errno: EMSGSIZE if it can never fit, EAGAIN while the arena is too
+ * full. */
+static inline int ipc_arena_put(struct ipc_arena* arena, const void* data, size_t length,
+                                struct ipc_descriptor* descriptor) {
+    if (length == 0 || length > IPC_ARENA_MAX_PAYLOAD) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    struct ipc_arena_shared* shared = arena->shared;
+    uint32_t needed = ipc_arena_slots_for(length);
+    uint32_t starts = IPC_ARENA_SLOTS - needed + 1;
+    uint32_t generation;
+    do {
+        generation = __atomic_add_fetch(&shared->next_generation, 1, __ATOMIC_RELAXED);
+    } while (generation == 0);
+
+    uint32_t first = __atomic_load_n(&shared->hint, __ATOMIC_RELAXED) % starts;
+    for (uint32_t tried = 0; tried < starts;) {
+        uint32_t claimed = 0;
+        while (claimed < needed) {
+            uint32_t expected = 0;
+            if (!__atomic_compare_exchange_n(&shared->owner[first + claimed], &expected, generation, 0,
+                                             __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                break;
+            }
+            claimed++;
+        }
+        if (claimed == needed) {
+            __atomic_store_n(&shared->hint, first + needed, __ATOMIC_RELAXED);
+            uint64_t offset = (uint64_t)first * IPC_ARENA_SLOT_BYTES;
+            memcpy(arena->data + offset, data, length);
+            descriptor->magic = IPC_DESCRIPTOR_MAGIC;
+            descriptor->generation = generation;
+            descriptor->offset = offset;
+            descriptor->length = length;
+            return 0;
+        }
+        /* Slot first + claimed is taken: no run can start before it */
+        ipc_arena_unclaim(shared, first, claimed);
+        uint32_t skip = claimed + 1;
+        tried += skip;
+        first = first + skip >= starts ? 0 : first + skip;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+/* Free a payload whose descriptor was never delivered */
+static inline void ipc_arena_discard(struct ipc_arena* arena, const struct ipc_descriptor* descriptor) {
+    ipc_arena_unclaim(arena->shared, (uint32_t)(descriptor->offset / IPC_ARENA_SLOT_BYTES),
+                      ipc_arena_slots_for(descriptor->length));
+}
+
+/* --- Receiver --- */
+
+/* True if a received record is a descriptor rather than a payload */
+static inline int ipc_is_descriptor(const void* data, size_t length) {
+    uint32_t magic;
+    if (length != sizeof(struct ipc_descriptor)) {
+        return 0;
+    }
+    memcpy(&magic, data, sizeof(magic));
+    return magic == IPC_DESCRIPTOR_MAGIC;
+}
+
+/* Where a descriptor's payload lives, or NULL (errno ESTALE) if its slots
+ * are no longer the allocation it names. The payload stays valid until
+ * ipc_arena_release(). */
+static inline const char* ipc_arena_get(struct ipc_arena* arena, const struct ipc_descriptor* descriptor) {
+    uint64_t space = (uint64_t)IPC_ARENA_SLOTS * IPC_ARENA_SLOT_BYTES;
+    if (descriptor->offset % IPC_ARENA_SLOT_BYTES != 0 || descriptor->length == 0 ||
+        descriptor->length > space - descriptor->offset || descriptor->offset >= space) {
+        errno = EINVAL;
+        return NULL;
+    }
+    uint32_t first = (uint32_t)(descriptor->offset / IPC_ARENA_SLOT_BYTES);
+    uint32_t last = first + ipc_arena_slots_for(descriptor->length) - 1;
+    if (__atomic_load_n(&arena->shared->owner[first], __ATOMIC_ACQUIRE) != descriptor->generation ||
+        __atomic_load_n(&arena->shared->owner[last], __ATOMIC_ACQUIRE) != descriptor->generation) {
+        errno = ESTALE;
+        return NULL;
+    }
+    return arena->data + descriptor->offset;
+}
+
+/* Hand a payload's slots back once it has been read */
+static inline void ipc_arena_release(struct ipc_arena* arena, const struct ipc_descriptor* descriptor) {
+    uint32_t first = (uint32_t)(descriptor->offset / IPC_ARENA_SLOT_BYTES);
+    if (__atomic_load_n(&arena->shared->owner[first], __ATOMIC_RELAXED) == descriptor->generation) {
+        ipc_arena_unclaim(arena->shared, first, ipc_arena_slots_for(descriptor->length));
+    }
+}
+
+#endif
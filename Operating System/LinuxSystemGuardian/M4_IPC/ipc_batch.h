@@ -0,0 +1,217 @@
+#ifndef IPC_BATCH_H
+#define IPC_BATCH_H
+
+/*
+ * Batched records over the System V message queue.
+ *
+ * A batcher packs several variable-length records of one message type into
+ * a single message: a small header, then each record as a 16-bit length and
+ * its bytes. A batch is sent when the next record would not fit, when its
+ * oldest record has waited max_delay_ns, or on ipc_batch_flush(). Sends use
+ * IPC_NOWAIT: a full queue leaves the batch pending and reports EAGAIN
+ * instead of stalling the sender.
+ *
+ * The receiver side drains everything available in one wakeup, emergencies
+ * first, and hands each record to a callback. Plain message_buf messages
+ * from older senders are delivered as a single record.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include "ipc_common.h"
+
+#define IPC_BATCH_MAGIC 0xB14D3442u
+#define IPC_BATCH_MAX_BYTES 8192 /* Linux's default msgmax */
+
+struct ipc_batch_header {
+    uint32_t magic;
+    uint16_t count;     /* records in the batch */
+    uint16_t reserved;
+    uint64_t sealed_ns; /* CLOCK_MONOTONIC when the batch was sent */
+};
+
+#define IPC_BATCH_MAX_RECORD (IPC_BATCH_MAX_BYTES - sizeof(struct ipc_batch_header) - sizeof(uint16_t))
+
+struct ipc_batch_buf {
+    long mtype;
+    char mtext[IPC_BATCH_MAX_BYTES];
+};
+
+static inline uint64_t ipc_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* --- Sender --- */
+
+struct ipc_batcher {
+    int msqid;
+    size_t max_bytes;      /* message size limit, at most IPC_BATCH_MAX_BYTES */
+    uint64_t max_delay_ns; /* 0 = send every record at once */
+    uint64_t first_ns;     /* when the oldest pending record was added */
+    size_t used;           /* bytes in buf.mtext, header included */
+    unsigned count;
+    unsigned long batches_sent;
+    unsigned long records_sent;
+    unsigned long would_block; /* sends refused because the queue was full */
+    struct ipc_batch_buf buf;
+};
+
+static inline void ipc_batcher_init(struct ipc_batcher* b, int msqid, long mtype, size_t max_bytes,
+                                    uint64_t max_delay_ns) {
+    memset(b, 0, sizeof(*b));
+    b->msqid = msqid;
+    b->buf.mtype = mtype;
+    b->max_bytes = max_bytes == 0 || max_bytes > IPC_BATCH_MAX_BYTES ? IPC_BATCH_MAX_BYTES : max_bytes;
+    if (b->max_bytes < sizeof(struct ipc_batch_header) + 64) {
+        b->max_bytes = sizeof(struct ipc_batch_header) + 64;
+    }
+    b->max_delay_ns = max_delay_ns;
+    b->used = sizeof(struct ipc_batch_header);
+}
+
+/* Send the pending batch. Returns 0, or -1 with errno (EAGAIN: queue full,
+ * the batch is kept for the next try). */
+static inline int ipc_batch_flush(struct ipc_batcher* b) {
+    if (b->count == 0) {
+        return 0;
+    }
+    struct ipc_batch_header header;
+    header.magic = IPC_BATCH_MAGIC;
+    header.count = (uint16_t)b->count;
+    header.reserved = 0;
+    header.sealed_ns = ipc_now_ns();
+    memcpy(b->buf.mtext, &header, sizeof(header));
+    while (msgsnd(b->msqid, &b->buf, b->used, IPC_NOWAIT) < 0) {
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN) {
+            b->would_block++;
+        }
+        return -1;
+    }
+    b->batches_sent++;
+    b->records_sent += b->count;
+    b->count = 0;
+    b->used = sizeof(struct ipc_batch_header);
+    return 0;
+}
+
+/* Queue one record. Returns 0, or -1 with errno: EMSGSIZE if the record can
+ * never fit, EAGAIN if the batch is full and the queue will not take it yet
+ * (the record was not added). A record that was added but whose batch could
+ * not be sent yet counts as accepted: it goes out on the next add, poll or
+ * flush. */
+static inline int ipc_batch_add(struct ipc_batcher* b, const void* data, size_t length) {
+    size_t needed = sizeof(uint16_t) + length;
+    if (sizeof(struct ipc_batch_header) + needed > b->max_bytes || length > UINT16_MAX) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (b->used + needed > b->max_bytes && ipc_batch_flush(b) < 0) {
+        return -1;
+    }
+    uint16_t record_length = (uint16_t)length;
+    memcpy(b->buf.mtext + b->used, &record_length, sizeof(record_length));
+    memcpy(b->buf.mtext + b->used + sizeof(record_length), data, length);
+    b->used += needed;
+    if (b->count++ == 0) {
+        b->first_ns = ipc_now_ns();
+    }
+    if ((b->max_delay_ns == 0 || ipc_now_ns() - b->first_ns >= b->max_delay_ns) && ipc_batch_flush(b) < 0 &&
+        errno != EAGAIN) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Send the batch if its oldest record is due; call from the sender's loop */
+static inline int ipc_batch_poll(struct ipc_batcher* b) {
+    if (b->count > 0 && ipc_now_ns() - b->first_ns >= b->max_delay_ns) {
+        return ipc_batch_flush(b);
+    }
+    return 0;
+}
+
+/* --- Receiver --- */
+
+typedef void (*ipc_record_fn)(void* context, long mtype, const char* data, size_t length, uint64_t sent_ns);
+
+struct ipc_drain_stats {
+    unsigned long messages;
+    unsigned long records;
+    unsigned long wakeups;
+};
+
+/* Split one received message into records. Returns the record count, or -1
+ * if a batch is malformed. */
+static inline int ipc_unpack(const struct ipc_batch_buf* buf, size_t size, ipc_record_fn fn, void* context) {
+    struct ipc_batch_header header;
+    if (size < sizeof(header) || (memcpy(&header, buf->mtext, sizeof(header)), header.magic != IPC_BATCH_MAGIC)) {
+        size_t length = strnlen(buf->mtext, size); /* a plain message_buf string */
+        fn(context, buf->mtype, buf->mtext, length, 0);
+        return 1;
+    }
+    size_t at = sizeof(header);
+    for (unsigned i = 0; i < header.count; ++i) {
+        uint16_t length;
+        if (at + sizeof(length) > size) {
+            return -1;
+        }
+        memcpy(&length, buf->mtext + at, sizeof(length));
+        at += sizeof(length);
+        if (at + length > size) {
+            return -1;
+        }
+        fn(context, buf->mtype, buf->mtext + at, length, header.sealed_ns);
+        at += length;
+    }
+    return header.count;
+}
+
+/*
+ * Deliver everything waiting, up to max_messages queue messages (0 = no
+ * limit), receiving into buf. Emergencies are taken before anything else at
+ * every step. With block set the call first waits for one message of any
+ * type. A small max_messages bounds the time spent per wakeup; a large one
+ * amortizes the wakeup over more records. A signal interrupts the wait;
+ * the call then returns what it delivered so far. Returns the records
+ * delivered, or -1 on error.
+ */
+static inline long ipc_drain(int msqid, struct ipc_batch_buf* buf, int block, unsigned long max_messages,
+                             ipc_record_fn fn, void* context, struct ipc_drain_stats* stats) {
+    long delivered = 0;
+    unsigned long messages = 0;
+    while (max_messages == 0 || messages < max_messages) {
+        ssize_t size = msgrcv(msqid, buf, sizeof(buf->mtext), EMERGENCY_TYPE, IPC_NOWAIT);
+        if (size < 0 && errno == ENOMSG) {
+            int wait = block && messages == 0;
+            size = msgrcv(msqid, buf, sizeof(buf->mtext), 0, wait ? 0 : IPC_NOWAIT);
+        }
+        if (size < 0) {
+            if (errno == ENOMSG || errno == EINTR) {
+                break;
+            }
+            return -1;
+        }
+        messages++;
+        int records = ipc_unpack(buf, (size_t)size, fn, context);
+        if (records > 0) {
+            delivered += records;
+        }
+    }
+    if (stats != NULL) {
+        stats->messages += messages;
+        stats->records += delivered;
+        stats->wakeups++;
+    }
+    return delivered;
+}
+
+#endif
@@ -8,4 +8,24 @@ if [ $? -eq 0 ]; then
     echo "Message Queue (Key: $KEY) successfully removed."
 else
     echo "Message Queue (Key: $KEY) not found or removal failed."
-fi
\ No newline at end of file
+fi
+REPLY_KEY=$((KEY + 1))
+ipcrm -Q $REPLY_KEY 2>/dev/null
+if [ $? -eq 0 ]; then
+    echo "Reply Queue (Key: $REPLY_KEY) successfully removed."
+else
+    echo "Reply Queue (Key: $REPLY_KEY) not found or removal failed."
+fi
+RING=/dev/shm/m4_ipc_ring_$KEY
+if [ -e "$RING" ] && rm -f "$RING"; then
+    echo "Shared memory ring ($RING) successfully removed."
+else
+    echo "Shared memory ring ($RING) not found or removal failed."
+fi
+
+ARENA=/dev/shm/m4_ipc_arena_$KEY
+if [ -e "$ARENA" ] && rm -f "$ARENA"; then
+    echo "Shared memory arena ($ARENA) successfully removed."
+else
+    echo "Shared memory arena ($ARENA) not found or removal failed."
+fi
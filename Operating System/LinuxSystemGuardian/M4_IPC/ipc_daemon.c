@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include "ipc_common.h"
+#include "ipc_transport.h"
+#include "ipc_dispatch.h"
+#include "ipc_wire.h"
+
+/*
+ * Receiver daemon: one reader thread (main) pulls alerts off the transport
+ * into priority lanes, and a pool of consumer threads handles them,
+ * emergencies strictly first. A control thread handles SIGINT/SIGTERM and
+ * prints per-lane depth and latency every --stats-interval seconds.
+ */
+
+struct daemon_options {
+    enum ipc_transport_kind transport;
+    unsigned consumers;
+    unsigned reserved;       /* consumers that only take emergencies */
+    long count;              /* stop after this many alerts, 0 = run until signalled */
+    unsigned long max_batch; /* transport messages per read */
+    size_t high_water;
+    long work_us;            /* simulated handling cost per alert */
+    double stats_interval;   /* seconds, 0 = final report only */
+    const char* stats_file;
+    int quiet;
+};
+
+static struct daemon_options options = {IPC_DEFAULT_TRANSPORT, 4, 1, 0, 64, 65536, 0, 0, NULL, 0};
+static struct ipc_dispatcher dispatcher;
+static struct ipc_receiver rx;
+static pthread_t reader_thread;
+static volatile sig_atomic_t stop_requested = 0;
+static volatile int finished = 0;
+static unsigned long handled[IPC_LANES];
+static unsigned long long payload_bytes;
+static uint64_t start_ns;
+
+/* --- Reader --- */
+
+struct staging {
+    struct ipc_alert* items;
+    size_t count;
+    size_t capacity;
+};
+
+static void stage_record(void* context, long mtype, const char* data, size_t length, uint64_t sent_ns) {
+    struct staging* staged = (struct staging*)context;
+    if (staged->count == staged->capacity) {
+        size_t capacity = staged->capacity ? staged->capacity * 2 : 256;
+        struct ipc_alert* items = realloc(staged->items, capacity * sizeof(*items));
+        if (items == NULL) {
+            return; /* dropped; the counts will show it */
+        }
+        staged->items = items;
+        staged->capacity = capacity;
+    }
+    /* Large payloads stay in the arena until a consumer is done with
+     * them; only their descriptor is copied. Map the arena here, on the
+     * reader, so consumers never race to do it. */
+    int in_arena = ipc_is_descriptor(data, length);
+    if (in_arena && ipc_receiver_arena(&rx) == NULL) {
+        rx.stale_descriptors++;
+        return;
+    }
+    char* copy = malloc(length + 1);
+    if (copy == NULL) {
+        return;
+    }
+    memcpy(copy, data, length);
+    copy[length] = '\0';
+    struct ipc_alert* alert = &staged->items[staged->count++];
+    alert->mtype = mtype;
+    alert->sent_ns = sent_ns;
+    alert->length = length;
+    alert->data = copy;
+    alert->in_arena = in_arena;
+}
+
+static void publish(struct staging* staged) {
+    size_t pushed = ipc_dispatch_push(&dispatcher, staged->items, staged->count);
+    for (size_t i = pushed; i < staged->count; ++i) {
+        free(staged->items[i].data);
+    }
+    staged->count = 0;
+}
+
+static void wakeup_handler(int signal_number) {
+    (void)signal_number;
+}
+
+/* --- Consumers --- */
+
+struct consumer {
+    pthread_t thread;
+    unsigned id;
+    int reserved;
+};
+
+static void spin_for_us(long us) {
+    uint64_t until = ipc_now_ns() + (uint64_t)us * 1000;
+    while (ipc_now_ns() < until) {
+        ipc_cpu_relax();
+    }
+}
+
+static void print_alert(unsigned id, long mtype, const char* data, size_t length) {
+    const char* text;
+    size_t shown;
+    struct wire_header header;
+    if (wire_alert_text(data, length, &text, &shown)) {
+        printf("[Consumer %u] RECEIVED [Type %ld]: %.*s (wire record)\n", id, mtype, (int)shown, text);
+        return;
+    }
+    if (wire_decode_header(data, length, &header) > 0) {
+        printf("[Consumer %u] RECEIVED [Type %ld]: %s wire record [%zu bytes]\n", id, mtype,
+               wire_type_name(header.type), length);
+        return;
+    }
+    shown = length;
+    if (shown > 0 && data[shown - 1] == '\0') {
+        shown--;
+    }
+    const char* newline = memchr(data, '\n', shown);
+    if (newline != NULL) {
+        /* a large payload: its first line and its size */
+        printf("[Consumer %u] RECEIVED [Type %ld]: %.*s [%zu bytes]\n", id, mtype, (int)(newline - data), data,
+               length);
+    } else {
+        printf("[Consumer %u] RECEIVED [Type %ld]: %.*s\n", id, mtype, (int)shown, data);
+    }
+}
+
+static void* consumer_main(void* arg) {
+    struct consumer* self = (struct consumer*)arg;
+    struct ipc_alert alert;
+    while (ipc_dispatch_take(&dispatcher, self->reserved, &alert) == 0) {
+        const char* data = alert.data;
+        size_t length = alert.length;
+        struct ipc_descriptor descriptor;
+        if (alert.in_arena) {
+            memcpy(&descriptor, alert.data, sizeof(descriptor));
+            data = ipc_arena_get(&rx.arena, &descriptor);
+            if (data == NULL) {
+                __atomic_add_fetch(&rx.stale_descriptors, 1, __ATOMIC_RELAXED);
+                free(alert.data);
+                continue;
+            }
+            length = (size_t)descriptor.length;
+        }
+        if (options.work_us > 0) {
+            spin_for_us(options.work_us);
+        }
+        if (!options.quiet) {
+            print_alert(self->id, alert.mtype, data, length);
+        }
+        __atomic_add_fetch(&payload_bytes, length, __ATOMIC_RELAXED);
+        if (alert.in_arena) {
+            ipc_arena_release(&rx.arena, &descriptor);
+        }
+        free(alert.data);
+        __atomic_add_fetch(&handled[ipc_lane_of(alert.mtype)], 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/* --- Metrics --- */
+
+static void print_lane_line(int lane, const struct ipc_lane* copy) {
+    printf("  %-12s depth %6zu (max %6zu) queued %9lu handled %9lu | wait p50 %9.2f p99 %9.2f us"
+           " | delivery p50 %9.2f p99 %9.2f max %9.2f us\n",
+           ipc_lane_name(lane), copy->depth, copy->max_depth, copy->queued,
+           __atomic_load_n(&handled[lane], __ATOMIC_RELAXED), ipc_latency_percentile(&copy->wait, 50) / 1e3,
+           ipc_latency_percentile(&copy->wait, 99) / 1e3, ipc_latency_percentile(&copy->delivery, 50) / 1e3,
+           ipc_latency_percentile(&copy->delivery, 99) / 1e3, copy->delivery.max_ns / 1e3);
+}
+
+static void write_latency_json(FILE* out, const char* name, const struct ipc_latency* h) {
+    fprintf(out, "\"%s\":{\"count\":%lu,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"p999\":%.3f,\"max\":%.3f}", name,
+            h->count, ipc_latency_percentile(h, 50) / 1e3, ipc_latency_percentile(h, 90) / 1e3,
+            ipc_latency_percentile(h, 99) / 1e3, ipc_latency_percentile(h, 99.9) / 1e3, h->max_ns / 1e3);
+}
+
+/* One JSON line per report: depth, counts and latencies in microseconds per lane */
+static void write_stats_json(const struct ipc_lane copies[IPC_LANES], int final) {
+    if (options.stats_file == NULL) {
+        return;
+    }
+    FILE* out = fopen(options.stats_file, "a");
+    if (out == NULL) {
+        perror("Cannot open stats file");
+        return;
+    }
+    fprintf(out, "{\"elapsed_ms\":%.3f,\"final\":%s,\"transport\":\"%s\",\"lanes\":{",
+            (ipc_now_ns() - start_ns) / 1e6, final ? "true" : "false", ipc_transport_name(options.transport));
+    for (int lane = 0; lane < IPC_LANES; ++lane) {
+        const struct ipc_lane* copy = &copies[lane];
+        fprintf(out, "%s\"%s\":{\"depth\":%zu,\"max_depth\":%zu,\"queued\":%lu,\"handled\":%lu,", lane ? "," : "",
+                ipc_lane_name(lane), copy->depth, copy->max_depth, copy->queued,
+                __atomic_load_n(&handled[lane], __ATOMIC_RELAXED));
+        write_latency_json(out, "wait_us", &copy->wait);
+        fputc(',', out);
+        write_latency_json(out, "delivery_us", &copy->delivery);
+        fputc('}', out);
+    }
+    fprintf(out, "}}\n");
+    fclose(out);
+}
+
+static void report_stats(int final) {
+    struct ipc_lane copies[IPC_LANES];
+    for (int lane = 0; lane < IPC_LANES; ++lane) {
+        ipc_dispatch_snapshot(&dispatcher, lane, &copies[lane]);
+    }
+    printf("%s (%.3f s):\n", final ? "\nFinal lane report" : "Lane report", (ipc_now_ns() - start_ns) / 1e9);
+    for (int lane = 0; lane < IPC_LANES; ++lane) {
+        print_lane_line(lane, &copies[lane]);
+    }
+    fflush(stdout);
+    write_stats_json(copies, final);
+}
+
+/* --- Control thread --- */
+/* Takes SIGINT/SIGTERM (blocked everywhere else), prints periodic reports,
+ * and once a stop is requested keeps nudging the reader with SIGUSR1 until
+ * it leaves its blocking read. SIGUSR2 from main ends it. */
+
+static void* control_main(void* arg) {
+    (void)arg;
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGUSR2); /* main: we are finished */
+    uint64_t next_report = options.stats_interval > 0 ? ipc_now_ns() + (uint64_t)(options.stats_interval * 1e9) : 0;
+    while (!__atomic_load_n(&finished, __ATOMIC_ACQUIRE)) {
+        struct timespec tick = {0, 100 * 1000 * 1000};
+        if (stop_requested) {
+            tick.tv_nsec = 10 * 1000 * 1000;
+        }
+        int signal_number = sigtimedwait(&stop_signals, NULL, &tick);
+        if (signal_number == SIGINT || signal_number == SIGTERM) {
+            if (!stop_requested) {
+                printf("\nSignal %d received, finishing queued alerts...\n", signal_number);
+            }
+            stop_requested = 1;
+        }
+        if (stop_requested) {
+            pthread_kill(reader_thread, SIGUSR1);
+        }
+        if (next_report != 0 && ipc_now_ns() >= next_report) {
+            report_stats(0);
+            next_report += (uint64_t)(options.stats_interval * 1e9);
+        }
+    }
+    return NULL;
+}
+
+/* --- Main Program --- */
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --transport NAME       msgq or shm (default %s)\n"
+            "  --consumers N          consumer threads (default 4)\n"
+            "  --reserved N           consumers kept for emergencies only (default 1)\n"
+            "  --count N              exit after N alerts (default: run until SIGINT/SIGTERM)\n"
+            "  --max-batch N          transport messages taken per read (default 64)\n"
+            "  --high-water N         queued notifications at which reading them pauses (default 65536)\n"
+            "  --work-us N            simulated handling time per alert (default 0)\n"
+            "  --stats-interval SEC   print a lane report every SEC seconds (default: at exit only)\n"
+            "  --stats-file PATH      also append each report as a JSON line\n"
+            "  --quiet                do not print each alert\n",
+            program, ipc_transport_name(IPC_DEFAULT_TRANSPORT));
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+            if (ipc_parse_transport(argv[++i], &options.transport) < 0) {
+                fprintf(stderr, "Unknown transport: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--consumers") == 0 && i + 1 < argc) {
+            options.consumers = (unsigned)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reserved") == 0 && i + 1 < argc) {
+            options.reserved = (unsigned)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            options.count = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--max-batch") == 0 && i + 1 < argc) {
+            options.max_batch = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--high-water") == 0 && i + 1 < argc) {
+            options.high_water = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--work-us") == 0 && i + 1 < argc) {
+            options.work_us = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+            options.stats_interval = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--stats-file") == 0 && i + 1 < argc) {
+            options.stats_file = argv[++i];
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            options.quiet = 1;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.consumers == 0) {
+        options.consumers = 1;
+    }
+    if (options.reserved >= options.consumers) {
+        options.reserved = options.consumers - 1; /* someone has to take notifications */
+    }
+
+    printf("--- Module 4: IPC Receiver Daemon ---\n");
+
+    if (ipc_receiver_open(&rx, options.transport, 1) < 0) {
+        perror(options.transport == IPC_TRANSPORT_SHM ? "shm_open failed" : "msgget failed");
+        exit(1);
+    }
+    rx.raw_descriptors = 1; /* consumers read large payloads in place */
+    printf("Transport %s, %u consumers (%u reserved for emergencies), notification high-water %zu\n",
+           ipc_transport_name(options.transport), options.consumers, options.reserved, options.high_water);
+
+    /* Only the control thread takes SIGINT/SIGTERM; SIGUSR1 from it
+     * interrupts the reader's blocking read. */
+    struct sigaction wakeup;
+    memset(&wakeup, 0, sizeof(wakeup));
+    wakeup.sa_handler = wakeup_handler; /* no SA_RESTART */
+    sigemptyset(&wakeup.sa_mask);
+    sigaction(SIGUSR1, &wakeup, NULL);
+    sigset_t blocked, original;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGUSR1);
+    sigaddset(&blocked, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &blocked, &original);
+
+    ipc_dispatcher_init(&dispatcher, options.high_water);
+    reader_thread = pthread_self();
+    start_ns = ipc_now_ns();
+    struct consumer* consumers = calloc(options.consumers, sizeof(*consumers));
+    if (consumers == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    for (unsigned i = 0; i < options.consumers; ++i) {
+        consumers[i].id = i + 1;
+        consumers[i].reserved = i < options.reserved;
+        pthread_create(&consumers[i].thread, NULL, consumer_main, &consumers[i]);
+    }
+    pthread_t control;
+    pthread_create(&control, NULL, control_main, NULL);
+
+    /* The reader keeps SIGINT/SIGTERM blocked but takes SIGUSR1 */
+    sigset_t reader_mask = blocked;
+    sigdelset(&reader_mask, SIGUSR1);
+    pthread_sigmask(SIG_SETMASK, &reader_mask, NULL);
+
+    struct staging staged = {NULL, 0, 0};
+    struct ipc_drain_stats stats = {0, 0, 0};
+    unsigned long backed_up = 0;
+    while (!stop_requested && (options.count == 0 || (long)stats.records < options.count)) {
+        long received;
+        if (ipc_dispatch_backed_up(&dispatcher)) {
+            /* Leave notifications in the transport; keep emergencies moving */
+            backed_up++;
+            received = ipc_receive_urgent(&rx, stage_record, &staged, &stats);
+            if (received >= 0) {
+                publish(&staged);
+                ipc_dispatch_wait_space(&dispatcher, 1000 * 1000);
+            }
+        } else {
+            received = ipc_receive(&rx, 1, options.max_batch, stage_record, &staged, &stats);
+            if (received >= 0) {
+                publish(&staged);
+            }
+        }
+        if (received < 0) {
+            perror("receive failed");
+            break;
+        }
+    }
+    free(staged.items);
+
+    ipc_dispatch_stop(&dispatcher);
+    for (unsigned i = 0; i < options.consumers; ++i) {
+        pthread_join(consumers[i].thread, NULL);
+    }
+    __atomic_store_n(&finished, 1, __ATOMIC_RELEASE);
+    pthread_kill(control, SIGUSR2);
+    pthread_join(control, NULL);
+    pthread_sigmask(SIG_SETMASK, &original, NULL);
+
+    report_stats(1);
+    printf("Read %lu alerts in %lu transport messages over %lu wakeups; %lu reads paused for backed-up"
+           " notifications.\n",
+           stats.records, stats.messages, stats.wakeups, backed_up);
+    printf("Handled %llu payload bytes", payload_bytes);
+    if (rx.stale_descriptors > 0) {
+        printf("; skipped %lu large payloads whose arena slots had been reused", rx.stale_descriptors);
+    }
+    printf(".\n");
+    free(consumers);
+    ipc_dispatcher_destroy(&dispatcher);
+    ipc_receiver_close(&rx);
+    printf("Receiver daemon finished.\n");
+    return 0;
+}
@@ -0,0 +1,303 @@
+#ifndef IPC_DISPATCH_H
+#define IPC_DISPATCH_H
+
+/*
+ * In-process priority lanes between the receiver daemon's reader and its
+ * consumer threads.
+ *
+ * The reader copies each alert into lane 0 (emergencies) or lane 1
+ * (everything else). A consumer always takes from lane 0 while it holds
+ * anything, and only then from lane 1, so notifications get whatever
+ * capacity emergencies leave over. Reserved consumers never take from lane
+ * 1 at all: however slow notification handling gets, some thread is free
+ * for the next emergency.
+ *
+ * Lanes grow as needed. Notification depth is kept near high_water by the
+ * reader, which stops pulling notifications from the transport at that
+ * depth. The backlog then stays in the kernel queue or shared ring, and the
+ * reader keeps taking emergencies.
+ *
+ * Each lane records its depth and two latency histograms: time spent waiting
+ * in the lane, and send-to-consumer delivery time.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ipc_common.h"
+#include "ipc_batch.h"
+
+#define IPC_LANES 2 /* 0: emergencies, 1: the rest */
+
+static inline int ipc_lane_of(long mtype) {
+    return mtype == EMERGENCY_TYPE ? 0 : 1;
+}
+
+static inline const char* ipc_lane_name(int lane) {
+    return lane == 0 ? "emergency" : "notification";
+}
+
+/* --- Latency histogram --- */
+/* Log-linear buckets: 8 per power of two, so values are kept to within 12.5% */
+
+#define IPC_LATENCY_SUB_BITS 3
+#define IPC_LATENCY_BUCKETS (64 << IPC_LATENCY_SUB_BITS)
+
+struct ipc_latency {
+    unsigned long count;
+    uint64_t max_ns;
+    uint64_t total_ns;
+    unsigned long buckets[IPC_LATENCY_BUCKETS];
+};
+
+static inline unsigned ipc_latency_bucket(uint64_t ns) {
+    if (ns < (1u << IPC_LATENCY_SUB_BITS)) {
+        return (unsigned)ns;
+    }
+    unsigned exponent = 63 - (unsigned)__builtin_clzll(ns);
+    unsigned sub = (unsigned)(ns >> (exponent - IPC_LATENCY_SUB_BITS)) & ((1u << IPC_LATENCY_SUB_BITS) - 1);
+    return ((exponent - IPC_LATENCY_SUB_BITS + 1) << IPC_LATENCY_SUB_BITS) + sub;
+}
+
+/* Largest value that falls in a bucket */
+static inline uint64_t ipc_latency_bucket_top(unsigned bucket) {
+    if (bucket < (1u << IPC_LATENCY_SUB_BITS)) {
+        return bucket;
+    }
+    unsigned shift = (bucket >> IPC_LATENCY_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)((1u << IPC_LATENCY_SUB_BITS) + (bucket & ((1u << IPC_LATENCY_SUB_BITS) - 1)))
+                   << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+static inline void ipc_latency_add(struct ipc_latency* h, uint64_t ns) {
+    h->count++;
+    h->total_ns += ns;
+    if (ns > h->max_ns) {
+        h->max_ns = ns;
+    }
+    h->buckets[ipc_latency_bucket(ns)]++;
+}
+
+/* Nearest-rank percentile in nanoseconds, 0 when empty */
+static inline uint64_t ipc_latency_percentile(const struct ipc_latency* h, double p) {
+    if (h->count == 0) {
+        return 0;
+    }
+    unsigned long rank = (unsigned long)(p / 100.0 * h->count + 0.999999);
+    rank = rank < 1 ? 1 : rank > h->count ? h->count : rank;
+    unsigned long seen = 0;
+    for (unsigned i = 0; i < IPC_LATENCY_BUCKETS; ++i) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t top = ipc_latency_bucket_top(i);
+            return top < h->max_ns ? top : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+/* --- Lanes --- */
+
+struct ipc_alert {
+    long mtype;
+    uint64_t sent_ns;   /* from the transport, 0 if the sender did not stamp it */
+    uint64_t queued_ns; /* when the reader put it in its lane */
+    size_t length;
+    char* data;         /* owned by whoever holds the alert */
+    int in_arena;       /* data is an arena descriptor; the payload is read in place */
+};
+
+struct ipc_lane {
+    struct ipc_alert* slots;
+    size_t capacity;
+    size_t head;
+    size_t depth;
+    size_t max_depth;
+    unsigned long queued;
+    unsigned long taken;
+    struct ipc_latency wait;     /* queued -> taken by a consumer */
+    struct ipc_latency delivery; /* sent -> taken by a consumer */
+};
+
+static inline int ipc_lane_push(struct ipc_lane* lane, const struct ipc_alert* alert) {
+    if (lane->depth == lane->capacity) {
+        size_t capacity = lane->capacity ? lane->capacity * 2 : 1024;
+        struct ipc_alert* slots = (struct ipc_alert*)malloc(capacity * sizeof(*slots));
+        if (slots == NULL) {
+            return -1;
+        }
+        /* Unwrap the old ring into the front of the new one */
+        for (size_t i = 0; i < lane->depth; ++i) {
+            slots[i] = lane->slots[(lane->head + i) % lane->capacity];
+        }
+        free(lane->slots);
+        lane->slots = slots;
+        lane->capacity = capacity;
+        lane->head = 0;
+    }
+    lane->slots[(lane->head + lane->depth) % lane->capacity] = *alert;
+    lane->depth++;
+    lane->queued++;
+    if (lane->depth > lane->max_depth) {
+        lane->max_depth = lane->depth;
+    }
+    return 0;
+}
+
+static inline void ipc_lane_pop(struct ipc_lane* lane, struct ipc_alert* alert, uint64_t now_ns) {
+    *alert = lane->slots[lane->head];
+    lane->head = (lane->head + 1) % lane->capacity;
+    lane->depth--;
+    lane->taken++;
+    ipc_latency_add(&lane->wait, now_ns - alert->queued_ns);
+    if (alert->sent_ns != 0 && now_ns >= alert->sent_ns) {
+        ipc_latency_add(&lane->delivery, now_ns - alert->sent_ns);
+    }
+}
+
+/* --- Dispatcher --- */
+
+struct ipc_dispatcher {
+    pthread_mutex_t lock;
+    pthread_cond_t urgent; /* reserved consumers wait here */
+    pthread_cond_t work;   /* the other consumers */
+    pthread_cond_t space;  /* the reader, while notifications are backed up */
+    struct ipc_lane lanes[IPC_LANES];
+    size_t high_water; /* notification depth at which the reader stops pulling them */
+    int reader_waiting;
+    int stopping;      /* no more alerts will be pushed */
+};
+
+static inline void ipc_dispatcher_init(struct ipc_dispatcher* d, size_t high_water) {
+    memset(d, 0, sizeof(*d));
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->urgent, NULL);
+    pthread_cond_init(&d->work, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&d->space, &attr);
+    pthread_condattr_destroy(&attr);
+    d->high_water = high_water ? high_water : 1;
+}
+
+static inline void ipc_dispatcher_destroy(struct ipc_dispatcher* d) {
+    for (int lane = 0; lane < IPC_LANES; ++lane) {
+        struct ipc_lane* l = &d->lanes[lane];
+        for (size_t i = 0; i < l->depth; ++i) {
+            free(l->slots[(l->head + i) % l->capacity].data);
+        }
+        free(l->slots);
+    }
+    pthread_cond_destroy(&d->space);
+    pthread_cond_destroy(&d->work);
+    pthread_cond_destroy(&d->urgent);
+    pthread_mutex_destroy(&d->lock);
+}
+
+/* Hand a batch of alerts to the consumers under one lock. Returns the
+ * number queued; alerts that could not be queued keep their data. */
+static inline size_t ipc_dispatch_push(struct ipc_dispatcher* d, struct ipc_alert* alerts, size_t count) {
+    size_t pushed[IPC_LANES] = {0, 0};
+    size_t done = 0;
+    uint64_t now = ipc_now_ns();
+    pthread_mutex_lock(&d->lock);
+    for (; done < count; ++done) {
+        int lane = ipc_lane_of(alerts[done].mtype);
+        alerts[done].queued_ns = now;
+        if (ipc_lane_push(&d->lanes[lane], &alerts[done]) < 0) {
+            break;
+        }
+        pushed[lane]++;
+    }
+    if (pushed[0] > 0) {
+        pthread_cond_broadcast(&d->urgent);
+        pthread_cond_broadcast(&d->work);
+    } else if (pushed[1] == 1) {
+        pthread_cond_signal(&d->work);
+    } else if (pushed[1] > 1) {
+        pthread_cond_broadcast(&d->work);
+    }
+    pthread_mutex_unlock(&d->lock);
+    return done;
+}
+
+/* Take the next alert for a consumer, emergencies first; reserved consumers
+ * only take emergencies. Blocks while there is nothing for the caller.
+ * Returns 0, or -1 once the dispatcher is stopping and the caller's lanes are
+ * empty. */
+static inline int ipc_dispatch_take(struct ipc_dispatcher* d, int reserved, struct ipc_alert* alert) {
+    pthread_mutex_lock(&d->lock);
+    for (;;) {
+        if (d->lanes[0].depth > 0) {
+            ipc_lane_pop(&d->lanes[0], alert, ipc_now_ns());
+            break;
+        }
+        if (!reserved && d->lanes[1].depth > 0) {
+            ipc_lane_pop(&d->lanes[1], alert, ipc_now_ns());
+            if (d->reader_waiting && d->lanes[1].depth <= d->high_water / 2) {
+                pthread_cond_signal(&d->space);
+            }
+            break;
+        }
+        if (d->stopping) {
+            pthread_mutex_unlock(&d->lock);
+            return -1;
+        }
+        pthread_cond_wait(reserved ? &d->urgent : &d->work, &d->lock);
+    }
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+/* True while notifications are at or above the high-water mark */
+static inline int ipc_dispatch_backed_up(struct ipc_dispatcher* d) {
+    pthread_mutex_lock(&d->lock);
+    int full = d->lanes[1].depth >= d->high_water;
+    pthread_mutex_unlock(&d->lock);
+    return full;
+}
+
+/* Wait up to timeout_ns for notifications to drain to half the high-water
+ * mark. Returns 1 if they have. */
+static inline int ipc_dispatch_wait_space(struct ipc_dispatcher* d, uint64_t timeout_ns) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += (time_t)(timeout_ns / 1000000000ULL);
+    deadline.tv_nsec += (long)(timeout_ns % 1000000000ULL);
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&d->lock);
+    d->reader_waiting = 1;
+    while (d->lanes[1].depth > d->high_water / 2 &&
+           pthread_cond_timedwait(&d->space, &d->lock, &deadline) == 0) {
+    }
+    d->reader_waiting = 0;
+    int ready = d->lanes[1].depth <= d->high_water / 2;
+    pthread_mutex_unlock(&d->lock);
+    return ready;
+}
+
+/* No more pushes: consumers finish what is queued, then take() returns -1 */
+static inline void ipc_dispatch_stop(struct ipc_dispatcher* d) {
+    pthread_mutex_lock(&d->lock);
+    d->stopping = 1;
+    pthread_cond_broadcast(&d->urgent);
+    pthread_cond_broadcast(&d->work);
+    pthread_mutex_unlock(&d->lock);
+}
+
+/* Copy of a lane's counters and histograms, taken under the lock */
+static inline void ipc_dispatch_snapshot(struct ipc_dispatcher* d, int lane, struct ipc_lane* copy) {
+    pthread_mutex_lock(&d->lock);
+    *copy = d->lanes[lane];
+    pthread_mutex_unlock(&d->lock);
+    copy->slots = NULL;
+}
+
+#endif
@@ -5,42 +5,155 @@
 #include <sys/msg.h>
 #include <errno.h>
 #include "ipc_common.h"
+#include "ipc_transport.h"
+#include "ipc_wire.h"
 
-int main() {
-    int msqid;
-    struct message_buf rbuf;
-    long msg_type_selector = 0; 
+struct receive_state {
+    int quiet;
+    unsigned long emergencies;
+    unsigned long notifications;
+    double* latencies_us;   /* send-to-delivery time per record, when counting */
+    unsigned long latency_capacity;
+    unsigned long latency_count;
+    unsigned long long bytes;
+};
 
-    printf("--- Module 4: IPC Receiver (Process 2) ---\n");
+static void print_record(void* context, long mtype, const char* data, size_t length, uint64_t sent_ns) {
+    struct receive_state* state = (struct receive_state*)context;
+    if (sent_ns != 0 && state->latency_count < state->latency_capacity) {
+        state->latencies_us[state->latency_count++] = (ipc_now_ns() - sent_ns) / 1e3;
+    }
+    if (mtype == EMERGENCY_TYPE) {
+        state->emergencies++;
+    } else {
+        state->notifications++;
+    }
+    state->bytes += length;
+    if (!state->quiet) {
+        const char* text;
+        size_t text_length;
+        struct wire_header header;
+        if (wire_alert_text(data, length, &text, &text_length)) {
+            printf("RECEIVED [Type %ld]: %.*s (wire record)\n", mtype, (int)text_length, text);
+            return;
+        }
+        if (wire_decode_header(data, length, &header) > 0) {
+            printf("RECEIVED [Type %ld]: %s wire record [%zu bytes]\n", mtype, wire_type_name(header.type), length);
+            return;
+        }
+        size_t shown = length;
+        if (shown > 0 && data[shown - 1] == '\0') {
+            shown--;
+        }
+        const char* newline = memchr(data, '\n', shown);
+        if (newline != NULL) {
+            /* a large payload: its first line and its size */
+            printf("RECEIVED [Type %ld]: %.*s [%zu bytes]\n", mtype, (int)(newline - data), data, length);
+        } else {
+            printf("RECEIVED [Type %ld]: %.*s\n", mtype, (int)shown, data);
+        }
+    }
+}
 
-    msqid = msgget(MSG_KEY, 0666); 
-    if (msqid < 0) {
-        perror("msgget failed, ensure sender ran first");
-        exit(1);
+static void print_usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --transport NAME  msgq or shm (default %s)\n"
+            "  --count N      keep draining until N alerts arrived (default: one drain)\n"
+            "  --max-batch N  queue messages taken per wakeup, 0 = all available (default 0)\n"
+            "  --quiet        count alerts instead of printing them\n",
+            program, ipc_transport_name(IPC_DEFAULT_TRANSPORT));
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile of a sorted sample */
+static double percentile(const double* sorted, unsigned long count, double p) {
+    unsigned long rank = (unsigned long)(p / 100.0 * count + 0.999999);
+    rank = rank < 1 ? 1 : rank > count ? count : rank;
+    return sorted[rank - 1];
+}
+
+int main(int argc, char* argv[]) {
+    static struct ipc_receiver rx;
+    long count = 0;
+    unsigned long max_batch = 0;
+    enum ipc_transport_kind transport = IPC_DEFAULT_TRANSPORT;
+    struct receive_state state;
+    struct ipc_drain_stats stats = {0, 0, 0};
+    memset(&state, 0, sizeof(state));
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+            if (ipc_parse_transport(argv[++i], &transport) < 0) {
+                fprintf(stderr, "Unknown transport: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--max-batch") == 0 && i + 1 < argc) {
+            max_batch = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            state.quiet = 1;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
     }
-    printf("Message Queue ID (msqid) obtained: %d\n", msqid);
 
-    printf("\nAttempting to read the FIRST message (Type 0, Blocking)...\n");
-    if (msgrcv(msqid, &rbuf, sizeof(rbuf.mtext), msg_type_selector, 0) < 0) {
-        perror("msgrcv failed (blocking)");
+    printf("--- Module 4: IPC Receiver (Process 2) ---\n");
+
+    if (ipc_receiver_open(&rx, transport, 0) < 0) {
+        perror(transport == IPC_TRANSPORT_SHM ? "shm_open failed, ensure sender ran first"
+                                              : "msgget failed, ensure sender ran first");
         exit(1);
     }
-    printf("RECEIVED [Type %ld, Blocking]: %s\n", rbuf.mtype, rbuf.mtext);
+    if (transport == IPC_TRANSPORT_SHM) {
+        printf("Shared memory ring obtained: %s\n", rx.ring.name);
+    } else {
+        printf("Message Queue ID (msqid) obtained: %d\n", rx.msqid);
+    }
+    if (count > 0) {
+        state.latency_capacity = (unsigned long)count;
+        state.latencies_us = malloc(count * sizeof(double));
+        if (state.latencies_us == NULL) {
+            state.latency_capacity = 0;
+        }
+    }
 
-    
-    msg_type_selector = EMERGENCY_TYPE;
-    printf("\nAttempting to read a specific message (Type %ld, Non-Blocking)...\n", msg_type_selector);
-    if (msgrcv(msqid, &rbuf, sizeof(rbuf.mtext), msg_type_selector, IPC_NOWAIT) < 0) {
-        if (errno == ENOMSG) {
-            printf("Non-Blocking Read: No message of Type %ld currently available.\n", msg_type_selector);
-        } else {
-            perror("msgrcv failed (non-blocking)");
+    /* Wait for the first message, then take everything queued behind it,
+     * emergencies first */
+    printf("\nDraining the queue (blocking for the first message, emergencies first)...\n");
+    uint64_t start = ipc_now_ns();
+    do {
+        if (ipc_receive(&rx, 1, max_batch, print_record, &state, &stats) < 0) {
+            perror("msgrcv failed");
             exit(1);
         }
-    } else {
-        printf("RECEIVED [Type %ld, Non-Blocking]: %s\n", rbuf.mtype, rbuf.mtext);
+    } while ((long)stats.records < count);
+    double elapsed_ms = (ipc_now_ns() - start) / 1e6;
+
+    printf("\nReceived %lu alerts (%lu emergency, %lu notification) in %lu messages over %lu wakeups",
+           stats.records, state.emergencies, state.notifications, stats.messages, stats.wakeups);
+    if (count > 0) {
+        printf(" in %.3f ms", elapsed_ms);
+    }
+    printf(", %llu payload bytes.\n", state.bytes);
+    if (rx.stale_descriptors > 0) {
+        printf("Skipped %lu large payloads whose arena slots had been reused.\n", rx.stale_descriptors);
+    }
+    if (state.latency_count > 0) {
+        qsort(state.latencies_us, state.latency_count, sizeof(double), compare_doubles);
+        printf("Delivery latency (us): p50 %.2f, p99 %.2f, max %.2f\n",
+               percentile(state.latencies_us, state.latency_count, 50),
+               percentile(state.latencies_us, state.latency_count, 99),
+               state.latencies_us[state.latency_count - 1]);
     }
-    
+    free(state.latencies_us);
+    ipc_receiver_close(&rx);
     printf("\nReceiver finished.\n");
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,243 @@
+#ifndef IPC_RING_H
+#define IPC_RING_H
+
+/*
+ * Shared-memory ring transport for same-host alerts.
+ *
+ * A POSIX shared memory segment holds two byte rings, one per priority lane
+ * (emergencies and everything else). Any number of senders reserve space
+ * with a compare-and-swap on the ring's head, copy their record in and
+ * publish it by storing its header word last; one receiver consumes in
+ * order. A record never wraps: when it would not fit before the end, the
+ * sender pads to the end and starts over at offset 0. The receiver zeroes
+ * what it consumed, so a header word is non-zero only once it is published.
+ *
+ * No system call is made per record. A receiver that finds both rings empty
+ * announces that it is going to sleep and waits on a futex in the segment;
+ * senders only call futex_wake when they see that announcement.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "ipc_common.h"
+#include "ipc_shm.h"
+
+#define IPC_RING_MAGIC 0x4D34524Eu
+#define IPC_RING_BYTES (1u << 20) /* per lane, a power of two */
+#define IPC_RING_LANES 2          /* 0: emergencies, 1: the rest */
+
+#define IPC_RECORD_COMMITTED 0x80000000u
+#define IPC_RECORD_PADDING 0x40000000u
+#define IPC_RECORD_SIZE_MASK 0x3FFFFFFFu
+
+struct ipc_ring_record {
+    uint32_t word;  /* size including this header | flags; 0 = not published */
+    int32_t mtype;
+    uint64_t sent_ns;
+};
+
+struct ipc_ring_lane {
+    uint64_t head __attribute__((aligned(64))); /* next byte senders reserve */
+    uint64_t tail __attribute__((aligned(64))); /* next byte the receiver reads */
+};
+
+struct ipc_ring_shared {
+    uint32_t magic; /* written last by the creator */
+    uint32_t capacity;
+    uint32_t sleeping __attribute__((aligned(64))); /* receiver is about to wait */
+    uint32_t wake_seq;                               /* futex word */
+    struct ipc_ring_lane lanes[IPC_RING_LANES];
+};
+
+struct ipc_ring {
+    struct ipc_ring_shared* shared;
+    char* data[IPC_RING_LANES];
+    size_t map_size;
+    char name[64];
+};
+
+#define IPC_RING_DATA_OFFSET ((sizeof(struct ipc_ring_shared) + 4095) & ~(size_t)4095)
+
+static inline void ipc_ring_name(char* name, size_t size) {
+    snprintf(name, size, "/m4_ipc_ring_%d", MSG_KEY);
+}
+
+static inline void ipc_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static inline int ipc_ring_futex(uint32_t* word, int op, uint32_t value, const struct timespec* timeout) {
+    return (int)syscall(SYS_futex, word, op, value, timeout, NULL, 0);
+}
+
+/* Map the segment, creating it if create is set. Returns 0 or -1 (errno). */
+static inline int ipc_ring_open(struct ipc_ring* ring, int create) {
+    ipc_ring_name(ring->name, sizeof(ring->name));
+    ring->map_size = IPC_RING_DATA_OFFSET + (size_t)IPC_RING_LANES * IPC_RING_BYTES;
+    int created;
+    void* map = ipc_shm_map(ring->name, ring->map_size, create, &created);
+    if (map == NULL) {
+        return -1;
+    }
+    ring->shared = (struct ipc_ring_shared*)map;
+    for (int lane = 0; lane < IPC_RING_LANES; ++lane) {
+        ring->data[lane] = (char*)map + IPC_RING_DATA_OFFSET + (size_t)lane * IPC_RING_BYTES;
+    }
+    if (created) {
+        ring->shared->capacity = IPC_RING_BYTES;
+        __atomic_store_n(&ring->shared->magic, IPC_RING_MAGIC, __ATOMIC_RELEASE);
+    } else if (ipc_shm_wait_ready(&ring->shared->magic, IPC_RING_MAGIC) < 0) {
+        munmap(map, ring->map_size);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void ipc_ring_close(struct ipc_ring* ring) {
+    munmap(ring->shared, ring->map_size);
+}
+
+static inline int ipc_ring_lane_of(long mtype) {
+    return mtype == EMERGENCY_TYPE ? 0 : 1;
+}
+
+/* --- Sender --- */
+
+/* Publish one record. Returns 0, or -1 with errno: EAGAIN when the lane is
+ * full, EMSGSIZE when the record is larger than a quarter of the ring. */
+static inline int ipc_ring_send(struct ipc_ring* ring, long mtype, const void* data, size_t length,
+                                uint64_t sent_ns) {
+    size_t size = (sizeof(struct ipc_ring_record) + length + 7) & ~(size_t)7;
+    if (size > IPC_RING_BYTES / 4) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    int lane = ipc_ring_lane_of(mtype);
+    struct ipc_ring_lane* state = &ring->shared->lanes[lane];
+    char* base = ring->data[lane];
+
+    uint64_t position, padding;
+    for (;;) {
+        position = __atomic_load_n(&state->head, __ATOMIC_RELAXED);
+        uint64_t tail = __atomic_load_n(&state->tail, __ATOMIC_ACQUIRE);
+        size_t offset = position & (IPC_RING_BYTES - 1);
+        padding = offset + size > IPC_RING_BYTES ? IPC_RING_BYTES - offset : 0;
+        if (position + padding + size - tail > IPC_RING_BYTES) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (__atomic_compare_exchange_n(&state->head, &position, position + padding + size, 1, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (padding != 0) {
+        struct ipc_ring_record* pad = (struct ipc_ring_record*)(base + (position & (IPC_RING_BYTES - 1)));
+        __atomic_store_n(&pad->word, (uint32_t)padding | IPC_RECORD_PADDING | IPC_RECORD_COMMITTED,
+                         __ATOMIC_RELEASE);
+        position += padding;
+    }
+    struct ipc_ring_record* record = (struct ipc_ring_record*)(base + (position & (IPC_RING_BYTES - 1)));
+    record->mtype = (int32_t)mtype;
+    record->sent_ns = sent_ns;
+    memcpy(record + 1, data, length);
+    __atomic_store_n(&record->word, (uint32_t)(sizeof(struct ipc_ring_record) + length) | IPC_RECORD_COMMITTED,
+                     __ATOMIC_RELEASE);
+
+    /* Pairs with the receiver's fence between announcing sleep and its last
+     * look at the rings: one of the two sides always sees the other */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->shared->sleeping, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&ring->shared->sleeping, 0, __ATOMIC_ACQ_REL)) {
+        __atomic_add_fetch(&ring->shared->wake_seq, 1, __ATOMIC_RELEASE);
+        ipc_ring_futex(&ring->shared->wake_seq, FUTEX_WAKE, 1, NULL);
+    }
+    return 0;
+}
+
+/* --- Receiver --- */
+
+typedef void (*ipc_ring_record_fn)(void* context, long mtype, const char* data, size_t length, uint64_t sent_ns);
+
+static inline int ipc_ring_ready(struct ipc_ring* ring, int lane) {
+    uint64_t tail = ring->shared->lanes[lane].tail;
+    const struct ipc_ring_record* record =
+        (const struct ipc_ring_record*)(ring->data[lane] + (tail & (IPC_RING_BYTES - 1)));
+    return __atomic_load_n(&record->word, __ATOMIC_ACQUIRE) != 0;
+}
+
+/* Consume up to max_records from one lane (0 = all published). Returns the
+ * records delivered. */
+static inline unsigned long ipc_ring_drain_lane(struct ipc_ring* ring, int lane, unsigned long max_records,
+                                                ipc_ring_record_fn fn, void* context) {
+    struct ipc_ring_lane* state = &ring->shared->lanes[lane];
+    char* base = ring->data[lane];
+    uint64_t tail = state->tail;
+    unsigned long delivered = 0;
+    while (max_records == 0 || delivered < max_records) {
+        struct ipc_ring_record* record = (struct ipc_ring_record*)(base + (tail & (IPC_RING_BYTES - 1)));
+        uint32_t word = __atomic_load_n(&record->word, __ATOMIC_ACQUIRE);
+        if (word == 0) {
+            break;
+        }
+        size_t length = word & IPC_RECORD_SIZE_MASK;
+        size_t size = (word & IPC_RECORD_PADDING) ? length : (length + 7) & ~(size_t)7;
+        if ((word & IPC_RECORD_PADDING) == 0) {
+            fn(context, record->mtype, (const char*)(record + 1), length - sizeof(struct ipc_ring_record),
+               record->sent_ns);
+            delivered++;
+        }
+        memset(record, 0, size);
+        tail += size;
+        __atomic_store_n(&state->tail, tail, __ATOMIC_RELEASE);
+    }
+    return delivered;
+}
+
+/*
+ * Deliver what is published, emergencies first, up to max_records (0 = no
+ * limit). With block set and nothing published, spin briefly and then sleep
+ * on the futex until a sender publishes; a signal ends the wait with 0.
+ * Returns the records delivered.
+ */
+static inline long ipc_ring_drain(struct ipc_ring* ring, int block, unsigned long max_records,
+                                  ipc_ring_record_fn fn, void* context) {
+    struct ipc_ring_shared* shared = ring->shared;
+    for (int spins = 0;; ++spins) {
+        unsigned long delivered = ipc_ring_drain_lane(ring, 0, max_records, fn, context);
+        if (max_records == 0 || delivered < max_records) {
+            delivered += ipc_ring_drain_lane(ring, 1, max_records ? max_records - delivered : 0, fn, context);
+        }
+        if (delivered > 0 || !block) {
+            return (long)delivered;
+        }
+        if (spins < 256) {
+            ipc_cpu_relax();
+            continue;
+        }
+        uint32_t seq = __atomic_load_n(&shared->wake_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&shared->sleeping, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (ipc_ring_ready(ring, 0) || ipc_ring_ready(ring, 1)) {
+            __atomic_store_n(&shared->sleeping, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (ipc_ring_futex(&shared->wake_seq, FUTEX_WAIT, seq, NULL) < 0 && errno != EAGAIN) {
+            __atomic_store_n(&shared->sleeping, 0, __ATOMIC_RELAXED);
+            return errno == EINTR ? 0 : -1;
+        }
+        spins = 0;
+    }
+}
+
+#endif
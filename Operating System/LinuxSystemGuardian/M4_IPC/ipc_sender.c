@@ -1,43 +1,220 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include <sys/ipc.h>
 #include <sys/msg.h>
 #include "ipc_common.h"
+#include "ipc_transport.h"
+#include "ipc_wire.h"
 
-int main() {
+/* Queue a record, waiting for the receiver while the transport is full */
+static void send_bytes(struct ipc_sender* tx, long mtype, const char* data, size_t length) {
+    while (ipc_send(tx, mtype, data, length) < 0) {
+        if (errno != EAGAIN) {
+            perror("msgsnd failed");
+            exit(1);
+        }
+        usleep(50);
+    }
+}
+
+static int wire_alerts = 0; /* --wire */
+
+static void send_record(struct ipc_sender* tx, long mtype, const char* text) {
+    if (wire_alerts) {
+        char record[256];
+        size_t length = wire_encode_alert(record, sizeof(record), (uint32_t)mtype, WIRE_SOURCE_IPC, text, strlen(text));
+        if (length == 0) {
+            fprintf(stderr, "Alert text too long for a wire record\n");
+            exit(1);
+        }
+        send_bytes(tx, mtype, record, length);
+        return;
+    }
+    send_bytes(tx, mtype, text, strlen(text) + 1);
+}
+
+/* text, then filler lines up to length bytes in all (NUL included) */
+static char* make_payload(const char* text, size_t length) {
+    char* payload = malloc(length);
+    if (payload == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    size_t at = (size_t)snprintf(payload, length, "%s\n", text);
+    for (unsigned line = 1; at + 1 < length; ++line) {
+        at += (size_t)snprintf(payload + at, length - at, "  detail line %u: sensor and process data\n", line);
+    }
+    payload[length - 1] = '\0';
+    return payload;
+}
+
+static void flush_batch(struct ipc_sender* tx) {
+    while (ipc_sender_flush(tx) < 0) {
+        if (errno != EAGAIN) {
+            perror("msgsnd failed");
+            exit(1);
+        }
+        usleep(50);
+    }
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --transport NAME    msgq or shm (default %s)\n"
+            "  --count N           send N notifications, then one emergency (default: the two demo alerts)\n"
+            "  --emergency-every N with --count, also send an emergency after every N notifications\n"
+            "  --payload-bytes N   make every notification N bytes long (default: just its text)\n"
+            "  --arena-threshold N send payloads above N bytes through the shared arena\n"
+            "                      (default: only those too large to send inline)\n"
+            "  --batch-bytes N     largest message, up to %d (default %d)\n"
+            "  --batch-delay-us N  longest a notification waits for a batch to fill (default 1000)\n"
+            "  --unbatched         msgq: one msgsnd per alert, in plain message_buf form\n"
+            "  --wire              send alert texts as binary wire records (ipc_wire.h)\n",
+            program, ipc_transport_name(IPC_DEFAULT_TRANSPORT), IPC_BATCH_MAX_BYTES, IPC_BATCH_MAX_BYTES);
+}
+
+int main(int argc, char* argv[]) {
     int msqid;
     struct message_buf sbuf;
     size_t buf_length;
+    long count = 0;
+    long emergency_every = 0;
+    size_t payload_bytes = 0;
+    long arena_threshold = -1;
+    size_t batch_bytes = IPC_BATCH_MAX_BYTES;
+    long batch_delay_us = 1000;
+    int unbatched = 0;
+    enum ipc_transport_kind transport = IPC_DEFAULT_TRANSPORT;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+            if (ipc_parse_transport(argv[++i], &transport) < 0) {
+                fprintf(stderr, "Unknown transport: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--emergency-every") == 0 && i + 1 < argc) {
+            emergency_every = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--payload-bytes") == 0 && i + 1 < argc) {
+            payload_bytes = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--arena-threshold") == 0 && i + 1 < argc) {
+            arena_threshold = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--batch-bytes") == 0 && i + 1 < argc) {
+            batch_bytes = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--batch-delay-us") == 0 && i + 1 < argc) {
+            batch_delay_us = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--unbatched") == 0) {
+            unbatched = 1;
+        } else if (strcmp(argv[i], "--wire") == 0) {
+            wire_alerts = 1;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
 
     printf("--- Module 4: IPC Sender (Process 1) ---\n");
 
-    msqid = msgget(MSG_KEY, IPC_CREAT | 0666);
-    if (msqid < 0) {
-        perror("msgget failed");
-        exit(1);
+    if (unbatched) {
+        msqid = msgget(MSG_KEY, IPC_CREAT | 0666);
+        if (msqid < 0) {
+            perror("msgget failed");
+            exit(1);
+        }
+        printf("Message Queue ID (msqid) obtained: %d\n", msqid);
+
+        const char* texts[2] = {"System Alert: Disk space is getting low (Type 1).",
+                                "CRITICAL: System integrity compromised. Immediate attention required (Type 2)!"};
+        long total = count > 0 ? count + 1 : 2;
+        uint64_t start = ipc_now_ns();
+        for (long i = 0; i < total; ++i) {
+            sbuf.mtype = i + 1 < total ? NOTIFICATION_TYPE : EMERGENCY_TYPE;
+            strcpy(sbuf.mtext, texts[sbuf.mtype == EMERGENCY_TYPE]);
+            buf_length = strlen(sbuf.mtext) + 1;
+            if (msgsnd(msqid, &sbuf, buf_length, 0) < 0) {
+                perror("msgsnd failed");
+                exit(1);
+            }
+            if (count == 0) {
+                printf("Sent [Type %ld] message: '%s'\n", sbuf.mtype, sbuf.mtext);
+            }
+        }
+        if (count > 0) {
+            printf("Sent %ld alerts in %ld messages in %.3f ms\n", total, total, (ipc_now_ns() - start) / 1e6);
+        }
+        printf("Sender finished sending messages.\n");
+        return 0;
     }
-    printf("Message Queue ID (msqid) obtained: %d\n", msqid);
 
-    sbuf.mtype = NOTIFICATION_TYPE;
-    strcpy(sbuf.mtext, "System Alert: Disk space is getting low (Type 1).");
-    buf_length = strlen(sbuf.mtext) + 1;
-    if (msgsnd(msqid, &sbuf, buf_length, 0) < 0) {
-        perror("msgsnd failed for notification 1");
+    /* msgq: notifications may wait a little to share a message; emergencies go at once */
+    struct ipc_sender tx;
+    if (ipc_sender_open(&tx, transport, batch_bytes, (uint64_t)batch_delay_us * 1000) < 0) {
+        perror(transport == IPC_TRANSPORT_SHM ? "shm_open failed" : "msgget failed");
         exit(1);
     }
-    printf("Sent [Type %ld] message: '%s'\n", sbuf.mtype, sbuf.mtext);
+    if (transport == IPC_TRANSPORT_SHM) {
+        printf("Shared memory ring obtained: %s\n", tx.ring.name);
+    } else {
+        printf("Message Queue ID (msqid) obtained: %d\n", tx.msqid);
+    }
+    if (arena_threshold >= 0) {
+        tx.arena_threshold = (size_t)arena_threshold;
+    }
 
+    if (count == 0) {
+        const char* text = "System Alert: Disk space is getting low (Type 1).";
+        if (payload_bytes > strlen(text) + 1) {
+            char* payload = make_payload(text, payload_bytes);
+            send_bytes(&tx, NOTIFICATION_TYPE, payload, payload_bytes);
+            free(payload);
+            printf("Sent [Type %d] message: '%s' with %zu bytes of detail%s\n", NOTIFICATION_TYPE, text,
+                   payload_bytes, tx.arena_payloads ? " (through the shared arena)" : "");
+        } else {
+            send_record(&tx, NOTIFICATION_TYPE, text);
+            printf("Sent [Type %d] message: '%s'\n", NOTIFICATION_TYPE, text);
+        }
+        flush_batch(&tx);
 
-    sbuf.mtype = EMERGENCY_TYPE;
-    strcpy(sbuf.mtext, "CRITICAL: System integrity compromised. Immediate attention required (Type 2)!");
-    buf_length = strlen(sbuf.mtext) + 1;
-    if (msgsnd(msqid, &sbuf, buf_length, 0) < 0) {
-        perror("msgsnd failed for notification 2");
-        exit(1);
+        text = "CRITICAL: System integrity compromised. Immediate attention required (Type 2)!";
+        send_record(&tx, EMERGENCY_TYPE, text);
+        printf("Sent [Type %d] message: '%s'\n", EMERGENCY_TYPE, text);
+    } else {
+        char text[128];
+        char* payload = payload_bytes > sizeof(text) ? make_payload("", payload_bytes) : NULL;
+        uint64_t start = ipc_now_ns();
+        for (long i = 0; i < count; ++i) {
+            int length = snprintf(text, sizeof(text), "System Alert #%ld: Disk space is getting low (Type 1).", i + 1);
+            if (payload != NULL) {
+                memcpy(payload, text, (size_t)length); /* over the filler's first line */
+                send_bytes(&tx, NOTIFICATION_TYPE, payload, payload_bytes);
+            } else {
+                send_record(&tx, NOTIFICATION_TYPE, text);
+            }
+            if (emergency_every > 0 && (i + 1) % emergency_every == 0) {
+                snprintf(text, sizeof(text), "CRITICAL #%ld: System integrity check failed (Type 2)!",
+                         (i + 1) / emergency_every);
+                send_record(&tx, EMERGENCY_TYPE, text);
+            }
+        }
+        flush_batch(&tx);
+        send_record(&tx, EMERGENCY_TYPE, "CRITICAL: System integrity compromised. Immediate attention required (Type 2)!");
+        free(payload);
+        unsigned long records, messages, would_block;
+        ipc_sender_counts(&tx, &records, &messages, &would_block);
+        printf("Sent %lu alerts in %lu %s in %.3f ms (%lu full-transport retries)\n", records, messages,
+               transport == IPC_TRANSPORT_SHM ? "ring records" : "messages", (ipc_now_ns() - start) / 1e6,
+               would_block);
+        if (tx.arena_payloads > 0) {
+            printf("%lu payloads of %zu bytes went through the shared arena\n", tx.arena_payloads, payload_bytes);
+        }
     }
-    printf("Sent [Type %ld] message: '%s'\n", sbuf.mtype, sbuf.mtext);
+    ipc_sender_close(&tx);
 
     printf("Sender finished sending messages.\n");
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,50 @@
+#ifndef IPC_SERVICE_H
+#define IPC_SERVICE_H
+
+/*
+ * Request/reply on top of the alert transports, for the guardian's analysis
+ * service. Requests are WIRE_ANALYSIS_REQUEST records sent like any alert
+ * (ipc_send(), either transport, batched on msgq), so they reach the
+ * guardian's existing receiver. The transports only run towards one
+ * receiver, so replies come back through a second System V queue,
+ * SERVICE_REPLY_KEY. Each message on it is one reply, typed with the
+ * request's reply_to (the client's PID), so every client msgrcv()s only its
+ * own replies and matches them to requests by request_id.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include "ipc_common.h"
+#include "ipc_batch.h"
+
+#define SERVICE_REPLY_KEY (MSG_KEY + 1)
+
+/* Returns the reply queue's id, or -1 with errno */
+static inline int ipc_service_reply_queue(int create) {
+    return msgget(SERVICE_REPLY_KEY, create ? IPC_CREAT | 0666 : 0666);
+}
+
+/* Server side: never blocks, a full queue drops the reply (EAGAIN).
+ * Returns 0, or -1 with errno. */
+static inline int ipc_service_reply(int qid, long reply_to, const void* data, size_t length) {
+    struct ipc_batch_buf buf;
+    if (reply_to <= 0 || length > sizeof(buf.mtext)) {
+        errno = reply_to <= 0 ? EINVAL : EMSGSIZE;
+        return -1;
+    }
+    buf.mtype = reply_to;
+    memcpy(buf.mtext, data, length);
+    return msgsnd(qid, &buf, length, IPC_NOWAIT);
+}
+
+/* Client side: take the next reply for reply_to into buf, blocking unless
+ * nonblocking is set. Returns its length, or -1 with errno (ENOMSG: none
+ * waiting, EINTR: interrupted). */
+static inline long ipc_service_next_reply(int qid, long reply_to, struct ipc_batch_buf* buf, int nonblocking) {
+    ssize_t size = msgrcv(qid, buf, sizeof(buf->mtext), reply_to, nonblocking ? IPC_NOWAIT : 0);
+    return (long)size;
+}
+
+#endif
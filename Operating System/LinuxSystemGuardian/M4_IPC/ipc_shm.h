@@ -0,0 +1,68 @@
+#ifndef IPC_SHM_H
+#define IPC_SHM_H
+
+/*
+ * POSIX shared memory segments shared by the M4 transports. The creator
+ * sizes the segment and publishes a magic word last; openers map it and
+ * wait briefly for that word.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Map segment name of size bytes, creating it if create is set (*created
+ * tells which happened). Returns the mapping, or NULL with errno. */
+static inline void* ipc_shm_map(const char* name, size_t size, int create, int* created) {
+    *created = 0;
+    int fd = -1;
+    if (create) {
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0) {
+            *created = 1;
+            if (ftruncate(fd, (off_t)size) < 0) {
+                int error = errno;
+                close(fd);
+                shm_unlink(name);
+                errno = error;
+                return NULL;
+            }
+        } else if (errno != EEXIST) {
+            return NULL;
+        }
+    }
+    if (fd < 0) {
+        fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0) {
+            return NULL;
+        }
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < size) {
+        /* The creator has not sized it yet, or it is from another build */
+        close(fd);
+        errno = EAGAIN;
+        return NULL;
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return map == MAP_FAILED ? NULL : map;
+}
+
+/* Give a concurrent creator a moment to publish its header. Returns 0, or
+ * -1 with errno EPROTO. */
+static inline int ipc_shm_wait_ready(const uint32_t* magic, uint32_t expected) {
+    for (int attempt = 0; __atomic_load_n(magic, __ATOMIC_ACQUIRE) != expected; ++attempt) {
+        if (attempt == 1000) {
+            errno = EPROTO;
+            return -1;
+        }
+        usleep(1000);
+    }
+    return 0;
+}
+
+#endif
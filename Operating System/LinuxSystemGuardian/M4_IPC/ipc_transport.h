@@ -0,0 +1,300 @@
+#ifndef IPC_TRANSPORT_H
+#define IPC_TRANSPORT_H
+
+/*
+ * One sender/receiver API over the two alert transports:
+ *   msgq  System V message queue (MSG_KEY), records batched per message
+ *   shm   shared-memory rings, no system call per record
+ * Both deliver emergencies ahead of everything else. Payloads too large to
+ * travel inline (or above the sender's arena_threshold) are written to the
+ * shared-memory arena, and only their descriptor is sent; ipc_receive()
+ * hands the callback the payload in place and frees it when the callback
+ * returns. The default transport
+ * is chosen at build time with -DIPC_DEFAULT_TRANSPORT=IPC_TRANSPORT_SHM and
+ * can be overridden at run time with --transport.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include "ipc_common.h"
+#include "ipc_batch.h"
+#include "ipc_ring.h"
+#include "ipc_arena.h"
+
+enum ipc_transport_kind { IPC_TRANSPORT_MSGQ, IPC_TRANSPORT_SHM };
+
+#ifndef IPC_DEFAULT_TRANSPORT
+#define IPC_DEFAULT_TRANSPORT IPC_TRANSPORT_MSGQ
+#endif
+
+static inline const char* ipc_transport_name(enum ipc_transport_kind kind) {
+    return kind == IPC_TRANSPORT_SHM ? "shm" : "msgq";
+}
+
+static inline int ipc_parse_transport(const char* name, enum ipc_transport_kind* kind) {
+    if (strcmp(name, "msgq") == 0) {
+        *kind = IPC_TRANSPORT_MSGQ;
+    } else if (strcmp(name, "shm") == 0) {
+        *kind = IPC_TRANSPORT_SHM;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* --- Sender --- */
+
+struct ipc_sender {
+    enum ipc_transport_kind kind;
+    int msqid;
+    struct ipc_batcher notifications; /* msgq: notifications may wait to share a message */
+    struct ipc_batcher emergencies;   /* msgq: sent at once */
+    struct ipc_ring ring;
+    struct ipc_arena arena;      /* mapped on the first large payload */
+    size_t arena_threshold;      /* payloads above this go through the arena */
+    unsigned long records_sent;  /* shm */
+    unsigned long would_block;   /* shm */
+    unsigned long arena_payloads;
+};
+
+/* Largest record the transport carries inline */
+static inline size_t ipc_sender_inline_limit(const struct ipc_sender* tx) {
+    if (tx->kind == IPC_TRANSPORT_SHM) {
+        return IPC_RING_BYTES / 4 - sizeof(struct ipc_ring_record);
+    }
+    return tx->notifications.max_bytes - sizeof(struct ipc_batch_header) - sizeof(uint16_t);
+}
+
+/* Returns 0, or -1 with errno */
+static inline int ipc_sender_open(struct ipc_sender* tx, enum ipc_transport_kind kind, size_t batch_bytes,
+                                  uint64_t batch_delay_ns) {
+    memset(tx, 0, sizeof(*tx));
+    tx->kind = kind;
+    tx->msqid = -1;
+    if (kind == IPC_TRANSPORT_SHM) {
+        if (ipc_ring_open(&tx->ring, 1) < 0) {
+            return -1;
+        }
+    } else {
+        tx->msqid = msgget(MSG_KEY, IPC_CREAT | 0666);
+        if (tx->msqid < 0) {
+            return -1;
+        }
+        ipc_batcher_init(&tx->notifications, tx->msqid, NOTIFICATION_TYPE, batch_bytes, batch_delay_ns);
+        ipc_batcher_init(&tx->emergencies, tx->msqid, EMERGENCY_TYPE, batch_bytes, 0);
+    }
+    tx->arena_threshold = ipc_sender_inline_limit(tx);
+    return 0;
+}
+
+static inline int ipc_send_inline(struct ipc_sender* tx, long mtype, const void* data, size_t length) {
+    if (tx->kind == IPC_TRANSPORT_SHM) {
+        if (ipc_ring_send(&tx->ring, mtype, data, length, ipc_now_ns()) < 0) {
+            if (errno == EAGAIN) {
+                tx->would_block++;
+            }
+            return -1;
+        }
+        tx->records_sent++;
+        return 0;
+    }
+    /* An emergency left pending by a full queue is retried on every send */
+    if (ipc_batch_poll(&tx->emergencies) < 0 && errno != EAGAIN) {
+        return -1;
+    }
+    return ipc_batch_add(mtype == EMERGENCY_TYPE ? &tx->emergencies : &tx->notifications, data, length);
+}
+
+/* Push out anything still batched. Returns 0, or -1 with errno. */
+static inline int ipc_sender_flush(struct ipc_sender* tx) {
+    if (tx->kind == IPC_TRANSPORT_SHM) {
+        return 0;
+    }
+    if (ipc_batch_flush(&tx->emergencies) < 0) {
+        return -1;
+    }
+    return ipc_batch_flush(&tx->notifications);
+}
+
+/* Queue one record. Returns 0, or -1 with errno (EAGAIN: transport or arena
+ * full, the record was not taken). */
+static inline int ipc_send(struct ipc_sender* tx, long mtype, const void* data, size_t length) {
+    if (length <= tx->arena_threshold || length <= sizeof(struct ipc_descriptor)) {
+        return ipc_send_inline(tx, mtype, data, length);
+    }
+    if (tx->arena.shared == NULL && ipc_arena_open(&tx->arena, 1) < 0) {
+        return -1;
+    }
+    struct ipc_descriptor descriptor;
+    if (ipc_arena_put(&tx->arena, data, length, &descriptor) < 0) {
+        if (errno == EAGAIN) {
+            /* Descriptors still batched here hold slots the receiver
+             * cannot free until it sees them */
+            tx->would_block++;
+            ipc_sender_flush(tx);
+            errno = EAGAIN;
+        }
+        return -1;
+    }
+    if (ipc_send_inline(tx, mtype, &descriptor, sizeof(descriptor)) < 0) {
+        int error = errno;
+        ipc_arena_discard(&tx->arena, &descriptor);
+        errno = error;
+        return -1;
+    }
+    tx->arena_payloads++;
+    return 0;
+}
+
+/* Records handed to the transport, transport messages used, full-transport refusals */
+static inline void ipc_sender_counts(const struct ipc_sender* tx, unsigned long* records, unsigned long* messages,
+                                     unsigned long* would_block) {
+    if (tx->kind == IPC_TRANSPORT_SHM) {
+        *records = *messages = tx->records_sent;
+        *would_block = tx->would_block;
+        return;
+    }
+    *records = tx->notifications.records_sent + tx->emergencies.records_sent;
+    *messages = tx->notifications.batches_sent + tx->emergencies.batches_sent;
+    *would_block = tx->notifications.would_block + tx->emergencies.would_block;
+}
+
+static inline void ipc_sender_close(struct ipc_sender* tx) {
+    if (tx->kind == IPC_TRANSPORT_SHM) {
+        ipc_ring_close(&tx->ring);
+    }
+    ipc_arena_close(&tx->arena);
+}
+
+/* --- Receiver --- */
+
+struct ipc_receiver {
+    enum ipc_transport_kind kind;
+    int msqid;
+    struct ipc_ring ring;
+    struct ipc_arena arena;   /* mapped on the first descriptor */
+    int raw_descriptors;      /* deliver descriptors as they are; the caller resolves them */
+    unsigned long stale_descriptors;
+    struct ipc_batch_buf buf;
+};
+
+/* Attach to the transport; without create, a sender must have made it
+ * already. Returns 0, or -1 with errno. */
+static inline int ipc_receiver_open(struct ipc_receiver* rx, enum ipc_transport_kind kind, int create) {
+    memset(rx, 0, sizeof(*rx) - sizeof(rx->buf)); /* buf is last and needs no clearing */
+    rx->kind = kind;
+    rx->msqid = -1;
+    if (kind == IPC_TRANSPORT_SHM) {
+        return ipc_ring_open(&rx->ring, create);
+    }
+    rx->msqid = msgget(MSG_KEY, create ? IPC_CREAT | 0666 : 0666);
+    return rx->msqid < 0 ? -1 : 0;
+}
+
+/* The arena, mapped if need be; NULL with errno if there is none yet */
+static inline struct ipc_arena* ipc_receiver_arena(struct ipc_receiver* rx) {
+    if (rx->arena.shared == NULL && ipc_arena_open(&rx->arena, 0) < 0) {
+        return NULL;
+    }
+    return &rx->arena;
+}
+
+struct ipc_resolve_context {
+    struct ipc_receiver* rx;
+    ipc_record_fn fn;
+    void* context;
+};
+
+/* Swap a descriptor for its payload around the caller's callback */
+static inline void ipc_resolve_record(void* arg, long mtype, const char* data, size_t length, uint64_t sent_ns) {
+    struct ipc_resolve_context* resolve = (struct ipc_resolve_context*)arg;
+    if (!ipc_is_descriptor(data, length)) {
+        resolve->fn(resolve->context, mtype, data, length, sent_ns);
+        return;
+    }
+    struct ipc_descriptor descriptor;
+    memcpy(&descriptor, data, sizeof(descriptor));
+    struct ipc_arena* arena = ipc_receiver_arena(resolve->rx);
+    const char* payload = arena != NULL ? ipc_arena_get(arena, &descriptor) : NULL;
+    if (payload == NULL) {
+        resolve->rx->stale_descriptors++;
+        return;
+    }
+    resolve->fn(resolve->context, mtype, payload, (size_t)descriptor.length, sent_ns);
+    ipc_arena_release(arena, &descriptor);
+}
+
+/*
+ * Deliver what is available, emergencies first, blocking for the first
+ * record if block is set. max_batch caps the queue messages (msgq) or
+ * records (shm) taken per call; 0 takes everything. A signal ends the
+ * wait early. Returns the records delivered, or -1 on error.
+ */
+static inline long ipc_receive(struct ipc_receiver* rx, int block, unsigned long max_batch, ipc_record_fn fn,
+                               void* context, struct ipc_drain_stats* stats) {
+    struct ipc_resolve_context resolve = {rx, fn, context};
+    if (!rx->raw_descriptors) {
+        fn = ipc_resolve_record;
+        context = &resolve;
+    }
+    if (rx->kind == IPC_TRANSPORT_MSGQ) {
+        return ipc_drain(rx->msqid, &rx->buf, block, max_batch, fn, context, stats);
+    }
+    long delivered = ipc_ring_drain(&rx->ring, block, max_batch, fn, context);
+    if (delivered >= 0 && stats != NULL) {
+        stats->messages += delivered;
+        stats->records += delivered;
+        stats->wakeups++;
+    }
+    return delivered;
+}
+
+/* Deliver only the emergencies already waiting, without blocking. Lets a
+ * receiver that is backed up on notifications keep emergencies moving.
+ * Returns the records delivered, or -1 on error. */
+static inline long ipc_receive_urgent(struct ipc_receiver* rx, ipc_record_fn fn, void* context,
+                                      struct ipc_drain_stats* stats) {
+    long delivered = 0;
+    unsigned long messages = 0;
+    struct ipc_resolve_context resolve = {rx, fn, context};
+    if (!rx->raw_descriptors) {
+        fn = ipc_resolve_record;
+        context = &resolve;
+    }
+    if (rx->kind == IPC_TRANSPORT_SHM) {
+        delivered = (long)ipc_ring_drain_lane(&rx->ring, 0, 0, fn, context);
+        messages = (unsigned long)delivered;
+    } else {
+        for (;;) {
+            ssize_t size = msgrcv(rx->msqid, &rx->buf, sizeof(rx->buf.mtext), EMERGENCY_TYPE, IPC_NOWAIT);
+            if (size < 0) {
+                if (errno == ENOMSG || errno == EINTR) {
+                    break;
+                }
+                return -1;
+            }
+            messages++;
+            int records = ipc_unpack(&rx->buf, (size_t)size, fn, context);
+            if (records > 0) {
+                delivered += records;
+            }
+        }
+    }
+    if (stats != NULL && messages > 0) {
+        stats->messages += messages;
+        stats->records += delivered;
+        stats->wakeups++;
+    }
+    return delivered;
+}
+
+static inline void ipc_receiver_close(struct ipc_receiver* rx) {
+    if (rx->kind == IPC_TRANSPORT_SHM) {
+        ipc_ring_close(&rx->ring);
+    }
+    ipc_arena_close(&rx->arena);
+}
+
+#endif
@@ -0,0 +1,468 @@
+#ifndef IPC_WIRE_H
+#define IPC_WIRE_H
+
+/*
+ * Binary record format shared by every module (C and C++).
+ *
+ * A record is a fixed 24-byte header followed by a typed body of
+ * header.length bytes. Bodies start with a fixed-layout struct; variable
+ * parts (text, names, term lists) follow it, each sized by a length field in
+ * the fixed part. All integers are little-endian and fields are naturally
+ * aligned within their struct, so a record can be copied into the struct
+ * with memcpy and read without any text parsing. Records can be sent as
+ * alert payloads or concatenated in a file.
+ *
+ * Version rules: fields are only ever appended to a body's fixed part, and
+ * the header records how long the fixed part is. Decoders accept a fixed
+ * part longer than they know and skip what they do not understand, so new
+ * fields do not break old readers. A change that would gets a new
+ * WIRE_VERSION.
+ *
+ * Writing: wire_writer_begin(), wire_put_fixed() for the fixed part,
+ * wire_put() for each variable part, then wire_writer_finish(); the
+ * wire_encode_*() helpers wrap that for each type. Reading:
+ * wire_decode_header() frames a record (and tells a short buffer from a bad
+ * one), and wire_decode_*() splits its body.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "ipc_wire.h stores host-order integers and needs a little-endian target"
+#endif
+
+#ifdef __cplusplus
+#define WIRE_STATIC_ASSERT(condition, message) static_assert(condition, message)
+#else
+#define WIRE_STATIC_ASSERT(condition, message) _Static_assert(condition, message)
+#endif
+
+#define WIRE_MAGIC 0x4E445247u /* "GRDN" */
+#define WIRE_VERSION 1
+
+enum wire_type {
+    WIRE_ALERT = 1,
+    WIRE_ANALYSIS = 2,         /* M3 AnalysisResults */
+    WIRE_CHILD_EXIT = 3,       /* M2 child exit and resource usage */
+    WIRE_SNAPSHOT = 4,         /* M1 system snapshot */
+    WIRE_ANALYSIS_REQUEST = 5, /* to the guardian's analysis service */
+    WIRE_ANALYSIS_REPLY = 6    /* its answer, followed by a WIRE_ANALYSIS record */
+};
+
+enum wire_source {
+    WIRE_SOURCE_SNAPSHOT = 1,
+    WIRE_SOURCE_PROCESS = 2,
+    WIRE_SOURCE_ANALYZER = 3,
+    WIRE_SOURCE_IPC = 4
+};
+
+struct wire_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;         /* enum wire_type */
+    uint64_t timestamp_ns; /* CLOCK_REALTIME when the record was written */
+    uint32_t length;       /* body bytes after the header */
+    uint32_t fixed_length; /* bytes of the body's fixed part */
+};
+WIRE_STATIC_ASSERT(sizeof(struct wire_header) == 24, "wire_header layout");
+
+/* --- Bodies --- */
+
+/* Followed by text_length bytes of text, no terminator */
+struct wire_alert {
+    uint32_t severity; /* NOTIFICATION_TYPE or EMERGENCY_TYPE */
+    uint16_t source;   /* enum wire_source */
+    uint16_t text_length;
+};
+WIRE_STATIC_ASSERT(sizeof(struct wire_alert) == 8, "wire_alert layout");
+
+/* Followed by term_count uint64 occurrence counts, path_length bytes of the
+ * input path, then term_count terms, each a uint16 length and its bytes */
+struct wire_analysis {
+    uint64_t total_chars;
+    uint64_t total_lines;
+    uint64_t total_words;
+    uint64_t input_bytes;
+    uint64_t elapsed_ns;
+    uint32_t threads;
+    uint32_t term_count;
+    uint32_t files;
+    uint32_t failed_files;
+    uint16_t path_length;
+    uint16_t reserved[3];
+};
+WIRE_STATIC_ASSERT(sizeof(struct wire_analysis) == 64, "wire_analysis layout");
+
+enum wire_outcome { WIRE_EXITED = 1, WIRE_SIGNALED = 2, WIRE_TIMED_OUT = 3, WIRE_SPAWN_FAILED = 4 };
+
+/* Followed by name_length bytes of the job name */
+struct wire_child_exit {
+    int32_t pid;
+    int32_t job_id;
+    int32_t wait_status;  /* raw, as from waitpid() */
+    uint16_t outcome;     /* enum wire_outcome */
+    uint16_t name_length;
+    uint64_t wall_ns;
+    uint64_t user_us;
+    uint64_t system_us;
+    uint64_t max_rss_kb;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    int64_t cgroup_memory_peak; /* bytes, -1 without a cgroup */
+    int64_t cgroup_throttled_us; /* -1 without a cgroup */
+};
+WIRE_STATIC_ASSERT(sizeof(struct wire_child_exit) == 80, "wire_child_exit layout");
+
+/* Fixed size; load averages are in thousandths */
+struct wire_snapshot {
+    uint64_t uptime_ms;
+    uint32_t load_milli[3];
+    uint32_t process_count;
+    uint64_t mem_total_kb;
+    uint64_t mem_used_kb;
+    uint64_t mem_free_kb;
+    uint64_t mem_available_kb;
+    uint64_t disk_total_bytes;
+    uint64_t disk_used_bytes;
+    uint64_t disk_available_bytes;
+};
+WIRE_STATIC_ASSERT(sizeof(struct wire_snapshot) == 80, "wire_snapshot layout");
+
+#define WIRE_REQUEST_NO_CACHE 1u /* analyze even if a cached result matches */
+#define WIRE_REPLY_CACHED 1u     /* the result came from the cache */
+
+/* Followed by path_length bytes of the path, then term_count terms in the
+ * wire_analysis layout (none: the analyzer's default term) */
+struct wire_analysis_request {
+    uint64_t request_id;  /* chosen by the client, echoed in the reply */
+    int32_t reply_to;     /* reply queue message type: the client's PID */
+    uint32_t flags;       /* WIRE_REQUEST_* */
+    uint32_t term_count;
+    uint16_t path_length;
+    uint16_t reserved;
+};
+WIRE_STATIC_ASSERT(sizeof(struct wire_analysis_request) == 24, "wire_analysis_request layout");
+
+/* No variable part. When error is 0, the same message carries the
+ * WIRE_ANALYSIS record right after this one. */
+struct wire_analysis_reply {
+    uint64_t request_id;
+    int32_t error;  /* errno value, 0 on success */
+    uint32_t flags; /* WIRE_REPLY_* */
+};
+WIRE_STATIC_ASSERT(sizeof(struct wire_analysis_reply) == 16, "wire_analysis_reply layout");
+
+static inline const char* wire_type_name(uint16_t type) {
+    switch (type) {
+        case WIRE_ALERT: return "alert";
+        case WIRE_ANALYSIS: return "analysis";
+        case WIRE_CHILD_EXIT: return "child_exit";
+        case WIRE_SNAPSHOT: return "snapshot";
+        case WIRE_ANALYSIS_REQUEST: return "analysis_request";
+        case WIRE_ANALYSIS_REPLY: return "analysis_reply";
+    }
+    return "unknown";
+}
+
+static inline uint64_t wire_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* --- Writing --- */
+
+struct wire_writer {
+    char* out;
+    size_t capacity;
+    size_t used;
+    int overflow; /* set once a put did not fit */
+    uint16_t type;
+    uint32_t fixed_length;
+};
+
+static inline void wire_put(struct wire_writer* w, const void* data, size_t length) {
+    if (w->overflow || length > w->capacity - w->used) {
+        w->overflow = 1;
+        return;
+    }
+    memcpy(w->out + w->used, data, length);
+    w->used += length;
+}
+
+static inline void wire_put_fixed(struct wire_writer* w, const void* fixed, size_t length) {
+    w->fixed_length = (uint32_t)length;
+    wire_put(w, fixed, length);
+}
+
+static inline void wire_writer_begin(struct wire_writer* w, void* out, size_t capacity, uint16_t type) {
+    w->out = (char*)out;
+    w->capacity = capacity;
+    w->used = 0;
+    w->overflow = capacity < sizeof(struct wire_header);
+    w->type = type;
+    w->fixed_length = 0;
+    if (!w->overflow) {
+        w->used = sizeof(struct wire_header);
+    }
+}
+
+/* Fill in the header. Returns the record's size, or 0 if it did not fit. */
+static inline size_t wire_writer_finish(struct wire_writer* w) {
+    size_t body = w->used - sizeof(struct wire_header);
+    if (w->overflow || body > UINT32_MAX) {
+        return 0;
+    }
+    struct wire_header header;
+    header.magic = WIRE_MAGIC;
+    header.version = WIRE_VERSION;
+    header.type = w->type;
+    header.timestamp_ns = wire_now_ns();
+    header.length = (uint32_t)body;
+    header.fixed_length = w->fixed_length;
+    memcpy(w->out, &header, sizeof(header));
+    return w->used;
+}
+
+static inline size_t wire_alert_size(size_t text_length) {
+    return sizeof(struct wire_header) + sizeof(struct wire_alert) + text_length;
+}
+
+static inline size_t wire_encode_alert(void* out, size_t capacity, uint32_t severity, uint16_t source,
+                                       const char* text, size_t text_length) {
+    if (text_length > UINT16_MAX) {
+        return 0;
+    }
+    struct wire_writer w;
+    struct wire_alert alert;
+    alert.severity = severity;
+    alert.source = source;
+    alert.text_length = (uint16_t)text_length;
+    wire_writer_begin(&w, out, capacity, WIRE_ALERT);
+    wire_put_fixed(&w, &alert, sizeof(alert));
+    wire_put(&w, text, text_length);
+    return wire_writer_finish(&w);
+}
+
+/* counts and terms have fixed->term_count entries; term_lengths may be NULL
+ * for NUL-terminated terms. path_length is taken from fixed. */
+static inline size_t wire_encode_analysis(void* out, size_t capacity, const struct wire_analysis* fixed,
+                                          const uint64_t* counts, const char* path, const char* const* terms,
+                                          const size_t* term_lengths) {
+    struct wire_writer w;
+    wire_writer_begin(&w, out, capacity, WIRE_ANALYSIS);
+    wire_put_fixed(&w, fixed, sizeof(*fixed));
+    wire_put(&w, counts, (size_t)fixed->term_count * sizeof(uint64_t));
+    wire_put(&w, path, fixed->path_length);
+    for (uint32_t i = 0; i < fixed->term_count; ++i) {
+        size_t length = term_lengths != NULL ? term_lengths[i] : strlen(terms[i]);
+        if (length > UINT16_MAX) {
+            return 0;
+        }
+        uint16_t stored = (uint16_t)length;
+        wire_put(&w, &stored, sizeof(stored));
+        wire_put(&w, terms[i], length);
+    }
+    return wire_writer_finish(&w);
+}
+
+static inline size_t wire_encode_child_exit(void* out, size_t capacity, const struct wire_child_exit* fixed,
+                                            const char* name) {
+    struct wire_writer w;
+    wire_writer_begin(&w, out, capacity, WIRE_CHILD_EXIT);
+    wire_put_fixed(&w, fixed, sizeof(*fixed));
+    wire_put(&w, name, fixed->name_length);
+    return wire_writer_finish(&w);
+}
+
+static inline size_t wire_encode_snapshot(void* out, size_t capacity, const struct wire_snapshot* snapshot) {
+    struct wire_writer w;
+    wire_writer_begin(&w, out, capacity, WIRE_SNAPSHOT);
+    wire_put_fixed(&w, snapshot, sizeof(*snapshot));
+    return wire_writer_finish(&w);
+}
+
+/* Terms as in wire_encode_analysis(); path_length is taken from fixed */
+static inline size_t wire_encode_analysis_request(void* out, size_t capacity,
+                                                  const struct wire_analysis_request* fixed, const char* path,
+                                                  const char* const* terms, const size_t* term_lengths) {
+    struct wire_writer w;
+    wire_writer_begin(&w, out, capacity, WIRE_ANALYSIS_REQUEST);
+    wire_put_fixed(&w, fixed, sizeof(*fixed));
+    wire_put(&w, path, fixed->path_length);
+    for (uint32_t i = 0; i < fixed->term_count; ++i) {
+        size_t length = term_lengths != NULL ? term_lengths[i] : strlen(terms[i]);
+        if (length > UINT16_MAX) {
+            return 0;
+        }
+        uint16_t stored = (uint16_t)length;
+        wire_put(&w, &stored, sizeof(stored));
+        wire_put(&w, terms[i], length);
+    }
+    return wire_writer_finish(&w);
+}
+
+static inline size_t wire_encode_analysis_reply(void* out, size_t capacity, const struct wire_analysis_reply* reply) {
+    struct wire_writer w;
+    wire_writer_begin(&w, out, capacity, WIRE_ANALYSIS_REPLY);
+    wire_put_fixed(&w, reply, sizeof(*reply));
+    return wire_writer_finish(&w);
+}
+
+/* --- Reading --- */
+
+/* Frame the record at data. Returns its total size, 0 if more bytes are
+ * needed, or -1 if this is not a record this version can read. */
+static inline long wire_decode_header(const void* data, size_t length, struct wire_header* header) {
+    if (length < sizeof(*header)) {
+        return 0;
+    }
+    memcpy(header, data, sizeof(*header));
+    if (header->magic != WIRE_MAGIC || header->version != WIRE_VERSION || header->fixed_length > header->length) {
+        return -1;
+    }
+    if (length - sizeof(*header) < header->length) {
+        return 0;
+    }
+    return (long)(sizeof(*header) + header->length);
+}
+
+/* True if data holds a whole record (alert payloads may be text or records) */
+static inline int wire_is_record(const void* data, size_t length) {
+    struct wire_header header;
+    return wire_decode_header(data, length, &header) > 0;
+}
+
+static inline const char* wire_body(const void* record) {
+    return (const char*)record + sizeof(struct wire_header);
+}
+
+/* Copy a body's fixed part if it holds at least fixed_size bytes. Returns
+ * the offset of the variable part, or 0 if the fixed part is too short. */
+static inline size_t wire_fixed(const struct wire_header* header, const char* body, void* fixed, size_t fixed_size) {
+    if (header->fixed_length < fixed_size) {
+        return 0;
+    }
+    memcpy(fixed, body, fixed_size);
+    return header->fixed_length;
+}
+
+/* The decoders take a header from wire_decode_header() and the body after
+ * it; pointers they return point into the body. Each returns 0, or -1 if
+ * the record is not of that type or its body is inconsistent. */
+
+static inline int wire_decode_alert(const struct wire_header* header, const char* body, struct wire_alert* alert,
+                                    const char** text) {
+    size_t at = header->type == WIRE_ALERT ? wire_fixed(header, body, alert, sizeof(*alert)) : 0;
+    if (at == 0 || alert->text_length > header->length - at) {
+        return -1;
+    }
+    *text = body + at;
+    return 0;
+}
+
+struct wire_analysis_view {
+    struct wire_analysis fixed;
+    const char* counts; /* term_count uint64s, possibly unaligned: use wire_analysis_count() */
+    const char* path;
+    const char* terms;  /* walk with wire_next_term() */
+    const char* end;
+};
+
+static inline int wire_decode_analysis(const struct wire_header* header, const char* body,
+                                       struct wire_analysis_view* view) {
+    size_t at = header->type == WIRE_ANALYSIS ? wire_fixed(header, body, &view->fixed, sizeof(view->fixed)) : 0;
+    if (at == 0) {
+        return -1;
+    }
+    size_t left = header->length - at;
+    size_t counts = (size_t)view->fixed.term_count * sizeof(uint64_t);
+    if (counts > left || view->fixed.path_length > left - counts) {
+        return -1;
+    }
+    view->counts = body + at;
+    view->path = view->counts + counts;
+    view->terms = view->path + view->fixed.path_length;
+    view->end = body + header->length;
+    return 0;
+}
+
+static inline uint64_t wire_analysis_count(const struct wire_analysis_view* view, uint32_t index) {
+    uint64_t count;
+    memcpy(&count, view->counts + (size_t)index * sizeof(count), sizeof(count));
+    return count;
+}
+
+/* Step *cursor (start at view->terms) over one term. Returns 0, or -1 at the
+ * end or on a truncated list. */
+static inline int wire_next_term(const char** cursor, const char* end, const char** term, size_t* term_length) {
+    uint16_t length;
+    if ((size_t)(end - *cursor) < sizeof(length)) {
+        return -1;
+    }
+    memcpy(&length, *cursor, sizeof(length));
+    if ((size_t)(end - *cursor) - sizeof(length) < length) {
+        return -1;
+    }
+    *term = *cursor + sizeof(length);
+    *term_length = length;
+    *cursor = *term + length;
+    return 0;
+}
+
+static inline int wire_decode_child_exit(const struct wire_header* header, const char* body,
+                                         struct wire_child_exit* fixed, const char** name) {
+    size_t at = header->type == WIRE_CHILD_EXIT ? wire_fixed(header, body, fixed, sizeof(*fixed)) : 0;
+    if (at == 0 || fixed->name_length > header->length - at) {
+        return -1;
+    }
+    *name = body + at;
+    return 0;
+}
+
+struct wire_request_view {
+    struct wire_analysis_request fixed;
+    const char* path;
+    const char* terms; /* walk with wire_next_term() */
+    const char* end;
+};
+
+static inline int wire_decode_analysis_request(const struct wire_header* header, const char* body,
+                                               struct wire_request_view* view) {
+    size_t at =
+        header->type == WIRE_ANALYSIS_REQUEST ? wire_fixed(header, body, &view->fixed, sizeof(view->fixed)) : 0;
+    if (at == 0 || view->fixed.path_length > header->length - at) {
+        return -1;
+    }
+    view->path = body + at;
+    view->terms = view->path + view->fixed.path_length;
+    view->end = body + header->length;
+    return 0;
+}
+
+static inline int wire_decode_analysis_reply(const struct wire_header* header, const char* body,
+                                             struct wire_analysis_reply* reply) {
+    return header->type == WIRE_ANALYSIS_REPLY && wire_fixed(header, body, reply, sizeof(*reply)) != 0 ? 0 : -1;
+}
+
+/* For alert payloads: if data is a WIRE_ALERT record, point *text at its
+ * text and return 1; otherwise return 0 */
+static inline int wire_alert_text(const void* data, size_t length, const char** text, size_t* text_length) {
+    struct wire_header header;
+    struct wire_alert alert;
+    if (wire_decode_header(data, length, &header) <= 0 || wire_decode_alert(&header, wire_body(data), &alert, text) < 0) {
+        return 0;
+    }
+    *text_length = alert.text_length;
+    return 1;
+}
+
+static inline int wire_decode_snapshot(const struct wire_header* header, const char* body,
+                                       struct wire_snapshot* snapshot) {
+    return header->type == WIRE_SNAPSHOT && wire_fixed(header, body, snapshot, sizeof(*snapshot)) != 0 ? 0 : -1;
+}
+
+#endif
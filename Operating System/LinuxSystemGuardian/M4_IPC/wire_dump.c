@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "ipc_wire.h"
+
+/*
+ * Print the binary records (ipc_wire.h) in one or more files, as written by
+ * the analyzer's --results-out and the process manager's --exit-records.
+ * Reads standard input with "-" or no arguments.
+ */
+
+static void print_alert(const struct wire_header* header, const char* body) {
+    struct wire_alert alert;
+    const char* text;
+    if (wire_decode_alert(header, body, &alert, &text) < 0) {
+        printf("  (malformed)\n");
+        return;
+    }
+    printf("  severity %u source %u: %.*s\n", alert.severity, alert.source, (int)alert.text_length, text);
+}
+
+static void print_analysis(const struct wire_header* header, const char* body) {
+    struct wire_analysis_view view;
+    if (wire_decode_analysis(header, body, &view) < 0) {
+        printf("  (malformed)\n");
+        return;
+    }
+    const struct wire_analysis* a = &view.fixed;
+    printf("  input '%.*s': %u files (%u failed), %u threads, %llu bytes in %.3f ms\n", (int)a->path_length,
+           view.path, a->files, a->failed_files, a->threads, (unsigned long long)a->input_bytes, a->elapsed_ns / 1e6);
+    printf("  %llu chars, %llu lines, %llu words\n", (unsigned long long)a->total_chars,
+           (unsigned long long)a->total_lines, (unsigned long long)a->total_words);
+    const char* cursor = view.terms;
+    for (uint32_t i = 0; i < a->term_count; ++i) {
+        const char* term;
+        size_t length;
+        if (wire_next_term(&cursor, view.end, &term, &length) < 0) {
+            printf("  (term list truncated)\n");
+            break;
+        }
+        printf("  term '%.*s': %llu\n", (int)length, term, (unsigned long long)wire_analysis_count(&view, i));
+    }
+}
+
+static const char* outcome_name(uint16_t outcome) {
+    switch (outcome) {
+        case WIRE_EXITED: return "exited";
+        case WIRE_SIGNALED: return "signaled";
+        case WIRE_TIMED_OUT: return "timed out";
+        case WIRE_SPAWN_FAILED: return "spawn failed";
+    }
+    return "unknown";
+}
+
+static void print_child_exit(const struct wire_header* header, const char* body) {
+    struct wire_child_exit c;
+    const char* name;
+    if (wire_decode_child_exit(header, body, &c, &name) < 0) {
+        printf("  (malformed)\n");
+        return;
+    }
+    printf("  job %d '%.*s' pid %d %s (status 0x%x) after %.3f ms\n", c.job_id, (int)c.name_length, name, c.pid,
+           outcome_name(c.outcome), (unsigned)c.wait_status, c.wall_ns / 1e6);
+    printf("  user %.3f ms, system %.3f ms, max RSS %llu KB, %llu/%llu context switches\n", c.user_us / 1e3,
+           c.system_us / 1e3, (unsigned long long)c.max_rss_kb, (unsigned long long)c.voluntary_switches,
+           (unsigned long long)c.involuntary_switches);
+    if (c.cgroup_memory_peak >= 0) {
+        printf("  cgroup memory peak %lld bytes, throttled %lld us\n", (long long)c.cgroup_memory_peak,
+               (long long)c.cgroup_throttled_us);
+    }
+}
+
+static void print_analysis_request(const struct wire_header* header, const char* body) {
+    struct wire_request_view view;
+    if (wire_decode_analysis_request(header, body, &view) < 0) {
+        printf("  (malformed)\n");
+        return;
+    }
+    const struct wire_analysis_request* r = &view.fixed;
+    printf("  request %llu from pid %d for '%.*s'%s\n", (unsigned long long)r->request_id, r->reply_to,
+           (int)r->path_length, view.path, (r->flags & WIRE_REQUEST_NO_CACHE) ? ", uncached" : "");
+    const char* cursor = view.terms;
+    for (uint32_t i = 0; i < r->term_count; ++i) {
+        const char* term;
+        size_t length;
+        if (wire_next_term(&cursor, view.end, &term, &length) < 0) {
+            printf("  (term list truncated)\n");
+            break;
+        }
+        printf("  term '%.*s'\n", (int)length, term);
+    }
+}
+
+static void print_analysis_reply(const struct wire_header* header, const char* body) {
+    struct wire_analysis_reply reply;
+    if (wire_decode_analysis_reply(header, body, &reply) < 0) {
+        printf("  (malformed)\n");
+        return;
+    }
+    printf("  reply to request %llu: %s%s\n", (unsigned long long)reply.request_id,
+           reply.error == 0 ? "ok" : strerror(reply.error), (reply.flags & WIRE_REPLY_CACHED) ? ", cached" : "");
+}
+
+static void print_snapshot(const struct wire_header* header, const char* body) {
+    struct wire_snapshot s;
+    if (wire_decode_snapshot(header, body, &s) < 0) {
+        printf("  (malformed)\n");
+        return;
+    }
+    printf("  uptime %.1f s, load %.2f %.2f %.2f, %u processes\n", s.uptime_ms / 1e3, s.load_milli[0] / 1e3,
+           s.load_milli[1] / 1e3, s.load_milli[2] / 1e3, s.process_count);
+    printf("  memory %llu/%llu KB used, %llu KB available; disk %llu/%llu bytes used\n",
+           (unsigned long long)s.mem_used_kb, (unsigned long long)s.mem_total_kb,
+           (unsigned long long)s.mem_available_kb, (unsigned long long)s.disk_used_bytes,
+           (unsigned long long)s.disk_total_bytes);
+}
+
+/* Returns the number of records, or -1 if the file holds something else */
+static long dump_file(const char* path) {
+    FILE* in = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    size_t capacity = 1 << 16, used = 0, at = 0;
+    char* buffer = malloc(capacity);
+    if (buffer == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    long records = 0;
+    long long offset = 0; /* of buffer[0] in the file */
+    int bad = 0;
+    for (;;) {
+        struct wire_header header;
+        long size = wire_decode_header(buffer + at, used - at, &header);
+        if (size < 0) {
+            fprintf(stderr, "%s: not a wire record at offset %lld\n", path, offset + (long long)at);
+            bad = 1;
+            break;
+        }
+        if (size > 0) {
+            printf("%s @%lld: %s, %u bytes, written at %.6f\n", path, offset + (long long)at,
+                   wire_type_name(header.type), header.length, header.timestamp_ns / 1e9);
+            const char* body = wire_body(buffer + at);
+            switch (header.type) {
+                case WIRE_ALERT: print_alert(&header, body); break;
+                case WIRE_ANALYSIS: print_analysis(&header, body); break;
+                case WIRE_CHILD_EXIT: print_child_exit(&header, body); break;
+                case WIRE_SNAPSHOT: print_snapshot(&header, body); break;
+                case WIRE_ANALYSIS_REQUEST: print_analysis_request(&header, body); break;
+                case WIRE_ANALYSIS_REPLY: print_analysis_reply(&header, body); break;
+            }
+            at += (size_t)size;
+            records++;
+            continue;
+        }
+        /* Need more bytes: keep the partial record and read on */
+        memmove(buffer, buffer + at, used - at);
+        offset += (long long)at;
+        used -= at;
+        at = 0;
+        if (used >= sizeof(header) && sizeof(header) + header.length > capacity) {
+            capacity = sizeof(header) + header.length;
+            char* grown = realloc(buffer, capacity);
+            if (grown == NULL) {
+                perror("realloc");
+                bad = 1;
+                break;
+            }
+            buffer = grown;
+        }
+        size_t got = fread(buffer + used, 1, capacity - used, in);
+        if (got == 0) {
+            if (used > 0) {
+                fprintf(stderr, "%s: %zu trailing bytes of a truncated record\n", path, used);
+                bad = 1;
+            }
+            break;
+        }
+        used += got;
+    }
+    free(buffer);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return bad ? -1 : records;
+}
+
+int main(int argc, char* argv[]) {
+    const char* stdin_only[] = {"-"};
+    const char** paths = argc > 1 ? (const char**)argv + 1 : stdin_only;
+    int count = argc > 1 ? argc - 1 : 1;
+    int status = 0;
+    long total = 0;
+    for (int i = 0; i < count; ++i) {
+        long records = dump_file(paths[i]);
+        if (records < 0) {
+            status = 1;
+        } else {
+            total += records;
+        }
+    }
+    printf("%ld records.\n", total);
+    return status;
+}
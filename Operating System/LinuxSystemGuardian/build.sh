@@ -0,0 +1,115 @@
+#!/bin/bash
+
+# Build every module. A target is only rebuilt when it is missing, older than
+# a source or header it may include, or was built in another mode.
+#   ./build.sh [release]   -O3 with link-time optimization (the default)
+#   ./build.sh debug       -O0 -g
+#   ./build.sh pgo         release, with the guardian and the analyzer rebuilt
+#                          from the profile of a short training run
+#   --force                rebuild everything
+
+BASE_DIR=$(cd "$(dirname "$0")" && pwd)
+MODE=release
+FORCE=0
+for arg in "$@"; do
+    case "$arg" in
+        release|debug|pgo) MODE=$arg ;;
+        --force) FORCE=1 ;;
+        *) echo "Usage: $0 [release|debug|pgo] [--force]" >&2; exit 1 ;;
+    esac
+done
+
+case "$MODE" in
+    debug) OPT="-O0 -g" ;;
+    *) OPT="-O3 -flto=auto" ;;
+esac
+
+# A mode switch invalidates every target
+STAMP="$BASE_DIR/.build_mode"
+if [ "$(cat "$STAMP" 2>/dev/null)" != "$MODE" ]; then
+    FORCE=1
+fi
+
+# gzip and zstd input support is built in when the libraries' headers are installed
+M3_LIBS=""
+for lib in zlib:z zstd:zstd; do
+    if echo "#include <${lib%%:*}.h>" | g++ -x c++ -E - >/dev/null 2>&1; then
+        M3_LIBS="$M3_LIBS -l${lib##*:}"
+    fi
+done
+
+# stale TARGET DIR...: true if TARGET must be rebuilt from the sources in DIRs
+stale() {
+    local target=$1
+    shift
+    [ "$FORCE" = 1 ] || [ ! -e "$target" ] ||
+        [ -n "$(find "$@" -maxdepth 1 \( -name '*.h' -o -name '*.c' -o -name '*.cpp' \) -newer "$target" | head -1)" ]
+}
+
+# build TARGET "DIR..." COMMAND...
+build() {
+    local target=$1 dirs=$2
+    shift 2
+    if stale "$BASE_DIR/$target" $dirs; then
+        echo "  building $target"
+        "$@" || { echo "Build of $target failed" >&2; exit 1; }
+    fi
+}
+
+build_all() {
+    local extra=$1
+    cd "$BASE_DIR" || exit 1
+    build M1_SystemSnapshot/snapshot_exe "M1_SystemSnapshot M4_IPC" \
+        g++ $OPT M1_SystemSnapshot/system_snapshot.cpp -o M1_SystemSnapshot/snapshot_exe
+    build M2_ProcessManager/manager_exe "M2_ProcessManager M4_IPC" \
+        g++ $OPT M2_ProcessManager/process_manager.cpp -o M2_ProcessManager/manager_exe -pthread
+    build M3_FileAnalyzer/analyzer_exe "M3_FileAnalyzer M4_IPC" \
+        g++ $OPT $extra M3_FileAnalyzer/multithreaded_analyzer.cpp -o M3_FileAnalyzer/analyzer_exe -pthread $M3_LIBS
+    build M3_FileAnalyzer/bench_exe "M3_FileAnalyzer" \
+        g++ $OPT M3_FileAnalyzer/analyzer_bench.cpp -o M3_FileAnalyzer/bench_exe
+    build M4_IPC/sender_exe "M4_IPC" gcc $OPT M4_IPC/ipc_sender.c -o M4_IPC/sender_exe
+    build M4_IPC/receiver_exe "M4_IPC" gcc $OPT M4_IPC/ipc_receiver.c -o M4_IPC/receiver_exe
+    build M4_IPC/receiver_daemon_exe "M4_IPC" gcc $OPT M4_IPC/ipc_daemon.c -o M4_IPC/receiver_daemon_exe -pthread
+    build M4_IPC/wire_dump_exe "M4_IPC" gcc $OPT M4_IPC/wire_dump.c -o M4_IPC/wire_dump_exe
+    build M4_IPC/analysis_client_exe "M4_IPC" gcc $OPT M4_IPC/analysis_client.c -o M4_IPC/analysis_client_exe
+    build Guardian/guardian_exe "Guardian M1_SystemSnapshot M2_ProcessManager M3_FileAnalyzer M4_IPC" \
+        g++ $OPT $extra Guardian/guardian.cpp -o Guardian/guardian_exe -pthread
+}
+
+# Training run for PGO: the guardian sampling fast with per-process tracking,
+# watching a file and taking a burst of alerts; the analyzer on a few MB of text
+train() {
+    local work=$1
+    for i in $(seq 2000); do cat M3_FileAnalyzer/sample_text.txt; done > "$work/train.txt"
+    M4_IPC/ipc_cleanup.sh >/dev/null
+    Guardian/guardian_exe --run-for 3 --status-sec 0 --snapshot-ms 10 --top 5 --series "" \
+        --analyze "$work/train.txt" --ipc --quiet-alerts --log-dir "$work" >/dev/null &
+    local guardian=$!
+    sleep 0.5
+    M4_IPC/sender_exe --count 50000 >/dev/null
+    wait $guardian
+    M4_IPC/ipc_cleanup.sh >/dev/null
+    M3_FileAnalyzer/analyzer_exe "$work/train.txt" >/dev/null
+    M3_FileAnalyzer/analyzer_exe --term threads --term the --term and "$work/train.txt" >/dev/null
+}
+
+echo "--- Building System Guardian Modules ($MODE) ---"
+if [ "$MODE" = pgo ]; then
+    # Relative, like every path here: the flags are split on spaces and
+    # the instrumented binaries run from BASE_DIR
+    PROFILE_DIR=.pgo
+    WORK=$(mktemp -d)
+    cd "$BASE_DIR" && rm -rf "$PROFILE_DIR"
+    # The profiled targets are always rebuilt, instrumented first
+    rm -f Guardian/guardian_exe M3_FileAnalyzer/analyzer_exe
+    build_all "-fprofile-generate=$PROFILE_DIR -fprofile-update=atomic"
+    echo "  training..."
+    train "$WORK"
+    rm -rf "$WORK"
+    rm -f Guardian/guardian_exe M3_FileAnalyzer/analyzer_exe
+    FORCE=0
+    build_all "-fprofile-use=$PROFILE_DIR -fprofile-partial-training -Wno-missing-profile"
+else
+    build_all ""
+fi
+echo "$MODE" > "$STAMP"
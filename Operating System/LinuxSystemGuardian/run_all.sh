@@ -10,11 +10,9 @@ chmod +x "$BASE_DIR/M2_ProcessManager/child_task.sh"
 chmod +x "$BASE_DIR/M4_IPC/ipc_cleanup.sh"
 mkdir -p "$BASE_DIR/logs"
 
-# Compile all modules
-g++ "$BASE_DIR/M2_ProcessManager/process_manager.cpp" -o "$BASE_DIR/M2_ProcessManager/manager_exe"
-g++ "$BASE_DIR/M3_FileAnalyzer/multithreaded_analyzer.cpp" -o "$BASE_DIR/M3_FileAnalyzer/analyzer_exe" -pthread
-gcc "$BASE_DIR/M4_IPC/ipc_sender.c" -o "$BASE_DIR/M4_IPC/sender_exe"
-gcc "$BASE_DIR/M4_IPC/ipc_receiver.c" -o "$BASE_DIR/M4_IPC/receiver_exe"
+# Build the modules; only what changed since the last build is recompiled.
+# BUILD_MODE=pgo (or debug) selects another build, see build.sh.
+"$BASE_DIR/build.sh" $BUILD_MODE || exit 1
 
 show_menu() {
     
@@ -23,10 +21,12 @@ show_menu() {
     echo "==================================================="
     echo "1) Module 1: System Snapshot (Bash/Monitoring)"
     echo "2) Module 2: Process Manager (C++/Fork/Exec)"
-    echo "3) Module 3: File Analyzer (C++/Pthreads/Mutex)"
+    echo "3) Module 3: File Analyzer (C++/Pthreads/Worker Pool)"
     echo "4) Module 4: IPC (C/Message Queues)"
     echo "5) Run All Modules (Full Demonstration)"
-    echo "6) Exit"
+    echo "6) Module 3 Benchmark (Throughput/Scaling JSON)"
+    echo "7) Guardian Daemon (all modules in one process, Ctrl+C stops)"
+    echo "8) Exit"
     echo "==================================================="
 }
 
@@ -49,7 +49,8 @@ print_footer() {
 
 run_module_1() {
     print_header "MODULE 1 - SYSTEM SNAPSHOT"
-    "$BASE_DIR/M1_SystemSnapshot/system_snapshot.sh"
+    # The native collector; system_snapshot.sh gives the same report through the shell tools
+    "$BASE_DIR/M1_SystemSnapshot/snapshot_exe"
     print_footer "MODULE 1"
 }
 
@@ -65,6 +66,25 @@ run_module_3() {
     print_footer "MODULE 3"
 }
 
+run_benchmark_3() {
+    print_header "MODULE 3 - ANALYZER BENCHMARK"
+    # Size, threads and modes can be overridden, e.g. BENCH_ARGS="--size 1G --threads 1,4,8"
+    "$BASE_DIR/M3_FileAnalyzer/bench_exe" --analyzer "$BASE_DIR/M3_FileAnalyzer/analyzer_exe" \
+        --output "$BASE_DIR/logs/M3_benchmark.json" $BENCH_ARGS
+    echo "Benchmark report written to logs/M3_benchmark.json"
+    print_footer "MODULE 3 BENCHMARK"
+}
+
+run_guardian() {
+    print_header "GUARDIAN DAEMON"
+    # Extra options can be given, e.g. GUARDIAN_ARGS="--services services.txt --top 5".
+    # While it runs, M4_IPC/analysis_client_exe FILE... sends it analysis requests.
+    "$BASE_DIR/Guardian/guardian_exe" --log-dir "$BASE_DIR/logs" --serve --serve-root "$BASE_DIR" \
+        --analyze "$BASE_DIR/M3_FileAnalyzer/sample_text.txt" $GUARDIAN_ARGS
+    "$BASE_DIR/M4_IPC/ipc_cleanup.sh"
+    print_footer "GUARDIAN DAEMON"
+}
+
 run_module_4() {
     print_header "MODULE 4 - IPC DEMONSTRATION"
     echo "[Sender] Sending messages to the kernel queue..."
@@ -79,7 +99,7 @@ run_module_4() {
 
 while true; do
     show_menu
-    read -p "Select an option [1-6]: " choice
+    read -p "Select an option [1-8]: " choice
     case "$choice" in
         1)
             run_module_1
@@ -102,11 +122,17 @@ while true; do
             print_footer "RUN ALL MODULES"
             ;;
         6)
+            run_benchmark_3
+            ;;
+        7)
+            run_guardian
+            ;;
+        8)
             echo "Exiting System Guardian. Goodbye!"
             break
             ;;
         *)
-            echo "Invalid option. Please choose 1-6."
+            echo "Invalid option. Please choose 1-8."
             sleep 1
             ;;
     esac